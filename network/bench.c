@@ -0,0 +1,454 @@
+/**
+ * Loopback Self-Benchmark for the Network Performance Measurement Tool
+ *
+ * Runs the netperf reflector and client in-process over loopback across a matrix of
+ * transports, packet sizes, rates and thread counts. Throughput, CPU per probe and
+ * RTT percentiles are written as a JSON baseline, and compared against a stored
+ * baseline to flag regressions before a new build is rolled out.
+ *
+ * Compile with: gcc -O2 -std=gnu99 -o netbench bench.c netperf_*.c -pthread -lm
+ *
+ * Usage:
+ *   ./netbench [-t tcp,udp] [-l sizes] [-r rates] [-w threads] [-n probes] [-p port]
+ *              [-o results.json] [-b baseline.json] [-T tolerance_pct]
+ */
+
+#include "netperf.h"
+
+#define BENCH_DEFAULT_PORT 18888
+#define BENCH_DEFAULT_PROBES 2000
+#define BENCH_DEFAULT_TOLERANCE 25.0    // Percent
+#define BENCH_LATENCY_SLACK_US 2.0      // Absolute slack before a latency change counts
+#define BENCH_MAX_LIST 16
+#define BENCH_MAX_CELLS 1024
+
+// One cell of the benchmark matrix and its measurements
+typedef struct {
+    int protocol;
+    int packet_size;
+    int rate_pps;            // Per client thread, 0 = as fast as possible
+    int threads;             // Client threads and reflector workers
+    int sent;
+    int received;
+    double throughput_pps;
+    double cpu_us_per_probe; // Client + reflector CPU, whole process
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double p999_us;
+    double max_us;
+} bench_result_t;
+
+// Client thread arguments
+typedef struct {
+    config_t config;
+    run_result_t result;
+    pthread_t thread;
+} bench_client_t;
+
+void print_bench_usage(const char* prog_name) {
+    printf("Usage: %s [-t tcp,udp] [-l sizes] [-r rates] [-w threads] [-n probes] [-p port]\n", prog_name);
+    printf("                  [-o results.json] [-b baseline.json] [-T tolerance_pct]\n\n");
+    printf("Options:\n");
+    printf("  -t transports     Comma-separated list of tcp,udp (default: tcp,udp)\n");
+    printf("  -l sizes          Packet sizes in bytes (default: 64,1024,8192)\n");
+    printf("  -r rates          Per-thread rates in pps, 0 = unpaced (default: 0,10000)\n");
+    printf("  -w threads        Client threads / reflector workers (default: 1,2)\n");
+    printf("  -n probes         Probes per client thread per cell (default: %d)\n", BENCH_DEFAULT_PROBES);
+    printf("  -p port           Loopback port for the reflector (default: %d)\n", BENCH_DEFAULT_PORT);
+    printf("  -o file           Write results as JSON\n");
+    printf("  -b file           Compare against this baseline; created from this run if missing\n");
+    printf("  -T percent        Regression tolerance (default: %.0f%%)\n", BENCH_DEFAULT_TOLERANCE);
+    printf("  -h                Display this help message\n");
+}
+
+/**
+ * Parse a comma-separated list of integers, returns the number of entries
+ */
+int parse_int_list(const char* text, int* values, int max_values) {
+    int count = 0;
+    const char* p = text;
+    while (*p != '\0' && count < max_values) {
+        char* end;
+        long v = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        values[count++] = (int)v;
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+void* bench_server_thread(void* arg) {
+    config_t* config = (config_t*)arg;
+    if (config->protocol == PROTOCOL_TCP) {
+        run_tcp_server(config);
+    } else {
+        run_udp_server(config);
+    }
+    return NULL;
+}
+
+void* bench_client_thread(void* arg) {
+    bench_client_t* client = (bench_client_t*)arg;
+    if (client->config.protocol == PROTOCOL_TCP) {
+        run_tcp_client(&client->config);
+    } else {
+        run_udp_client(&client->config);
+    }
+    return NULL;
+}
+
+/**
+ * Run one matrix cell: start the reflector, run all client threads to
+ * completion, stop the reflector and fill in the measurements
+ */
+void run_bench_cell(bench_result_t* cell, int port, int probes) {
+    config_t server_config;
+    pthread_t server_thread;
+    bench_client_t* clients;
+    latency_hist_t rtt;
+    overhead_sample_t usage_start, usage_end;
+
+    // Netperf's own reports go to /dev/null while the cell runs
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    memset(&server_config, 0, sizeof(config_t));
+    server_config.is_server = 1;
+    server_config.port = port;
+    server_config.protocol = cell->protocol;
+    server_config.workers = cell->threads;
+    server_config.quiet = 1;
+
+    running = 1;
+    if (pthread_create(&server_thread, NULL, bench_server_thread, &server_config) != 0) {
+        perror("Failed to start reflector");
+        exit(EXIT_FAILURE);
+    }
+    for (int waited = 0; !server_config.ready; waited++) {
+        if (waited > 5000) {
+            fprintf(stderr, "Reflector did not start on port %d\n", port);
+            exit(EXIT_FAILURE);
+        }
+        usleep(1000);
+    }
+
+    clients = (bench_client_t*)calloc(cell->threads, sizeof(bench_client_t));
+    if (clients == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    overhead_sample(&usage_start);
+    for (int t = 0; t < cell->threads; t++) {
+        config_t* config = &clients[t].config;
+        strcpy(config->server_ip, "127.0.0.1");
+        config->port = port;
+        config->protocol = cell->protocol;
+        config->num_packets = probes;
+        config->packet_size = cell->packet_size;
+        config->rate_pps = cell->rate_pps;
+        config->delay_ms = 0;
+        config->quiet = 1;
+        config->result = &clients[t].result;
+        hist_init(&clients[t].result.rtt);
+
+        if (pthread_create(&clients[t].thread, NULL, bench_client_thread, &clients[t]) != 0) {
+            perror("Failed to start client");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    hist_init(&rtt);
+    cell->sent = 0;
+    cell->received = 0;
+    for (int t = 0; t < cell->threads; t++) {
+        pthread_join(clients[t].thread, NULL);
+        hist_merge(&rtt, &clients[t].result.rtt);
+        cell->sent += clients[t].result.packets_sent;
+        cell->received += clients[t].result.packets_received;
+    }
+    overhead_sample(&usage_end);
+
+    stop_servers();
+    pthread_join(server_thread, NULL);
+    running = 1;
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    double wall_sec = (usage_end.wall_usec - usage_start.wall_usec) / 1000000.0;
+    double cpu_us = (double)(usage_end.utime_usec - usage_start.utime_usec) +
+                    (double)(usage_end.stime_usec - usage_start.stime_usec);
+    cell->throughput_pps = wall_sec > 0 ? cell->received / wall_sec : 0.0;
+    cell->cpu_us_per_probe = cell->sent > 0 ? cpu_us / cell->sent : 0.0;
+    cell->p50_us = hist_percentile(&rtt, 50) / 1000.0;
+    cell->p90_us = hist_percentile(&rtt, 90) / 1000.0;
+    cell->p99_us = hist_percentile(&rtt, 99) / 1000.0;
+    cell->p999_us = hist_percentile(&rtt, 99.9) / 1000.0;
+    cell->max_us = rtt.max_ns / 1000.0;
+
+    free(clients);
+}
+
+/**
+ * Write results as JSON, one result object per line so baselines diff cleanly
+ */
+int write_bench_json(const char* path, bench_result_t* cells, int count, int probes) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror("Failed to open results file");
+        return -1;
+    }
+
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    time_t now = time(NULL);
+    char created[32];
+    strftime(created, sizeof(created), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"tool\": \"netbench\",\n");
+    fprintf(f, "  \"version\": 1,\n");
+    fprintf(f, "  \"host\": \"%s\",\n", host);
+    fprintf(f, "  \"created\": \"%s\",\n", created);
+    fprintf(f, "  \"probes_per_thread\": %d,\n", probes);
+    fprintf(f, "  \"results\": [\n");
+    for (int i = 0; i < count; i++) {
+        bench_result_t* c = &cells[i];
+        fprintf(f, "    {\"transport\": \"%s\", \"size\": %d, \"rate\": %d, \"threads\": %d, "
+                   "\"sent\": %d, \"received\": %d, \"throughput_pps\": %.1f, \"cpu_us_per_probe\": %.3f, "
+                   "\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f}%s\n",
+                c->protocol == PROTOCOL_TCP ? "tcp" : "udp", c->packet_size, c->rate_pps, c->threads,
+                c->sent, c->received, c->throughput_pps, c->cpu_us_per_probe,
+                c->p50_us, c->p90_us, c->p99_us, c->p999_us, c->max_us,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return 0;
+}
+
+/**
+ * Extract a numeric field from one baseline result line
+ */
+double json_number(const char* line, const char* key) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\":", key);
+    const char* p = strstr(line, pattern);
+    return p != NULL ? strtod(p + strlen(pattern), NULL) : 0.0;
+}
+
+/**
+ * Load a baseline written by write_bench_json
+ * Returns the number of results, or -1 if the file cannot be read
+ */
+int load_bench_json(const char* path, bench_result_t* cells, int max_cells) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+
+    char line[1024];
+    int count = 0;
+    while (fgets(line, sizeof(line), f) != NULL && count < max_cells) {
+        if (strstr(line, "\"transport\":") == NULL) {
+            continue;
+        }
+        bench_result_t* c = &cells[count++];
+        memset(c, 0, sizeof(bench_result_t));
+        c->protocol = strstr(line, "\"transport\": \"tcp\"") != NULL ? PROTOCOL_TCP : PROTOCOL_UDP;
+        c->packet_size = (int)json_number(line, "size");
+        c->rate_pps = (int)json_number(line, "rate");
+        c->threads = (int)json_number(line, "threads");
+        c->sent = (int)json_number(line, "sent");
+        c->received = (int)json_number(line, "received");
+        c->throughput_pps = json_number(line, "throughput_pps");
+        c->cpu_us_per_probe = json_number(line, "cpu_us_per_probe");
+        c->p50_us = json_number(line, "p50_us");
+        c->p90_us = json_number(line, "p90_us");
+        c->p99_us = json_number(line, "p99_us");
+        c->p999_us = json_number(line, "p999_us");
+        c->max_us = json_number(line, "max_us");
+    }
+    fclose(f);
+    return count;
+}
+
+/**
+ * Compare one cell against its baseline; prints each regression found
+ * Returns the number of regressions
+ */
+int compare_bench_cell(const bench_result_t* cur, const bench_result_t* base, double tolerance) {
+    double up = 1.0 + tolerance / 100.0;
+    double down = 1.0 - tolerance / 100.0;
+    int regressions = 0;
+
+    if (cur->throughput_pps < base->throughput_pps * down) {
+        printf("    REGRESSION throughput %.0f pps vs baseline %.0f pps\n",
+               cur->throughput_pps, base->throughput_pps);
+        regressions++;
+    }
+    if (cur->cpu_us_per_probe > base->cpu_us_per_probe * up) {
+        printf("    REGRESSION CPU %.2f us/probe vs baseline %.2f us/probe\n",
+               cur->cpu_us_per_probe, base->cpu_us_per_probe);
+        regressions++;
+    }
+    if (cur->p50_us > base->p50_us * up + BENCH_LATENCY_SLACK_US) {
+        printf("    REGRESSION p50 %.2f us vs baseline %.2f us\n", cur->p50_us, base->p50_us);
+        regressions++;
+    }
+    if (cur->p99_us > base->p99_us * up + BENCH_LATENCY_SLACK_US) {
+        printf("    REGRESSION p99 %.2f us vs baseline %.2f us\n", cur->p99_us, base->p99_us);
+        regressions++;
+    }
+    if (base->sent > 0 && cur->sent > 0 &&
+        cur->received * (double)base->sent < base->received * (double)cur->sent * 0.999) {
+        printf("    REGRESSION loss %d/%d vs baseline %d/%d\n",
+               cur->sent - cur->received, cur->sent, base->sent - base->received, base->sent);
+        regressions++;
+    }
+
+    return regressions;
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    int protocols[2] = { PROTOCOL_TCP, PROTOCOL_UDP };
+    int num_protocols = 2;
+    int sizes[BENCH_MAX_LIST] = { 64, 1024, 8192 };
+    int num_sizes = 3;
+    int rates[BENCH_MAX_LIST] = { 0, 10000 };
+    int num_rates = 2;
+    int threads[BENCH_MAX_LIST] = { 1, 2 };
+    int num_threads = 2;
+    int probes = BENCH_DEFAULT_PROBES;
+    int port = BENCH_DEFAULT_PORT;
+    double tolerance = BENCH_DEFAULT_TOLERANCE;
+    const char* output_file = NULL;
+    const char* baseline_file = NULL;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    while ((opt = getopt(argc, argv, "t:l:r:w:n:p:o:b:T:h")) != -1) {
+        switch (opt) {
+            case 't':
+                num_protocols = 0;
+                if (strstr(optarg, "tcp") != NULL) protocols[num_protocols++] = PROTOCOL_TCP;
+                if (strstr(optarg, "udp") != NULL) protocols[num_protocols++] = PROTOCOL_UDP;
+                break;
+            case 'l':
+                num_sizes = parse_int_list(optarg, sizes, BENCH_MAX_LIST);
+                break;
+            case 'r':
+                num_rates = parse_int_list(optarg, rates, BENCH_MAX_LIST);
+                break;
+            case 'w':
+                num_threads = parse_int_list(optarg, threads, BENCH_MAX_LIST);
+                break;
+            case 'n':
+                probes = atoi(optarg);
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'b':
+                baseline_file = optarg;
+                break;
+            case 'T':
+                tolerance = atof(optarg);
+                break;
+            case 'h':
+                print_bench_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_bench_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (num_protocols == 0 || num_sizes == 0 || num_rates == 0 || num_threads == 0 || probes <= 0) {
+        print_bench_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    int total_cells = num_protocols * num_sizes * num_rates * num_threads;
+    if (total_cells > BENCH_MAX_CELLS) {
+        fprintf(stderr, "Matrix too large (%d cells, max %d)\n", total_cells, BENCH_MAX_CELLS);
+        exit(EXIT_FAILURE);
+    }
+    bench_result_t* cells = (bench_result_t*)calloc(total_cells, sizeof(bench_result_t));
+    bench_result_t* baseline = (bench_result_t*)calloc(BENCH_MAX_CELLS, sizeof(bench_result_t));
+    if (cells == NULL || baseline == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    int baseline_count = baseline_file != NULL ? load_bench_json(baseline_file, baseline, BENCH_MAX_CELLS) : -1;
+
+    printf("Loopback self-benchmark: %d cells, %d probes per client thread\n", total_cells, probes);
+    if (baseline_count >= 0) {
+        printf("Comparing against %s (%d results, tolerance %.0f%%)\n", baseline_file, baseline_count, tolerance);
+    }
+    printf("\n%-5s %6s %7s %4s %10s %10s %9s %9s %9s %9s %6s\n",
+           "proto", "size", "rate", "thr", "pps", "cpu us/p", "p50 us", "p90 us", "p99 us", "p99.9 us", "loss");
+
+    int n = 0;
+    int regressions = 0;
+    for (int a = 0; a < num_protocols; a++) {
+        for (int b = 0; b < num_sizes; b++) {
+            for (int c = 0; c < num_rates; c++) {
+                for (int d = 0; d < num_threads; d++) {
+                    bench_result_t* cell = &cells[n++];
+                    cell->protocol = protocols[a];
+                    cell->packet_size = sizes[b] < MIN_PACKET_SIZE ? MIN_PACKET_SIZE :
+                                        sizes[b] > MAX_PACKET_SIZE ? MAX_PACKET_SIZE : sizes[b];
+                    cell->rate_pps = rates[c];
+                    cell->threads = threads[d] < 1 ? 1 : threads[d] > MAX_WORKERS ? MAX_WORKERS : threads[d];
+
+                    run_bench_cell(cell, port, probes);
+
+                    printf("%-5s %6d %7d %4d %10.0f %10.2f %9.2f %9.2f %9.2f %9.2f %6d\n",
+                           cell->protocol == PROTOCOL_TCP ? "tcp" : "udp", cell->packet_size,
+                           cell->rate_pps, cell->threads, cell->throughput_pps, cell->cpu_us_per_probe,
+                           cell->p50_us, cell->p90_us, cell->p99_us, cell->p999_us,
+                           cell->sent - cell->received);
+
+                    for (int i = 0; i < baseline_count; i++) {
+                        bench_result_t* base = &baseline[i];
+                        if (base->protocol == cell->protocol && base->packet_size == cell->packet_size &&
+                            base->rate_pps == cell->rate_pps && base->threads == cell->threads) {
+                            regressions += compare_bench_cell(cell, base, tolerance);
+                            break;
+                        }
+                    }
+                    fflush(stdout);
+                }
+            }
+        }
+    }
+
+    if (output_file != NULL && write_bench_json(output_file, cells, n, probes) == 0) {
+        printf("\nResults saved to %s\n", output_file);
+    }
+    if (baseline_file != NULL && baseline_count < 0) {
+        if (write_bench_json(baseline_file, cells, n, probes) == 0) {
+            printf("\nNo baseline found, saved this run as %s\n", baseline_file);
+        }
+    } else if (baseline_count >= 0) {
+        printf("\n%d regression%s against %s\n", regressions, regressions == 1 ? "" : "s", baseline_file);
+    }
+
+    free(cells);
+    free(baseline);
+    return regressions > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,431 @@
+/**
+ * Microbenchmarks for the Network Performance Measurement Tool primitives
+ *
+ * Times the building blocks of netperf_core.c in isolation - timestamps,
+ * packet creation and validation, address setup and summary statistics - next to
+ * their alternatives (clock sources, vectorised validation, histogram recording).
+ * Each case is warmed up, then timed over repeated batches; the median and the
+ * median absolute deviation (MAD) of the per-operation cost are reported.
+ *
+ * Compile with: gcc -O2 -std=gnu99 -o microbench microbench.c netperf_*.c -pthread -lm
+ *
+ * Usage:
+ *   ./microbench [-r repetitions] [-w warmup_ms] [-f filter] [-o results.json]
+ */
+
+#include "netperf.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define MICRO_DEFAULT_REPS 31
+#define MICRO_DEFAULT_WARMUP_MS 50
+#define MICRO_BATCH_TARGET_NS 1000000   // Aim for ~1 ms per timed batch
+#define MICRO_STATS_SAMPLES 10000
+#define MICRO_MAX_REPS 1001
+
+// Sink that keeps the compiler from discarding benchmarked work
+volatile uint64_t micro_sink;
+
+typedef void (*micro_fn_t)(void* ctx, uint64_t iterations);
+
+// One benchmark case
+typedef struct {
+    const char* name;
+    micro_fn_t fn;
+    void* ctx;
+    double median_ns;        // Per operation
+    double mad_ns;
+    uint64_t batch;          // Operations per timed batch
+} micro_case_t;
+
+// Shared inputs
+typedef struct {
+    packet_t* packet;
+    int packet_size;
+    double* samples;
+    double* scratch;
+    latency_hist_t hist;
+} micro_ctx_t;
+
+static uint8_t payload_pattern[256];
+
+uint64_t micro_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* --- Timestamp sources --- */
+
+void bench_get_timestamp_usec(void* ctx, uint64_t iterations) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += get_timestamp_usec();
+    }
+}
+
+void bench_clock(clockid_t clock, uint64_t iterations) {
+    struct timespec ts;
+    for (uint64_t i = 0; i < iterations; i++) {
+        clock_gettime(clock, &ts);
+        micro_sink += ts.tv_nsec;
+    }
+}
+
+void bench_clock_realtime(void* ctx, uint64_t iterations) {
+    (void)ctx;
+    bench_clock(CLOCK_REALTIME, iterations);
+}
+
+void bench_clock_monotonic(void* ctx, uint64_t iterations) {
+    (void)ctx;
+    bench_clock(CLOCK_MONOTONIC, iterations);
+}
+
+#ifdef __linux__
+void bench_clock_monotonic_raw(void* ctx, uint64_t iterations) {
+    (void)ctx;
+    bench_clock(CLOCK_MONOTONIC_RAW, iterations);
+}
+
+void bench_clock_monotonic_coarse(void* ctx, uint64_t iterations) {
+    (void)ctx;
+    bench_clock(CLOCK_MONOTONIC_COARSE, iterations);
+}
+#endif
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+void bench_rdtsc(void* ctx, uint64_t iterations) {
+    (void)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += __builtin_ia32_rdtsc();
+    }
+}
+#endif
+
+/* --- Packet primitives --- */
+
+void bench_create_packet(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        packet_t* p = create_packet(m->packet_size);
+        micro_sink += p->payload[m->packet_size - sizeof(packet_t) - 1];
+        free(p);
+    }
+}
+
+void bench_validate_packet(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += validate_packet(m->packet);
+    }
+}
+
+/**
+ * Alternative: compare the payload against the 256-byte pattern with memcmp,
+ * which libc implements with vector instructions
+ */
+int validate_packet_memcmp(packet_t* packet) {
+    if (packet == NULL || packet->packet_size < sizeof(packet_t)) {
+        return 0;
+    }
+
+    size_t length = packet->packet_size - sizeof(packet_t);
+    for (size_t offset = 0; offset < length; offset += sizeof(payload_pattern)) {
+        size_t chunk = length - offset < sizeof(payload_pattern) ? length - offset : sizeof(payload_pattern);
+        if (memcmp(packet->payload + offset, payload_pattern, chunk) != 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void bench_validate_packet_memcmp(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += validate_packet_memcmp(m->packet);
+    }
+}
+
+#if defined(__SSE2__)
+/**
+ * Alternative: explicit SSE2 comparison, 16 bytes per step
+ */
+int validate_packet_sse2(packet_t* packet) {
+    if (packet == NULL || packet->packet_size < sizeof(packet_t)) {
+        return 0;
+    }
+
+    size_t length = packet->packet_size - sizeof(packet_t);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i data = _mm_loadu_si128((const __m128i*)(packet->payload + i));
+        __m128i want = _mm_loadu_si128((const __m128i*)(payload_pattern + (i & 255)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(data, want)) != 0xFFFF) {
+            return 0;
+        }
+    }
+    for (; i < length; i++) {
+        if (packet->payload[i] != (i % 256)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+void bench_validate_packet_sse2(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += validate_packet_sse2(m->packet);
+    }
+}
+#endif
+
+void bench_init_socket_address_v4(void* ctx, uint64_t iterations) {
+    struct sockaddr_storage addr;
+    (void)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += init_socket_address(&addr, "192.168.1.50", DEFAULT_PORT, 0);
+    }
+}
+
+void bench_init_socket_address_v6(void* ctx, uint64_t iterations) {
+    struct sockaddr_storage addr;
+    (void)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += init_socket_address(&addr, "fe80::1:2:3:4", DEFAULT_PORT, 1);
+    }
+}
+
+/* --- Summary statistics (cost per sample over MICRO_STATS_SAMPLES) --- */
+
+void bench_stats_array_store(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        m->scratch[i % MICRO_STATS_SAMPLES] = m->samples[i % MICRO_STATS_SAMPLES];
+    }
+    micro_sink += (uint64_t)m->scratch[0];
+}
+
+void bench_stats_hist_record(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        hist_record(&m->hist, (uint64_t)(m->samples[i % MICRO_STATS_SAMPLES] * 1000));
+    }
+    micro_sink += m->hist.total;
+}
+
+/**
+ * The summary path: sort a copy of the samples, then read percentiles
+ * One operation = one full summary over MICRO_STATS_SAMPLES samples
+ */
+void bench_stats_sort_percentiles(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        memcpy(m->scratch, m->samples, MICRO_STATS_SAMPLES * sizeof(double));
+        qsort(m->scratch, MICRO_STATS_SAMPLES, sizeof(double), compare_doubles);
+        micro_sink += (uint64_t)sorted_percentile(m->scratch, MICRO_STATS_SAMPLES, 50);
+        micro_sink += (uint64_t)sorted_percentile(m->scratch, MICRO_STATS_SAMPLES, 99);
+    }
+}
+
+/**
+ * Histogram alternative: read the same percentiles from a filled histogram
+ */
+void bench_stats_hist_percentiles(void* ctx, uint64_t iterations) {
+    micro_ctx_t* m = (micro_ctx_t*)ctx;
+    for (uint64_t i = 0; i < iterations; i++) {
+        micro_sink += hist_percentile(&m->hist, 50);
+        micro_sink += hist_percentile(&m->hist, 99);
+    }
+}
+
+/* --- Harness --- */
+
+int compare_micro_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Warm up, size the batch to ~1 ms, then time reps batches
+ */
+void run_micro_case(micro_case_t* c, int reps, int warmup_ms) {
+    double per_op[MICRO_MAX_REPS];
+    double deviation[MICRO_MAX_REPS];
+
+    // Warmup doubles the batch until the warmup budget is spent
+    uint64_t batch = 1;
+    uint64_t warmup_end = micro_now_ns() + (uint64_t)warmup_ms * 1000000ULL;
+    uint64_t elapsed = 0;
+    do {
+        uint64_t start = micro_now_ns();
+        c->fn(c->ctx, batch);
+        elapsed = micro_now_ns() - start;
+        if (elapsed < MICRO_BATCH_TARGET_NS) {
+            batch *= 2;
+        }
+    } while (micro_now_ns() < warmup_end || elapsed < MICRO_BATCH_TARGET_NS / 2);
+    c->batch = batch;
+
+    for (int r = 0; r < reps; r++) {
+        uint64_t start = micro_now_ns();
+        c->fn(c->ctx, batch);
+        per_op[r] = (double)(micro_now_ns() - start) / batch;
+    }
+
+    qsort(per_op, reps, sizeof(double), compare_micro_doubles);
+    c->median_ns = per_op[reps / 2];
+    for (int r = 0; r < reps; r++) {
+        deviation[r] = fabs(per_op[r] - c->median_ns);
+    }
+    qsort(deviation, reps, sizeof(double), compare_micro_doubles);
+    c->mad_ns = deviation[reps / 2];
+}
+
+void print_micro_usage(const char* prog_name) {
+    printf("Usage: %s [-r repetitions] [-w warmup_ms] [-f filter] [-o results.json]\n\n", prog_name);
+    printf("Options:\n");
+    printf("  -r repetitions    Timed batches per case (default: %d, max: %d)\n",
+           MICRO_DEFAULT_REPS, MICRO_MAX_REPS);
+    printf("  -w warmup_ms      Warmup time per case (default: %d)\n", MICRO_DEFAULT_WARMUP_MS);
+    printf("  -f filter         Only run cases whose name contains filter\n");
+    printf("  -o file           Write results as JSON\n");
+    printf("  -h                Display this help message\n");
+}
+
+int main(int argc, char *argv[]) {
+    int opt;
+    int reps = MICRO_DEFAULT_REPS;
+    int warmup_ms = MICRO_DEFAULT_WARMUP_MS;
+    const char* filter = NULL;
+    const char* output_file = NULL;
+
+    while ((opt = getopt(argc, argv, "r:w:f:o:h")) != -1) {
+        switch (opt) {
+            case 'r':
+                reps = atoi(optarg);
+                if (reps < 1) reps = 1;
+                if (reps > MICRO_MAX_REPS) reps = MICRO_MAX_REPS;
+                break;
+            case 'w':
+                warmup_ms = atoi(optarg);
+                break;
+            case 'f':
+                filter = optarg;
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'h':
+                print_micro_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_micro_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    for (int i = 0; i < 256; i++) {
+        payload_pattern[i] = (uint8_t)i;
+    }
+
+    // Inputs: a small and a maximum-size packet, and a latency-like sample set
+    micro_ctx_t small, large, stats;
+    memset(&small, 0, sizeof(small));
+    memset(&large, 0, sizeof(large));
+    memset(&stats, 0, sizeof(stats));
+    small.packet_size = DEFAULT_PACKET_SIZE;
+    small.packet = create_packet(small.packet_size);
+    large.packet_size = 8192;
+    large.packet = create_packet(large.packet_size);
+    stats.samples = (double*)malloc(MICRO_STATS_SAMPLES * sizeof(double));
+    stats.scratch = (double*)malloc(MICRO_STATS_SAMPLES * sizeof(double));
+    if (stats.samples == NULL || stats.scratch == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    srand(42);
+    for (int i = 0; i < MICRO_STATS_SAMPLES; i++) {
+        // Log-normal-ish RTTs around 50 us with a tail (microseconds)
+        double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+        stats.samples[i] = 50.0 * exp(0.5 * sqrt(-2.0 * log(u)));
+    }
+    hist_init(&stats.hist);
+    for (int i = 0; i < MICRO_STATS_SAMPLES; i++) {
+        hist_record(&stats.hist, (uint64_t)(stats.samples[i] * 1000));
+    }
+
+    micro_case_t cases[] = {
+        { "timestamp/get_timestamp_usec", bench_get_timestamp_usec, NULL, 0, 0, 0 },
+        { "timestamp/clock_realtime", bench_clock_realtime, NULL, 0, 0, 0 },
+        { "timestamp/clock_monotonic", bench_clock_monotonic, NULL, 0, 0, 0 },
+#ifdef __linux__
+        { "timestamp/clock_monotonic_raw", bench_clock_monotonic_raw, NULL, 0, 0, 0 },
+        { "timestamp/clock_monotonic_coarse", bench_clock_monotonic_coarse, NULL, 0, 0, 0 },
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+        { "timestamp/rdtsc", bench_rdtsc, NULL, 0, 0, 0 },
+#endif
+        { "create_packet/1024", bench_create_packet, &small, 0, 0, 0 },
+        { "create_packet/8192", bench_create_packet, &large, 0, 0, 0 },
+        { "validate_packet/1024", bench_validate_packet, &small, 0, 0, 0 },
+        { "validate_packet/8192", bench_validate_packet, &large, 0, 0, 0 },
+        { "validate_packet_memcmp/1024", bench_validate_packet_memcmp, &small, 0, 0, 0 },
+        { "validate_packet_memcmp/8192", bench_validate_packet_memcmp, &large, 0, 0, 0 },
+#if defined(__SSE2__)
+        { "validate_packet_sse2/1024", bench_validate_packet_sse2, &small, 0, 0, 0 },
+        { "validate_packet_sse2/8192", bench_validate_packet_sse2, &large, 0, 0, 0 },
+#endif
+        { "init_socket_address/ipv4", bench_init_socket_address_v4, NULL, 0, 0, 0 },
+        { "init_socket_address/ipv6", bench_init_socket_address_v6, NULL, 0, 0, 0 },
+        { "stats/array_store", bench_stats_array_store, &stats, 0, 0, 0 },
+        { "stats/hist_record", bench_stats_hist_record, &stats, 0, 0, 0 },
+        { "stats/sort_percentiles_10k", bench_stats_sort_percentiles, &stats, 0, 0, 0 },
+        { "stats/hist_percentiles", bench_stats_hist_percentiles, &stats, 0, 0, 0 },
+    };
+    int num_cases = sizeof(cases) / sizeof(cases[0]);
+
+    printf("%-36s %12s %10s %12s\n", "case", "median ns", "MAD ns", "batch");
+    for (int i = 0; i < num_cases; i++) {
+        if (filter != NULL && strstr(cases[i].name, filter) == NULL) {
+            cases[i].batch = 0;
+            continue;
+        }
+        run_micro_case(&cases[i], reps, warmup_ms);
+        printf("%-36s %12.2f %10.2f %12lu\n", cases[i].name, cases[i].median_ns, cases[i].mad_ns,
+               (unsigned long)cases[i].batch);
+        fflush(stdout);
+    }
+
+    if (output_file != NULL) {
+        FILE* f = fopen(output_file, "w");
+        if (f == NULL) {
+            perror("Failed to open results file");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(f, "{\n  \"tool\": \"microbench\",\n  \"repetitions\": %d,\n  \"results\": [\n", reps);
+        int first = 1;
+        for (int i = 0; i < num_cases; i++) {
+            if (cases[i].batch == 0) {
+                continue;
+            }
+            fprintf(f, "%s    {\"case\": \"%s\", \"median_ns\": %.3f, \"mad_ns\": %.3f, \"batch\": %lu}",
+                    first ? "" : ",\n", cases[i].name, cases[i].median_ns, cases[i].mad_ns,
+                    (unsigned long)cases[i].batch);
+            first = 0;
+        }
+        fprintf(f, "\n  ]\n}\n");
+        fclose(f);
+        printf("\nResults saved to %s\n", output_file);
+    }
+
+    free(small.packet);
+    free(large.packet);
+    free(stats.samples);
+    free(stats.scratch);
+    return 0;
+}
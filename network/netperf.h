@@ -0,0 +1,830 @@
+/**
+ * Shared declarations for netperf and the tools built on its modules
+ * (netbench, microbench, nettest): build settings, packet, configuration
+ * and statistics types, and the functions each module exports
+ */
+
+#ifndef NETPERF_H
+#define NETPERF_H
+
+/* Define AIX compatibility features */
+#define _ALL_SOURCE
+
+/* Order of includes is important for AIX with GCC to avoid conflicts */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/* AIX-specific includes */
+#ifdef _AIX
+#include <sys/machine.h>  /* For byte-order functions specific to AIX */
+#endif
+
+/* Network includes */
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+
+/* Additional includes */
+#include <time.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+/* Linux-only instrumentation */
+#ifdef __linux__
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <linux/sockios.h>
+#include <sys/prctl.h>
+#include <ifaddrs.h>
+#include <linux/errqueue.h>
+#include <sys/epoll.h>
+#include <sys/timex.h>
+#include <sys/statvfs.h>
+#ifndef PR_SET_THP_DISABLE
+#define PR_SET_THP_DISABLE 41
+#define PR_GET_THP_DISABLE 42
+#endif
+#ifndef O_DIRECT                     /* glibc declares it only with _GNU_SOURCE */
+#if defined(__aarch64__) || defined(__arm__)
+#define O_DIRECT 0200000
+#elif defined(__powerpc__) || defined(__powerpc64__)
+#define O_DIRECT 0400000
+#else
+#define O_DIRECT 040000
+#endif
+#endif
+#endif
+
+/* AF_XDP reflector (Linux, raw bpf syscall, no libbpf) */
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/if_xdp.h>) && __has_include(<linux/bpf.h>)
+#define HAVE_AF_XDP 1
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+#endif
+#endif
+
+/* Optional TLS layer (make TLS=1) */
+#ifdef HAVE_OPENSSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+#endif
+
+// Default parameters
+#define DEFAULT_PORT 8888
+#define DEFAULT_NUM_PACKETS 100
+#define DEFAULT_DELAY_MS 100
+#define MIN_PACKET_SIZE 64
+#define DEFAULT_PACKET_SIZE 1024
+#define MAX_PACKET_SIZE 9216         // Room for a 9000-byte jumbo frame's UDP payload
+#define DEFAULT_RATE_PPS 10  // packets per second
+#define DEFAULT_OVERHEAD_BUDGET 0.0  // CPU ms per 1k probes, 0 = no budget
+
+// Host noise sampler settings
+#define NOISE_RING_SIZE 8192         // Samples kept (oldest are overwritten)
+#define NOISE_SOFTIRQ_TYPES 10
+#define NOISE_SOFTIRQ_TIMER 1
+#define NOISE_SOFTIRQ_NET_TX 2
+#define NOISE_SOFTIRQ_NET_RX 3
+#define NOISE_MAX_IRQ_LINES 1024     // /proc/interrupts lines tracked for the busiest IRQ
+#define NOISE_MAX_SPIKES 10          // Latency spikes shown in the report
+
+// Host metrics collector settings (-K)
+#define HOSTMON_RING_SIZE 8192       // Samples kept (oldest are overwritten)
+#define HOSTMON_MAX_DISKS 64         // Whole disks tracked from /proc/diskstats
+#define HOSTMON_MAX_FS 64            // Local filesystems checked with statvfs
+#define HOSTMON_FREE_PCT 10.0        // Default free-space alarm, as misc/diskmon.sh
+#define HOSTMON_MAX_SLOW 10          // Slowest probe intervals shown with their host row
+#define QUEUE_SAMPLE_EVERY 64        // Packets between SIOCINQ/SIOCOUTQ samples
+#define MAX_WORKERS 64               // Reflector worker threads
+#define MAX_SERVER_SOCKETS (MAX_WORKERS + 1)
+#define BUSY_SPIN_MIN_USEC 50        // Adaptive spin budget bounds before sleeping in poll()
+#define BUSY_SPIN_MAX_USEC 2000
+#define RT_DEFAULT_PRIORITY 50       // SCHED_FIFO priority of measurement threads
+#define RT_STACK_PREFAULT (256 * 1024)  // Stack bytes touched up front per thread
+#define RT_MAX_CPUS 1024
+#define NUMA_MAX_NODES 64
+#define NUMA_NODE_UNKNOWN 0xFFFF     // server_node value when the reflector does not report it
+#define NUMA_MPOL_PREFERRED 1        // From linux/mempolicy.h
+#define NUMA_MPOL_F_NODE 1
+#define NUMA_MPOL_F_ADDR 2
+#define CTL_MAX_LINE 65536           // Control messages, large enough for a sparse histogram
+#define CTL_MAX_PLAN_LINE 1024
+#define CTL_MAX_AGENTS 64
+#define CTL_CONNECT_RETRIES 50       // 100 ms apart
+#define CTL_TIME_SAMPLES 5
+#define CTL_START_LEAD_USEC 1000000  // Shared start this far after all agents are ready
+#define CTL_READ_TIMEOUT_MS 1000     // Control sockets wake this often to notice a signal
+#define CTL_REPLY_TIMEOUT_MS 30000   // A silent agent (or unauthenticated controller) is dropped after this
+#define CTL_MAX_RATE_PPS 100000      // Default agent caps on a plan's probe rate ...
+#define CTL_MAX_PROBES 10000000      // ... and probe count (-r/-n on the agent override them)
+#define CTL_TOKEN_ENV "NETPERF_AGENT_TOKEN"  // Shared secret a controller must present, if set
+#define MCAST_BATCH 64               // Datagrams per recvmmsg/sendmmsg call
+#define MCAST_MAX_RECEIVERS 256
+#define MCAST_DEFAULT_TTL 1          // Interconnect multicast stays on the local subnet
+#define MCAST_DRAIN_USEC 500000      // Sender waits this long for the last replies
+#define TLS_HANDSHAKES 100           // Full, then resumed, handshakes per client thread
+#define SWEEP_MAX_SIZES 128          // Sizes in one -S sweep
+#define SWEEP_DEFAULT_STEPS 8        // Steps for a range given without :step
+#define SWEEP_TIMEOUT_MS 1000        // UDP reply timeout per probe
+#define SOCKOPT_MAX_COMBOS 256       // Combinations in one -O grid
+#define SOCKOPT_MAX_VALUES 8         // Values per -O option
+#define SOCKOPT_WARMUP 16            // Untimed probes on each new connection
+#define PMTU_TRIES 3                 // DF probes per size before it counts as lost
+#define PMTU_TIMEOUT_MS 500          // Reply timeout per DF probe
+#define PMTU_MAX_STEPS 64            // Probe sizes in one -m search
+#define HEALTH_PROBE_SEC 10          // Default probe interval per held connection
+#define HEALTH_STALL_MS 1000         // Default: a probe reply this late is a stall
+#define HEALTH_CONNECT_INFLIGHT 256  // Non-blocking connects in progress at once
+#define HEALTH_CONNS_PER_PORT 20000  // Held connections per reflector port (ephemeral port range)
+#define HEALTH_KEEPCNT 3             // Unanswered keepalive probes before the kernel gives up
+#define HEALTH_EVENTS 1024           // Events per epoll_wait
+#define HEALTH_REPORT_SEC 10         // Interim status line interval
+#define REDO_MAGIC 0x5245444FU       // "REDO", opens a redo transport session
+#define REDO_DEFAULT_CHUNK 8192
+#define REDO_MAX_CHUNK (1 << 20)
+#define REDO_MAX_GROUP 64            // Chunks in flight / per receiver write
+#define REDO_FILE_SIZE (64 << 20)    // Redo file is pre-zeroed to this size and written circularly
+#define REDO_ALIGN 4096              // O_DIRECT buffer, offset and length alignment
+#define REDO_FILE_NAME "netperf_redo.dat"  // Used when the -W path is a directory
+#define RATE_SLA_P99_US 500          // Default -L SLA: p99 round trip ...
+#define RATE_SLA_LOSS_PCT 0.1        // ... and loss
+#define RATE_STEP_MS 1000            // Default length of one search step
+#define RATE_MAX_STEP_MS 10000       // Low rates stretch a step up to this to reach RATE_MIN_PROBES
+#define RATE_MIN_PROBES 2000         // Gives p99 about 20 samples above it
+#define RATE_DRAIN_MS 100            // Minimum wait for replies after a step's last probe
+#define RATE_MAX_STEPS 40            // Steps in one -L search
+#define RATE_START_PPS 1000
+#define RATE_MIN_PPS 10
+#define RATE_MAX_PPS 1000000
+#define RATE_TOLERANCE 0.05          // Search ends when the pass/fail bracket is this close
+#define RATE_OFFERED_MIN 0.95        // A step that sent less than this share of its target failed to offer it
+#define RATE_RX_BUFFER 65536
+#define CLOCK_SAMPLE_US 1000         // Spacing of -D clock samples for short runs
+#define CLOCK_MAX_SAMPLES 200000     // Longer runs space samples out to stay under this
+#define CLOCK_MAX_READ_NS 20000      // A sample whose reads took longer was preempted and is dropped
+#define CLOCK_STEP_NS 100000         // Jump between samples, beyond the clock's rate, that counts as a step
+#define CLOCK_PEER_INTERVAL_MS 50    // Offset exchanges with the -c peer
+#define CLOCK_PEER_TIMEOUT_MS 200
+#define CLOCK_MAX_EVENTS 64          // Step events kept for the report
+
+// Outcome of probe_exchange() in the sweeps and -m
+#define PROBE_REPLY 0
+#define PROBE_LOST 1                 // No valid reply in time
+#define PROBE_DISCONNECTED 2         // TCP: the server closed or reset the connection
+#define PROBE_ERROR 3                // UDP: send failed or the socket reported an error; errno holds it
+
+// Outcome of a DF probe in -m mode
+#define PMTU_PASS 0
+#define PMTU_LOCAL 1                 // Refused by the sender's own interface/route MTU
+#define PMTU_ICMP 2                  // A hop returned 'fragmentation needed' / 'packet too big'
+#define PMTU_SILENT 3                // No reply and no error: dropped on the path
+
+// How a held connection (-H) failed
+#define HEALTH_FAIL_RESET 0          // RST while idle: a middlebox or the peer reset it
+#define HEALTH_FAIL_HALF_OPEN 1      // RST in answer to a probe: the peer had lost the connection
+#define HEALTH_FAIL_KEEPALIVE 2      // ETIMEDOUT while idle: keepalive probes went unanswered
+#define HEALTH_FAIL_TIMEOUT 3        // ETIMEDOUT with a probe unacknowledged: user/retransmit timeout
+#define HEALTH_FAIL_CLOSED 4         // Orderly close (FIN) by the peer
+#define HEALTH_FAIL_OTHER 5          // Any other socket error, including failed reconnects
+#define HEALTH_FAIL_CLASSES 6
+
+// How the redo receiver makes a write durable before acknowledging
+#define REDO_SYNC_NONE 0             // Page cache only: the network-only baseline
+#define REDO_SYNC_DSYNC 1            // O_DSYNC
+#define REDO_SYNC_FSYNC 2            // write() then fsync()
+#define REDO_SYNC_DIRECT 3           // O_DIRECT | O_DSYNC, as LGWR/RFS write redo
+#define XDP_RING_SIZE 2048           // Entries per AF_XDP ring, also the UMEM frame count
+#define XDP_FRAME_SIZE 4096
+#define XDP_BATCH 64                 // RX descriptors handled per pass
+#define XDP_UDP_PAYLOAD 42           // Ethernet + IPv4 (no options) + UDP headers
+#define XDP_INSN(c, d, s, o, i) ((struct bpf_insn){ .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) })
+#ifndef MSG_WAITFORONE
+#define MSG_WAITFORONE 0x10000       // recvmmsg: block for the first datagram only
+#endif
+
+// Latency histogram: log-linear buckets, 32 per power of two (~3% resolution)
+#define HIST_SUB_BITS 5
+#define HIST_SUB_BUCKETS (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (60 * HIST_SUB_BUCKETS)
+
+// Protocol settings
+#define PROTOCOL_TCP 0
+#define PROTOCOL_UDP 1
+
+// NUMA placement policies
+#define NUMA_POLICY_NONE 0
+#define NUMA_POLICY_NIC 1            // All threads on the NIC's node
+#define NUMA_POLICY_SPREAD 2         // Reflector workers round-robin across nodes
+#define NUMA_POLICY_NODE 3           // All threads on a given node
+
+// Signal handling state, defined in netperf_core.c
+extern volatile sig_atomic_t running;
+extern volatile sig_atomic_t signal_received;  // Set by SIGINT/SIGTERM, never reset (running is, by agents)
+
+#ifdef HAVE_OPENSSL
+typedef SSL tls_conn_t;
+extern SSL_CTX* tls_ctx;     // Process-wide, set up by tls_init()
+#else
+typedef void tls_conn_t;     // TLS not compiled in: connections are always plain
+#endif
+
+// Packet structure with variable payload size
+typedef struct {
+    uint64_t seq_num;        // Sequence number for packet loss detection
+    uint64_t client_send;    // Timestamp when client sent the packet
+    uint64_t server_recv;    // Timestamp when server received the packet
+    uint64_t server_send;    // Timestamp when server sent response
+    uint64_t client_recv;    // Timestamp when client received response
+    uint32_t packet_size;    // Size of this packet in bytes
+    uint32_t server_drops;   // Reflector's cumulative socket receive-queue drops (UDP)
+    uint16_t server_node;    // NUMA node the reflector worker ran on (NUMA_NODE_UNKNOWN if not reported)
+    uint16_t server_cpu;     // CPU the reflector worker ran on
+    uint32_t reserved;       // Keeps the payload 8-byte aligned
+    uint8_t payload[];       // Variable-sized payload (C99 flexible array member)
+} packet_t;
+
+// Test configuration structure
+typedef struct config_t {
+    int is_server;
+    char server_ip[128];     // Support for IPv6 addresses
+    int port;
+    int protocol;            // TCP or UDP
+    int use_ipv6;            // IPv4 or IPv6
+    int num_packets;
+    int delay_ms;
+    int packet_size;
+    int rate_pps;            // Packets per second
+    int time_sync;           // Whether to use time synchronization
+    double overhead_budget;  // Max CPU ms per 1k probes before the run fails
+    int perf_counters;       // Whether to collect hardware performance counters
+    int noise_interval_ms;   // Host noise sampling interval, 0 = disabled
+    int workers;             // Reflector worker threads
+    int quiet;               // Suppress per-packet output
+    int busy_poll;           // Spin on non-blocking receive instead of sleeping
+    int busy_poll_us;        // SO_BUSY_POLL value to request, 0 = userspace spin only
+    int rt_profile;          // Real-time scheduling and memory locking for measurement threads
+    int rt_cpu;              // First CPU to pin to, -1 = isolated CPUs
+    int rt_priority;         // SCHED_FIFO priority
+    int numa_policy;         // NUMA_POLICY_*
+    int numa_node;           // Node for NUMA_POLICY_NODE; resolved NIC node otherwise
+    char interface[32];      // NIC whose node drives placement, empty = detect
+    int agent;               // Run as an agent waiting for a controller
+    char agent_bind[128];    // -a: address the agent's control port binds, empty = any
+    int agent_max_pps;       // Highest probe rate an agent accepts from a plan, 0 = CTL_MAX_RATE_PPS
+    int agent_max_packets;   // Largest probe count an agent accepts, 0 = CTL_MAX_PROBES
+    char plan_file[256];     // Run as a controller for this plan
+    char mcast_group[64];    // IPv4 multicast group: sender in client mode, receiver with -s
+    int tls;                 // TLS over TCP (HAVE_OPENSSL builds)
+    int xdp;                 // AF_XDP reflector on the -I interface
+    char sweep_sizes[256];   // Size sweep spec for -S, empty = single size
+    char sockopt_grid[256];  // Socket option grid for -O, empty = no option sweep
+    int pmtu;                // Path MTU discovery and black-hole check (-m)
+    char health_spec[128];   // Held-connection health monitor spec for -H, empty = off
+    char redo_spec[256];     // -W: redo file path (server) or chunk spec (client), empty = off
+    char rate_sla[64];       // -L: SLA for the adaptive rate search, empty = off
+    int clock_diag_sec;      // -D: clock drift diagnostics for this many seconds, 0 = off
+    char host_spec[64];      // -K: host metrics collector spec, empty = off
+    volatile int ready;      // Set by a reflector once its sockets accept traffic
+    struct run_result_t* result;  // Optional: where a client stores its results
+    char output_file[256];
+} config_t;
+
+// Latency histogram (values in nanoseconds)
+typedef struct {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    double sum_ns;
+} latency_hist_t;
+
+// Results of one client run, for callers embedding the client (bench, tests)
+typedef struct run_result_t {
+    int packets_sent;
+    int packets_received;
+    int late_replies;        // UDP replies that arrived after their probe timed out
+    double duration_sec;     // Wall time of the probe loop
+    latency_hist_t rtt;
+} run_result_t;
+
+// Snapshot of the prober's own resource usage
+typedef struct {
+    uint64_t wall_usec;      // Timestamp of the snapshot
+    uint64_t utime_usec;     // User CPU time (all threads)
+    uint64_t stime_usec;     // System CPU time (all threads)
+    long nvcsw;              // Voluntary context switches
+    long nivcsw;             // Involuntary context switches
+    uint64_t run_delay_ns;   // Time spent waiting on a run queue
+    int have_schedstat;      // Whether run_delay_ns is valid
+} overhead_sample_t;
+
+// Per-thread hardware counter group (cycles, instructions, cache/branch misses)
+#define PERF_NUM_COUNTERS 4
+typedef struct {
+    int fds[PERF_NUM_COUNTERS];      // fds[0] is the group leader, -1 if not open
+    int slot[PERF_NUM_COUNTERS];     // Order in which members appear in a group read
+    int nr_open;
+    int user_only;                   // Kernel counting was refused, user space only
+    int multiplexed;                 // Counts were scaled for PMU multiplexing
+    int open_errno;
+    uint64_t values[PERF_NUM_COUNTERS];
+} perf_counters_t;
+
+// One host noise sample (cumulative counters, deltas are taken at report time)
+typedef struct {
+    uint64_t ts_usec;                        // Same clock as packet timestamps
+    uint64_t softirq[NOISE_SOFTIRQ_TYPES];   // /proc/softirqs, summed over CPUs
+    uint64_t irq_total;                      // /proc/interrupts, all lines and CPUs
+    uint64_t top_irq_delta;                  // Busiest IRQ line since previous sample
+    char top_irq[32];
+    uint64_t cpu_total, cpu_busy, cpu_irq, cpu_steal;  // /proc/stat jiffies
+    uint32_t freq_min_khz, freq_avg_khz;     // cpufreq scaling_cur_freq
+} noise_sample_t;
+
+// Background sampler writing into a ring buffer
+typedef struct {
+    pthread_t thread;
+    volatile int active;
+    int interval_ms;
+    noise_sample_t* ring;
+    uint64_t count;                          // Samples taken; newest is ring[(count-1) % size]
+    int fd_softirqs, fd_interrupts, fd_stat;
+    int* freq_fds;
+    int nr_freq;
+    char* buf;                               // Reused read buffer
+    size_t buf_size;
+    uint64_t irq_prev[NOISE_MAX_IRQ_LINES];
+    int have_prev;
+} noise_sampler_t;
+
+// Cumulative /proc/diskstats counters of one disk
+typedef struct {
+    uint64_t rd_ios, rd_sectors, rd_ms;
+    uint64_t wr_ios, wr_sectors, wr_ms;
+    uint64_t io_ms;                          // Time with at least one request in flight
+    uint64_t weighted_ms;                    // Time x requests in flight
+} hostmon_diskstat_t;
+
+// Rates of one disk over an interval, as iostat -x reports them
+typedef struct {
+    double r_s, w_s;
+    double rmb_s, wmb_s;
+    double r_await_ms, w_await_ms;
+    double util_pct;
+    double queue;                            // Average requests in flight
+} hostmon_io_t;
+
+// A whole disk seen in /proc/diskstats
+typedef struct {
+    char name[32];
+    int skip;                                // Partition, loop or ram device
+    hostmon_diskstat_t first, prev;          // Counters at the first and latest sample
+    uint64_t first_usec, prev_usec;
+    double peak_util;
+} hostmon_disk_t;
+
+// A local filesystem from /proc/mounts
+typedef struct {
+    char dir[128];
+    double free_pct;                         // df-style: avail / (used + avail)
+    double min_free_pct;
+} hostmon_fs_t;
+
+// One host metrics sample: rates over the interval ending at ts_usec
+typedef struct {
+    uint64_t ts_usec;                        // Same clock as packet timestamps
+    double user_pct, sys_pct, iowait_pct, steal_pct, idle_pct;
+    double intr_rate, cs_rate;
+    double procs_running, procs_blocked;     // vmstat r and b
+    double mem_total_mb, mem_avail_mb, dirty_mb, swap_used_mb;
+    hostmon_io_t disk;                       // Busiest disk in the interval
+    char disk_name[32];
+    double fs_free_pct;                      // Fullest local filesystem
+    char fs_dir[64];
+} hostmon_sample_t;
+
+// Host metrics collector: /proc files opened once and re-read into one buffer
+typedef struct {
+    pthread_t thread;
+    volatile int active;
+    int interval_ms;
+    double free_pct;                         // Alarm threshold for filesystems
+    hostmon_sample_t* ring;
+    uint64_t count;                          // Samples taken; newest is ring[(count-1) % size]
+    int fd_stat, fd_meminfo, fd_diskstats;
+    char* buf;                               // Reused read buffer
+    size_t buf_size;
+    uint64_t prev_usec;
+    uint64_t cpu_prev[8];                    // /proc/stat aggregate jiffies
+    uint64_t intr_prev, ctxt_prev;
+    hostmon_disk_t disks[HOSTMON_MAX_DISKS];
+    int nr_disks;
+    hostmon_fs_t fs[HOSTMON_MAX_FS];
+    int nr_fs;
+    uint64_t cpu_ns;                         // Collector CPU time over all samples
+} hostmon_t;
+
+// Kernel drop counter and queue depth telemetry for one UDP socket
+typedef struct {
+    int enabled;             // SO_RXQ_OVFL accepted by the kernel
+    uint32_t rx_drops;       // Cumulative receive-queue drops (from the last control message)
+    uint64_t samples;        // Queue depth samples taken
+    uint64_t inq_sum;
+    uint64_t outq_sum;
+    int inq_max;
+    int outq_max;
+} sock_telemetry_t;
+
+// Spin-receive state and counters for one receiving thread
+typedef struct {
+    int enabled;
+    int busy_poll_us;        // SO_BUSY_POLL read back from the kernel, 0 = not in effect
+    int prefer_busy_poll;    // SO_PREFER_BUSY_POLL read back from the kernel
+    int spin_budget_us;      // Current adaptive spin budget
+    uint64_t waits;
+    uint64_t spin_hits;      // Waits satisfied while spinning
+    uint64_t sleeps;         // Waits that backed off to poll()
+    uint64_t spins;          // Empty non-blocking receive attempts
+} busy_poll_t;
+
+// Per-thread reflector state
+typedef struct {
+    config_t* config;
+    int fd;                  // UDP: own socket; TCP: shared listening socket
+    int index;
+    pthread_t thread;
+    uint64_t packets;
+    sock_telemetry_t telemetry;
+    perf_counters_t counters;
+    busy_poll_t busy;
+    int node;                // NUMA node this worker is placed on, -1 = not placed
+    uint64_t tls_full;       // Handshakes accepted without resumption
+    uint64_t tls_resumed;
+    uint64_t tls_failed;
+    uint64_t tls_full_cpu_ns;     // Thread CPU spent in SSL_accept
+    uint64_t tls_resumed_cpu_ns;
+    uint64_t tls_ktls_tx;    // Connections with kernel TLS offload per direction
+    uint64_t tls_ktls_rx;
+} reflector_worker_t;
+
+// One agent of a controller campaign
+typedef struct {
+    char role[16];           // "probe" or "reflect"
+    char host[128];
+    int port;
+    char options[CTL_MAX_PLAN_LINE];  // Plan fields passed through to the agent
+    int conn;                // Entry owning the control connection (an agent may hold two roles)
+    int fd;
+    FILE* in;
+    int64_t clock_offset;    // Agent clock minus controller clock (usec)
+    long long skew_us;       // How late the agent started against the shared schedule
+    int status;
+    long long reflected;
+    run_result_t result;
+} campaign_agent_t;
+
+// One datagram of a batched receive/send (layout of the kernel's struct mmsghdr)
+typedef struct {
+    struct msghdr msg_hdr;
+    unsigned int msg_len;
+} mcast_mmsghdr_t;
+
+// Per-receiver state at the multicast sender, keyed by reply source address
+typedef struct {
+    struct sockaddr_storage addr;
+    socklen_t addr_len;
+    uint64_t replies;        // Unique probes answered
+    uint64_t duplicates;
+    uint64_t first_seq;      // First probe answered (earlier ones were sent before the join took effect)
+    double first_reply_ms;   // Since the first probe was sent
+    uint8_t* seen;           // Bitmap of answered sequence numbers
+    latency_hist_t rtt;
+} mcast_receiver_t;
+
+// One TLS handshake thread at the client
+typedef struct {
+    config_t* config;
+    struct sockaddr_storage* addr;
+    int addr_len;
+    pthread_t thread;
+    latency_hist_t connect;  // TCP connect
+    latency_hist_t full;     // TLS handshake after connect, no resumption
+    latency_hist_t resumed;
+    uint64_t full_cpu_ns;    // Thread CPU spent in SSL_connect
+    uint64_t resumed_cpu_ns;
+    int not_resumed;         // Resumption offered but refused
+    int failed;
+} tls_handshake_worker_t;
+
+#ifdef HAVE_AF_XDP
+// One mmap'd AF_XDP ring; producer/consumer indices are shared with the kernel
+typedef struct {
+    uint32_t* producer;
+    uint32_t* consumer;
+    uint32_t* flags;
+    void* descs;
+    uint32_t size;
+    void* map;
+    size_t map_len;
+} xdp_ring_t;
+
+// AF_XDP socket, UMEM and rings bound to one NIC queue, with its reflector counters
+typedef struct {
+    config_t* config;
+    int fd;
+    int queue;
+    int zerocopy;            // Bound with XDP_ZEROCOPY; copy mode otherwise
+    uint8_t* umem;
+    size_t umem_len;
+    xdp_ring_t fill, comp, rx, tx;
+    pthread_t thread;
+    uint64_t packets;
+    uint64_t batches;
+    uint64_t kicks;          // sendto() calls to start transmission
+    uint64_t invalid;        // Frames too short to hold a probe
+    uint64_t first_usec, last_usec;
+    uint64_t cpu_ns;         // Thread CPU time of the reflector loop
+} xdp_worker_t;
+
+// The socket reflector run beside the AF_XDP one for comparison
+typedef struct {
+    reflector_worker_t worker;
+    uint64_t cpu_ns;
+} xdp_socket_path_t;
+#endif
+
+// Results for one size of a sweep
+typedef struct {
+    int size;
+    int sent;
+    int received;
+    double min_us, p50_us, p90_us, p99_us, max_us;
+} sweep_point_t;
+
+// Socket options for one -O combination, as requested or as read back
+typedef struct {
+    int nodelay;
+    int quickack;
+    int sndbuf;              // 0 = kernel default
+    int rcvbuf;
+    int busy_poll_us;
+    char cc[16];             // TCP_CONGESTION, empty = system default
+} sockopt_set_t;
+
+// Results for one combination of an option sweep
+typedef struct {
+    sockopt_set_t want;
+    sockopt_set_t got;
+    int sent;
+    int received;
+    double p50_us, p99_us;
+    double probes_per_sec;
+    double mbit_per_sec;
+} sockopt_point_t;
+
+// One size tried by the path MTU search
+typedef struct {
+    int size;                // UDP payload bytes
+    int result;              // PMTU_*
+    double rtt_us;
+} pmtu_step_t;
+
+// Held-connection monitor settings parsed from -H
+typedef struct {
+    int conns;
+    int probe_sec;           // One probe per connection per interval
+    int stall_ms;            // Reply later than this counts as a stall
+    int keepalive_sec;       // TCP_KEEPIDLE, 0 = keepalive off
+    int user_timeout_ms;     // TCP_USER_TIMEOUT, 0 = kernel default
+    int duration_sec;        // 0 = until interrupted
+} health_spec_t;
+
+// One held connection on the client; kept small so 100k fit in a few MB
+typedef struct {
+    int fd;
+    uint8_t state;           // 0 closed, 1 connecting, 2 up
+    uint8_t stalled;         // The outstanding probe was already counted as a stall
+    uint16_t got;            // Reply bytes received so far
+    uint32_t seq;            // Outstanding probe, 0 = none
+    uint64_t sent_us;        // When the outstanding probe was sent
+    uint64_t last_ok_us;     // Last reply, or when the connection came up
+    uint8_t reply[MIN_PACKET_SIZE];
+} health_conn_t;
+
+// Redo session hello; the receiver echoes it with the settings it applied
+typedef struct {
+    uint32_t magic;
+    uint32_t chunk_size;     // Payload bytes per chunk
+    uint32_t sync_mode;      // REDO_SYNC_*
+    uint32_t group;          // Max chunks per receiver write
+    uint32_t write_size;     // Bytes written per chunk (padded for O_DIRECT)
+    int32_t status;          // 0, or errno of opening/preparing the redo file
+} redo_hello_t;
+
+// Header in front of each redo chunk
+typedef struct {
+    uint64_t seq;
+    uint64_t client_send;
+    uint32_t size;           // Payload bytes after this header
+    uint32_t reserved;
+} redo_chunk_t;
+
+// Acknowledgement, one per chunk once the write holding it is durable
+typedef struct {
+    uint64_t seq;
+    uint64_t disk_ns;        // write + sync of the batch holding this chunk
+    uint64_t hold_ns;        // Chunk fully received -> ack sent
+    uint32_t batch;          // Chunks in that write
+    int32_t status;          // 0 = durable, else errno of the failed write
+} redo_ack_t;
+
+// SLA and limits of an adaptive rate search, parsed from -L
+typedef struct {
+    double p99_us;
+    double loss_pct;
+    int step_ms;
+    int start_pps;
+    int max_pps;
+} rate_sla_t;
+
+// Parsed -K spec
+typedef struct {
+    int interval_ms;
+    int count;               // Standalone samples, 0 = until interrupted
+    double free_pct;
+} hostmon_spec_t;
+
+// One step of a rate search: a fixed rate held for a short interval
+typedef struct {
+    int target_pps;
+    const char* phase;       // "ramp", "back-off", "bisect" or "confirm"
+    int duration_ms;
+    int sent;
+    int received;
+    double sent_pps;         // Offered rate actually achieved
+    double reply_pps;
+    double loss_pct;
+    double p50_us, p99_us, p999_us, max_us;
+    const char* verdict;     // "pass", or which part of the SLA failed
+    int pass;
+} rate_step_t;
+
+// One -D sample: every clock read between two MONOTONIC_RAW/counter reads
+typedef struct {
+    int64_t raw;             // Midpoint of the two MONOTONIC_RAW reads, ns
+    int64_t realtime;
+    int64_t monotonic;
+    int64_t tai;
+    uint64_t counter;        // Midpoint of the two cycle counter reads, 0 if there is none
+    int32_t read_ns;         // Time the reads took
+    int32_t cpu;
+} clock_sample_t;
+
+// One offset exchange with the -c peer, in the style of synchronize_clocks()
+typedef struct {
+    double t_s;              // MONOTONIC_RAW seconds since the first sample
+    double offset_us;        // Peer REALTIME minus local REALTIME
+    double rtt_us;
+    int sample;              // Sample taken just before the exchange
+} clock_peer_t;
+
+// Functions shared between the netperf translation units
+uint64_t get_timestamp_usec(void);
+void handle_signal(int sig);
+int init_socket_address(struct sockaddr_storage* addr, const char* host, int port, int use_ipv6);
+packet_t* create_packet(int packet_size);
+int validate_packet(packet_t* packet);
+int64_t synchronize_clocks(int socket_fd, int is_client, int protocol);
+ssize_t recv_all(int socket_fd, void* buffer, size_t length);
+ssize_t send_all(int socket_fd, const void* buffer, size_t length);
+void register_server_socket(int fd);
+void stop_servers(void);
+int hist_bucket(uint64_t value);
+uint64_t hist_bucket_floor(int index);
+void hist_init(latency_hist_t* h);
+void hist_record(latency_hist_t* h, uint64_t value_ns);
+void hist_merge(latency_hist_t* dst, const latency_hist_t* src);
+uint64_t hist_percentile(const latency_hist_t* h, double percentile);
+void overhead_sample(overhead_sample_t* sample);
+int overhead_report(const char* role, const overhead_sample_t* start, const overhead_sample_t* end,
+                    uint64_t probes, double budget);
+int perf_counters_open(perf_counters_t* pc);
+void perf_counters_start(perf_counters_t* pc);
+void perf_counters_stop(perf_counters_t* pc);
+void perf_counters_report(const char* role, perf_counters_t* pc, uint64_t packets);
+void perf_counters_close(perf_counters_t* pc);
+int noise_sampler_start(noise_sampler_t* ns, int interval_ms);
+void noise_sampler_stop(noise_sampler_t* ns);
+void noise_sampler_free(noise_sampler_t* ns);
+void host_noise_report(noise_sampler_t* ns, uint64_t* send_times, double* rtts, int count);
+int hostmon_parse_spec(const char* text, hostmon_spec_t* spec);
+int hostmon_start(hostmon_t* hm, const char* spec_text);
+void hostmon_stop(hostmon_t* hm);
+void hostmon_free(hostmon_t* hm);
+int host_metrics_report(hostmon_t* hm, uint64_t* send_times, double* rtts, int count);
+ssize_t proc_reread(int fd, char** buf, size_t* buf_size);
+int compare_doubles(const void* a, const void* b);
+double sorted_percentile(const double* sorted, int count, double percentile);
+void sock_telemetry_enable(int fd, sock_telemetry_t* t);
+ssize_t recv_with_telemetry(int fd, void* buf, size_t len, struct sockaddr_storage* from,
+                            socklen_t* fromlen, sock_telemetry_t* t);
+void sock_telemetry_sample_queues(int fd, sock_telemetry_t* t);
+void sock_telemetry_report(const char* role, sock_telemetry_t* t);
+void busy_poll_init(busy_poll_t* b, int enabled);
+void busy_poll_enable(int fd, busy_poll_t* b, int busy_poll_us);
+int busy_poll_wait(int fd, busy_poll_t* b, int timeout_ms);
+void busy_poll_report(const char* role, busy_poll_t* b);
+void busy_poll_floor_report(const latency_hist_t* spin, const latency_hist_t* block);
+int parse_cpu_list(const char* text, int* cpus, int max_cpus);
+int read_sys_line(const char* path, char* buffer, size_t size);
+int rt_profile_apply_process(void);
+int rt_profile_apply_thread(config_t* config, int index, const char* role);
+void rt_prefault(void* buffer, size_t length);
+int numa_resolve_node(config_t* config);
+packet_t* numa_place_thread(int node, const char* role, int packet_size);
+int numa_current_node(int* cpu);
+void numa_latency_report(latency_hist_t** node_rtt);
+void numa_assign_workers(config_t* config, reflector_worker_t* workers, int nworkers);
+void print_summary(config_t* config, const char* proto, double* latencies, double* rtts,
+                   int packets_received, int actual_delay_us);
+void print_loss_breakdown(int packets_sent, int packets_received, int late_replies,
+                          uint32_t reflector_drops, sock_telemetry_t* client_telemetry);
+uint64_t thread_cpu_ns(void);
+int tls_init(config_t* config, int is_server);
+int tls_accept(int fd, reflector_worker_t* worker, tls_conn_t** conn);
+void tls_close(tls_conn_t* conn);
+ssize_t stream_recv_all(int fd, tls_conn_t* conn, void* buffer, size_t length);
+ssize_t stream_send_all(int fd, tls_conn_t* conn, const void* buffer, size_t length);
+void tls_server_report(reflector_worker_t* workers, int nworkers);
+void* tcp_reflector_worker(void* arg);
+void* udp_reflector_worker(void* arg);
+int run_tcp_server(config_t* config);
+int run_udp_server(config_t* config);
+int run_xdp_server(config_t* config);
+int run_tcp_client(config_t* config);
+int run_udp_client(config_t* config);
+int run_mcast_receiver(config_t* config);
+int run_mcast_sender(config_t* config);
+int run_tls_client(config_t* config);
+int sweep_parse_sizes(const char* spec, int mtu_payload, int* sizes, int max_sizes);
+int sweep_fit(const double* x, const double* y, int n, double* intercept, double* slope);
+int run_size_sweep(config_t* config);
+int sockopt_parse_grid(const char* spec, int tcp, sockopt_set_t* combos, int max_combos);
+int run_sockopt_sweep(config_t* config);
+int run_pmtu_discovery(config_t* config);
+int health_parse_spec(const char* text, health_spec_t* spec);
+int run_health_server(config_t* config);
+int run_health_monitor(config_t* config);
+int run_redo_server(config_t* config);
+int run_redo_client(config_t* config);
+int rate_parse_sla(const char* text, rate_sla_t* sla);
+int run_rate_search(config_t* config);
+int run_clock_diag(config_t* config);
+int run_host_monitor(config_t* config);
+int ctl_send_line(int fd, const char* format, ...);
+const char* ctl_field(const char* line, const char* key);
+long long ctl_int(const char* line, const char* key, long long fallback);
+void ctl_str(const char* line, const char* key, char* value, size_t size);
+int ctl_split_host_port(const char* text, char* host, size_t size, int* port);
+int ctl_send_hist(int fd, const latency_hist_t* h);
+void ctl_parse_hist(const char* line, latency_hist_t* h);
+void ctl_set_timeout(int fd);
+char* ctl_read_line(FILE* in, char* line, int timeout_ms);
+void* agent_reflector_thread(void* arg);
+void agent_handle_campaign(config_t* base, int ctl_fd);
+int run_agent(config_t* config);
+int campaign_load_plan(const char* path, campaign_agent_t* agents, int max_agents);
+int campaign_connect(campaign_agent_t* a, char* line);
+int run_controller(config_t* config);
+
+#endif /* NETPERF_H */
@@ -0,0 +1,743 @@
+/**
+ * Distributed campaigns: agents (-A) that run the probes and reflectors a
+ * controller (-C) pushes to them over a line-based control channel
+ */
+
+#include "netperf.h"
+
+/**
+ * Control-channel helpers for controller/agent mode (one text line per message)
+ */
+int ctl_send_line(int fd, const char* format, ...) {
+    char line[CTL_MAX_LINE];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(line, sizeof(line) - 1, format, args);
+    va_end(args);
+    if (len < 0 || len >= (int)sizeof(line) - 1) {
+        return -1;
+    }
+    line[len++] = '\n';
+    return send_all(fd, line, len) == len ? 0 : -1;
+}
+
+/**
+ * Value of a " key=" field in a control line, NULL if absent
+ */
+const char* ctl_field(const char* line, const char* key) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), " %s=", key);
+    const char* p = strstr(line, pattern);
+    return p != NULL ? p + strlen(pattern) : NULL;
+}
+
+long long ctl_int(const char* line, const char* key, long long fallback) {
+    const char* p = ctl_field(line, key);
+    return p != NULL ? strtoll(p, NULL, 10) : fallback;
+}
+
+void ctl_str(const char* line, const char* key, char* value, size_t size) {
+    const char* p = ctl_field(line, key);
+    size_t n = 0;
+    if (p != NULL) {
+        while (p[n] != '\0' && p[n] != ' ' && p[n] != '\n' && n < size - 1) {
+            n++;
+        }
+        memcpy(value, p, n);
+    }
+    value[n] = '\0';
+}
+
+/**
+ * Split "host:port" (the last colon separates the port)
+ */
+int ctl_split_host_port(const char* text, char* host, size_t size, int* port) {
+    const char* colon = strrchr(text, ':');
+    if (colon == NULL || (size_t)(colon - text) >= size) {
+        return -1;
+    }
+    memcpy(host, text, colon - text);
+    host[colon - text] = '\0';
+    *port = atoi(colon + 1);
+    return *port > 0 ? 0 : -1;
+}
+
+/**
+ * Serialize a histogram as a sparse HIST line
+ */
+int ctl_send_hist(int fd, const latency_hist_t* h) {
+    char* line = (char*)malloc(CTL_MAX_LINE);
+    if (line == NULL) {
+        return -1;
+    }
+    int len = snprintf(line, CTL_MAX_LINE, "HIST total=%lu min=%lu max=%lu sum=%.0f b=",
+                       (unsigned long)h->total, (unsigned long)h->min_ns, (unsigned long)h->max_ns, h->sum_ns);
+    for (int i = 0; i < HIST_BUCKETS && len < CTL_MAX_LINE - 32; i++) {
+        if (h->counts[i] != 0) {
+            len += snprintf(line + len, CTL_MAX_LINE - len, "%d:%lu,", i, (unsigned long)h->counts[i]);
+        }
+    }
+    int rc = ctl_send_line(fd, "%s", line);
+    free(line);
+    return rc;
+}
+
+/**
+ * Parse a HIST line produced by ctl_send_hist
+ */
+void ctl_parse_hist(const char* line, latency_hist_t* h) {
+    hist_init(h);
+    h->total = ctl_int(line, "total", 0);
+    h->min_ns = strtoull(ctl_field(line, "min") != NULL ? ctl_field(line, "min") : "0", NULL, 10);
+    h->max_ns = ctl_int(line, "max", 0);
+    h->sum_ns = ctl_field(line, "sum") != NULL ? strtod(ctl_field(line, "sum"), NULL) : 0.0;
+    const char* p = ctl_field(line, "b");
+    while (p != NULL && *p >= '0' && *p <= '9') {
+        char* end;
+        long index = strtol(p, &end, 10);
+        if (*end != ':') {
+            break;
+        }
+        unsigned long long count = strtoull(end + 1, &end, 10);
+        if (index >= 0 && index < HIST_BUCKETS) {
+            h->counts[index] = count;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+}
+
+void* agent_reflector_thread(void* arg) {
+    config_t* config = (config_t*)arg;
+    if (config->protocol == PROTOCOL_TCP) {
+        run_tcp_server(config);
+    } else {
+        run_udp_server(config);
+    }
+    return NULL;
+}
+
+/**
+ * Wake blocked reads on a control socket every CTL_READ_TIMEOUT_MS
+ */
+void ctl_set_timeout(int fd) {
+    struct timeval tv;
+    tv.tv_sec = CTL_READ_TIMEOUT_MS / 1000;
+    tv.tv_usec = (CTL_READ_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+/**
+ * Read one control line from a socket set up with ctl_set_timeout, riding
+ * out the receive timeouts. NULL on EOF, on a signal, or after timeout_ms
+ * (0 = no limit).
+ */
+char* ctl_read_line(FILE* in, char* line, int timeout_ms) {
+    uint64_t deadline = timeout_ms > 0 ? get_timestamp_usec() + timeout_ms * 1000ULL : 0;
+    size_t len = 0;
+    for (;;) {
+        if (fgets(line + len, CTL_MAX_LINE - (int)len, in) != NULL) {
+            len += strlen(line + len);
+            if (line[len - 1] == '\n' || len == CTL_MAX_LINE - 1) {
+                return line;
+            }
+        }
+        // A receive timeout sets the error flag; a partial line stays in line
+        if (!ferror(in) || (errno != EAGAIN && errno != EWOULDBLOCK) || !running || signal_received ||
+            (deadline != 0 && get_timestamp_usec() >= deadline)) {
+            return NULL;
+        }
+        clearerr(in);
+    }
+}
+
+/**
+ * Compare a presented token with the agent's without an early exit
+ */
+static int ctl_token_equal(const char* expected, const char* offered) {
+    size_t n = strlen(expected), m = strlen(offered);
+    unsigned char diff = (unsigned char)(n != m);
+    for (size_t i = 0; i < n; i++) {
+        diff |= (unsigned char)(expected[i] ^ (i < m ? offered[i] : 0));
+    }
+    return diff == 0;
+}
+
+/**
+ * Stop the agent's reflector thread. stop_servers() clears running; it is
+ * restored unless a signal asked the whole agent to exit.
+ */
+static void agent_stop_reflector(pthread_t reflector) {
+    stop_servers();
+    pthread_join(reflector, NULL);
+    if (!signal_received) {
+        running = 1;
+    }
+}
+
+/**
+ * Serve one controller connection: HELLO, TIME, PLAN, START, STOP, BYE.
+ * A connection may hold one reflect and one probe role at a time.
+ */
+void agent_handle_campaign(config_t* base, int ctl_fd) {
+    FILE* in = fdopen(dup(ctl_fd), "r");
+    char* line = (char*)malloc(CTL_MAX_LINE);
+    const char* token = getenv(CTL_TOKEN_ENV);
+    int authorized = token == NULL || token[0] == '\0';
+    config_t reflect_task, probe_task;
+    run_result_t reflect_result, probe_result;
+    pthread_t reflector;
+    int reflecting = 0;
+    int probing = 0;
+    int max_pps = base->agent_max_pps > 0 ? base->agent_max_pps : CTL_MAX_RATE_PPS;
+    int max_packets = base->agent_max_packets > 0 ? base->agent_max_packets : CTL_MAX_PROBES;
+
+    if (in == NULL || line == NULL) {
+        perror("Agent setup failed");
+        if (in != NULL) {
+            fclose(in);
+        }
+        free(line);
+        return;
+    }
+    memset(&reflect_result, 0, sizeof(reflect_result));
+    ctl_set_timeout(ctl_fd);
+
+    // An unauthenticated controller gets CTL_REPLY_TIMEOUT_MS to say HELLO
+    while (!signal_received && ctl_read_line(in, line, authorized ? 0 : CTL_REPLY_TIMEOUT_MS) != NULL) {
+        if (strncmp(line, "HELLO", 5) == 0) {
+            char offered[128];
+            ctl_str(line, "token", offered, sizeof(offered));
+            if (!authorized && !ctl_token_equal(token, offered)) {
+                printf("Agent: controller presented a wrong token\n");
+                ctl_send_line(ctl_fd, "ERR reason=auth");
+                break;
+            }
+            authorized = 1;
+            ctl_send_line(ctl_fd, "HELLO");
+        } else if (!authorized) {
+            printf("Agent: controller did not authenticate (%s is set)\n", CTL_TOKEN_ENV);
+            ctl_send_line(ctl_fd, "ERR reason=auth");
+            break;
+        } else if (strncmp(line, "TIME", 4) == 0) {
+            ctl_send_line(ctl_fd, "TIME now=%lu", (unsigned long)get_timestamp_usec());
+        } else if (strncmp(line, "PLAN", 4) == 0) {
+            char role[16], proto[8], target[160];
+            ctl_str(line, "role", role, sizeof(role));
+            ctl_str(line, "proto", proto, sizeof(proto));
+            int reflect = strcmp(role, "reflect") == 0;
+            if (!reflect && strcmp(role, "probe") != 0) {
+                ctl_send_line(ctl_fd, "ERR reason=unknown_role");
+                continue;
+            }
+            if (reflect ? reflecting : probing) {
+                // The running role still reads its task
+                ctl_send_line(ctl_fd, "ERR reason=busy");
+                continue;
+            }
+
+            // Start from the agent's own options (-R, -M, -b ...) and apply the plan
+            config_t* task = reflect ? &reflect_task : &probe_task;
+            run_result_t* result = reflect ? &reflect_result : &probe_result;
+            *task = *base;
+            task->result = result;
+            task->quiet = 1;
+            task->ready = 0;
+            task->output_file[0] = '\0';
+            task->protocol = strcmp(proto, "tcp") == 0 ? PROTOCOL_TCP : PROTOCOL_UDP;
+            task->packet_size = (int)ctl_int(line, "size", DEFAULT_PACKET_SIZE);
+            if (task->packet_size < MIN_PACKET_SIZE) task->packet_size = MIN_PACKET_SIZE;
+            if (task->packet_size > MAX_PACKET_SIZE) task->packet_size = MAX_PACKET_SIZE;
+            memset(result, 0, sizeof(run_result_t));
+            hist_init(&result->rtt);
+
+            if (reflect) {
+                task->is_server = 1;
+                task->port = (int)ctl_int(line, "port", DEFAULT_PORT);
+                task->workers = (int)ctl_int(line, "workers", 1);
+                if (task->workers < 1) task->workers = 1;
+                if (task->workers > MAX_WORKERS) task->workers = MAX_WORKERS;
+                if (pthread_create(&reflector, NULL, agent_reflector_thread, task) != 0) {
+                    ctl_send_line(ctl_fd, "ERR reason=reflector_thread");
+                    continue;
+                }
+                for (int waited = 0; !task->ready && waited < 5000; waited++) {
+                    usleep(1000);
+                }
+                reflecting = 1;
+                ctl_send_line(ctl_fd, task->ready ? "READY" : "ERR reason=reflector_not_ready");
+            } else {
+                ctl_str(line, "target", target, sizeof(target));
+                task->is_server = 0;
+                if (ctl_split_host_port(target, task->server_ip, sizeof(task->server_ip), &task->port) < 0) {
+                    ctl_send_line(ctl_fd, "ERR reason=bad_target");
+                    continue;
+                }
+                // Plans are always paced: rate=0 (unpaced) would bypass the cap
+                long long rate = ctl_int(line, "rate", DEFAULT_RATE_PPS);
+                if (rate <= 0 || rate > max_pps) {
+                    ctl_send_line(ctl_fd, "ERR reason=rate_limit max=%d", max_pps);
+                    continue;
+                }
+                long long count = ctl_int(line, "count", 0);
+                if (count <= 0) {
+                    count = rate * ctl_int(line, "duration", 10);
+                }
+                if (count <= 0) {
+                    ctl_send_line(ctl_fd, "ERR reason=no_count");
+                    continue;
+                }
+                if (count > max_packets) {
+                    ctl_send_line(ctl_fd, "ERR reason=count_limit max=%d", max_packets);
+                    continue;
+                }
+                task->rate_pps = (int)rate;
+                task->delay_ms = 0;
+                task->num_packets = (int)count;
+                probing = 1;
+                ctl_send_line(ctl_fd, "READY");
+            }
+        } else if (strncmp(line, "START", 5) == 0) {
+            // Wait for the shared start time (already in this host's clock)
+            uint64_t at = (uint64_t)ctl_int(line, "at", 0);
+            uint64_t now = get_timestamp_usec();
+            while (running && now < at) {
+                uint64_t wait = at - now;
+                usleep(wait > 100000 ? 100000 : (useconds_t)wait);
+                now = get_timestamp_usec();
+            }
+            long long skew = (long long)(now - at);
+            if (probing) {
+                printf("Agent: probing %s:%d from the shared start (%lld us late)\n",
+                       probe_task.server_ip, probe_task.port, skew);
+                int status = probe_task.protocol == PROTOCOL_TCP ? run_tcp_client(&probe_task)
+                                                                 : run_udp_client(&probe_task);
+                ctl_send_line(ctl_fd, "RESULT status=%d sent=%d received=%d late=%d duration_us=%.0f skew_us=%lld",
+                              status, probe_result.packets_sent, probe_result.packets_received,
+                              probe_result.late_replies, probe_result.duration_sec * 1000000.0, skew);
+                ctl_send_hist(ctl_fd, &probe_result.rtt);
+                probing = 0;
+            } else {
+                ctl_send_line(ctl_fd, "STARTED skew_us=%lld", skew);
+            }
+        } else if (strncmp(line, "STOP", 4) == 0) {
+            if (reflecting) {
+                agent_stop_reflector(reflector);
+                reflecting = 0;
+            }
+            ctl_send_line(ctl_fd, "RESULT status=0 reflected=%d", reflect_result.packets_received);
+        } else if (strncmp(line, "BYE", 3) == 0) {
+            break;
+        }
+    }
+
+    if (reflecting) {
+        agent_stop_reflector(reflector);
+    }
+    fclose(in);
+    free(line);
+}
+
+/**
+ * Agent mode: wait for controllers on the control port and run their plans
+ */
+int run_agent(config_t* config) {
+    struct sockaddr_storage address;
+    int opt = 1;
+    const char* token = getenv(CTL_TOKEN_ENV);
+
+    int listen_fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    int addr_size = init_socket_address(&address, config->agent_bind[0] != '\0' ? config->agent_bind : NULL,
+                                        config->port, config->use_ipv6);
+    if (addr_size < 0 || bind(listen_fd, (struct sockaddr*)&address, addr_size) < 0 ||
+        listen(listen_fd, 4) < 0) {
+        perror("Agent control socket setup failed");
+        close(listen_fd);
+        return -1;
+    }
+    printf("Agent listening for a controller on %s port %d\n",
+           config->agent_bind[0] != '\0' ? config->agent_bind : "all addresses", config->port);
+    if (token == NULL || token[0] == '\0') {
+        printf("Warning: %s is not set; any host that reaches the control port can run plans\n", CTL_TOKEN_ENV);
+    }
+    fflush(stdout);
+
+    // Poll rather than block in accept() so a signal ends the agent
+    while (running && !signal_received) {
+        struct pollfd pfd;
+        pfd.fd = listen_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, 200) <= 0) {
+            continue;
+        }
+        int ctl_fd = accept(listen_fd, NULL, NULL);
+        if (ctl_fd < 0) {
+            continue;
+        }
+        printf("Agent: controller connected\n");
+        fflush(stdout);
+        agent_handle_campaign(config, ctl_fd);
+        close(ctl_fd);
+        printf("Agent: campaign finished\n");
+        fflush(stdout);
+    }
+
+    close(listen_fd);
+    printf("Agent shutdown complete\n");
+    return 0;
+}
+
+/**
+ * Read one reply line from an agent, NULL on EOF, timeout or a signal
+ */
+static char* campaign_read(campaign_agent_t* a, char* line, int timeout_ms) {
+    char* r = ctl_read_line(a->in, line, timeout_ms);
+    if (r == NULL) {
+        fprintf(stderr, "Agent %s:%d: %s\n", a->host, a->port,
+                !running || signal_received ? "interrupted" :
+                ferror(a->in) ? "no reply in time" : "closed the control connection");
+    }
+    return r;
+}
+
+/**
+ * Parse a plan file: one role per line, "<role> agent=host:port key=value ..."
+ * An agent may appear twice, once per role (it then shares one connection).
+ * Returns the number of entries, -1 on error
+ */
+int campaign_load_plan(const char* path, campaign_agent_t* agents, int max_agents) {
+    FILE* f = fopen(path, "r");
+    char line[CTL_MAX_PLAN_LINE];
+    int count = 0;
+    if (f == NULL) {
+        perror("Failed to open plan file");
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        line[strcspn(line, "\r\n#")] = '\0';
+        char role[16];
+        if (sscanf(line, "%15s", role) != 1) {
+            continue;
+        }
+        if (count >= max_agents) {
+            fprintf(stderr, "Plan has more than %d agents\n", max_agents);
+            fclose(f);
+            return -1;
+        }
+        campaign_agent_t* a = &agents[count];
+        memset(a, 0, sizeof(campaign_agent_t));
+        a->fd = -1;
+        a->conn = count;
+        snprintf(a->role, sizeof(a->role), "%s", role);
+        char agent[160];
+        ctl_str(line, "agent", agent, sizeof(agent));
+        if (ctl_split_host_port(agent, a->host, sizeof(a->host), &a->port) < 0 ||
+            (strcmp(role, "probe") != 0 && strcmp(role, "reflect") != 0)) {
+            fprintf(stderr, "Bad plan line: %s\n", line);
+            fclose(f);
+            return -1;
+        }
+        for (int i = 0; i < count; i++) {
+            if (agents[i].port != a->port || strcmp(agents[i].host, a->host) != 0) {
+                continue;
+            }
+            if (strcmp(agents[i].role, role) == 0) {
+                fprintf(stderr, "Plan gives agent %s:%d two %s roles; an agent runs one of each\n",
+                        a->host, a->port, role);
+                fclose(f);
+                return -1;
+            }
+            a->conn = agents[i].conn;
+        }
+        const char* options = line + strlen(role);
+        snprintf(a->options, sizeof(a->options), "%s", options);
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+/**
+ * Connect to an agent, retrying while it starts up, and authenticate
+ */
+int campaign_connect(campaign_agent_t* a, char* line) {
+    struct sockaddr_storage addr;
+    int use_ipv6 = strchr(a->host, ':') != NULL;
+    int addr_len = init_socket_address(&addr, a->host, a->port, use_ipv6);
+    const char* token = getenv(CTL_TOKEN_ENV);
+    if (addr_len < 0) {
+        return -1;
+    }
+    for (int attempt = 0; attempt < CTL_CONNECT_RETRIES && running; attempt++) {
+        int fd = socket(use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr*)&addr, addr_len) == 0) {
+            ctl_set_timeout(fd);
+            a->fd = fd;
+            a->in = fdopen(dup(fd), "r");
+            if (a->in == NULL) {
+                return -1;
+            }
+            if (ctl_send_line(fd, "HELLO token=%s", token != NULL ? token : "") < 0 ||
+                campaign_read(a, line, CTL_REPLY_TIMEOUT_MS) == NULL) {
+                return -1;
+            }
+            if (strncmp(line, "HELLO", 5) != 0) {
+                fprintf(stderr, "Agent %s:%d refused the controller: %s", a->host, a->port, line);
+                return -1;
+            }
+            return 0;
+        }
+        close(fd);
+        usleep(100000);
+    }
+    fprintf(stderr, "Cannot reach agent %s:%d\n", a->host, a->port);
+    return -1;
+}
+
+/**
+ * Estimate agent clock minus controller clock from the lowest-RTT TIME exchange
+ */
+static int campaign_sync_clock(campaign_agent_t* a, char* line) {
+    uint64_t best_rtt = UINT64_MAX;
+    for (int i = 0; i < CTL_TIME_SAMPLES; i++) {
+        uint64_t t0 = get_timestamp_usec();
+        if (ctl_send_line(a->fd, "TIME") < 0 || campaign_read(a, line, CTL_REPLY_TIMEOUT_MS) == NULL) {
+            return -1;
+        }
+        uint64_t t1 = get_timestamp_usec();
+        uint64_t agent_now = (uint64_t)ctl_int(line, "now", 0);
+        if (t1 - t0 < best_rtt) {
+            best_rtt = t1 - t0;
+            a->clock_offset = (int64_t)agent_now - (int64_t)((t0 + t1) / 2);
+        }
+    }
+    return 0;
+}
+
+/**
+ * How long to wait for a probe's RESULT: the shared start lead, the probe's
+ * own run time at its rate, and CTL_REPLY_TIMEOUT_MS on top. Agents refuse
+ * unpaced plans (rate=0), so the rate is always known.
+ */
+static int campaign_probe_timeout_ms(const campaign_agent_t* a) {
+    long long rate = ctl_int(a->options, "rate", DEFAULT_RATE_PPS);
+    long long count = ctl_int(a->options, "count", 0);
+    long long run_ms = count > 0 && rate > 0 ? count * 1000 / rate : ctl_int(a->options, "duration", 10) * 1000;
+    if (run_ms < 0) {
+        return 0;
+    }
+    run_ms += CTL_START_LEAD_USEC / 1000 + CTL_REPLY_TIMEOUT_MS;
+    return run_ms > INT32_MAX ? 0 : (int)run_ms;
+}
+
+/**
+ * Controller mode: push the plan to all agents, start them on one schedule,
+ * merge their histograms into one report
+ */
+int run_controller(config_t* config) {
+    campaign_agent_t agents[CTL_MAX_AGENTS];
+    char* line = (char*)malloc(CTL_MAX_LINE);
+    latency_hist_t combined;
+    int status = 0;
+    int probes = 0;
+
+    if (line == NULL) {
+        perror("Memory allocation failed");
+        return -1;
+    }
+    int num_agents = campaign_load_plan(config->plan_file, agents, CTL_MAX_AGENTS);
+    if (num_agents <= 0) {
+        fprintf(stderr, "No agents in plan %s\n", config->plan_file);
+        free(line);
+        return -1;
+    }
+
+    // Connect and measure clock offsets, once per agent; a second role shares the connection
+    for (int i = 0; i < num_agents; i++) {
+        campaign_agent_t* a = &agents[i];
+        if (a->conn != i) {
+            a->fd = agents[a->conn].fd;
+            a->in = agents[a->conn].in;
+            a->clock_offset = agents[a->conn].clock_offset;
+            continue;
+        }
+        if (campaign_connect(a, line) < 0 || campaign_sync_clock(a, line) < 0) {
+            status = -1;
+            goto done;
+        }
+    }
+
+    // Reflectors first, so probes have something to hit
+    for (int pass = 0; pass < 2; pass++) {
+        for (int i = 0; i < num_agents; i++) {
+            campaign_agent_t* a = &agents[i];
+            if ((pass == 0) != (strcmp(a->role, "reflect") == 0)) {
+                continue;
+            }
+            if (ctl_send_line(a->fd, "PLAN role=%s%s", a->role, a->options) < 0 ||
+                campaign_read(a, line, CTL_REPLY_TIMEOUT_MS) == NULL) {
+                status = -1;
+                goto done;
+            }
+            if (strncmp(line, "READY", 5) != 0) {
+                fprintf(stderr, "Agent %s:%d rejected its plan: %s", a->host, a->port, line);
+                status = -1;
+                goto done;
+            }
+        }
+    }
+
+    // Shared schedule: everyone starts at the same controller time, sent in each agent's clock
+    uint64_t start = get_timestamp_usec() + CTL_START_LEAD_USEC;
+    printf("Campaign: %d agents ready, starting in %.1f s\n", num_agents, CTL_START_LEAD_USEC / 1000000.0);
+    fflush(stdout);
+    for (int i = 0; i < num_agents; i++) {
+        if (agents[i].conn == i) {
+            ctl_send_line(agents[i].fd, "START at=%lu", (unsigned long)(start + agents[i].clock_offset));
+        }
+    }
+
+    // Collect probe results, then stop the reflectors. Each connection answers START
+    // once: with its probe's RESULT and HIST, or STARTED if it only reflects.
+    hist_init(&combined);
+    for (int i = 0; i < num_agents; i++) {
+        campaign_agent_t* a = &agents[i];
+        if (a->conn != i) {
+            continue;
+        }
+        for (int j = i + 1; j < num_agents; j++) {
+            if (agents[j].conn == i && strcmp(agents[j].role, "probe") == 0) {
+                a = &agents[j];
+            }
+        }
+        if (strcmp(a->role, "probe") != 0) {
+            if (campaign_read(a, line, CTL_START_LEAD_USEC / 1000 + CTL_REPLY_TIMEOUT_MS) == NULL) {
+                status = -1;
+                goto done;
+            }
+            a->skew_us = ctl_int(line, "skew_us", 0);
+            continue;
+        }
+        if (campaign_read(a, line, campaign_probe_timeout_ms(a)) == NULL) {
+            status = -1;
+            goto done;
+        }
+        a->status = (int)ctl_int(line, "status", -1);
+        a->result.packets_sent = (int)ctl_int(line, "sent", 0);
+        a->result.packets_received = (int)ctl_int(line, "received", 0);
+        a->result.late_replies = (int)ctl_int(line, "late", 0);
+        a->result.duration_sec = ctl_int(line, "duration_us", 0) / 1000000.0;
+        a->skew_us = ctl_int(line, "skew_us", 0);
+        for (int j = i; j < num_agents; j++) {
+            if (agents[j].conn == i) {
+                agents[j].skew_us = a->skew_us;
+            }
+        }
+        if (campaign_read(a, line, CTL_REPLY_TIMEOUT_MS) == NULL) {
+            status = -1;
+            goto done;
+        }
+        ctl_parse_hist(line, &a->result.rtt);
+        hist_merge(&combined, &a->result.rtt);
+        if (a->status != 0) {
+            status = -1;
+        }
+        probes++;
+    }
+    for (int i = 0; i < num_agents; i++) {
+        campaign_agent_t* a = &agents[i];
+        if (strcmp(a->role, "reflect") == 0) {
+            if (ctl_send_line(a->fd, "STOP") < 0 || campaign_read(a, line, CTL_REPLY_TIMEOUT_MS) == NULL) {
+                status = -1;
+                goto done;
+            }
+            a->reflected = ctl_int(line, "reflected", 0);
+        }
+    }
+
+    // Report
+    printf("\n--- Campaign Report (%d agents, %d probing) ---\n", num_agents, probes);
+    int total_sent = 0, total_received = 0;
+    for (int i = 0; i < num_agents; i++) {
+        campaign_agent_t* a = &agents[i];
+        printf("Agent %s:%d %-7s clock offset %+lld us, start skew %lld us\n", a->host, a->port, a->role,
+               (long long)a->clock_offset, a->skew_us);
+        if (strcmp(a->role, "reflect") == 0) {
+            printf("  Reflected %lld packets\n", a->reflected);
+            continue;
+        }
+        latency_hist_t* h = &a->result.rtt;
+        printf("  Sent %d, received %d, late %d", a->result.packets_sent, a->result.packets_received,
+               a->result.late_replies);
+        if (h->total > 0) {
+            printf(", RTT p50 %.2f us, p99 %.2f us, max %.2f us", hist_percentile(h, 50) / 1000.0,
+                   hist_percentile(h, 99) / 1000.0, h->max_ns / 1000.0);
+        }
+        printf("\n");
+        total_sent += a->result.packets_sent;
+        total_received += a->result.packets_received;
+    }
+    printf("Combined:\n");
+    printf("  Sent %d, received %d, loss %.3f%%\n", total_sent, total_received,
+           total_sent > 0 ? 100.0 * (total_sent - total_received) / total_sent : 0.0);
+    if (combined.total > 0) {
+        printf("  RTT min %.2f us, p50 %.2f us, p90 %.2f us, p99 %.2f us, p99.9 %.2f us, max %.2f us\n",
+               combined.min_ns / 1000.0, hist_percentile(&combined, 50) / 1000.0,
+               hist_percentile(&combined, 90) / 1000.0, hist_percentile(&combined, 99) / 1000.0,
+               hist_percentile(&combined, 99.9) / 1000.0, combined.max_ns / 1000.0);
+    }
+
+    if (config->output_file[0] != '\0') {
+        FILE* f = fopen(config->output_file, "w");
+        if (f == NULL) {
+            perror("Failed to open report file");
+        } else {
+            fprintf(f, "{\n  \"tool\": \"netperf-campaign\",\n  \"agents\": [\n");
+            for (int i = 0; i < num_agents; i++) {
+                campaign_agent_t* a = &agents[i];
+                latency_hist_t* h = &a->result.rtt;
+                fprintf(f, "    {\"agent\": \"%s:%d\", \"role\": \"%s\", \"clock_offset_us\": %lld, "
+                           "\"skew_us\": %lld, \"sent\": %d, \"received\": %d, \"reflected\": %lld, "
+                           "\"p50_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}%s\n",
+                        a->host, a->port, a->role, (long long)a->clock_offset, a->skew_us,
+                        a->result.packets_sent, a->result.packets_received, a->reflected,
+                        h->total > 0 ? hist_percentile(h, 50) / 1000.0 : 0.0,
+                        h->total > 0 ? hist_percentile(h, 99) / 1000.0 : 0.0,
+                        h->total > 0 ? h->max_ns / 1000.0 : 0.0, i + 1 < num_agents ? "," : "");
+            }
+            fprintf(f, "  ],\n  \"combined\": {\"sent\": %d, \"received\": %d, \"p50_us\": %.2f, "
+                       "\"p90_us\": %.2f, \"p99_us\": %.2f, \"p999_us\": %.2f, \"max_us\": %.2f}\n}\n",
+                    total_sent, total_received,
+                    combined.total > 0 ? hist_percentile(&combined, 50) / 1000.0 : 0.0,
+                    combined.total > 0 ? hist_percentile(&combined, 90) / 1000.0 : 0.0,
+                    combined.total > 0 ? hist_percentile(&combined, 99) / 1000.0 : 0.0,
+                    combined.total > 0 ? hist_percentile(&combined, 99.9) / 1000.0 : 0.0,
+                    combined.total > 0 ? combined.max_ns / 1000.0 : 0.0);
+            fclose(f);
+            printf("\nReport saved to %s\n", config->output_file);
+        }
+    }
+    if (config->result != NULL) {
+        config->result->packets_sent = total_sent;
+        config->result->packets_received = total_received;
+        hist_merge(&config->result->rtt, &combined);
+    }
+
+done:
+    for (int i = 0; i < num_agents; i++) {
+        if (agents[i].conn == i && agents[i].fd >= 0) {
+            ctl_send_line(agents[i].fd, "BYE");
+            fclose(agents[i].in);
+            close(agents[i].fd);
+        }
+    }
+    free(line);
+    return status;
+}
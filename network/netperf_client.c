@@ -0,0 +1,583 @@
+/**
+ * TCP and UDP probe clients (-c)
+ */
+
+#include "netperf.h"
+
+/**
+ * Client implementation - TCP protocol
+ */
+int run_tcp_client(config_t* config) {
+    int sock = 0;
+    struct sockaddr_storage server_addr;
+    packet_t* packet;
+    double* latencies;
+    double* rtts;
+    uint64_t* send_times;
+    int packets_received = 0;
+    int packets_sent = 0;
+    FILE* csv_file = NULL;
+    int64_t clock_offset = 0;
+    overhead_sample_t usage_start, usage_end;
+    perf_counters_t counters;
+    noise_sampler_t noise;
+    hostmon_t host;
+    busy_poll_t busy;
+    latency_hist_t spin_rtt, block_rtt;
+    latency_hist_t* node_rtt[NUMA_MAX_NODES] = { NULL };
+    
+    // Allocate memory for statistics
+    latencies = (double*)malloc(config->num_packets * sizeof(double));
+    rtts = (double*)malloc(config->num_packets * sizeof(double));
+    send_times = (uint64_t*)malloc(config->num_packets * sizeof(uint64_t));
+    
+    if (latencies == NULL || rtts == NULL || send_times == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if (config->rt_profile) {
+        rt_profile_apply_thread(config, 0, "prober");
+        rt_prefault(latencies, config->num_packets * sizeof(double));
+        rt_prefault(rtts, config->num_packets * sizeof(double));
+        rt_prefault(send_times, config->num_packets * sizeof(uint64_t));
+    }
+    
+    // Open output file if specified
+    if (config->output_file[0] != '\0') {
+        csv_file = fopen(config->output_file, "w");
+        if (csv_file == NULL) {
+            perror("Failed to open output file");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(csv_file, "seq_num,packet_size,one_way_latency_us,rtt_us,server_processing_us\n");
+    }
+    
+    // Create socket
+    sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Setup address structure
+    int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (addr_size < 0) {
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+    
+    // Connect to server
+    printf("Connecting to %s server %s:%d...\n", 
+           config->use_ipv6 ? "IPv6" : "IPv4", config->server_ip, config->port);
+           
+    if (connect(sock, (struct sockaddr*)&server_addr, addr_size) < 0) {
+        perror("Connection failed");
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+    
+    printf("Connected. Using TCP protocol.\n");
+    busy_poll_init(&busy, config->busy_poll);
+    busy_poll_enable(sock, &busy, config->busy_poll_us);
+    hist_init(&spin_rtt);
+    hist_init(&block_rtt);
+    
+    // Perform clock synchronization if enabled
+    if (config->time_sync) {
+        clock_offset = synchronize_clocks(sock, 1, PROTOCOL_TCP);
+    }
+    
+    // Allocate packet with specified size, on the chosen node if placed
+    if (config->numa_policy != NUMA_POLICY_NONE) {
+        numa_resolve_node(config);
+        packet = numa_place_thread(config->numa_node, "prober", config->packet_size);
+    } else {
+        packet = create_packet(config->packet_size);
+    }
+    
+    printf("Sending %d packets of size %d bytes with %d ms delay (or rate of %d pps)\n", 
+           config->num_packets, config->packet_size, config->delay_ms, config->rate_pps);
+    printf("Measuring latency and jitter...\n\n");
+    
+    // Calculate delay between packets based on rate or delay setting
+    int actual_delay_us;
+    if (config->rate_pps > 0) {
+        actual_delay_us = 1000000 / config->rate_pps;
+    } else {
+        actual_delay_us = config->delay_ms * 1000;
+    }
+    
+    // Send packets and measure response time
+    overhead_sample(&usage_start);
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_start(&noise, config->noise_interval_ms);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_start(&host, config->host_spec);
+    }
+    if (config->perf_counters) {
+        perf_counters_open(&counters);
+        perf_counters_start(&counters);
+    }
+    for (int i = 0; i < config->num_packets && running; i++) {
+        // Prepare packet
+        packet->seq_num = i + 1;
+        packet->client_send = get_timestamp_usec();
+        packet->server_recv = 0;
+        packet->server_send = 0;
+        packet->server_node = NUMA_NODE_UNKNOWN;
+        
+        // Send packet to server
+        if (send_all(sock, packet, packet->packet_size) < 0) {
+            printf("Server disconnected\n");
+            break;
+        }
+        packets_sent++;
+        
+        // Receive response from server; in busy-poll mode every other probe spins
+        int spin = busy.enabled && i % 2 == 0;
+        if (spin && busy_poll_wait(sock, &busy, -1) < 0) {
+            break;
+        }
+        if (recv_all(sock, packet, sizeof(packet_t)) <= 0) {
+            printf("Server disconnected\n");
+            break;
+        }
+        
+        // Receive the rest of the packet if needed
+        if (packet->packet_size != (uint32_t)config->packet_size) {
+            printf("Server sent unexpected packet size %u\n", packet->packet_size);
+            break;
+        }
+        int remaining_bytes = packet->packet_size - sizeof(packet_t);
+        if (remaining_bytes > 0 && recv_all(sock, ((char*)packet) + sizeof(packet_t), remaining_bytes) <= 0) {
+            printf("Server disconnected\n");
+            break;
+        }
+        
+        // Record reception time
+        packet->client_recv = get_timestamp_usec();
+        
+        // Validate packet
+        if (!validate_packet(packet)) {
+            printf("Warning: Received invalid packet (seq=%lu)\n", packet->seq_num);
+            continue;
+        }
+        
+        // Calculate measurements with clock offset correction
+        double server_processing = packet->server_send - packet->server_recv;
+        double rtt = packet->client_recv - packet->client_send;
+        
+        // Adjust for clock offset if synchronization was performed
+        double one_way_latency;
+        if (config->time_sync) {
+            // Direct calculation using synchronized timestamps
+            one_way_latency = (packet->server_recv - clock_offset) - packet->client_send;
+        } else {
+            // Estimate using RTT
+            one_way_latency = (rtt - server_processing) / 2.0;
+        }
+        
+        // Store results
+        latencies[packets_received] = one_way_latency;
+        rtts[packets_received] = rtt;
+        send_times[packets_received] = packet->client_send;
+        packets_received++;
+        
+        if (config->result != NULL) {
+            hist_record(&config->result->rtt, (uint64_t)(rtt * 1000));
+        }
+        if (busy.enabled) {
+            hist_record(spin ? &spin_rtt : &block_rtt, (uint64_t)(rtt * 1000));
+        }
+        if (packet->server_node < NUMA_MAX_NODES) {
+            if (node_rtt[packet->server_node] == NULL) {
+                node_rtt[packet->server_node] = (latency_hist_t*)malloc(sizeof(latency_hist_t));
+                if (node_rtt[packet->server_node] == NULL) {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+                hist_init(node_rtt[packet->server_node]);
+            }
+            hist_record(node_rtt[packet->server_node], (uint64_t)(rtt * 1000));
+        }
+        
+        if (!config->quiet) {
+            printf("Packet %lu (%d bytes): One-way Latency = %.3f ms, RTT = %.3f ms\n", 
+                   packet->seq_num, packet->packet_size, one_way_latency / 1000, rtt / 1000);
+        }
+        
+        // Write to CSV if enabled
+        if (csv_file != NULL) {
+            fprintf(csv_file, "%lu,%d,%.3f,%.3f,%.3f\n", 
+                    packet->seq_num, packet->packet_size, one_way_latency, rtt, server_processing);
+        }
+        
+        // Delay before sending next packet
+        if (actual_delay_us > 0) {
+            usleep(actual_delay_us);
+        }
+    }
+    
+    overhead_sample(&usage_end);
+    if (config->result != NULL) {
+        config->result->packets_sent = packets_sent;
+        config->result->packets_received = packets_received;
+        config->result->duration_sec = (usage_end.wall_usec - usage_start.wall_usec) / 1000000.0;
+    }
+    if (config->perf_counters) {
+        perf_counters_stop(&counters);
+    }
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_stop(&noise);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_stop(&host);
+    }
+    
+    // Calculate statistics
+    print_summary(config, "TCP", latencies, rtts, packets_received, actual_delay_us);
+    if (busy.enabled) {
+        busy_poll_floor_report(&spin_rtt, &block_rtt);
+        busy_poll_report("prober", &busy);
+    }
+    for (int n = 0; n < NUMA_MAX_NODES; n++) {
+        if (node_rtt[n] != NULL) {
+            numa_latency_report(node_rtt);
+            break;
+        }
+    }
+    int status = overhead_report("prober", &usage_start, &usage_end, packets_sent,
+                                 config->overhead_budget);
+    if (config->perf_counters) {
+        perf_counters_report("prober", &counters, packets_sent);
+        perf_counters_close(&counters);
+    }
+    if (config->noise_interval_ms > 0) {
+        host_noise_report(&noise, send_times, rtts, packets_received);
+        noise_sampler_free(&noise);
+    }
+    if (config->host_spec[0] != '\0') {
+        host_metrics_report(&host, send_times, rtts, packets_received);
+        hostmon_free(&host);
+    }
+    
+    // Close file if open
+    if (csv_file != NULL) {
+        fclose(csv_file);
+        printf("\nResults saved to %s\n", config->output_file);
+    }
+    
+    // Clean up
+    for (int n = 0; n < NUMA_MAX_NODES; n++) {
+        free(node_rtt[n]);
+    }
+    free(packet);
+    free(latencies);
+    free(rtts);
+    free(send_times);
+    close(sock);
+    return status;
+}
+
+/**
+ * Client implementation - UDP protocol
+ */
+int run_udp_client(config_t* config) {
+    int sock = 0;
+    struct sockaddr_storage server_addr;
+    socklen_t addr_len;
+    packet_t* packet;
+    double* latencies;
+    double* rtts;
+    uint64_t* send_times;
+    int packets_received = 0;
+    int packets_sent = 0;
+    FILE* csv_file = NULL;
+    int64_t clock_offset = 0;
+    overhead_sample_t usage_start, usage_end;
+    sock_telemetry_t telemetry;
+    int late_replies = 0;
+    int have_server_drops = 0;
+    uint32_t server_drops_first = 0, server_drops_last = 0;
+    perf_counters_t counters;
+    noise_sampler_t noise;
+    hostmon_t host;
+    busy_poll_t busy;
+    latency_hist_t spin_rtt, block_rtt;
+    latency_hist_t* node_rtt[NUMA_MAX_NODES] = { NULL };
+    
+    // Allocate memory for statistics
+    latencies = (double*)malloc(config->num_packets * sizeof(double));
+    rtts = (double*)malloc(config->num_packets * sizeof(double));
+    send_times = (uint64_t*)malloc(config->num_packets * sizeof(uint64_t));
+    
+    if (latencies == NULL || rtts == NULL || send_times == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    if (config->rt_profile) {
+        rt_profile_apply_thread(config, 0, "prober");
+        rt_prefault(latencies, config->num_packets * sizeof(double));
+        rt_prefault(rtts, config->num_packets * sizeof(double));
+        rt_prefault(send_times, config->num_packets * sizeof(uint64_t));
+    }
+    
+    // Open output file if specified
+    if (config->output_file[0] != '\0') {
+        csv_file = fopen(config->output_file, "w");
+        if (csv_file == NULL) {
+            perror("Failed to open output file");
+            exit(EXIT_FAILURE);
+        }
+        fprintf(csv_file, "seq_num,packet_size,one_way_latency_us,rtt_us,server_processing_us\n");
+    }
+    
+    // Create socket
+    sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("Socket creation failed");
+        exit(EXIT_FAILURE);
+    }
+    sock_telemetry_enable(sock, &telemetry);
+    busy_poll_init(&busy, config->busy_poll);
+    busy_poll_enable(sock, &busy, config->busy_poll_us);
+    hist_init(&spin_rtt);
+    hist_init(&block_rtt);
+    
+    // Setup address structure
+    int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (addr_size < 0) {
+        close(sock);
+        exit(EXIT_FAILURE);
+    }
+    addr_len = (socklen_t)addr_size;
+    
+    printf("Using UDP protocol over %s to server %s:%d\n", 
+           config->use_ipv6 ? "IPv6" : "IPv4", config->server_ip, config->port);
+    
+    // Perform clock synchronization if enabled
+    if (config->time_sync) {
+        // For UDP, we need to "connect" the socket to the server first for synchronization
+        if (connect(sock, (struct sockaddr*)&server_addr, addr_len) < 0) {
+            perror("UDP connect for synchronization failed");
+            close(sock);
+            exit(EXIT_FAILURE);
+        }
+        
+        clock_offset = synchronize_clocks(sock, 1, PROTOCOL_UDP);
+    }
+    
+    // Allocate packet with specified size, on the chosen node if placed
+    if (config->numa_policy != NUMA_POLICY_NONE) {
+        numa_resolve_node(config);
+        packet = numa_place_thread(config->numa_node, "prober", config->packet_size);
+    } else {
+        packet = create_packet(config->packet_size);
+    }
+    
+    printf("Sending %d packets of size %d bytes with %d ms delay (or rate of %d pps)\n", 
+           config->num_packets, config->packet_size, config->delay_ms, config->rate_pps);
+    printf("Measuring latency and jitter...\n\n");
+    
+    // Calculate delay between packets based on rate or delay setting
+    int actual_delay_us;
+    if (config->rate_pps > 0) {
+        actual_delay_us = 1000000 / config->rate_pps;
+    } else {
+        actual_delay_us = config->delay_ms * 1000;
+    }
+    
+    // For UDP, set a reasonable timeout
+    struct timeval tv;
+    tv.tv_sec = 1;  // 1 second timeout
+    tv.tv_usec = 0;
+    if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (char*)&tv, sizeof(tv)) < 0) {
+        perror("Setting socket timeout failed");
+    }
+    
+    // Send packets and measure response time
+    overhead_sample(&usage_start);
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_start(&noise, config->noise_interval_ms);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_start(&host, config->host_spec);
+    }
+    if (config->perf_counters) {
+        perf_counters_open(&counters);
+        perf_counters_start(&counters);
+    }
+    for (int i = 0; i < config->num_packets && running; i++) {
+        // Prepare packet
+        packet->seq_num = i + 1;
+        packet->client_send = get_timestamp_usec();
+        packet->server_recv = 0;
+        packet->server_send = 0;
+        packet->server_node = NUMA_NODE_UNKNOWN;
+        
+        // Send packet to server
+        int sent = sendto(sock, packet, packet->packet_size, 0, 
+                         (struct sockaddr*)&server_addr, addr_len);
+        if (sent < 0) {
+            perror("UDP send failed");
+            continue;
+        }
+        packets_sent++;
+        
+        // Receive response from server, discarding replies that arrive after
+        // their own timeout so they are not mistaken for this probe's reply;
+        // in busy-poll mode every other probe spins
+        int spin = busy.enabled && i % 2 == 0;
+        int bytes_received;
+        do {
+            if (spin && busy_poll_wait(sock, &busy, 1000) <= 0) {
+                bytes_received = -1;
+                break;
+            }
+            bytes_received = recv_with_telemetry(sock, packet, packet->packet_size, NULL, NULL, &telemetry);
+        } while (bytes_received > 0 && packet->seq_num < (uint64_t)(i + 1) && ++late_replies);
+        if (bytes_received <= 0) {
+            if (!config->quiet) {
+                printf("Packet %d: No response (timeout)\n", i + 1);
+            }
+            continue;
+        }
+        if (packets_sent % QUEUE_SAMPLE_EVERY == 0) {
+            sock_telemetry_sample_queues(sock, &telemetry);
+        }
+        
+        // Record reception time
+        packet->client_recv = get_timestamp_usec();
+        
+        // Validate packet
+        if (!validate_packet(packet) || packet->seq_num != (uint64_t)(i + 1)) {
+            printf("Warning: Received invalid or out-of-sequence packet\n");
+            continue;
+        }
+        
+        // Calculate measurements with clock offset correction
+        double server_processing = packet->server_send - packet->server_recv;
+        double rtt = packet->client_recv - packet->client_send;
+        
+        // Adjust for clock offset if synchronization was performed
+        double one_way_latency;
+        if (config->time_sync) {
+            // Direct calculation using synchronized timestamps
+            one_way_latency = (packet->server_recv - clock_offset) - packet->client_send;
+        } else {
+            // Estimate using RTT
+            one_way_latency = (rtt - server_processing) / 2.0;
+        }
+        
+        // Track the reflector's socket drop counter over the run
+        if (!have_server_drops) {
+            server_drops_first = packet->server_drops;
+            have_server_drops = 1;
+        }
+        server_drops_last = packet->server_drops;
+        
+        // Store results
+        latencies[packets_received] = one_way_latency;
+        rtts[packets_received] = rtt;
+        send_times[packets_received] = packet->client_send;
+        packets_received++;
+        
+        if (config->result != NULL) {
+            hist_record(&config->result->rtt, (uint64_t)(rtt * 1000));
+        }
+        if (busy.enabled) {
+            hist_record(spin ? &spin_rtt : &block_rtt, (uint64_t)(rtt * 1000));
+        }
+        if (packet->server_node < NUMA_MAX_NODES) {
+            if (node_rtt[packet->server_node] == NULL) {
+                node_rtt[packet->server_node] = (latency_hist_t*)malloc(sizeof(latency_hist_t));
+                if (node_rtt[packet->server_node] == NULL) {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+                hist_init(node_rtt[packet->server_node]);
+            }
+            hist_record(node_rtt[packet->server_node], (uint64_t)(rtt * 1000));
+        }
+        
+        if (!config->quiet) {
+            printf("Packet %lu (%d bytes): One-way Latency = %.3f ms, RTT = %.3f ms\n", 
+                   packet->seq_num, packet->packet_size, one_way_latency / 1000, rtt / 1000);
+        }
+        
+        // Write to CSV if enabled
+        if (csv_file != NULL) {
+            fprintf(csv_file, "%lu,%d,%.3f,%.3f,%.3f\n", 
+                    packet->seq_num, packet->packet_size, one_way_latency, rtt, server_processing);
+        }
+        
+        // Delay before sending next packet
+        if (actual_delay_us > 0) {
+            usleep(actual_delay_us);
+        }
+    }
+    
+    overhead_sample(&usage_end);
+    if (config->result != NULL) {
+        config->result->packets_sent = packets_sent;
+        config->result->packets_received = packets_received;
+        config->result->late_replies = late_replies;
+        config->result->duration_sec = (usage_end.wall_usec - usage_start.wall_usec) / 1000000.0;
+    }
+    if (config->perf_counters) {
+        perf_counters_stop(&counters);
+    }
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_stop(&noise);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_stop(&host);
+    }
+    
+    // Calculate statistics
+    print_summary(config, "UDP", latencies, rtts, packets_received, actual_delay_us);
+    print_loss_breakdown(packets_sent, packets_received, late_replies,
+                         server_drops_last - server_drops_first, &telemetry);
+    if (busy.enabled) {
+        busy_poll_floor_report(&spin_rtt, &block_rtt);
+        busy_poll_report("prober", &busy);
+    }
+    for (int n = 0; n < NUMA_MAX_NODES; n++) {
+        if (node_rtt[n] != NULL) {
+            numa_latency_report(node_rtt);
+            break;
+        }
+    }
+    int status = overhead_report("prober", &usage_start, &usage_end, packets_sent,
+                                 config->overhead_budget);
+    if (config->perf_counters) {
+        perf_counters_report("prober", &counters, packets_sent);
+        perf_counters_close(&counters);
+    }
+    if (config->noise_interval_ms > 0) {
+        host_noise_report(&noise, send_times, rtts, packets_received);
+        noise_sampler_free(&noise);
+    }
+    if (config->host_spec[0] != '\0') {
+        host_metrics_report(&host, send_times, rtts, packets_received);
+        hostmon_free(&host);
+    }
+    
+    // Close file if open
+    if (csv_file != NULL) {
+        fclose(csv_file);
+        printf("\nResults saved to %s\n", config->output_file);
+    }
+    
+    // Clean up
+    for (int n = 0; n < NUMA_MAX_NODES; n++) {
+        free(node_rtt[n]);
+    }
+    free(packet);
+    free(latencies);
+    free(rtts);
+    free(send_times);
+    close(sock);
+    return status;
+}
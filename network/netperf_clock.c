@@ -0,0 +1,588 @@
+/**
+ * Clock diagnostics (-D): clock rates, steps and the kernel discipline
+ */
+
+#include "netperf.h"
+
+#ifdef __linux__
+#ifndef CLOCK_TAI
+#define CLOCK_TAI 11
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#define CLOCK_COUNTER_NAME "TSC"
+#elif defined(__aarch64__)
+#define CLOCK_COUNTER_NAME "CNTVCT"
+#endif
+
+// A jump found between two samples of one clock
+typedef struct {
+    const char* clock;
+    double t_s;
+    double size_ns;
+    int cpu_from, cpu_to;
+} clock_event_t;
+
+/**
+ * Read the CPU cycle counter directly, bypassing the kernel clocksource
+ */
+static inline uint64_t clock_read_counter(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    uint32_t lo, hi;
+    __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+    uint64_t value;
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(value));
+    return value;
+#else
+    return 0;
+#endif
+}
+
+static int64_t clock_read_ns(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void clock_take_sample(clock_sample_t* s) {
+    uint64_t c0 = clock_read_counter();
+    int64_t r0 = clock_read_ns(CLOCK_MONOTONIC_RAW);
+    s->realtime = clock_read_ns(CLOCK_REALTIME);
+    s->monotonic = clock_read_ns(CLOCK_MONOTONIC);
+    s->tai = clock_read_ns(CLOCK_TAI);
+    int64_t r1 = clock_read_ns(CLOCK_MONOTONIC_RAW);
+    uint64_t c1 = clock_read_counter();
+    s->raw = r0 + (r1 - r0) / 2;
+    s->counter = c0 + (c1 - c0) / 2;
+    s->read_ns = (int32_t)(r1 - r0);
+}
+
+/**
+ * Take the median rate of y against x over the sample intervals, then treat
+ * any interval where y moved more than step_ns (in x units) off that rate
+ * as a step. Steps are subtracted from y in place so a fit sees only drift.
+ * Returns the number of steps; the first max_events are recorded
+ */
+static int clock_remove_steps(const char* name, const double* x, double* y, const clock_sample_t* samples, int n,
+                              double* scratch, clock_event_t* events, int* nevents, int max_events) {
+    int m = 0;
+    for (int i = 1; i < n; i++) {
+        if (x[i] > x[i - 1]) {
+            scratch[m++] = (y[i] - y[i - 1]) / (x[i] - x[i - 1]);
+        }
+    }
+    if (m == 0) {
+        return 0;
+    }
+    qsort(scratch, m, sizeof(double), compare_doubles);
+    double rate = sorted_percentile(scratch, m, 50);
+
+    int steps = 0;
+    double correction = 0;
+    double prev = y[0];
+    for (int i = 1; i < n; i++) {
+        double raw_y = y[i];
+        double jump = (raw_y - prev) - (x[i] - x[i - 1]) * rate;
+        if (fabs(jump) > CLOCK_STEP_NS * rate) {
+            correction += jump;
+            steps++;
+            if (*nevents < max_events) {
+                clock_event_t* e = &events[(*nevents)++];
+                e->clock = name;
+                e->t_s = x[i] / 1e9;
+                e->size_ns = jump / rate;
+                e->cpu_from = samples[i - 1].cpu;
+                e->cpu_to = samples[i].cpu;
+            }
+        }
+        prev = raw_y;
+        y[i] = raw_y - correction;
+    }
+    return steps;
+}
+
+static double clock_fit_rms(const double* x, const double* y, int n, double intercept, double slope) {
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        double r = y[i] - (intercept + slope * x[i]);
+        sum += r * r;
+    }
+    return n > 0 ? sqrt(sum / n) : 0.0;
+}
+
+/**
+ * One offset exchange with a reflector, using the same header-only sync
+ * packets as synchronize_clocks(); replies to timed-out exchanges are
+ * skipped by their echoed send time. Returns 0 on a reply
+ */
+static int clock_peer_exchange(int sock, int tcp, int k, clock_peer_t* p) {
+    packet_t sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.seq_num = 0xFFFFFFFF - (k % 20);
+    sync.packet_size = sizeof(packet_t);
+    uint64_t t1 = get_timestamp_usec();
+    sync.client_send = t1;
+    if ((tcp ? send_all(sock, &sync, sizeof(sync)) : send(sock, &sync, sizeof(sync), 0)) < 0) {
+        return -1;
+    }
+    uint64_t deadline = t1 + CLOCK_PEER_TIMEOUT_MS * 1000;
+    for (;;) {
+        uint64_t now = get_timestamp_usec();
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (now >= deadline || poll(&pfd, 1, (int)((deadline - now) / 1000) + 1) <= 0) {
+            return -1;
+        }
+        ssize_t n = tcp ? recv_all(sock, &sync, sizeof(sync)) : recv(sock, &sync, sizeof(sync), 0);
+        uint64_t t4 = get_timestamp_usec();
+        if (n <= 0) {
+            return -1;
+        }
+        if (n == sizeof(sync) && sync.client_send == t1) {
+            int64_t t2 = (int64_t)sync.server_recv, t3 = (int64_t)sync.server_send;
+            p->rtt_us = (double)((int64_t)(t4 - t1) - (t3 - t2));
+            p->offset_us = ((t2 - (int64_t)t1) + (t3 - (int64_t)t4)) / 2.0;
+            return 0;
+        }
+    }
+}
+
+static const char* clock_state_name(int state) {
+    static const char* names[] = { "TIME_OK", "TIME_INS", "TIME_DEL", "TIME_OOP", "TIME_WAIT", "TIME_ERROR" };
+    return state >= 0 && state <= 5 ? names[state] : "unknown";
+}
+
+/**
+ * Slew the kernel applies to REALTIME: frequency plus tick adjustment, in ppm
+ */
+static double clock_kernel_slew_ppm(const struct timex* tx) {
+    long hz = sysconf(_SC_CLK_TCK);
+    double nominal_tick = 1000000.0 / (hz > 0 ? hz : 100);
+    return tx->freq / 65536.0 + (tx->tick - nominal_tick) / nominal_tick * 1e6;
+}
+
+static void clock_print_adjtimex(const struct timex* tx, int state) {
+    static const struct { int flag; const char* name; } flags[] = {
+        { STA_PLL, "PLL" }, { STA_PPSFREQ, "PPSFREQ" }, { STA_PPSTIME, "PPSTIME" }, { STA_FLL, "FLL" },
+        { STA_INS, "INS" }, { STA_DEL, "DEL" }, { STA_UNSYNC, "UNSYNC" }, { STA_FREQHOLD, "FREQHOLD" },
+        { STA_NANO, "NANO" },
+    };
+    double freq_ppm = tx->freq / 65536.0;
+    double slew_ppm = clock_kernel_slew_ppm(tx);
+
+    printf("  State: %s, status", clock_state_name(state));
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+        if (tx->status & flags[i].flag) {
+            printf(" %s", flags[i].name);
+        }
+    }
+    printf("\n  Frequency correction: %+.3f ppm, tick %ld us (%+.0f ppm), total slew %+.3f ppm\n",
+           freq_ppm, (long)tx->tick, slew_ppm - freq_ppm, slew_ppm);
+    printf("  Offset being slewed: %ld %s, max error %ld us, estimated error %ld us, TAI-UTC %d s\n",
+           (long)tx->offset, (tx->status & STA_NANO) ? "ns" : "us", (long)tx->maxerror, (long)tx->esterror,
+           tx->tai);
+}
+
+/**
+ * Clock diagnostics: samples every clock together for -D seconds, fits the
+ * rate of each against CLOCK_MONOTONIC_RAW (the clocksource without NTP
+ * adjustment), finds steps, reports the kernel discipline and, with -c,
+ * fits the offset to a reflector's clock to tell a bad local oscillator
+ * from a bad time source
+ */
+int run_clock_diag(config_t* config) {
+    int seconds = config->clock_diag_sec;
+    int64_t interval_ns = CLOCK_SAMPLE_US * 1000LL;
+    if ((int64_t)seconds * 1000000000LL / interval_ns > CLOCK_MAX_SAMPLES) {
+        interval_ns = (int64_t)seconds * 1000000000LL / CLOCK_MAX_SAMPLES;
+    }
+    int max_samples = (int)((int64_t)seconds * 1000000000LL / interval_ns) + 16;
+    int max_peers = seconds * 1000 / CLOCK_PEER_INTERVAL_MS + 16;
+    if (max_peers > max_samples) {
+        max_peers = max_samples;
+    }
+    clock_sample_t* samples = (clock_sample_t*)calloc(max_samples, sizeof(clock_sample_t));
+    double* x = (double*)malloc(max_samples * sizeof(double));
+    double* y = (double*)malloc(max_samples * sizeof(double));
+    double* scratch = (double*)malloc(max_samples * sizeof(double));
+    clock_peer_t* peers = (clock_peer_t*)calloc(max_peers, sizeof(clock_peer_t));
+    clock_event_t events[CLOCK_MAX_EVENTS];
+    int nevents = 0;
+    if (samples == NULL || x == NULL || y == NULL || scratch == NULL || peers == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int status = 0;
+
+    int sock = -1;
+    int tcp = config->protocol == PROTOCOL_TCP;
+    if (config->server_ip[0] != '\0') {
+        struct sockaddr_storage server_addr;
+        sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+        int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+        if (sock < 0 || addr_size < 0 || connect(sock, (struct sockaddr*)&server_addr, addr_size) < 0) {
+            perror("Connection failed");
+            if (sock >= 0) {
+                close(sock);
+            }
+            return -1;
+        }
+        if (tcp) {
+            int one = 1;
+            setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+    }
+
+    printf("Clock diagnostics: %d s, a sample every %lld us", seconds, (long long)(interval_ns / 1000));
+    if (sock >= 0) {
+        printf(", offset to %s:%d over %s every %d ms", config->server_ip, config->port, tcp ? "TCP" : "UDP",
+               CLOCK_PEER_INTERVAL_MS);
+    }
+    printf("\n");
+
+    // Clocksource and counter identification
+    char current[64] = "", available[256] = "", line[512];
+    read_sys_line("/sys/devices/system/clocksource/clocksource0/current_clocksource", current, sizeof(current));
+    read_sys_line("/sys/devices/system/clocksource/clocksource0/available_clocksource", available,
+                  sizeof(available));
+    for (size_t len = strlen(available); len > 0 && available[len - 1] == ' '; len--) {
+        available[len - 1] = '\0';
+    }
+    printf("\n--- Clocksource ---\n");
+    printf("  Current: %s (available: %s)\n", current[0] ? current : "?", available[0] ? available : "?");
+    double nominal_hz = 0;
+    char cpu_flags[128] = "";
+    FILE* cpuinfo = fopen("/proc/cpuinfo", "r");
+    if (cpuinfo != NULL) {
+        while (fgets(line, sizeof(line), cpuinfo) != NULL) {
+            char* at = strstr(line, " @ ");
+            if (strncmp(line, "model name", 10) == 0 && at != NULL && nominal_hz == 0) {
+                nominal_hz = atof(at + 3) * 1e9;  // "... @ 2.20GHz"
+            }
+            if (strncmp(line, "flags", 5) == 0) {
+                const char* wanted[] = { " constant_tsc", " nonstop_tsc", " tsc_reliable", " hypervisor" };
+                line[strcspn(line, "\n")] = ' ';
+                for (size_t i = 0; i < sizeof(wanted) / sizeof(wanted[0]); i++) {
+                    char key[32];
+                    snprintf(key, sizeof(key), "%s ", wanted[i]);
+                    if (strstr(line, key) != NULL) {
+                        strcat(cpu_flags, wanted[i]);
+                    }
+                }
+                break;
+            }
+        }
+        fclose(cpuinfo);
+    }
+    double kernel_counter_hz = 0;
+    if (read_sys_line("/sys/devices/system/cpu/cpu0/tsc_freq_khz", line, sizeof(line)) == 0) {
+        kernel_counter_hz = atof(line) * 1000.0;
+    }
+#ifdef CLOCK_COUNTER_NAME
+    printf("  %s flags:%s%s", CLOCK_COUNTER_NAME, cpu_flags[0] ? cpu_flags : " none",
+           nominal_hz > 0 ? "" : "\n");
+    if (nominal_hz > 0) {
+        printf(", nominal CPU frequency %.2f MHz\n", nominal_hz / 1e6);
+    }
+#endif
+
+    printf("\n--- Kernel Time Discipline (adjtimex) ---\n");
+    struct timex tx_start, tx_end;
+    memset(&tx_start, 0, sizeof(tx_start));
+    int state_start = adjtimex(&tx_start);
+    clock_print_adjtimex(&tx_start, state_start);
+    fflush(stdout);
+
+    // Sampling
+    int n = 0, npeers = 0, dropped = 0;
+    int64_t start = clock_read_ns(CLOCK_MONOTONIC_RAW);
+    int64_t end = start + (int64_t)seconds * 1000000000LL;
+    int64_t next = start, next_peer = start;
+    while (running && n < max_samples) {
+        int64_t now = clock_read_ns(CLOCK_MONOTONIC_RAW);
+        if (now >= end) {
+            break;
+        }
+        if (now < next) {
+            struct timespec ts = { (time_t)((next - now) / 1000000000LL), (long)((next - now) % 1000000000LL) };
+            nanosleep(&ts, NULL);
+            continue;
+        }
+        next += interval_ns;
+        if (next < now) {
+            next = now + interval_ns;
+        }
+        clock_sample_t* s = &samples[n];
+        clock_take_sample(s);
+        numa_current_node(&s->cpu);
+        if (s->read_ns > CLOCK_MAX_READ_NS) {
+            dropped++;
+            continue;
+        }
+        n++;
+        if (sock >= 0 && now >= next_peer && npeers < max_peers) {
+            next_peer += CLOCK_PEER_INTERVAL_MS * 1000000LL;
+            clock_peer_t* p = &peers[npeers];
+            p->sample = n - 1;
+            p->t_s = (s->raw - start) / 1e9;
+            if (clock_peer_exchange(sock, tcp, npeers, p) == 0) {
+                npeers++;
+            }
+        }
+    }
+    memset(&tx_end, 0, sizeof(tx_end));
+    int state_end = adjtimex(&tx_end);
+    if (n < 16) {
+        fprintf(stderr, "Only %d clock samples; nothing to fit\n", n);
+        status = -1;
+        goto done;
+    }
+    double elapsed = (samples[n - 1].raw - samples[0].raw) / 1e9;
+    for (int i = 0; i < n; i++) {
+        x[i] = (double)(samples[i].raw - samples[0].raw);
+        scratch[i] = samples[i].read_ns;
+    }
+    qsort(scratch, n, sizeof(double), compare_doubles);
+    printf("\n--- Rates vs CLOCK_MONOTONIC_RAW (%d samples over %.2f s, read window p50 %.0f ns, "
+           "%d preempted samples dropped) ---\n", n, elapsed, sorted_percentile(scratch, n, 50), dropped);
+    printf("  %-10s %14s %14s %8s\n", "clock", "rate", "residual ns", "steps");
+
+    // REALTIME, MONOTONIC and TAI: fit (clock - raw) so the slope is the ppm error directly
+    const char* names[] = { "REALTIME", "MONOTONIC", "TAI" };
+    double ppm[3] = { 0, 0, 0 };
+    int steps[3] = { 0, 0, 0 };
+    double tai_offset_s = 0;
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < n; i++) {
+            int64_t v = c == 0 ? samples[i].realtime : c == 1 ? samples[i].monotonic : samples[i].tai;
+            int64_t v0 = c == 0 ? samples[0].realtime : c == 1 ? samples[0].monotonic : samples[0].tai;
+            y[i] = (double)(v - v0);
+        }
+        steps[c] = clock_remove_steps(names[c], x, y, samples, n, scratch, events, &nevents, CLOCK_MAX_EVENTS);
+        for (int i = 0; i < n; i++) {
+            y[i] -= x[i];
+        }
+        double intercept = 0, slope = 0;
+        sweep_fit(x, y, n, &intercept, &slope);
+        ppm[c] = slope * 1e6;
+        printf("  %-10s %+10.3f ppm %14.1f %8d\n", names[c], ppm[c], clock_fit_rms(x, y, n, intercept, slope),
+               steps[c]);
+    }
+    tai_offset_s = (samples[n - 1].tai - samples[n - 1].realtime) / 1e9;
+
+    // Cycle counter: fit ticks against raw ns for its frequency, then per-CPU residuals
+    double counter_hz = 0, nominal_ppm = 0, kernel_ppm = 0, cpu_spread_ns = 0;
+    int counter_steps = 0;
+    double* residual = NULL;
+#ifdef CLOCK_COUNTER_NAME
+    for (int i = 0; i < n; i++) {
+        y[i] = (double)(samples[i].counter - samples[0].counter);
+    }
+    counter_steps = clock_remove_steps(CLOCK_COUNTER_NAME, x, y, samples, n, scratch, events, &nevents,
+                                       CLOCK_MAX_EVENTS);
+    double c_intercept = 0, c_slope = 0;
+    if (sweep_fit(x, y, n, &c_intercept, &c_slope) && c_slope > 0) {
+        counter_hz = c_slope * 1e9;
+        printf("  %-10s %10.3f MHz %14.1f %8d", CLOCK_COUNTER_NAME, counter_hz / 1e6,
+               clock_fit_rms(x, y, n, c_intercept, c_slope) / c_slope, counter_steps);
+        if (kernel_counter_hz > 0) {
+            kernel_ppm = (counter_hz / kernel_counter_hz - 1) * 1e6;
+            printf("   %+.0f ppm vs kernel tsc_freq_khz", kernel_ppm);
+        }
+        if (nominal_hz > 0) {
+            nominal_ppm = (counter_hz / nominal_hz - 1) * 1e6;
+            printf("   %+.0f ppm vs nominal", nominal_ppm);
+        }
+        printf("\n");
+
+        residual = (double*)malloc(n * sizeof(double));
+        long ncpus = sysconf(_SC_NPROCESSORS_CONF);
+        int max_cpu = 0;
+        for (int i = 0; i < n; i++) {
+            residual[i] = (y[i] - (c_intercept + c_slope * x[i])) / c_slope;
+            if (samples[i].cpu > max_cpu) {
+                max_cpu = samples[i].cpu;
+            }
+        }
+        if (max_cpu + 1 > ncpus) {
+            ncpus = max_cpu + 1;
+        }
+        double* cpu_sum = (double*)calloc(ncpus, sizeof(double));
+        int* cpu_count = (int*)calloc(ncpus, sizeof(int));
+        int seen = 0;
+        double lo = 0, hi = 0;
+        for (int i = 0; i < n; i++) {
+            if (samples[i].cpu >= 0) {
+                cpu_sum[samples[i].cpu] += residual[i];
+                cpu_count[samples[i].cpu]++;
+            }
+        }
+        for (int c = 0; c < ncpus; c++) {
+            if (cpu_count[c] > 0) {
+                double mean = cpu_sum[c] / cpu_count[c];
+                lo = seen == 0 || mean < lo ? mean : lo;
+                hi = seen == 0 || mean > hi ? mean : hi;
+                seen++;
+            }
+        }
+        if (seen > 1) {
+            cpu_spread_ns = hi - lo;
+            printf("  %s offset across the %d CPUs sampled: %.1f ns spread\n", CLOCK_COUNTER_NAME, seen,
+                   cpu_spread_ns);
+        }
+        free(cpu_sum);
+        free(cpu_count);
+    }
+#endif
+
+    printf("  TAI-REALTIME: %.6f s (adjtimex TAI-UTC %d s)\n", tai_offset_s, tx_end.tai);
+    printf("  Kernel slew %+.3f ppm at start, %+.3f ppm at end (%s); measured REALTIME %+.3f ppm\n",
+           clock_kernel_slew_ppm(&tx_start), clock_kernel_slew_ppm(&tx_end), clock_state_name(state_end), ppm[0]);
+
+    printf("\n--- Step Events ---\n");
+    if (nevents == 0) {
+        printf("  None (no clock moved more than %d us off its rate between samples)\n", CLOCK_STEP_NS / 1000);
+    }
+    for (int i = 0; i < nevents; i++) {
+        printf("  %8.3f s  %-9s %+14.3f us", events[i].t_s, events[i].clock, events[i].size_ns / 1000.0);
+        if (events[i].cpu_from != events[i].cpu_to) {
+            printf("  (moved CPU %d -> %d)", events[i].cpu_from, events[i].cpu_to);
+        }
+        printf("\n");
+    }
+
+    // Peer: fit the offsets of the faster half of the exchanges, whose queuing noise is lowest
+    double peer_ppm = 0, raw_vs_peer_ppm = 0;
+    int peer_fit = 0;
+    if (sock >= 0) {
+        printf("\n--- Offset to %s (%d exchanges) ---\n", config->server_ip, npeers);
+        if (npeers >= 4) {
+            for (int i = 0; i < npeers; i++) {
+                scratch[i] = peers[i].rtt_us;
+            }
+            qsort(scratch, npeers, sizeof(double), compare_doubles);
+            double rtt_cut = sorted_percentile(scratch, npeers, 50);
+            int m = 0;
+            for (int i = 0; i < npeers; i++) {
+                if (peers[i].rtt_us <= rtt_cut) {
+                    x[m] = peers[i].t_s;
+                    y[m] = peers[i].offset_us;
+                    m++;
+                }
+            }
+            double intercept = 0, slope = 0;
+            if (sweep_fit(x, y, m, &intercept, &slope)) {
+                peer_fit = 1;
+                peer_ppm = -slope;
+                raw_vs_peer_ppm = peer_ppm - ppm[0];
+                printf("  RTT min %.0f us, median %.0f us; fit on the %d exchanges at or below the median\n",
+                       scratch[0], rtt_cut, m);
+                printf("  Peer minus local REALTIME: %+.1f us at start, %+.1f us at end (residual %.1f us)\n",
+                       intercept, intercept + slope * elapsed, clock_fit_rms(x, y, m, intercept, slope));
+                printf("  Local REALTIME runs %+.3f ppm vs the peer; local oscillator (MONOTONIC_RAW) %+.3f ppm\n",
+                       peer_ppm, raw_vs_peer_ppm);
+            }
+        } else {
+            printf("  Too few replies to fit (is a reflector running on port %d?)\n", config->port);
+        }
+    }
+
+    printf("\n--- Diagnosis ---\n");
+    int findings = 0;
+    if (steps[0] > 0) {
+        printf("  REALTIME stepped %d time(s): something set the clock (NTP makestep, ntpdate, date, VM resume)\n",
+               steps[0]);
+        findings++;
+    }
+    if (state_end == TIME_ERROR || (tx_end.status & STA_UNSYNC)) {
+        printf("  The kernel reports the clock unsynchronized: no NTP daemon is disciplining it\n");
+        findings++;
+    }
+    if (fabs((double)(tx_end.freq - tx_start.freq)) / 65536.0 > 1.0) {
+        printf("  The NTP daemon changed the kernel frequency by %+.3f ppm during the run\n",
+               (tx_end.freq - tx_start.freq) / 65536.0);
+        findings++;
+    }
+    if (fabs(ppm[0]) > 500) {
+        printf("  REALTIME is slewed %+.0f ppm, beyond NTP's 500 ppm frequency limit: the tick is adjusted to\n"
+               "  chase a large error\n", ppm[0]);
+        findings++;
+    }
+    if (peer_fit && fabs(raw_vs_peer_ppm) > 500) {
+        printf("  The local oscillator runs %+.0f ppm against the peer. If the peer keeps good time the fault is\n"
+               "  local (clocksource or %s calibration); confirm against a second peer to rule out a falseticker\n",
+               raw_vs_peer_ppm, current[0] ? current : "counter");
+        findings++;
+    } else if (peer_fit && fabs(peer_ppm) > 100) {
+        printf("  Local REALTIME drifts %+.0f ppm from the peer while the oscillator is within 500 ppm: the NTP\n"
+               "  discipline, or its source, is pulling the clock away\n", peer_ppm);
+        findings++;
+    }
+    // The nominal frequency is rounded to 10 MHz, so only a gross miss counts
+    if (strcmp(current, "tsc") == 0 && fabs(nominal_ppm) > 10000) {
+        printf("  The kernel's TSC calibration is %+.0f ppm off the CPU's nominal frequency: a wrong boot-time\n"
+               "  calibration drifts the clock by that much; check dmesg for 'tsc: ... MHz'\n", nominal_ppm);
+        findings++;
+    } else if (strcmp(current, "tsc") != 0 && fabs(kernel_ppm) > 100) {
+        printf("  The TSC and the %s clocksource disagree by %+.0f ppm: one of them is miscalibrated\n",
+               current, kernel_ppm);
+        findings++;
+    }
+    if (counter_steps > 0 || cpu_spread_ns > 1000) {
+        printf("  The %s jumps between samples or differs across CPUs (%.0f ns): unsynchronized or unstable\n",
+               counter_hz > 0 ? "cycle counter" : "counter", cpu_spread_ns);
+        findings++;
+    }
+    if (findings == 0) {
+        printf("  No anomaly: rates within limits and no steps%s\n", peer_fit ? ", peer agrees" : "");
+    } else {
+        status = -1;
+    }
+
+    if (config->output_file[0] != '\0') {
+        FILE* csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "elapsed_s,cpu,read_ns,realtime_minus_raw_ns,tai_minus_realtime_ns,counter_residual_ns,"
+                         "peer_offset_us,peer_rtt_us\n");
+            int p = 0;
+            for (int i = 0; i < n; i++) {
+                clock_sample_t* s = &samples[i];
+                fprintf(csv, "%.6f,%d,%d,%lld,%lld,", (s->raw - samples[0].raw) / 1e9, s->cpu, s->read_ns,
+                        (long long)((s->realtime - samples[0].realtime) - (s->raw - samples[0].raw)),
+                        (long long)(s->tai - s->realtime));
+                if (residual != NULL) {
+                    fprintf(csv, "%.1f", residual[i]);
+                }
+                if (p < npeers && peers[p].sample == i) {
+                    fprintf(csv, ",%.1f,%.1f\n", peers[p].offset_us, peers[p].rtt_us);
+                    p++;
+                } else {
+                    fprintf(csv, ",,\n");
+                }
+            }
+            fclose(csv);
+            printf("\nResults saved to %s\n", config->output_file);
+        }
+    }
+    free(residual);
+
+done:
+    if (sock >= 0) {
+        close(sock);
+    }
+    free(peers);
+    free(scratch);
+    free(y);
+    free(x);
+    free(samples);
+    return status;
+}
+#else
+int run_clock_diag(config_t* config) {
+    (void)config;
+    fprintf(stderr, "Clock diagnostics (-D) need Linux (CLOCK_MONOTONIC_RAW, CLOCK_TAI, adjtimex)\n");
+    return -1;
+}
+#endif
@@ -0,0 +1,1867 @@
+/**
+ * Probe and statistics core shared by netperf, netbench, microbench and
+ * nettest: timestamps, packets, socket I/O, latency histograms, clock
+ * sync, overhead and perf counters, host noise sampling, socket telemetry,
+ * busy polling, RT and NUMA placement, and the run summaries
+ */
+
+#include "netperf.h"
+
+// Global variables for signal handling
+volatile sig_atomic_t running = 1;
+volatile sig_atomic_t signal_received = 0;
+static int server_sockets[MAX_SERVER_SOCKETS];
+static int num_server_sockets = 0;
+
+/**
+ * Get current timestamp in microseconds with highest available precision
+ */
+uint64_t get_timestamp_usec() {
+    /* Use gettimeofday for AIX and other systems for better compatibility */
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)(tv.tv_sec * 1000000 + tv.tv_usec);
+}
+
+/**
+ * Signal handler for graceful termination
+ */
+void handle_signal(int sig) {
+    printf("\nReceived signal %d, shutting down...\n", sig);
+    signal_received = sig;
+    stop_servers();
+}
+
+/**
+ * Create and allocate a packet with the specified size
+ */
+packet_t* create_packet(int packet_size) {
+    if (packet_size < (int)sizeof(packet_t)) {
+        packet_size = sizeof(packet_t);
+    }
+    
+    // Allocate with enough space for the payload
+    packet_t* packet = (packet_t*)malloc(packet_size);
+    if (packet == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    memset(packet, 0, packet_size);
+    packet->packet_size = packet_size;
+    
+    // Fill payload with a recognizable pattern
+    for (int i = 0; i < packet_size - (int)sizeof(packet_t); i++) {
+        packet->payload[i] = (i % 256);
+    }
+    
+    return packet;
+}
+
+/**
+ * Validate packet integrity (check payload)
+ */
+int validate_packet(packet_t* packet) {
+    if (packet == NULL || packet->packet_size < sizeof(packet_t)) {
+        return 0;
+    }
+    
+    // Check payload integrity
+    for (int i = 0; i < (int)packet->packet_size - (int)sizeof(packet_t); i++) {
+        if (packet->payload[i] != (i % 256)) {
+            return 0;
+        }
+    }
+    
+    return 1;
+}
+
+/**
+ * Initialize socket address structure (works with both IPv4 and IPv6)
+ */
+int init_socket_address(struct sockaddr_storage* addr, const char* host, int port, int use_ipv6) {
+    memset(addr, 0, sizeof(struct sockaddr_storage));
+    
+    if (use_ipv6) {
+        struct sockaddr_in6* addr6 = (struct sockaddr_in6*)addr;
+        addr6->sin6_family = AF_INET6;
+        addr6->sin6_port = htons(port);
+        
+        if (host == NULL) {
+            // Server mode, bind to any address
+            addr6->sin6_addr = in6addr_any;
+        } else {
+            // Client mode, connect to specific host
+            if (inet_pton(AF_INET6, host, &addr6->sin6_addr) <= 0) {
+                perror("Invalid IPv6 address format");
+                return -1;
+            }
+        }
+        return sizeof(struct sockaddr_in6);
+    } else {
+        struct sockaddr_in* addr4 = (struct sockaddr_in*)addr;
+        addr4->sin_family = AF_INET;
+        addr4->sin_port = htons(port);
+        
+        if (host == NULL) {
+            // Server mode, bind to any address
+            addr4->sin_addr.s_addr = INADDR_ANY;
+        } else {
+            // Client mode, connect to specific host
+            if (inet_pton(AF_INET, host, &addr4->sin_addr) <= 0) {
+                perror("Invalid IPv4 address format");
+                return -1;
+            }
+        }
+        return sizeof(struct sockaddr_in);
+    }
+}
+
+/**
+ * Receive exactly length bytes from a stream socket
+ * Returns length, 0 if the peer closed the connection, -1 on error
+ */
+ssize_t recv_all(int socket_fd, void* buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = recv(socket_fd, (char*)buffer + done, length - done, 0);
+        if (n < 0 && errno == EINTR && running) {
+            continue;
+        }
+        if (n <= 0) {
+            return n;
+        }
+        done += n;
+    }
+    return (ssize_t)done;
+}
+
+/**
+ * Send exactly length bytes on a stream socket
+ * Returns length or -1 on error
+ */
+ssize_t send_all(int socket_fd, const void* buffer, size_t length) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = send(socket_fd, (const char*)buffer + done, length - done, 0);
+        if (n < 0 && errno == EINTR && running) {
+            continue;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        done += n;
+    }
+    return (ssize_t)done;
+}
+
+/**
+ * Remember a listening/reflector socket so it can be shut down on exit
+ */
+void register_server_socket(int fd) {
+    if (num_server_sockets < MAX_SERVER_SOCKETS) {
+        server_sockets[num_server_sockets++] = fd;
+    }
+}
+
+/**
+ * Stop all reflectors in this process: clear the running flag and shut down
+ * their sockets to wake threads blocked in accept()/recv(). Safe to call
+ * from a signal handler.
+ */
+void stop_servers(void) {
+    running = 0;
+    for (int i = 0; i < num_server_sockets; i++) {
+        shutdown(server_sockets[i], SHUT_RDWR);
+    }
+    num_server_sockets = 0;
+}
+
+/**
+ * Map a value to its log-linear histogram bucket
+ */
+int hist_bucket(uint64_t value) {
+    if (value < HIST_SUB_BUCKETS) {
+        return (int)value;
+    }
+    
+#if defined(__GNUC__)
+    int msb = 63 - __builtin_clzll(value);
+#else
+    int msb = 0;
+    for (uint64_t v = value; v > 1; v >>= 1) {
+        msb++;
+    }
+#endif
+    int major = msb - HIST_SUB_BITS + 1;
+    int sub = (int)((value >> (msb - HIST_SUB_BITS)) & (HIST_SUB_BUCKETS - 1));
+    int index = major * HIST_SUB_BUCKETS + sub;
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+/**
+ * Lowest value that falls into a histogram bucket
+ */
+uint64_t hist_bucket_floor(int index) {
+    int major = index / HIST_SUB_BUCKETS;
+    int sub = index % HIST_SUB_BUCKETS;
+    if (major == 0) {
+        return sub;
+    }
+    return (uint64_t)(HIST_SUB_BUCKETS + sub) << (major - 1);
+}
+
+void hist_init(latency_hist_t* h) {
+    memset(h, 0, sizeof(latency_hist_t));
+    h->min_ns = UINT64_MAX;
+}
+
+/**
+ * Record one latency sample (nanoseconds)
+ */
+void hist_record(latency_hist_t* h, uint64_t value_ns) {
+    h->counts[hist_bucket(value_ns)]++;
+    h->total++;
+    h->sum_ns += value_ns;
+    if (value_ns < h->min_ns) h->min_ns = value_ns;
+    if (value_ns > h->max_ns) h->max_ns = value_ns;
+}
+
+/**
+ * Add all samples of src into dst
+ */
+void hist_merge(latency_hist_t* dst, const latency_hist_t* src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->counts[i] += src->counts[i];
+    }
+    dst->total += src->total;
+    dst->sum_ns += src->sum_ns;
+    if (src->min_ns < dst->min_ns) dst->min_ns = src->min_ns;
+    if (src->max_ns > dst->max_ns) dst->max_ns = src->max_ns;
+}
+
+/**
+ * Value at the given percentile (0-100), as the midpoint of its bucket
+ * clamped to the observed min/max
+ */
+uint64_t hist_percentile(const latency_hist_t* h, double percentile) {
+    if (h->total == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = (uint64_t)ceil(percentile / 100.0 * h->total);
+    if (rank < 1) rank = 1;
+    
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t lo = hist_bucket_floor(i);
+            uint64_t hi = i + 1 < HIST_BUCKETS ? hist_bucket_floor(i + 1) : lo;
+            uint64_t mid = lo + (hi - lo) / 2;
+            if (mid < h->min_ns) mid = h->min_ns;
+            if (mid > h->max_ns) mid = h->max_ns;
+            return mid;
+        }
+    }
+    return h->max_ns;
+}
+
+/**
+ * Attempt to synchronize clocks between client and server
+ * This is a simplified approach inspired by PTP (Precision Time Protocol)
+ */
+int64_t synchronize_clocks(int socket_fd, int is_client, int protocol) {
+    if (!is_client) {
+        return 0; // Server doesn't adjust time
+    }
+    
+    const int SYNC_ROUNDS = 10;
+    int64_t offsets[SYNC_ROUNDS];
+    int64_t min_rtt = INT64_MAX;
+    int best_round = 0;
+    
+    printf("Attempting clock synchronization with server...\n");
+    
+    for (int i = 0; i < SYNC_ROUNDS; i++) {
+        uint64_t t1, t2, t3, t4;
+        packet_t sync_packet;
+        
+        // Prepare sync packet
+        memset(&sync_packet, 0, sizeof(packet_t));
+        sync_packet.seq_num = 0xFFFFFFFF - i; // Special sequence for sync packets
+        sync_packet.packet_size = sizeof(packet_t);
+        
+        // t1: Client send time
+        t1 = get_timestamp_usec();
+        sync_packet.client_send = t1;
+        
+        // Send to server
+        if (protocol == PROTOCOL_TCP) {
+            if (send(socket_fd, &sync_packet, sizeof(packet_t), 0) < 0) {
+                perror("Sync send failed");
+                continue;
+            }
+            
+            if (recv(socket_fd, &sync_packet, sizeof(packet_t), 0) <= 0) {
+                perror("Sync recv failed");
+                continue;
+            }
+        } else {
+            struct sockaddr_storage server_addr;
+            socklen_t addr_len = sizeof(server_addr);
+            
+            if (sendto(socket_fd, &sync_packet, sizeof(packet_t), 0, 
+                      (struct sockaddr*)&server_addr, addr_len) < 0) {
+                perror("Sync UDP send failed");
+                continue;
+            }
+                  
+            if (recvfrom(socket_fd, &sync_packet, sizeof(packet_t), 0,
+                        (struct sockaddr*)&server_addr, &addr_len) <= 0) {
+                perror("Sync UDP recv failed");
+                continue;
+            }
+        }
+        
+        // t4: Client receive time
+        t4 = get_timestamp_usec();
+        
+        // Extract t2 and t3 from packet
+        t2 = sync_packet.server_recv;
+        t3 = sync_packet.server_send;
+        
+        // Calculate RTT and offset
+        int64_t rtt = (t4 - t1) - (t3 - t2);
+        int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+        
+        offsets[i] = offset;
+        
+        // Keep track of the round with minimum RTT
+        if (rtt < min_rtt) {
+            min_rtt = rtt;
+            best_round = i;
+        }
+        
+        // Small delay between sync rounds
+        usleep(50000); // 50ms
+    }
+    
+    int64_t best_offset = offsets[best_round];
+    printf("Clock synchronization complete. Estimated offset: %ld μs (%.2f ms)\n", 
+           best_offset, best_offset / 1000.0);
+    
+    return best_offset;
+}
+
+/**
+ * Take a snapshot of the prober's own CPU time, context switches and
+ * run-queue wait so its footprint on the measured host can be reported
+ */
+void overhead_sample(overhead_sample_t* sample) {
+    struct rusage ru;
+    
+    memset(sample, 0, sizeof(overhead_sample_t));
+    sample->wall_usec = get_timestamp_usec();
+    
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        sample->utime_usec = (uint64_t)ru.ru_utime.tv_sec * 1000000 + ru.ru_utime.tv_usec;
+        sample->stime_usec = (uint64_t)ru.ru_stime.tv_sec * 1000000 + ru.ru_stime.tv_usec;
+        sample->nvcsw = ru.ru_nvcsw;
+        sample->nivcsw = ru.ru_nivcsw;
+    }
+    
+#ifdef __linux__
+    // Sum run-queue wait over all live threads (second field of schedstat)
+    DIR* dir = opendir("/proc/self/task");
+    if (dir != NULL) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (entry->d_name[0] == '.') {
+                continue;
+            }
+            
+            char path[320];
+            snprintf(path, sizeof(path), "/proc/self/task/%s/schedstat", entry->d_name);
+            FILE* f = fopen(path, "r");
+            if (f == NULL) {
+                continue;
+            }
+            
+            unsigned long long run_ns, wait_ns;
+            if (fscanf(f, "%llu %llu", &run_ns, &wait_ns) == 2) {
+                sample->run_delay_ns += wait_ns;
+                sample->have_schedstat = 1;
+            }
+            fclose(f);
+        }
+        closedir(dir);
+    }
+#endif
+}
+
+/**
+ * Print the prober's self-overhead between two snapshots
+ * Returns 0 if within budget (or no budget set), -1 if the budget was exceeded
+ */
+int overhead_report(const char* role, const overhead_sample_t* start, const overhead_sample_t* end,
+                    uint64_t probes, double budget) {
+    double wall_sec = (end->wall_usec - start->wall_usec) / 1000000.0;
+    double user_ms = (end->utime_usec - start->utime_usec) / 1000.0;
+    double sys_ms = (end->stime_usec - start->stime_usec) / 1000.0;
+    long nvcsw = end->nvcsw - start->nvcsw;
+    long nivcsw = end->nivcsw - start->nivcsw;
+    double per_1k = probes > 0 ? 1000.0 / probes : 0.0;
+    
+    printf("\nSelf-overhead (%s):\n", role);
+    printf("  Probes: %lu in %.2f s\n", (unsigned long)probes, wall_sec);
+    printf("  CPU per 1k probes: user %.3f ms, sys %.3f ms, total %.3f ms\n",
+           user_ms * per_1k, sys_ms * per_1k, (user_ms + sys_ms) * per_1k);
+    if (wall_sec > 0) {
+        printf("  CPU utilisation: %.3f%% of one core\n", (user_ms + sys_ms) / (wall_sec * 10.0));
+    }
+    printf("  Context switches: %ld voluntary, %ld involuntary (%.1f / %.1f per 1k probes)\n",
+           nvcsw, nivcsw, nvcsw * per_1k, nivcsw * per_1k);
+    if (start->have_schedstat && end->have_schedstat) {
+        double wait_ms = (end->run_delay_ns - start->run_delay_ns) / 1000000.0;
+        printf("  Run-queue wait: %.3f ms total (%.2f us per probe)\n",
+               wait_ms, probes > 0 ? wait_ms * 1000.0 / probes : 0.0);
+    } else {
+        printf("  Run-queue wait: not available\n");
+    }
+    
+    if (budget > 0 && probes > 0 && (user_ms + sys_ms) * per_1k > budget) {
+        printf("FAIL: self-overhead %.3f ms CPU per 1k probes exceeds budget of %.3f ms\n",
+               (user_ms + sys_ms) * per_1k, budget);
+        return -1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Open a per-thread group of hardware counters (cycles leads the group)
+ * Falls back to user-space-only counting when perf_event_paranoid forbids
+ * kernel counting. Returns 0 on success, -1 if counters are unavailable.
+ */
+int perf_counters_open(perf_counters_t* pc) {
+    memset(pc, 0, sizeof(perf_counters_t));
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        pc->fds[i] = -1;
+    }
+    
+#ifdef __linux__
+    static const uint64_t configs[PERF_NUM_COUNTERS] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,
+        PERF_COUNT_HW_BRANCH_MISSES
+    };
+    
+    for (int attempt = 0; attempt < 2; attempt++) {
+        pc->user_only = attempt;
+        
+        for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+            struct perf_event_attr attr;
+            memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = (i == 0);  // Leader starts the whole group
+            attr.exclude_kernel = pc->user_only;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                               PERF_FORMAT_TOTAL_TIME_RUNNING;
+            
+            // pid 0, cpu -1: this thread on any CPU
+            int fd = syscall(__NR_perf_event_open, &attr, 0, -1,
+                             i == 0 ? -1 : pc->fds[0], 0);
+            if (fd < 0) {
+                if (i == 0) {
+                    pc->open_errno = errno;
+                    break;
+                }
+                continue;  // Missing member events are reported as n/a
+            }
+            pc->fds[i] = fd;
+            pc->slot[pc->nr_open++] = i;
+        }
+        
+        if (pc->fds[0] >= 0 || (pc->open_errno != EACCES && pc->open_errno != EPERM)) {
+            break;
+        }
+    }
+    
+    if (pc->fds[0] >= 0) {
+        return 0;
+    }
+#else
+    pc->open_errno = ENOSYS;
+#endif
+    
+    return -1;
+}
+
+/**
+ * Reset and enable the counter group for the calling thread
+ */
+void perf_counters_start(perf_counters_t* pc) {
+#ifdef __linux__
+    if (pc->fds[0] >= 0) {
+        ioctl(pc->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(pc->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+}
+
+/**
+ * Disable the group and read all members with a single read()
+ * Values are scaled up if the kernel had to multiplex the PMU
+ */
+void perf_counters_stop(perf_counters_t* pc) {
+#ifdef __linux__
+    if (pc->fds[0] < 0) {
+        return;
+    }
+    
+    ioctl(pc->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    
+    // { nr, time_enabled, time_running, value[nr] }
+    uint64_t buf[3 + PERF_NUM_COUNTERS];
+    if (read(pc->fds[0], buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t))) {
+        return;
+    }
+    
+    double scale = 1.0;
+    if (buf[2] > 0 && buf[2] < buf[1]) {
+        scale = (double)buf[1] / buf[2];
+        pc->multiplexed = 1;
+    }
+    
+    for (uint64_t i = 0; i < buf[0] && i < (uint64_t)pc->nr_open; i++) {
+        pc->values[pc->slot[i]] = (uint64_t)(buf[3 + i] * scale);
+    }
+#endif
+}
+
+/**
+ * Print per-packet hardware counter figures for one thread
+ */
+void perf_counters_report(const char* role, perf_counters_t* pc, uint64_t packets) {
+    static const char* names[PERF_NUM_COUNTERS] = {
+        "Cycles", "Instructions", "Cache misses", "Branch misses"
+    };
+    
+    printf("\nHardware counters (%s, per packet):\n", role);
+    if (pc->fds[0] < 0) {
+        printf("  Not available: %s", strerror(pc->open_errno));
+        if (pc->open_errno == EACCES || pc->open_errno == EPERM) {
+            printf(" (check /proc/sys/kernel/perf_event_paranoid)");
+        } else if (pc->open_errno == ENOENT || pc->open_errno == EOPNOTSUPP) {
+            printf(" (no hardware PMU exposed, e.g. inside a VM)");
+        }
+        printf("\n");
+        return;
+    }
+    if (packets == 0) {
+        printf("  No packets processed\n");
+        return;
+    }
+    
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (pc->fds[i] < 0) {
+            printf("  %-14s n/a\n", names[i]);
+        } else {
+            printf("  %-14s %.1f\n", names[i], (double)pc->values[i] / packets);
+        }
+    }
+    if (pc->fds[1] >= 0 && pc->values[0] > 0) {
+        printf("  %-14s %.2f\n", "IPC", (double)pc->values[1] / pc->values[0]);
+    }
+    if (pc->user_only) {
+        printf("  (user-space only: kernel counting not permitted by perf_event_paranoid)\n");
+    }
+    if (pc->multiplexed) {
+        printf("  (counts scaled: PMU was multiplexed)\n");
+    }
+}
+
+/**
+ * Release the counter group
+ */
+void perf_counters_close(perf_counters_t* pc) {
+    for (int i = 0; i < PERF_NUM_COUNTERS; i++) {
+        if (pc->fds[i] >= 0) {
+            close(pc->fds[i]);
+            pc->fds[i] = -1;
+        }
+    }
+}
+
+#ifdef __linux__
+/**
+ * Re-read a /proc or sysfs file from offset 0 into a reused buffer,
+ * growing the buffer if the file does not fit
+ */
+ssize_t proc_reread(int fd, char** buf, size_t* buf_size) {
+    for (;;) {
+        ssize_t n = pread(fd, *buf, *buf_size - 1, 0);
+        if (n < 0) {
+            return -1;
+        }
+        if ((size_t)n < *buf_size - 1) {
+            (*buf)[n] = '\0';
+            return n;
+        }
+        
+        char* bigger = (char*)realloc(*buf, *buf_size * 2);
+        if (bigger == NULL) {
+            (*buf)[n] = '\0';
+            return n;
+        }
+        *buf = bigger;
+        *buf_size *= 2;
+    }
+}
+
+static ssize_t noise_read_file(noise_sampler_t* ns, int fd) {
+    return proc_reread(fd, &ns->buf, &ns->buf_size);
+}
+
+/**
+ * Sum all numeric columns following "label:" on one line
+ * Returns a pointer to the first non-numeric token (or end of line)
+ */
+static char* noise_sum_columns(char* p, uint64_t* total) {
+    *total = 0;
+    for (;;) {
+        while (*p == ' ' || *p == '\t') {
+            p++;
+        }
+        if (*p < '0' || *p > '9') {
+            return p;
+        }
+        *total += strtoull(p, &p, 10);
+    }
+}
+
+/**
+ * Take one host sample: softirqs by type, interrupts (total and busiest
+ * line since the previous sample), CPU time split and CPU frequency
+ */
+static void noise_take_sample(noise_sampler_t* ns, noise_sample_t* sample) {
+    static const char* softirq_names[NOISE_SOFTIRQ_TYPES] = {
+        "HI", "TIMER", "NET_TX", "NET_RX", "BLOCK", "IRQ_POLL", "TASKLET", "SCHED", "HRTIMER", "RCU"
+    };
+    
+    memset(sample, 0, sizeof(noise_sample_t));
+    sample->ts_usec = get_timestamp_usec();
+    
+    // /proc/softirqs: one row per type, one column per CPU
+    if (ns->fd_softirqs >= 0 && noise_read_file(ns, ns->fd_softirqs) > 0) {
+        char* line = strchr(ns->buf, '\n');  // Skip the CPU header
+        while (line != NULL && *++line != '\0') {
+            char* colon = strchr(line, ':');
+            char* eol = strchr(line, '\n');
+            if (colon == NULL || (eol != NULL && colon > eol)) {
+                break;
+            }
+            
+            char* name = line;
+            while (*name == ' ') {
+                name++;
+            }
+            for (int t = 0; t < NOISE_SOFTIRQ_TYPES; t++) {
+                size_t len = strlen(softirq_names[t]);
+                if ((size_t)(colon - name) == len && strncmp(name, softirq_names[t], len) == 0) {
+                    noise_sum_columns(colon + 1, &sample->softirq[t]);
+                    break;
+                }
+            }
+            line = eol;
+        }
+    }
+    
+    // /proc/interrupts: total, plus the line with the largest delta
+    if (ns->fd_interrupts >= 0 && noise_read_file(ns, ns->fd_interrupts) > 0) {
+        uint64_t best_delta = 0;
+        int idx = 0;
+        char* line = strchr(ns->buf, '\n');
+        while (line != NULL && *++line != '\0') {
+            char* eol = strchr(line, '\n');
+            char* colon = strchr(line, ':');
+            if (colon == NULL || (eol != NULL && colon > eol)) {
+                break;
+            }
+            
+            uint64_t count;
+            char* rest = noise_sum_columns(colon + 1, &count);
+            sample->irq_total += count;
+            
+            if (idx < NOISE_MAX_IRQ_LINES) {
+                uint64_t delta = count - ns->irq_prev[idx];
+                if (ns->have_prev && count >= ns->irq_prev[idx] && delta > best_delta) {
+                    best_delta = delta;
+                    sample->top_irq_delta = delta;
+                    
+                    // Label is "<irq>:<device>", e.g. "45:eth0-TxRx-0", or just "LOC"
+                    char* label = line;
+                    while (*label == ' ') {
+                        label++;
+                    }
+                    if (*label < '0' || *label > '9') {
+                        snprintf(sample->top_irq, sizeof(sample->top_irq), "%.*s",
+                                 (int)(colon - label), label);
+                        ns->irq_prev[idx++] = count;
+                        line = eol;
+                        continue;
+                    }
+                    char* end = eol != NULL ? eol : rest + strlen(rest);
+                    while (end > rest && (end[-1] == ' ' || end[-1] == '\r')) {
+                        end--;
+                    }
+                    char* dev = end;
+                    while (dev > rest && dev[-1] != ' ') {
+                        dev--;
+                    }
+                    snprintf(sample->top_irq, sizeof(sample->top_irq), "%.*s:%.*s",
+                             (int)(colon - label), label, (int)(end - dev), dev);
+                }
+                ns->irq_prev[idx++] = count;
+            }
+            line = eol;
+        }
+        ns->have_prev = 1;
+    }
+    
+    // /proc/stat aggregate line: user nice system idle iowait irq softirq steal
+    if (ns->fd_stat >= 0 && noise_read_file(ns, ns->fd_stat) > 0 &&
+        strncmp(ns->buf, "cpu ", 4) == 0) {
+        unsigned long long v[8] = {0};
+        sscanf(ns->buf + 4, "%llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+        for (int i = 0; i < 8; i++) {
+            sample->cpu_total += v[i];
+        }
+        sample->cpu_busy = sample->cpu_total - v[3] - v[4];
+        sample->cpu_irq = v[5] + v[6];
+        sample->cpu_steal = v[7];
+    }
+    
+    // cpufreq: slowest and average current frequency over all CPUs
+    uint64_t freq_sum = 0;
+    int freq_count = 0;
+    for (int i = 0; i < ns->nr_freq; i++) {
+        char small[32];
+        ssize_t n = pread(ns->freq_fds[i], small, sizeof(small) - 1, 0);
+        if (n <= 0) {
+            continue;
+        }
+        small[n] = '\0';
+        uint32_t khz = (uint32_t)strtoul(small, NULL, 10);
+        if (freq_count == 0 || khz < sample->freq_min_khz) {
+            sample->freq_min_khz = khz;
+        }
+        freq_sum += khz;
+        freq_count++;
+    }
+    if (freq_count > 0) {
+        sample->freq_avg_khz = (uint32_t)(freq_sum / freq_count);
+    }
+}
+
+/**
+ * Sampler thread: one sample per interval on an absolute monotonic schedule
+ */
+static void* noise_sampler_thread(void* arg) {
+    noise_sampler_t* ns = (noise_sampler_t*)arg;
+    struct timespec next;
+    
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (ns->active) {
+        noise_take_sample(ns, &ns->ring[ns->count % NOISE_RING_SIZE]);
+        ns->count++;
+        
+        next.tv_nsec += (long)ns->interval_ms * 1000000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    
+    return NULL;
+}
+#endif
+
+/**
+ * Start the host noise sampler thread
+ * Returns 0 on success, -1 if sampling is not supported on this platform
+ */
+int noise_sampler_start(noise_sampler_t* ns, int interval_ms) {
+    memset(ns, 0, sizeof(noise_sampler_t));
+    ns->interval_ms = interval_ms > 0 ? interval_ms : 1;
+    
+#ifdef __linux__
+    ns->ring = (noise_sample_t*)calloc(NOISE_RING_SIZE, sizeof(noise_sample_t));
+    ns->buf_size = 16384;
+    ns->buf = (char*)malloc(ns->buf_size);
+    if (ns->ring == NULL || ns->buf == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    ns->fd_softirqs = open("/proc/softirqs", O_RDONLY);
+    ns->fd_interrupts = open("/proc/interrupts", O_RDONLY);
+    ns->fd_stat = open("/proc/stat", O_RDONLY);
+    
+    long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+    ns->freq_fds = (int*)malloc((ncpu > 0 ? ncpu : 1) * sizeof(int));
+    for (long cpu = 0; ns->freq_fds != NULL && cpu < ncpu; cpu++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%ld/cpufreq/scaling_cur_freq", cpu);
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0) {
+            ns->freq_fds[ns->nr_freq++] = fd;
+        }
+    }
+    
+    ns->active = 1;
+    if (pthread_create(&ns->thread, NULL, noise_sampler_thread, ns) != 0) {
+        perror("Failed to start host noise sampler");
+        ns->active = 0;
+        return -1;
+    }
+    return 0;
+#else
+    printf("Warning: host noise sampling is only supported on Linux\n");
+    return -1;
+#endif
+}
+
+/**
+ * Stop the sampler thread; the ring stays readable until noise_sampler_free
+ */
+void noise_sampler_stop(noise_sampler_t* ns) {
+#ifdef __linux__
+    if (ns->active) {
+        ns->active = 0;
+        pthread_join(ns->thread, NULL);
+    }
+#endif
+}
+
+/**
+ * Release sampler resources
+ */
+void noise_sampler_free(noise_sampler_t* ns) {
+#ifdef __linux__
+    if (ns->fd_softirqs >= 0) close(ns->fd_softirqs);
+    if (ns->fd_interrupts >= 0) close(ns->fd_interrupts);
+    if (ns->fd_stat >= 0) close(ns->fd_stat);
+    for (int i = 0; i < ns->nr_freq; i++) {
+        close(ns->freq_fds[i]);
+    }
+    free(ns->freq_fds);
+    free(ns->buf);
+    free(ns->ring);
+#endif
+    memset(ns, 0, sizeof(noise_sampler_t));
+}
+
+/**
+ * Per-second rates for the interval between two consecutive samples
+ */
+typedef struct {
+    double irq_rate;
+    double net_rx_rate;
+    double net_tx_rate;
+    double timer_rate;
+    double busy_pct;
+    double irq_pct;          // hardirq + softirq share of CPU time
+    double steal_pct;
+    double freq_min_mhz;
+} noise_rates_t;
+
+static void noise_interval_rates(const noise_sample_t* a, const noise_sample_t* b, noise_rates_t* r) {
+    double sec = (b->ts_usec - a->ts_usec) / 1000000.0;
+    double jiffies = (double)(b->cpu_total - a->cpu_total);
+    
+    memset(r, 0, sizeof(noise_rates_t));
+    if (sec <= 0) {
+        return;
+    }
+    r->irq_rate = (b->irq_total - a->irq_total) / sec;
+    r->net_rx_rate = (b->softirq[NOISE_SOFTIRQ_NET_RX] - a->softirq[NOISE_SOFTIRQ_NET_RX]) / sec;
+    r->net_tx_rate = (b->softirq[NOISE_SOFTIRQ_NET_TX] - a->softirq[NOISE_SOFTIRQ_NET_TX]) / sec;
+    r->timer_rate = (b->softirq[NOISE_SOFTIRQ_TIMER] - a->softirq[NOISE_SOFTIRQ_TIMER]) / sec;
+    if (jiffies > 0) {
+        r->busy_pct = 100.0 * (b->cpu_busy - a->cpu_busy) / jiffies;
+        r->irq_pct = 100.0 * (b->cpu_irq - a->cpu_irq) / jiffies;
+        r->steal_pct = 100.0 * (b->cpu_steal - a->cpu_steal) / jiffies;
+    }
+    r->freq_min_mhz = b->freq_min_khz / 1000.0;
+}
+
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * Nearest-rank percentile (0-100) of an ascending array
+ */
+double sorted_percentile(const double* sorted, int count, double percentile) {
+    if (count <= 0) {
+        return 0.0;
+    }
+    int rank = (int)ceil(percentile / 100.0 * count);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+static void noise_print_rates(const char* label, const noise_rates_t* r) {
+    printf("  %-9s IRQ/s %9.0f  NET_RX/s %8.0f  NET_TX/s %8.0f  TIMER/s %7.0f  "
+           "busy %5.1f%%  irq+si %4.1f%%  steal %4.1f%%",
+           label, r->irq_rate, r->net_rx_rate, r->net_tx_rate, r->timer_rate,
+           r->busy_pct, r->irq_pct, r->steal_pct);
+    if (r->freq_min_mhz > 0) {
+        printf("  min %.0f MHz", r->freq_min_mhz);
+    }
+    printf("\n");
+}
+
+/**
+ * Report host noise over the run and, for a client, line the worst RTT
+ * spikes up with the host sample interval they were sent in.
+ * send_times/rtts may be NULL (reflector side: summary only).
+ */
+void host_noise_report(noise_sampler_t* ns, uint64_t* send_times, double* rtts, int count) {
+    if (ns->ring == NULL || ns->count < 2) {
+        return;
+    }
+    
+    uint64_t first = ns->count > NOISE_RING_SIZE ? ns->count - NOISE_RING_SIZE : 0;
+    int intervals = (int)(ns->count - first - 1);
+    noise_rates_t* rates = (noise_rates_t*)malloc(intervals * sizeof(noise_rates_t));
+    double* column = (double*)malloc(intervals * sizeof(double));
+    if (rates == NULL || column == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    int peak = 0;
+    for (int i = 0; i < intervals; i++) {
+        noise_interval_rates(&ns->ring[(first + i) % NOISE_RING_SIZE],
+                             &ns->ring[(first + i + 1) % NOISE_RING_SIZE], &rates[i]);
+        if (rates[i].irq_rate + rates[i].net_rx_rate > rates[peak].irq_rate + rates[peak].net_rx_rate) {
+            peak = i;
+        }
+    }
+    
+    // Baseline is the per-field median over all intervals
+    noise_rates_t median;
+    double* fields[] = { &median.irq_rate, &median.net_rx_rate, &median.net_tx_rate, &median.timer_rate,
+                         &median.busy_pct, &median.irq_pct, &median.steal_pct, &median.freq_min_mhz };
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        size_t offset = (char*)fields[f] - (char*)&median;
+        for (int i = 0; i < intervals; i++) {
+            column[i] = *(double*)((char*)&rates[i] + offset);
+        }
+        qsort(column, intervals, sizeof(double), compare_doubles);
+        *fields[f] = column[intervals / 2];
+    }
+    
+    printf("\nHost noise (%lu samples every %d ms):\n", (unsigned long)(ns->count - first), ns->interval_ms);
+    noise_print_rates("Median", &median);
+    noise_print_rates("Peak", &rates[peak]);
+    const noise_sample_t* peak_sample = &ns->ring[(first + peak + 1) % NOISE_RING_SIZE];
+    if (peak_sample->top_irq[0] != '\0') {
+        printf("  Busiest IRQ in peak interval: %s (%lu)\n",
+               peak_sample->top_irq, (unsigned long)peak_sample->top_irq_delta);
+    }
+    
+    if (send_times != NULL && rtts != NULL && count > 0) {
+        // A spike is an RTT above 3x the median RTT
+        double* sorted = (double*)malloc(count * sizeof(double));
+        int* spikes = (int*)malloc(count * sizeof(int));
+        if (sorted == NULL || spikes == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(sorted, rtts, count * sizeof(double));
+        qsort(sorted, count, sizeof(double), compare_doubles);
+        double threshold = 3.0 * sorted[count / 2];
+        
+        int nr_spikes = 0;
+        for (int i = 0; i < count; i++) {
+            if (rtts[i] > threshold) {
+                spikes[nr_spikes++] = i;
+            }
+        }
+        
+        // Worst spikes first (selection of the top NOISE_MAX_SPIKES)
+        int shown = nr_spikes < NOISE_MAX_SPIKES ? nr_spikes : NOISE_MAX_SPIKES;
+        for (int i = 0; i < shown; i++) {
+            for (int j = i + 1; j < nr_spikes; j++) {
+                if (rtts[spikes[j]] > rtts[spikes[i]]) {
+                    int tmp = spikes[i];
+                    spikes[i] = spikes[j];
+                    spikes[j] = tmp;
+                }
+            }
+        }
+        
+        printf("\nLatency spikes (RTT > %.3f ms): %d of %d packets", threshold / 1000, nr_spikes, count);
+        printf(shown > 0 ? ", worst %d vs host samples:\n" : "\n", shown);
+        for (int i = 0; i < shown; i++) {
+            int p = spikes[i];
+            
+            // Find the first sample at or after the send time (binary search)
+            uint64_t lo = first + 1, hi = ns->count;
+            while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (ns->ring[mid % NOISE_RING_SIZE].ts_usec < send_times[p]) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            
+            char label[32];
+            snprintf(label, sizeof(label), "%.3fms", rtts[p] / 1000);
+            if (lo >= ns->count || send_times[p] < ns->ring[first % NOISE_RING_SIZE].ts_usec) {
+                printf("  %-9s (no host sample covers this packet)\n", label);
+                continue;
+            }
+            noise_rates_t r;
+            const noise_sample_t* s = &ns->ring[lo % NOISE_RING_SIZE];
+            noise_interval_rates(&ns->ring[(lo - 1) % NOISE_RING_SIZE], s, &r);
+            noise_print_rates(label, &r);
+            if (s->top_irq[0] != '\0') {
+                printf("  %-9s busiest IRQ %s (%lu)\n", "", s->top_irq, (unsigned long)s->top_irq_delta);
+            }
+        }
+        
+        free(sorted);
+        free(spikes);
+    }
+    
+    free(rates);
+    free(column);
+}
+
+/**
+ * Enable kernel drop reporting (SO_RXQ_OVFL) on a UDP socket
+ */
+void sock_telemetry_enable(int fd, sock_telemetry_t* t) {
+    memset(t, 0, sizeof(sock_telemetry_t));
+#if defined(__linux__) && defined(SO_RXQ_OVFL)
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) == 0) {
+        t->enabled = 1;
+    }
+#endif
+}
+
+/**
+ * recvfrom() replacement that also picks up the socket's cumulative
+ * receive-queue drop counter from the SO_RXQ_OVFL control message
+ */
+ssize_t recv_with_telemetry(int fd, void* buf, size_t len, struct sockaddr_storage* from,
+                            socklen_t* fromlen, sock_telemetry_t* t) {
+    struct iovec iov;
+    struct msghdr msg;
+    union {
+        char buf[CMSG_SPACE(sizeof(uint32_t))];
+        struct cmsghdr align;
+    } control;
+    
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = from;
+    msg.msg_namelen = fromlen != NULL ? *fromlen : 0;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    
+    ssize_t n = recvmsg(fd, &msg, 0);
+    if (n < 0) {
+        return n;
+    }
+    if (fromlen != NULL) {
+        *fromlen = msg.msg_namelen;
+    }
+    
+#if defined(__linux__) && defined(SO_RXQ_OVFL)
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_RXQ_OVFL) {
+            memcpy(&t->rx_drops, CMSG_DATA(cmsg), sizeof(uint32_t));
+        }
+    }
+#endif
+    
+    return n;
+}
+
+/**
+ * Sample receive and send queue depth (bytes) of a socket
+ */
+void sock_telemetry_sample_queues(int fd, sock_telemetry_t* t) {
+#ifdef __linux__
+    int inq = 0, outq = 0;
+    if (ioctl(fd, SIOCINQ, &inq) < 0 || ioctl(fd, SIOCOUTQ, &outq) < 0) {
+        return;
+    }
+    
+    t->samples++;
+    t->inq_sum += inq;
+    t->outq_sum += outq;
+    if (inq > t->inq_max) t->inq_max = inq;
+    if (outq > t->outq_max) t->outq_max = outq;
+#endif
+}
+
+/**
+ * Print socket drop and queue depth telemetry
+ */
+void sock_telemetry_report(const char* role, sock_telemetry_t* t) {
+    printf("  %s socket: ", role);
+    if (t->enabled) {
+        printf("%lu receive-queue drops", (unsigned long)t->rx_drops);
+    } else {
+        printf("drop counter not available");
+    }
+    if (t->samples > 0) {
+        printf(", rx queue avg %.0f / max %d bytes, tx queue avg %.0f / max %d bytes",
+               (double)t->inq_sum / t->samples, t->inq_max,
+               (double)t->outq_sum / t->samples, t->outq_max);
+    }
+    printf("\n");
+}
+
+/**
+ * Reset spin-receive state; the spin budget starts at its maximum
+ */
+void busy_poll_init(busy_poll_t* b, int enabled) {
+    memset(b, 0, sizeof(busy_poll_t));
+    b->enabled = enabled;
+    b->spin_budget_us = BUSY_SPIN_MAX_USEC;
+}
+
+/**
+ * Request kernel busy polling on a socket and record what the kernel accepted
+ * Raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN
+ */
+void busy_poll_enable(int fd, busy_poll_t* b, int busy_poll_us) {
+    if (!b->enabled || busy_poll_us <= 0) {
+        return;
+    }
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    int value = busy_poll_us;
+    socklen_t len = sizeof(value);
+    setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, sizeof(value));
+    if (getsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &value, &len) == 0) {
+        b->busy_poll_us = value;
+    }
+#ifdef SO_PREFER_BUSY_POLL
+    value = 1;
+    len = sizeof(value);
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, sizeof(value));
+    if (getsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &value, &len) == 0) {
+        b->prefer_busy_poll = value;
+    }
+#endif
+#else
+    (void)fd;
+#endif
+}
+
+/**
+ * Wait until fd is readable by spinning on a non-blocking peek, backing off
+ * to poll() once the spin budget is used up. The budget doubles after a wait
+ * served while spinning and halves after one that had to sleep, so idle
+ * periods stop burning CPU and back-to-back traffic keeps spinning.
+ * Returns 1 when readable (or EOF/error is pending), 0 on timeout, -1 when stopped
+ */
+int busy_poll_wait(int fd, busy_poll_t* b, int timeout_ms) {
+    char peek;
+    b->waits++;
+
+#ifdef MSG_DONTWAIT
+    uint64_t start = get_timestamp_usec();
+    uint64_t now = start;
+    while (running && now - start < (uint64_t)b->spin_budget_us) {
+        ssize_t n = recv(fd, &peek, 1, MSG_PEEK | MSG_DONTWAIT);
+        if (n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            b->spin_hits++;
+            b->spin_budget_us *= 2;
+            if (b->spin_budget_us > BUSY_SPIN_MAX_USEC) {
+                b->spin_budget_us = BUSY_SPIN_MAX_USEC;
+            }
+            return 1;
+        }
+        b->spins++;
+        now = get_timestamp_usec();
+    }
+    b->spin_budget_us /= 2;
+    if (b->spin_budget_us < BUSY_SPIN_MIN_USEC) {
+        b->spin_budget_us = BUSY_SPIN_MIN_USEC;
+    }
+    if (timeout_ms >= 0) {
+        timeout_ms -= (int)((now - start) / 1000);
+        if (timeout_ms < 0) {
+            timeout_ms = 0;
+        }
+    }
+#endif
+
+    if (!running) {
+        return -1;
+    }
+    b->sleeps++;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    int ready = poll(&pfd, 1, timeout_ms);
+    if (ready < 0) {
+        return errno == EINTR && running ? 0 : -1;
+    }
+    return ready > 0 ? 1 : 0;
+}
+
+/**
+ * Print how often receives were served by spinning and what busy polling the kernel granted
+ */
+void busy_poll_report(const char* role, busy_poll_t* b) {
+    if (!b->enabled || b->waits == 0) {
+        return;
+    }
+    printf("Busy-poll (%s): %.1f%% of %lu waits served while spinning, %lu backoffs to sleep, "
+           "%.1f empty polls per wait, spin budget now %d us\n",
+           role, 100.0 * b->spin_hits / b->waits, (unsigned long)b->waits,
+           (unsigned long)b->sleeps, (double)b->spins / b->waits, b->spin_budget_us);
+    if (b->busy_poll_us > 0) {
+        printf("  SO_BUSY_POLL %d us, SO_PREFER_BUSY_POLL %s\n", b->busy_poll_us,
+               b->prefer_busy_poll ? "on" : "off");
+    }
+}
+
+/**
+ * Compare the RTT floor of probes received by spinning against blocking ones
+ */
+void busy_poll_floor_report(const latency_hist_t* spin, const latency_hist_t* block) {
+    printf("\nLatency floor (alternating spinning and blocking probes):\n");
+    if (spin->total == 0 || block->total == 0) {
+        printf("  Not enough replies of each kind to compare\n");
+        return;
+    }
+    printf("  Spinning: min %.2f us, p1 %.2f us, p50 %.2f us (%lu probes)\n",
+           spin->min_ns / 1000.0, hist_percentile(spin, 1) / 1000.0,
+           hist_percentile(spin, 50) / 1000.0, (unsigned long)spin->total);
+    printf("  Blocking: min %.2f us, p1 %.2f us, p50 %.2f us (%lu probes)\n",
+           block->min_ns / 1000.0, hist_percentile(block, 1) / 1000.0,
+           hist_percentile(block, 50) / 1000.0, (unsigned long)block->total);
+    printf("  Spinning vs blocking: p1 %+.2f us, p50 %+.2f us\n",
+           ((double)hist_percentile(spin, 1) - (double)hist_percentile(block, 1)) / 1000.0,
+           ((double)hist_percentile(spin, 50) - (double)hist_percentile(block, 50)) / 1000.0);
+}
+
+/**
+ * Parse a kernel CPU list such as "2-3,6" into cpus, returns the number of entries
+ */
+int parse_cpu_list(const char* text, int* cpus, int max_cpus) {
+    int count = 0;
+    const char* p = text;
+    while (*p != '\0' && *p != '\n' && count < max_cpus) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long c = first; c <= last && count < max_cpus; c++) {
+            cpus[count++] = (int)c;
+        }
+        p = (*end == ',') ? end + 1 : end;
+    }
+    return count;
+}
+
+/**
+ * Read the first line of a small sysfs/procfs file, returns 0 on success
+ */
+int read_sys_line(const char* path, char* buffer, size_t size) {
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    char* line = fgets(buffer, size, f);
+    fclose(f);
+    if (line == NULL) {
+        return -1;
+    }
+    buffer[strcspn(buffer, "\n")] = '\0';
+    return 0;
+}
+
+/**
+ * Touch every page of a buffer so no page fault lands in the measurement loop
+ */
+void rt_prefault(void* buffer, size_t length) {
+    long page = sysconf(_SC_PAGESIZE);
+    if (page <= 0) {
+        page = 4096;
+    }
+    for (size_t off = 0; off < length; off += page) {
+        ((volatile char*)buffer)[off] = ((volatile char*)buffer)[off];
+    }
+}
+
+/**
+ * Fault in the top of this thread's stack
+ */
+static void rt_prefault_stack(void) {
+    volatile char stack[RT_STACK_PREFAULT];
+    for (size_t off = 0; off < sizeof(stack); off += 4096) {
+        stack[off] = 0;
+    }
+}
+
+/**
+ * Process-wide part of the real-time profile: lock memory, keep THP from stalling
+ * Returns the number of settings the host did not honour
+ */
+int rt_profile_apply_process(void) {
+    int warnings = 0;
+    char value[256];
+
+    printf("Real-time profile (process):\n");
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+        printf("  mlockall: ok (current and future mappings locked)\n");
+    } else {
+        printf("  WARNING: mlockall failed: %s (needs CAP_IPC_LOCK or a larger RLIMIT_MEMLOCK)\n",
+               strerror(errno));
+        warnings++;
+    }
+
+#ifdef __linux__
+    if (prctl(PR_SET_THP_DISABLE, 1, 0, 0, 0) == 0 && prctl(PR_GET_THP_DISABLE, 0, 0, 0, 0) == 1) {
+        printf("  Transparent hugepages: disabled for this process");
+    } else {
+        printf("  WARNING: PR_SET_THP_DISABLE not honoured: %s", strerror(errno));
+        warnings++;
+    }
+    if (read_sys_line("/sys/kernel/mm/transparent_hugepage/defrag", value, sizeof(value)) == 0) {
+        // The active choice is the bracketed one, e.g. "always defer [madvise] never"
+        char* selected = strchr(value, '[');
+        if (selected != NULL) {
+            selected++;
+            selected[strcspn(selected, "]")] = '\0';
+        }
+        printf(" (system defrag: %s)", selected != NULL ? selected : value);
+    }
+    printf("\n");
+    if (read_sys_line("/proc/sys/kernel/sched_rt_runtime_us", value, sizeof(value)) == 0 &&
+        strcmp(value, "-1") != 0) {
+        printf("  Note: RT throttling active (sched_rt_runtime_us=%s), FIFO threads can still be "
+               "preempted when they saturate a CPU\n", value);
+    }
+#else
+    printf("  WARNING: THP control not supported on this platform\n");
+    warnings++;
+#endif
+
+    return warnings;
+}
+
+/**
+ * Per-thread part of the real-time profile: CPU pinning, SCHED_FIFO, stack pre-fault
+ * Thread index picks the CPU (rt_cpu + index, or the index-th isolated CPU).
+ * Each setting is read back and reported in a single block.
+ * Returns the number of settings the host did not honour
+ */
+int rt_profile_apply_thread(config_t* config, int index, const char* role) {
+    char report[1024];
+    int len = 0;
+    int warnings = 0;
+
+    if (!config->rt_profile) {
+        return 0;
+    }
+    len += snprintf(report + len, sizeof(report) - len, "Real-time profile (%s):\n", role);
+
+#ifdef __linux__
+    if (config->numa_policy != NUMA_POLICY_NONE) {
+        len += snprintf(report + len, sizeof(report) - len, "  CPU pinning left to NUMA placement (-M)\n");
+    } else {
+        int isolated[RT_MAX_CPUS];
+        int num_isolated = 0;
+        char value[256];
+        if (read_sys_line("/sys/devices/system/cpu/isolated", value, sizeof(value)) == 0) {
+            num_isolated = parse_cpu_list(value, isolated, RT_MAX_CPUS);
+        }
+
+        int cpu = -1;
+        if (config->rt_cpu >= 0) {
+            cpu = config->rt_cpu + index;
+        } else if (index < num_isolated) {
+            cpu = isolated[index];
+        }
+
+        if (cpu < 0) {
+            len += snprintf(report + len, sizeof(report) - len,
+                            "  WARNING: no isolated CPU available (isolcpus=), thread not pinned\n");
+            warnings++;
+        } else if (cpu >= RT_MAX_CPUS) {
+            len += snprintf(report + len, sizeof(report) - len, "  WARNING: CPU %d out of range\n", cpu);
+            warnings++;
+        } else {
+            uint64_t mask[RT_MAX_CPUS / 64];
+            memset(mask, 0, sizeof(mask));
+            mask[cpu / 64] = 1ULL << (cpu % 64);
+            int ok = syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0;
+            int err = errno;
+            memset(mask, 0, sizeof(mask));
+            if (ok && syscall(SYS_sched_getaffinity, 0, sizeof(mask), mask) > 0 &&
+                (mask[cpu / 64] & (1ULL << (cpu % 64)))) {
+                int is_isolated = 0;
+                for (int i = 0; i < num_isolated; i++) {
+                    is_isolated |= isolated[i] == cpu;
+                }
+                len += snprintf(report + len, sizeof(report) - len, "  Pinned to CPU %d%s\n", cpu,
+                                is_isolated ? " (isolated)" : "");
+                if (!is_isolated) {
+                    len += snprintf(report + len, sizeof(report) - len,
+                                    "  WARNING: CPU %d is not isolated, other tasks may run on it\n", cpu);
+                    warnings++;
+                }
+            } else {
+                len += snprintf(report + len, sizeof(report) - len,
+                                "  WARNING: cannot pin to CPU %d: %s\n", cpu, strerror(ok ? EINVAL : err));
+                warnings++;
+            }
+        }
+    }
+#else
+    len += snprintf(report + len, sizeof(report) - len,
+                    "  WARNING: CPU pinning not supported on this platform\n");
+    warnings++;
+#endif
+
+    struct sched_param param;
+    int policy;
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = config->rt_priority;
+    int rc = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (rc == 0 && pthread_getschedparam(pthread_self(), &policy, &param) == 0 &&
+        policy == SCHED_FIFO && param.sched_priority == config->rt_priority) {
+        len += snprintf(report + len, sizeof(report) - len, "  SCHED_FIFO priority %d\n",
+                        param.sched_priority);
+    } else {
+        len += snprintf(report + len, sizeof(report) - len,
+                        "  WARNING: SCHED_FIFO priority %d not granted: %s (needs CAP_SYS_NICE or RLIMIT_RTPRIO)\n",
+                        config->rt_priority, strerror(rc != 0 ? rc : EPERM));
+        warnings++;
+    }
+
+    rt_prefault_stack();
+    len += snprintf(report + len, sizeof(report) - len, "  Stack pre-faulted: %d KB\n",
+                    RT_STACK_PREFAULT / 1024);
+
+    fputs(report, stdout);
+    fflush(stdout);
+    return warnings;
+}
+
+/**
+ * NUMA node the calling thread is running on (and its CPU), -1 if unknown
+ */
+int numa_current_node(int* cpu) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned int c = 0, node = 0;
+    if (syscall(SYS_getcpu, &c, &node, NULL) == 0) {
+        if (cpu != NULL) {
+            *cpu = (int)c;
+        }
+        return (int)node;
+    }
+#endif
+    if (cpu != NULL) {
+        *cpu = 0;
+    }
+    return -1;
+}
+
+#ifdef __linux__
+/**
+ * NUMA node of a network interface's device, -1 for virtual interfaces or no affinity
+ */
+static int numa_nic_node(const char* ifname) {
+    char path[320], value[32];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/device/numa_node", ifname);
+    if (read_sys_line(path, value, sizeof(value)) < 0) {
+        return -1;
+    }
+    return atoi(value);
+}
+
+/**
+ * Name of the interface that owns the given local address
+ */
+static int numa_interface_for_addr(const struct sockaddr* local, char* ifname, size_t len) {
+    struct ifaddrs* list;
+    int found = -1;
+    if (getifaddrs(&list) < 0) {
+        return -1;
+    }
+    for (struct ifaddrs* ifa = list; ifa != NULL && found < 0; ifa = ifa->ifa_next) {
+        if (ifa->ifa_addr == NULL || ifa->ifa_addr->sa_family != local->sa_family) {
+            continue;
+        }
+        int match = 0;
+        if (local->sa_family == AF_INET) {
+            match = ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr.s_addr ==
+                    ((const struct sockaddr_in*)local)->sin_addr.s_addr;
+        } else if (local->sa_family == AF_INET6) {
+            match = memcmp(&((struct sockaddr_in6*)ifa->ifa_addr)->sin6_addr,
+                           &((const struct sockaddr_in6*)local)->sin6_addr, sizeof(struct in6_addr)) == 0;
+        }
+        if (match) {
+            snprintf(ifname, len, "%s", ifa->ifa_name);
+            found = 0;
+        }
+    }
+    freeifaddrs(list);
+    return found;
+}
+
+/**
+ * Pick the NIC for placement: the one routing to the server (client), or the
+ * first interface backed by a device with a NUMA node (reflector)
+ */
+static int numa_detect_interface(config_t* config, char* ifname, size_t len) {
+    if (config->server_ip[0] != '\0') {
+        struct sockaddr_storage remote, local;
+        socklen_t local_len = sizeof(local);
+        int addr_len = init_socket_address(&remote, config->server_ip, config->port, config->use_ipv6);
+        int fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+        int rc = -1;
+        if (fd >= 0 && addr_len > 0 && connect(fd, (struct sockaddr*)&remote, addr_len) == 0 &&
+            getsockname(fd, (struct sockaddr*)&local, &local_len) == 0) {
+            rc = numa_interface_for_addr((struct sockaddr*)&local, ifname, len);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+        return rc;
+    }
+
+    DIR* dir = opendir("/sys/class/net");
+    struct dirent* entry;
+    int rc = -1;
+    if (dir == NULL) {
+        return -1;
+    }
+    while (rc < 0 && (entry = readdir(dir)) != NULL) {
+        // A name too long for ifname cannot be used with the placement options
+        if (entry->d_name[0] != '.' && numa_nic_node(entry->d_name) >= 0 &&
+            snprintf(ifname, len, "%s", entry->d_name) < (int)len) {
+            rc = 0;
+        }
+    }
+    closedir(dir);
+    return rc;
+}
+#endif
+
+/**
+ * Resolve the node threads are placed on and print the host's NUMA layout
+ * Returns the number of nodes with CPUs (0 if NUMA information is unavailable)
+ */
+int numa_resolve_node(config_t* config) {
+#ifdef __linux__
+    char value[256];
+    int nodes[NUMA_MAX_NODES];
+    int num_nodes = 0;
+    if (read_sys_line("/sys/devices/system/node/has_cpu", value, sizeof(value)) == 0) {
+        num_nodes = parse_cpu_list(value, nodes, NUMA_MAX_NODES);
+    }
+    printf("NUMA: %d node%s with CPUs (%s)\n", num_nodes, num_nodes == 1 ? "" : "s",
+           num_nodes > 0 ? value : "no /sys/devices/system/node");
+
+    if (config->numa_policy == NUMA_POLICY_NODE) {
+        printf("  Placement: node %d (requested)\n", config->numa_node);
+        return num_nodes;
+    }
+
+    if (config->interface[0] == '\0' &&
+        numa_detect_interface(config, config->interface, sizeof(config->interface)) < 0) {
+        printf("  WARNING: could not detect the NIC (use -I), placing on node 0\n");
+        config->numa_node = 0;
+        return num_nodes;
+    }
+    int nic_node = numa_nic_node(config->interface);
+    if (nic_node < 0) {
+        printf("  WARNING: %s reports no NUMA node (virtual device or single-node host), using node 0\n",
+               config->interface);
+        nic_node = 0;
+    } else {
+        printf("  NIC %s is on node %d\n", config->interface, nic_node);
+    }
+    config->numa_node = nic_node;
+    if (config->numa_policy == NUMA_POLICY_SPREAD) {
+        printf("  Placement: workers spread over all nodes, starting with the NIC's\n");
+    }
+    return num_nodes;
+#else
+    (void)config;
+    printf("NUMA: placement not supported on this platform\n");
+    return 0;
+#endif
+}
+
+/**
+ * Bind the calling thread to a node's CPUs, prefer that node for its memory,
+ * then allocate (first-touch) its packet buffer there and verify where it landed
+ */
+packet_t* numa_place_thread(int node, const char* role, int packet_size) {
+    char report[512];
+    int len = 0;
+
+    len += snprintf(report + len, sizeof(report) - len, "NUMA placement (%s): ", role);
+#ifdef __linux__
+    char path[96], cpulist[256];
+    int cpus[RT_MAX_CPUS];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    int num_cpus = read_sys_line(path, cpulist, sizeof(cpulist)) == 0 ?
+                   parse_cpu_list(cpulist, cpus, RT_MAX_CPUS) : 0;
+    if (num_cpus == 0) {
+        len += snprintf(report + len, sizeof(report) - len, "WARNING: node %d has no CPUs, not placed", node);
+    } else {
+        uint64_t mask[RT_MAX_CPUS / 64];
+        memset(mask, 0, sizeof(mask));
+        for (int i = 0; i < num_cpus; i++) {
+            mask[cpus[i] / 64] |= 1ULL << (cpus[i] % 64);
+        }
+        if (syscall(SYS_sched_setaffinity, 0, sizeof(mask), mask) == 0) {
+            len += snprintf(report + len, sizeof(report) - len, "node %d, CPUs %s", node, cpulist);
+        } else {
+            len += snprintf(report + len, sizeof(report) - len, "WARNING: cannot bind to node %d CPUs: %s",
+                            node, strerror(errno));
+        }
+
+        uint64_t nodemask[NUMA_MAX_NODES / 64];
+        memset(nodemask, 0, sizeof(nodemask));
+        nodemask[node / 64] = 1ULL << (node % 64);
+        if (syscall(SYS_set_mempolicy, NUMA_MPOL_PREFERRED, nodemask, NUMA_MAX_NODES + 1) < 0) {
+            len += snprintf(report + len, sizeof(report) - len, ", memory policy not set: %s",
+                            strerror(errno));
+        }
+    }
+#else
+    len += snprintf(report + len, sizeof(report) - len, "not supported on this platform");
+#endif
+
+    packet_t* packet = create_packet(packet_size);
+
+#ifdef __linux__
+    int page_node = -1;
+    if (syscall(SYS_get_mempolicy, &page_node, NULL, 0, packet, NUMA_MPOL_F_NODE | NUMA_MPOL_F_ADDR) == 0) {
+        len += snprintf(report + len, sizeof(report) - len, ", packet buffer on node %d%s", page_node,
+                        page_node != node ? " (WARNING: not local)" : "");
+    }
+#endif
+    printf("%s\n", report);
+    fflush(stdout);
+    return packet;
+}
+
+/**
+ * Choose each reflector worker's node from the placement policy (-1 = not placed)
+ */
+void numa_assign_workers(config_t* config, reflector_worker_t* workers, int nworkers) {
+    for (int w = 0; w < nworkers; w++) {
+        workers[w].node = -1;
+    }
+    if (config->numa_policy == NUMA_POLICY_NONE) {
+        return;
+    }
+
+    int num_nodes = numa_resolve_node(config);
+    int nodes[NUMA_MAX_NODES];
+    int first = 0;
+#ifdef __linux__
+    char value[256];
+    if (read_sys_line("/sys/devices/system/node/has_cpu", value, sizeof(value)) == 0) {
+        num_nodes = parse_cpu_list(value, nodes, NUMA_MAX_NODES);
+    }
+#endif
+    for (int i = 0; i < num_nodes; i++) {
+        if (nodes[i] == config->numa_node) {
+            first = i;
+        }
+    }
+    for (int w = 0; w < nworkers; w++) {
+        if (config->numa_policy == NUMA_POLICY_SPREAD && num_nodes > 0) {
+            workers[w].node = nodes[(first + w) % num_nodes];
+        } else {
+            workers[w].node = config->numa_node;
+        }
+    }
+}
+
+/**
+ * Print RTT per reflector NUMA node, from the node each reply was stamped with
+ */
+void numa_latency_report(latency_hist_t** node_rtt) {
+    int cpu;
+    int client_node = numa_current_node(&cpu);
+    printf("\nLatency by reflector NUMA node (prober on node %d, CPU %d):\n", client_node, cpu);
+    for (int n = 0; n < NUMA_MAX_NODES; n++) {
+        latency_hist_t* h = node_rtt[n];
+        if (h == NULL || h->total == 0) {
+            continue;
+        }
+        printf("  Node %d: %lu replies, min %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n",
+               n, (unsigned long)h->total, h->min_ns / 1000.0, hist_percentile(h, 50) / 1000.0,
+               hist_percentile(h, 99) / 1000.0, h->max_ns / 1000.0);
+    }
+}
+
+/**
+ * Print latency, jitter, loss and throughput summary for a client run
+ */
+void print_summary(config_t* config, const char* proto, double* latencies, double* rtts,
+                   int packets_received, int actual_delay_us) {
+    if (packets_received > 0) {
+        // Initialize statistics
+        double total_latency = 0;
+        double min_latency = latencies[0];
+        double max_latency = latencies[0];
+        double avg_latency = 0;
+        double jitter = 0;
+        double std_dev = 0;
+        
+        double total_rtt = 0;
+        double min_rtt = rtts[0];
+        double max_rtt = rtts[0];
+        double avg_rtt = 0;
+        
+        // Calculate min, max, avg
+        for (int i = 0; i < packets_received; i++) {
+            // Latency stats
+            total_latency += latencies[i];
+            if (latencies[i] < min_latency) min_latency = latencies[i];
+            if (latencies[i] > max_latency) max_latency = latencies[i];
+            
+            // RTT stats
+            total_rtt += rtts[i];
+            if (rtts[i] < min_rtt) min_rtt = rtts[i];
+            if (rtts[i] > max_rtt) max_rtt = rtts[i];
+        }
+        
+        avg_latency = total_latency / packets_received;
+        avg_rtt = total_rtt / packets_received;
+        
+        // Calculate jitter (standard deviation of latencies)
+        for (int i = 0; i < packets_received; i++) {
+            std_dev += pow(latencies[i] - avg_latency, 2);
+        }
+        std_dev = sqrt(std_dev / packets_received);
+        jitter = std_dev;
+        
+        // RTT percentiles (nearest rank over a sorted copy)
+        double* sorted_rtts = (double*)malloc(packets_received * sizeof(double));
+        if (sorted_rtts == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(sorted_rtts, rtts, packets_received * sizeof(double));
+        qsort(sorted_rtts, packets_received, sizeof(double), compare_doubles);
+        
+        // Calculate packet loss
+        double packet_loss = 100.0 * (config->num_packets - packets_received) / config->num_packets;
+        
+        // Calculate throughput (bits per second)
+        double test_duration_sec = 0.0;
+        if (packets_received > 1) {
+            test_duration_sec = (rtts[packets_received-1] - rtts[0]) / 1000000.0 + 
+                                (actual_delay_us / 1000000.0);
+        } else {
+            test_duration_sec = actual_delay_us / 1000000.0;
+        }
+        
+        double throughput_bps = (packets_received * config->packet_size * 8) / test_duration_sec;
+        
+        // Print summary statistics
+        printf("\n--- Latency and Jitter Summary (%s) ---\n", proto);
+        printf("Test configuration:\n");
+        printf("  Protocol: %s over %s\n", proto, config->use_ipv6 ? "IPv6" : "IPv4");
+        printf("  Packet size: %d bytes\n", config->packet_size);
+        printf("  Packets sent: %d\n", config->num_packets);
+        printf("  Packets received: %d\n", packets_received);
+        printf("  Packet loss: %.2f%%\n", packet_loss);
+        printf("\n");
+        printf("One-way Latency:\n");
+        printf("  Minimum: %.3f ms\n", min_latency / 1000);
+        printf("  Maximum: %.3f ms\n", max_latency / 1000);
+        printf("  Average: %.3f ms\n", avg_latency / 1000);
+        printf("  Jitter (std deviation): %.3f ms\n", jitter / 1000);
+        printf("\n");
+        printf("Round-Trip Time (RTT):\n");
+        printf("  Minimum: %.3f ms\n", min_rtt / 1000);
+        printf("  Maximum: %.3f ms\n", max_rtt / 1000);
+        printf("  Average: %.3f ms\n", avg_rtt / 1000);
+        printf("  Percentiles: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, p99.9 %.3f ms\n",
+               sorted_percentile(sorted_rtts, packets_received, 50) / 1000,
+               sorted_percentile(sorted_rtts, packets_received, 90) / 1000,
+               sorted_percentile(sorted_rtts, packets_received, 99) / 1000,
+               sorted_percentile(sorted_rtts, packets_received, 99.9) / 1000);
+        printf("\n");
+        printf("Throughput:\n");
+        printf("  Average: %.2f Kbps (%.2f Mbps)\n", 
+               throughput_bps / 1000, throughput_bps / 1000000);
+        free(sorted_rtts);
+    } else {
+        printf("No packets were successfully exchanged\n");
+    }
+}
+
+/**
+ * Split UDP loss into drops counted by the kernel on either end and loss in the network
+ */
+void print_loss_breakdown(int packets_sent, int packets_received, int late_replies,
+                          uint32_t reflector_drops, sock_telemetry_t* client_telemetry) {
+    int lost = packets_sent - packets_received;
+    int unexplained = lost - (int)reflector_drops - (int)client_telemetry->rx_drops - late_replies;
+    
+    printf("\nLoss breakdown (UDP):\n");
+    printf("  Lost probes: %d of %d\n", lost, packets_sent);
+    printf("  Reflector socket drops: %lu (SO_RXQ_OVFL, counts all clients of the reflector)\n",
+           (unsigned long)reflector_drops);
+    sock_telemetry_report("Client", client_telemetry);
+    printf("  Late replies (after timeout): %d\n", late_replies);
+    printf("  In-network loss: %d\n", unexplained > 0 ? unexplained : 0);
+}
+
+/**
+ * Thread CPU time in nanoseconds (0 where the clock is not available)
+ */
+uint64_t thread_cpu_ns(void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+#endif
+    return 0;
+}
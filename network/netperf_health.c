@@ -0,0 +1,632 @@
+/**
+ * Held-connection health monitor (-H) and its reflector
+ */
+
+#include "netperf.h"
+
+/**
+ * Parse "conns[,probe=s][,stall=ms][,keepalive=s][,timeout=ms][,duration=s]"
+ */
+int health_parse_spec(const char* text, health_spec_t* spec) {
+    char buffer[128];
+    memset(spec, 0, sizeof(health_spec_t));
+    spec->probe_sec = HEALTH_PROBE_SEC;
+    spec->stall_ms = HEALTH_STALL_MS;
+
+    strncpy(buffer, text, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    char* item = strtok(buffer, ",");
+    spec->conns = item != NULL ? atoi(item) : 0;
+    while ((item = strtok(NULL, ",")) != NULL) {
+        char name[16];
+        int value;
+        if (sscanf(item, "%15[^=]=%d", name, &value) != 2 || value < 0) {
+            fprintf(stderr, "Bad -H setting '%s'\n", item);
+            return -1;
+        }
+        if (strcmp(name, "probe") == 0 && value > 0) {
+            spec->probe_sec = value;
+        } else if (strcmp(name, "stall") == 0 && value > 0) {
+            spec->stall_ms = value;
+        } else if (strcmp(name, "keepalive") == 0) {
+            spec->keepalive_sec = value;
+        } else if (strcmp(name, "timeout") == 0) {
+            spec->user_timeout_ms = value;
+        } else if (strcmp(name, "duration") == 0) {
+            spec->duration_sec = value;
+        } else {
+            fprintf(stderr, "Unknown -H setting '%s' (use probe, stall, keepalive, timeout, duration)\n", name);
+            return -1;
+        }
+    }
+    if (spec->conns < 1) {
+        fprintf(stderr, "-H needs a connection count\n");
+        return -1;
+    }
+    return 0;
+}
+
+#ifdef __linux__
+/**
+ * Raise the open file limit to fit conns sockets; returns the limit in effect
+ */
+static int health_raise_nofile(int conns) {
+    struct rlimit rl;
+    rlim_t want = (rlim_t)conns + 64;
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+        return -1;
+    }
+    if (rl.rlim_cur < want) {
+        struct rlimit raised = { want, rl.rlim_max > want ? rl.rlim_max : want };
+        // Raising the hard limit needs CAP_SYS_RESOURCE; fall back to the hard limit
+        if (setrlimit(RLIMIT_NOFILE, &raised) < 0) {
+            raised.rlim_cur = rl.rlim_max;
+            raised.rlim_max = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &raised);
+        }
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    return rl.rlim_cur > INT32_MAX ? INT32_MAX : (int)rl.rlim_cur;
+}
+
+/**
+ * Apply keepalive and TCP_USER_TIMEOUT from the spec
+ */
+static void health_tune(int fd, const health_spec_t* spec) {
+    int one = 1;
+    if (spec->keepalive_sec > 0) {
+        int idle = spec->keepalive_sec;
+        int intvl = spec->keepalive_sec / HEALTH_KEEPCNT > 0 ? spec->keepalive_sec / HEALTH_KEEPCNT : 1;
+        int cnt = HEALTH_KEEPCNT;
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, sizeof(intvl));
+        setsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &cnt, sizeof(cnt));
+    }
+#ifdef TCP_USER_TIMEOUT
+    if (spec->user_timeout_ms > 0) {
+        unsigned int timeout = spec->user_timeout_ms;
+        setsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout));
+    }
+#endif
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+/**
+ * Print the keepalive settings the kernel actually uses for a connection
+ */
+static void health_print_settings(int fd) {
+    int keepalive = 0, idle = 0, intvl = 0, cnt = 0;
+    unsigned int user_timeout = 0;
+    socklen_t len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &keepalive, &len);
+    len = sizeof(int);
+    getsockopt(fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, &len);
+    len = sizeof(int);
+    getsockopt(fd, IPPROTO_TCP, TCP_KEEPINTVL, &intvl, &len);
+    len = sizeof(int);
+    getsockopt(fd, IPPROTO_TCP, TCP_KEEPCNT, &cnt, &len);
+#ifdef TCP_USER_TIMEOUT
+    len = sizeof(user_timeout);
+    getsockopt(fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &user_timeout, &len);
+#endif
+    if (keepalive) {
+        printf("Read back: SO_KEEPALIVE on, idle %d s, interval %d s, %d probes (dead after ~%d s idle)",
+               idle, intvl, cnt, idle + intvl * cnt);
+    } else {
+        printf("Read back: SO_KEEPALIVE off (an idle half-open connection is only found by a probe)");
+    }
+    if (user_timeout > 0) {
+        printf(", TCP_USER_TIMEOUT %u ms\n", user_timeout);
+    } else {
+        printf(", TCP_USER_TIMEOUT default (retransmissions, ~15 min)\n");
+    }
+}
+
+/**
+ * Kernel memory for all TCP sockets, from /proc/net/sockstat (bytes, -1 if unknown)
+ */
+static long long health_tcp_kernel_mem(void) {
+    char line[256];
+    long long pages = -1;
+    FILE* f = fopen("/proc/net/sockstat", "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char* mem = strstr(line, " mem ");
+        if (strncmp(line, "TCP:", 4) == 0 && mem != NULL) {
+            pages = atoll(mem + 5);
+        }
+    }
+    fclose(f);
+    return pages < 0 ? -1 : pages * sysconf(_SC_PAGESIZE);
+}
+
+/**
+ * Epoll reflector for held connections: one thread, non-blocking sockets and
+ * a small per-fd buffer, listening on one port per HEALTH_CONNS_PER_PORT
+ */
+int run_health_server(config_t* config) {
+    health_spec_t spec;
+    int status = 0;
+    uint64_t probes = 0, accepted = 0, closes[HEALTH_FAIL_CLASSES] = { 0 };
+    if (health_parse_spec(config->health_spec, &spec) < 0) {
+        return -1;
+    }
+    int max_fds = health_raise_nofile(spec.conns);
+    if (max_fds < spec.conns) {
+        printf("Warning: open file limit %d is below %d connections\n", max_fds, spec.conns);
+    }
+    int nports = (spec.conns + HEALTH_CONNS_PER_PORT - 1) / HEALTH_CONNS_PER_PORT;
+    uint8_t* buffers = (uint8_t*)calloc((size_t)max_fds, MIN_PACKET_SIZE);
+    uint16_t* got = (uint16_t*)calloc((size_t)max_fds, sizeof(uint16_t));
+    uint8_t* listener = (uint8_t*)calloc((size_t)max_fds, 1);
+    struct epoll_event* events = (struct epoll_event*)malloc(HEALTH_EVENTS * sizeof(struct epoll_event));
+    int epfd = epoll_create1(0);
+    if (buffers == NULL || got == NULL || listener == NULL || events == NULL || epfd < 0) {
+        perror("Health reflector setup failed");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int p = 0; p < nports; p++) {
+        struct sockaddr_storage address;
+        int opt = 1;
+        int fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+        int addr_size = init_socket_address(&address, NULL, config->port + p, config->use_ipv6);
+        if (fd < 0 || addr_size < 0 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+            bind(fd, (struct sockaddr*)&address, addr_size) < 0 || listen(fd, SOMAXCONN) < 0) {
+            perror("Listen failed");
+            exit(EXIT_FAILURE);
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        struct epoll_event ev = { EPOLLIN, { .fd = fd } };
+        epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+        listener[fd] = 1;
+        register_server_socket(fd);
+    }
+    printf("Health reflector (epoll) on %s ports %d-%d for up to %d connections, open file limit %d\n",
+           config->use_ipv6 ? "IPv6" : "IPv4", config->port, config->port + nports - 1, spec.conns, max_fds);
+    config->ready = 1;
+
+    int held = 0;
+    uint64_t next_report = get_timestamp_usec() + HEALTH_REPORT_SEC * 1000000ULL;
+    while (running) {
+        int n = epoll_wait(epfd, events, HEALTH_EVENTS, 1000);
+        uint64_t now = get_timestamp_usec();
+        for (int e = 0; e < n; e++) {
+            int fd = events[e].data.fd;
+            if (listener[fd]) {
+                int client;
+                while ((client = accept(fd, NULL, NULL)) >= 0) {
+                    if (client >= max_fds) {
+                        close(client);
+                        continue;
+                    }
+                    fcntl(client, F_SETFL, fcntl(client, F_GETFL) | O_NONBLOCK);
+                    health_tune(client, &spec);
+                    struct epoll_event ev = { EPOLLIN | EPOLLRDHUP, { .fd = client } };
+                    epoll_ctl(epfd, EPOLL_CTL_ADD, client, &ev);
+                    got[client] = 0;
+                    held++;
+                    accepted++;
+                }
+                continue;
+            }
+
+            // Read what is there; echo each complete probe with reflector timestamps
+            int error = 0, closed = 0;
+            uint8_t* buf = buffers + (size_t)fd * MIN_PACKET_SIZE;
+            for (;;) {
+                ssize_t r = recv(fd, buf + got[fd], MIN_PACKET_SIZE - got[fd], 0);
+                if (r == 0) {
+                    closed = 1;
+                    break;
+                }
+                if (r < 0) {
+                    error = errno == EAGAIN || errno == EWOULDBLOCK ? 0 : errno;
+                    break;
+                }
+                got[fd] += r;
+                if (got[fd] == MIN_PACKET_SIZE) {
+                    packet_t* packet = (packet_t*)buf;
+                    packet->server_recv = now;
+                    packet->server_send = get_timestamp_usec();
+                    if (packet->packet_size != MIN_PACKET_SIZE ||
+                        send(fd, buf, MIN_PACKET_SIZE, MSG_NOSIGNAL | MSG_DONTWAIT) != MIN_PACKET_SIZE) {
+                        error = errno != 0 ? errno : EPROTO;
+                        break;
+                    }
+                    got[fd] = 0;
+                    probes++;
+                }
+            }
+            if (!closed && !error && (events[e].events & (EPOLLERR | EPOLLHUP))) {
+                socklen_t len = sizeof(error);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+                closed = error == 0;
+            }
+            if (closed || error) {
+                closes[closed ? HEALTH_FAIL_CLOSED : error == ECONNRESET ? HEALTH_FAIL_RESET :
+                       error == ETIMEDOUT ? HEALTH_FAIL_TIMEOUT : HEALTH_FAIL_OTHER]++;
+                epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+                close(fd);
+                held--;
+            }
+        }
+        if (now >= next_report || !running) {
+            printf("[health] holding %d connections, %lu accepted, %lu probes; closed: %lu FIN, %lu reset, "
+                   "%lu timed out, %lu other\n", held, (unsigned long)accepted, (unsigned long)probes,
+                   (unsigned long)closes[HEALTH_FAIL_CLOSED], (unsigned long)closes[HEALTH_FAIL_RESET],
+                   (unsigned long)closes[HEALTH_FAIL_TIMEOUT], (unsigned long)closes[HEALTH_FAIL_OTHER]);
+            fflush(stdout);
+            next_report = now + HEALTH_REPORT_SEC * 1000000ULL;
+        }
+    }
+
+    close(epfd);
+    free(events);
+    free(listener);
+    free(got);
+    free(buffers);
+    return status;
+}
+
+static const char* health_class_names[HEALTH_FAIL_CLASSES] = {
+    "reset while idle", "half-open (RST)", "keepalive timeout", "probe timeout", "closed by peer", "other error"
+};
+
+/**
+ * Start a non-blocking connect for one held connection
+ */
+static int health_connect(health_conn_t* c, int index, int epfd, const health_spec_t* spec,
+                          struct sockaddr_storage* addrs, int* addr_sizes, int nports) {
+    int port = index % nports;
+    c->fd = socket(addrs[port].ss_family, SOCK_STREAM, 0);
+    if (c->fd < 0) {
+        return -1;
+    }
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+    health_tune(c->fd, spec);
+    if (connect(c->fd, (struct sockaddr*)&addrs[port], addr_sizes[port]) < 0 && errno != EINPROGRESS) {
+        close(c->fd);
+        c->fd = -1;
+        return -1;
+    }
+    struct epoll_event ev = { EPOLLOUT | EPOLLIN | EPOLLRDHUP, { .u32 = (uint32_t)index } };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+    c->state = 1;
+    c->got = 0;
+    c->seq = 0;
+    c->stalled = 0;
+    return 0;
+}
+
+/**
+ * Held-connection health monitor: spec.conns TCP connections on one epoll
+ * set, one probe per connection per interval in a fixed staggered order, so
+ * the probe schedule and the stall checks that trail it are O(1) per
+ * connection. Failures are classified from the socket error and whether a
+ * probe was outstanding; time to detect runs from the last sign of life
+ */
+int run_health_monitor(config_t* config) {
+    health_spec_t spec;
+    int status = 0;
+    if (health_parse_spec(config->health_spec, &spec) < 0) {
+        return -1;
+    }
+    int max_fds = health_raise_nofile(spec.conns);
+    if (max_fds < spec.conns + 16) {
+        printf("Warning: open file limit %d caps the monitor at ~%d connections\n", max_fds, max_fds - 16);
+        spec.conns = max_fds - 16 > 0 ? max_fds - 16 : 1;
+    }
+    int nports = (spec.conns + HEALTH_CONNS_PER_PORT - 1) / HEALTH_CONNS_PER_PORT;
+    struct sockaddr_storage addrs[64];
+    int addr_sizes[64];
+    if (nports > 64) {
+        nports = 64;
+    }
+    for (int p = 0; p < nports; p++) {
+        addr_sizes[p] = init_socket_address(&addrs[p], config->server_ip, config->port + p, config->use_ipv6);
+        if (addr_sizes[p] < 0) {
+            return -1;
+        }
+    }
+
+    health_conn_t* conns = (health_conn_t*)calloc(spec.conns, sizeof(health_conn_t));
+    latency_hist_t* hists = (latency_hist_t*)malloc((HEALTH_FAIL_CLASSES + 2) * sizeof(latency_hist_t));
+    struct epoll_event* events = (struct epoll_event*)malloc(HEALTH_EVENTS * sizeof(struct epoll_event));
+    packet_t* probe = create_packet(MIN_PACKET_SIZE);
+    int epfd = epoll_create1(0);
+    if (conns == NULL || hists == NULL || events == NULL || epfd < 0) {
+        perror("Health monitor setup failed");
+        exit(EXIT_FAILURE);
+    }
+    latency_hist_t* ttd = hists;                          // Per failure class
+    latency_hist_t* rtt = &hists[HEALTH_FAIL_CLASSES];
+    latency_hist_t* stall_len = &hists[HEALTH_FAIL_CLASSES + 1];
+    for (int h = 0; h < HEALTH_FAIL_CLASSES + 2; h++) {
+        hist_init(&hists[h]);
+    }
+    FILE* csv = NULL;
+    if (config->output_file[0] != '\0') {
+        csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "time_s,connection,event,detect_ms\n");
+        }
+    }
+    long long kernel_mem_start = health_tcp_kernel_mem();
+
+    printf("Health monitor: %d TCP connections to %s ports %d-%d, a probe each every %d s, stall after %d ms\n",
+           spec.conns, config->server_ip, config->port, config->port + nports - 1, spec.probe_sec, spec.stall_ms);
+    printf("Keepalive: %s, TCP_USER_TIMEOUT: %s, duration: %s\n",
+           spec.keepalive_sec > 0 ? "on" : "off (kernel default)",
+           spec.user_timeout_ms > 0 ? "set" : "kernel default", spec.duration_sec > 0 ? "fixed" : "until Ctrl-C");
+
+    uint64_t fails[HEALTH_FAIL_CLASSES] = { 0 };
+    uint64_t probes = 0, replies = 0, stalls = 0, recovered = 0, connects = 0, reconnects = 0;
+    int opened = 0, connecting = 0, up = 0, stalled_now = 0, settings_shown = 0;
+    uint32_t seq = 0;
+    uint64_t begin = get_timestamp_usec();
+    uint64_t start = 0;          // Probe schedule origin, set once every connection has been tried
+    uint64_t interval_us = (uint64_t)spec.probe_sec * 1000000ULL;
+    uint64_t stall_us = (uint64_t)spec.stall_ms * 1000ULL;
+    double slot_us = (double)interval_us / spec.conns;
+    uint64_t probe_ticks = 0, check_ticks = 0;
+    uint64_t end = spec.duration_sec > 0 ? begin + spec.duration_sec * 1000000ULL : 0;
+    uint64_t next_report = begin + HEALTH_REPORT_SEC * 1000000ULL;
+
+    while (running && (end == 0 || get_timestamp_usec() < end)) {
+        uint64_t now = get_timestamp_usec();
+
+        // Ramp up: keep a bounded number of connects in flight
+        while (opened < spec.conns && connecting < HEALTH_CONNECT_INFLIGHT) {
+            if (health_connect(&conns[opened], opened, epfd, &spec, addrs, addr_sizes, nports) == 0) {
+                connecting++;
+            } else {
+                fails[HEALTH_FAIL_OTHER]++;
+            }
+            opened++;
+        }
+
+        // Probing starts after the ramp-up, so connects queued at the reflector do not read as stalls
+        if (start == 0 && opened == spec.conns && connecting == 0) {
+            start = now;
+            printf("Ramp-up: %d connections up in %.1f s\n", up, (now - begin) / 1e6);
+        }
+
+        // Probes due by now, one slot per connection per interval; closed ones reconnect in their slot
+        while (start > 0 && start + (uint64_t)(probe_ticks * slot_us) <= now) {
+            health_conn_t* c = &conns[probe_ticks % spec.conns];
+            int index = (int)(probe_ticks % spec.conns);
+            probe_ticks++;
+            if (c->state == 2 && c->seq == 0) {
+                if (++seq == 0) {
+                    seq = 1;
+                }
+                probe->seq_num = c->seq = seq;
+                probe->client_send = c->sent_us = now;
+                if (send(c->fd, probe, MIN_PACKET_SIZE, MSG_NOSIGNAL | MSG_DONTWAIT) == MIN_PACKET_SIZE) {
+                    probes++;
+                } else {
+                    c->seq = 0;
+                }
+            } else if (c->state == 0 && index < opened && probe_ticks > (uint64_t)spec.conns) {
+                if (health_connect(c, index, epfd, &spec, addrs, addr_sizes, nports) == 0) {
+                    connecting++;
+                    reconnects++;
+                }
+            }
+        }
+
+        // Stall checks trail the probe schedule by the stall threshold
+        while (check_ticks < probe_ticks && start + (uint64_t)(check_ticks * slot_us) + stall_us <= now) {
+            health_conn_t* c = &conns[check_ticks % spec.conns];
+            if (c->state == 2 && c->seq != 0 && !c->stalled && now - c->sent_us >= stall_us) {
+                c->stalled = 1;
+                stalls++;
+                stalled_now++;
+                if (csv != NULL) {
+                    fprintf(csv, "%.3f,%lu,stall,%.1f\n", (now - begin) / 1e6,
+                            (unsigned long)(check_ticks % spec.conns), (now - c->sent_us) / 1000.0);
+                }
+            }
+            check_ticks++;
+        }
+
+        // Sleep until the next probe or check is due
+        int timeout_ms = 1000;
+        if (start > 0) {
+            uint64_t next = start + (uint64_t)(probe_ticks * slot_us);
+            uint64_t next_check = start + (uint64_t)(check_ticks * slot_us) + stall_us;
+            if (check_ticks < probe_ticks && next_check < next) {
+                next = next_check;
+            }
+            timeout_ms = next > now ? (int)((next - now + 999) / 1000) : 0;
+            timeout_ms = timeout_ms > 1000 ? 1000 : timeout_ms;
+        } else if (opened < spec.conns && connecting < HEALTH_CONNECT_INFLIGHT) {
+            timeout_ms = 0;
+        }
+        int n = epoll_wait(epfd, events, HEALTH_EVENTS, timeout_ms);
+        now = get_timestamp_usec();
+        for (int e = 0; e < n; e++) {
+            int index = (int)events[e].data.u32;
+            health_conn_t* c = &conns[index];
+            int error = 0, closed = 0;
+            if (c->state == 1) {
+                // Connect finished, or failed
+                socklen_t len = sizeof(error);
+                getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+                connecting--;
+                if (error == 0) {
+                    struct epoll_event ev = { EPOLLIN | EPOLLRDHUP, { .u32 = (uint32_t)index } };
+                    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+                    c->state = 2;
+                    c->last_ok_us = now;
+                    up++;
+                    connects++;
+                    if (!settings_shown) {
+                        health_print_settings(c->fd);
+                        settings_shown = 1;
+                    }
+                    continue;
+                }
+                c->last_ok_us = now;
+            } else {
+                for (;;) {
+                    ssize_t r = recv(c->fd, c->reply + c->got, MIN_PACKET_SIZE - c->got, 0);
+                    if (r == 0) {
+                        closed = 1;
+                        break;
+                    }
+                    if (r < 0) {
+                        error = errno == EAGAIN || errno == EWOULDBLOCK ? 0 : errno;
+                        break;
+                    }
+                    c->got += r;
+                    if (c->got == MIN_PACKET_SIZE) {
+                        packet_t* reply = (packet_t*)c->reply;
+                        c->got = 0;
+                        if (c->seq == 0 || reply->seq_num != c->seq) {
+                            continue;
+                        }
+                        hist_record(rtt, (now - c->sent_us) * 1000ULL);
+                        if (c->stalled) {
+                            hist_record(stall_len, (now - c->sent_us) * 1000ULL);
+                            recovered++;
+                            stalled_now--;
+                        }
+                        c->seq = 0;
+                        c->stalled = 0;
+                        c->last_ok_us = now;
+                        replies++;
+                    }
+                }
+                if (!closed && !error && (events[e].events & (EPOLLERR | EPOLLHUP))) {
+                    socklen_t len = sizeof(error);
+                    getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+                    closed = error == 0;
+                }
+                if (!closed && !error) {
+                    continue;
+                }
+            }
+
+            // Classify the failure and record how long it went unnoticed
+            int cls = HEALTH_FAIL_OTHER;
+            if (c->state == 2) {
+                if (closed) {
+                    cls = HEALTH_FAIL_CLOSED;
+                } else if (error == ECONNRESET || error == EPIPE) {
+                    cls = c->seq != 0 ? HEALTH_FAIL_HALF_OPEN : HEALTH_FAIL_RESET;
+                } else if (error == ETIMEDOUT) {
+                    cls = c->seq != 0 ? HEALTH_FAIL_TIMEOUT : HEALTH_FAIL_KEEPALIVE;
+                }
+                up--;
+            }
+            uint64_t detect_us = now - c->last_ok_us;
+            fails[cls]++;
+            hist_record(&ttd[cls], detect_us * 1000ULL);
+            if (c->stalled) {
+                stalled_now--;
+            }
+            if (csv != NULL) {
+                fprintf(csv, "%.3f,%d,%s,%.1f\n", (now - begin) / 1e6, index, health_class_names[cls],
+                        detect_us / 1000.0);
+            }
+            epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+            close(c->fd);
+            c->fd = -1;
+            c->state = 0;
+            c->seq = 0;
+            c->stalled = 0;
+        }
+
+        if (now >= next_report) {
+            uint64_t failed = 0;
+            for (int k = 0; k < HEALTH_FAIL_CLASSES; k++) {
+                failed += fails[k];
+            }
+            printf("[%4.0fs] up %d/%d, %lu probes, rtt p50 %.0f us, stalled now %d, failures %lu, reconnects %lu\n",
+                   (now - begin) / 1e6, up, spec.conns, (unsigned long)probes,
+                   hist_percentile(rtt, 50) / 1000.0, stalled_now, (unsigned long)failed,
+                   (unsigned long)reconnects);
+            fflush(stdout);
+            next_report = now + HEALTH_REPORT_SEC * 1000000ULL;
+        }
+    }
+
+    long long kernel_mem = health_tcp_kernel_mem();
+    printf("\n--- Connection Health (%.0f s) ---\n", (get_timestamp_usec() - begin) / 1e6);
+    printf("  Connections: %d held, %d up at the end, %lu connects, %lu reconnects\n", spec.conns, up,
+           (unsigned long)connects, (unsigned long)reconnects);
+    printf("  Probes: %lu sent, %lu replies", (unsigned long)probes, (unsigned long)replies);
+    if (rtt->total > 0) {
+        printf(", rtt p50 %.0f us, p99 %.0f us, max %.0f us", hist_percentile(rtt, 50) / 1000.0,
+               hist_percentile(rtt, 99) / 1000.0, rtt->max_ns / 1000.0);
+    }
+    printf("\n  Stalls (reply > %d ms): %lu, %lu recovered", spec.stall_ms, (unsigned long)stalls,
+           (unsigned long)recovered);
+    if (stall_len->total > 0) {
+        printf(" after p50 %.0f ms, max %.0f ms", hist_percentile(stall_len, 50) / 1e6, stall_len->max_ns / 1e6);
+    }
+    printf("\n\n  %-20s %8s %14s %14s %14s\n", "failure", "count", "detect p50 ms", "detect p99 ms",
+           "detect max ms");
+    for (int k = 0; k < HEALTH_FAIL_CLASSES; k++) {
+        if (fails[k] == 0) {
+            continue;
+        }
+        status = -1;
+        printf("  %-20s %8lu %14.0f %14.0f %14.0f\n", health_class_names[k], (unsigned long)fails[k],
+               hist_percentile(&ttd[k], 50) / 1e6, hist_percentile(&ttd[k], 99) / 1e6, ttd[k].max_ns / 1e6);
+    }
+    if (status == 0) {
+        printf("  (no failures)\n");
+    }
+    printf("  Time to detect runs from the connection's last reply (or connect) to the failure report\n");
+    if (fails[HEALTH_FAIL_RESET] > 0) {
+        printf("  Resets while idle usually come from a firewall or NAT dropping the idle session; a keepalive\n");
+        printf("  idle time below the middlebox timeout keeps such sessions alive\n");
+    }
+    if (fails[HEALTH_FAIL_TIMEOUT] > 0 && spec.user_timeout_ms == 0) {
+        printf("  Probe timeouts took the kernel's retransmission limit; TCP_USER_TIMEOUT (timeout=ms) bounds it\n");
+    }
+    printf("  Memory: %zu bytes of monitor state per connection (%.1f MB)", sizeof(health_conn_t),
+           spec.conns * sizeof(health_conn_t) / 1048576.0);
+    if (kernel_mem >= 0 && kernel_mem_start >= 0) {
+        printf(", kernel TCP memory %.1f MB (host-wide, %.1f MB at start)", kernel_mem / 1048576.0,
+               kernel_mem_start / 1048576.0);
+    }
+    printf("\n");
+
+    for (int i = 0; i < opened; i++) {
+        if (conns[i].state != 0) {
+            close(conns[i].fd);
+        }
+    }
+    if (csv != NULL) {
+        fclose(csv);
+        printf("\nEvents saved to %s\n", config->output_file);
+    }
+    close(epfd);
+    free(probe);
+    free(events);
+    free(hists);
+    free(conns);
+    return status;
+}
+#else
+int run_health_server(config_t* config) {
+    (void)config;
+    fprintf(stderr, "The connection health monitor (-H) needs Linux epoll\n");
+    return -1;
+}
+
+int run_health_monitor(config_t* config) {
+    (void)config;
+    fprintf(stderr, "The connection health monitor (-H) needs Linux epoll\n");
+    return -1;
+}
+#endif
@@ -0,0 +1,682 @@
+/**
+ * Host metrics collector (-K): CPU, memory, disk I/O and filesystem samples
+ * from /proc, beside a probe run or standalone
+ */
+
+#include "netperf.h"
+
+/**
+ * Parse "seconds[,count=n][,free=pct]"; seconds may be fractional
+ */
+int hostmon_parse_spec(const char* text, hostmon_spec_t* spec) {
+    char buffer[64];
+    spec->interval_ms = 1000;
+    spec->count = 0;
+    spec->free_pct = HOSTMON_FREE_PCT;
+
+    strncpy(buffer, text, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    for (char* item = strtok(buffer, ","); item != NULL; item = strtok(NULL, ",")) {
+        char name[16];
+        double value;
+        if (strchr(item, '=') == NULL) {
+            spec->interval_ms = (int)(atof(item) * 1000);
+            continue;
+        }
+        if (sscanf(item, "%15[^=]=%lf", name, &value) != 2 || value < 0) {
+            fprintf(stderr, "Bad -K setting '%s'\n", item);
+            return -1;
+        }
+        if (strcmp(name, "count") == 0) {
+            spec->count = (int)value;
+        } else if (strcmp(name, "free") == 0 && value <= 100) {
+            spec->free_pct = value;
+        } else {
+            fprintf(stderr, "Unknown -K setting '%s' (use count, free)\n", name);
+            return -1;
+        }
+    }
+    if (spec->interval_ms < 10) {
+        fprintf(stderr, "-K needs an interval of at least 0.01 seconds\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Rates of one disk between two diskstats readings sec seconds apart
+ */
+static void hostmon_io_rates(const hostmon_diskstat_t* a, const hostmon_diskstat_t* b, double sec,
+                             hostmon_io_t* io) {
+    memset(io, 0, sizeof(hostmon_io_t));
+    if (sec <= 0 || b->rd_ios < a->rd_ios || b->wr_ios < a->wr_ios || b->io_ms < a->io_ms) {
+        return;                      // Device was reset or re-added
+    }
+    uint64_t rd = b->rd_ios - a->rd_ios;
+    uint64_t wr = b->wr_ios - a->wr_ios;
+    io->r_s = rd / sec;
+    io->w_s = wr / sec;
+    io->rmb_s = (b->rd_sectors - a->rd_sectors) * 512.0 / 1048576.0 / sec;
+    io->wmb_s = (b->wr_sectors - a->wr_sectors) * 512.0 / 1048576.0 / sec;
+    io->r_await_ms = rd > 0 ? (double)(b->rd_ms - a->rd_ms) / rd : 0;
+    io->w_await_ms = wr > 0 ? (double)(b->wr_ms - a->wr_ms) / wr : 0;
+    io->util_pct = (b->io_ms - a->io_ms) / (sec * 10.0);
+    if (io->util_pct > 100) {
+        io->util_pct = 100;
+    }
+    io->queue = (b->weighted_ms - a->weighted_ms) / (sec * 1000.0);
+}
+
+#ifdef __linux__
+/**
+ * Whole disk to track: listed in /sys/block, and not a loop or ram device.
+ * Checked once per device, when it first shows up in /proc/diskstats.
+ */
+static int hostmon_whole_disk(const char* name) {
+    char path[64];
+    if (strncmp(name, "loop", 4) == 0 || strncmp(name, "ram", 3) == 0) {
+        return 0;
+    }
+    // sysfs spells "cciss/c0d0" as "cciss!c0d0"
+    int len = snprintf(path, sizeof(path), "/sys/block/%s", name);
+    for (int i = (int)strlen("/sys/block/"); i < len && i < (int)sizeof(path); i++) {
+        if (path[i] == '/') {
+            path[i] = '!';
+        }
+    }
+    return access(path, F_OK) == 0;
+}
+
+/**
+ * Read the local filesystems from /proc/mounts once. Only block-device
+ * mounts are kept, so statvfs never touches NFS or pseudo filesystems;
+ * read-only mounts and images (squashfs, iso9660) cannot fill up and are
+ * skipped.
+ */
+static void hostmon_load_mounts(hostmon_t* hm) {
+    FILE* f = fopen("/proc/mounts", "r");
+    char line[1024];
+    if (f == NULL) {
+        return;
+    }
+    while (hm->nr_fs < HOSTMON_MAX_FS && fgets(line, sizeof(line), f) != NULL) {
+        char dev[256], dir[256], type[64], opts[256];
+        if (sscanf(line, "%255s %255s %63s %255s", dev, dir, type, opts) != 4 || dev[0] != '/' ||
+            strncmp(dev, "/dev/loop", 9) == 0 || strcmp(type, "squashfs") == 0 || strcmp(type, "iso9660") == 0 ||
+            strcmp(opts, "ro") == 0 || strncmp(opts, "ro,", 3) == 0) {
+            continue;
+        }
+        
+        // Undo the octal escapes of spaces and tabs ("\040")
+        hostmon_fs_t* fs = &hm->fs[hm->nr_fs];
+        size_t o = 0;
+        for (const char* p = dir; *p != '\0' && o < sizeof(fs->dir) - 1; p++) {
+            if (p[0] == '\\' && p[1] >= '0' && p[1] <= '3' && p[2] >= '0' && p[2] <= '7' &&
+                p[3] >= '0' && p[3] <= '7') {
+                fs->dir[o++] = (char)((p[1] - '0') * 64 + (p[2] - '0') * 8 + (p[3] - '0'));
+                p += 3;
+            } else {
+                fs->dir[o++] = *p;
+            }
+        }
+        fs->dir[o] = '\0';
+        
+        int duplicate = 0;
+        for (int i = 0; i < hm->nr_fs; i++) {
+            if (strcmp(hm->fs[i].dir, fs->dir) == 0) {
+                duplicate = 1;
+                break;
+            }
+        }
+        if (!duplicate) {
+            fs->min_free_pct = 100;
+            hm->nr_fs++;
+        }
+    }
+    fclose(f);
+}
+
+/**
+ * Take one sample: CPU split, interrupts, context switches and run queue
+ * from /proc/stat, memory from /proc/meminfo, the busiest disk from
+ * /proc/diskstats and the fullest local filesystem from statvfs. Rates
+ * are over the interval since the previous call.
+ */
+static void hostmon_take_sample(hostmon_t* hm, hostmon_sample_t* sample) {
+    uint64_t cpu_start = thread_cpu_ns();
+    uint64_t now = get_timestamp_usec();
+    double sec = hm->prev_usec > 0 && now > hm->prev_usec ? (now - hm->prev_usec) / 1000000.0 : 0;
+    
+    memset(sample, 0, sizeof(hostmon_sample_t));
+    sample->ts_usec = now;
+    
+    // /proc/stat: aggregate cpu line (user nice system idle iowait irq softirq steal), then
+    // intr, ctxt, procs_running and procs_blocked lines
+    if (hm->fd_stat >= 0 && proc_reread(hm->fd_stat, &hm->buf, &hm->buf_size) > 0 &&
+        strncmp(hm->buf, "cpu ", 4) == 0) {
+        unsigned long long v[8] = {0};
+        uint64_t d[8], total = 0;
+        sscanf(hm->buf + 4, "%llu %llu %llu %llu %llu %llu %llu %llu",
+               &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]);
+        for (int i = 0; i < 8; i++) {
+            d[i] = v[i] >= hm->cpu_prev[i] ? v[i] - hm->cpu_prev[i] : 0;
+            total += d[i];
+            hm->cpu_prev[i] = v[i];
+        }
+        if (total > 0) {
+            sample->user_pct = 100.0 * (d[0] + d[1]) / total;
+            sample->sys_pct = 100.0 * (d[2] + d[5] + d[6]) / total;
+            sample->idle_pct = 100.0 * d[3] / total;
+            sample->iowait_pct = 100.0 * d[4] / total;
+            sample->steal_pct = 100.0 * d[7] / total;
+        }
+        
+        for (char* line = strchr(hm->buf, '\n'); line != NULL; line = strchr(line, '\n')) {
+            line++;
+            if (strncmp(line, "intr ", 5) == 0) {
+                uint64_t intr = strtoull(line + 5, NULL, 10);
+                if (sec > 0 && intr >= hm->intr_prev) {
+                    sample->intr_rate = (intr - hm->intr_prev) / sec;
+                }
+                hm->intr_prev = intr;
+            } else if (strncmp(line, "ctxt ", 5) == 0) {
+                uint64_t ctxt = strtoull(line + 5, NULL, 10);
+                if (sec > 0 && ctxt >= hm->ctxt_prev) {
+                    sample->cs_rate = (ctxt - hm->ctxt_prev) / sec;
+                }
+                hm->ctxt_prev = ctxt;
+            } else if (strncmp(line, "procs_running ", 14) == 0) {
+                sample->procs_running = strtoul(line + 14, NULL, 10);
+            } else if (strncmp(line, "procs_blocked ", 14) == 0) {
+                sample->procs_blocked = strtoul(line + 14, NULL, 10);
+                break;               // Last line of interest
+            }
+        }
+    }
+    
+    // /proc/meminfo, in kB
+    if (hm->fd_meminfo >= 0 && proc_reread(hm->fd_meminfo, &hm->buf, &hm->buf_size) > 0) {
+        uint64_t swap_total = 0, swap_free = 0;
+        for (char* line = hm->buf; line != NULL; line = strchr(line, '\n')) {
+            if (*line == '\n') {
+                line++;
+            }
+            if (strncmp(line, "MemTotal:", 9) == 0) {
+                sample->mem_total_mb = strtoull(line + 9, NULL, 10) / 1024.0;
+            } else if (strncmp(line, "MemAvailable:", 13) == 0) {
+                sample->mem_avail_mb = strtoull(line + 13, NULL, 10) / 1024.0;
+            } else if (strncmp(line, "Dirty:", 6) == 0) {
+                sample->dirty_mb = strtoull(line + 6, NULL, 10) / 1024.0;
+            } else if (strncmp(line, "SwapTotal:", 10) == 0) {
+                swap_total = strtoull(line + 10, NULL, 10);
+            } else if (strncmp(line, "SwapFree:", 9) == 0) {
+                swap_free = strtoull(line + 9, NULL, 10);
+            }
+        }
+        sample->swap_used_mb = swap_total > swap_free ? (swap_total - swap_free) / 1024.0 : 0;
+    }
+    
+    // /proc/diskstats: major minor name, then reads completed, merged, sectors, ms,
+    // writes completed, merged, sectors, ms, in flight, io ms, weighted ms
+    if (hm->fd_diskstats >= 0 && proc_reread(hm->fd_diskstats, &hm->buf, &hm->buf_size) > 0) {
+        int idx = 0;
+        for (char* line = hm->buf; line != NULL && *line != '\0'; idx++) {
+            char* eol = strchr(line, '\n');
+            char* p = line;
+            char name[32];
+            line = eol != NULL ? eol + 1 : NULL;
+            
+            strtoul(p, &p, 10);
+            strtoul(p, &p, 10);
+            while (*p == ' ') {
+                p++;
+            }
+            size_t len = strcspn(p, " \n");
+            if (len == 0 || len >= sizeof(name)) {
+                continue;
+            }
+            memcpy(name, p, len);
+            name[len] = '\0';
+            p += len;
+            
+            // Lines keep their order, so the disk at the same index is usually the one
+            hostmon_disk_t* disk = NULL;
+            if (idx < hm->nr_disks && strcmp(hm->disks[idx].name, name) == 0) {
+                disk = &hm->disks[idx];
+            } else {
+                for (int i = 0; i < hm->nr_disks; i++) {
+                    if (strcmp(hm->disks[i].name, name) == 0) {
+                        disk = &hm->disks[i];
+                        break;
+                    }
+                }
+            }
+            if (disk == NULL) {
+                if (hm->nr_disks == HOSTMON_MAX_DISKS) {
+                    continue;
+                }
+                disk = &hm->disks[hm->nr_disks++];
+                snprintf(disk->name, sizeof(disk->name), "%s", name);
+                disk->skip = !hostmon_whole_disk(name);
+            }
+            if (disk->skip) {
+                continue;
+            }
+            
+            uint64_t c[11];
+            for (int i = 0; i < 11; i++) {
+                c[i] = strtoull(p, &p, 10);
+            }
+            hostmon_diskstat_t ds = { c[0], c[2], c[3], c[4], c[6], c[7], c[9], c[10] };
+            if (disk->first_usec == 0) {
+                disk->first = ds;
+                disk->first_usec = now;
+            } else {
+                hostmon_io_t io;
+                hostmon_io_rates(&disk->prev, &ds, (now - disk->prev_usec) / 1000000.0, &io);
+                if (io.util_pct > disk->peak_util) {
+                    disk->peak_util = io.util_pct;
+                }
+                if (sample->disk_name[0] == '\0' || io.util_pct > sample->disk.util_pct) {
+                    sample->disk = io;
+                    snprintf(sample->disk_name, sizeof(sample->disk_name), "%s", disk->name);
+                }
+            }
+            disk->prev = ds;
+            disk->prev_usec = now;
+        }
+    }
+    
+    // Local filesystems, df-style: used / (used + available to non-root)
+    sample->fs_free_pct = 100;
+    for (int i = 0; i < hm->nr_fs; i++) {
+        struct statvfs v;
+        if (statvfs(hm->fs[i].dir, &v) != 0 || v.f_blocks == 0) {
+            continue;
+        }
+        double used = (double)(v.f_blocks - v.f_bfree);
+        double avail = (double)v.f_bavail;
+        hostmon_fs_t* fs = &hm->fs[i];
+        fs->free_pct = used + avail > 0 ? 100.0 * avail / (used + avail) : 100;
+        if (fs->free_pct < fs->min_free_pct) {
+            fs->min_free_pct = fs->free_pct;
+        }
+        if (sample->fs_dir[0] == '\0' || fs->free_pct < sample->fs_free_pct) {
+            sample->fs_free_pct = fs->free_pct;
+            snprintf(sample->fs_dir, sizeof(sample->fs_dir), "%s", fs->dir);
+        }
+    }
+    
+    hm->prev_usec = now;
+    hm->cpu_ns += thread_cpu_ns() - cpu_start;
+}
+
+/**
+ * Open the /proc files, read the mount table and take a first reading
+ * that later samples are measured against
+ */
+static int hostmon_open(hostmon_t* hm, const hostmon_spec_t* spec) {
+    hm->interval_ms = spec->interval_ms;
+    hm->free_pct = spec->free_pct;
+    hm->ring = (hostmon_sample_t*)calloc(HOSTMON_RING_SIZE, sizeof(hostmon_sample_t));
+    hm->buf_size = 16384;
+    hm->buf = (char*)malloc(hm->buf_size);
+    if (hm->ring == NULL || hm->buf == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    hm->fd_stat = open("/proc/stat", O_RDONLY);
+    hm->fd_meminfo = open("/proc/meminfo", O_RDONLY);
+    hm->fd_diskstats = open("/proc/diskstats", O_RDONLY);
+    if (hm->fd_stat < 0 && hm->fd_meminfo < 0 && hm->fd_diskstats < 0) {
+        perror("Failed to open /proc for host metrics");
+        return -1;
+    }
+    hostmon_load_mounts(hm);
+    
+    hostmon_sample_t baseline;
+    hostmon_take_sample(hm, &baseline);
+    hm->cpu_ns = 0;                  // Cost is reported for steady-state samples only
+    return 0;
+}
+
+/**
+ * Collector thread: one sample per interval on an absolute monotonic schedule
+ */
+static void* hostmon_thread(void* arg) {
+    hostmon_t* hm = (hostmon_t*)arg;
+    struct timespec next;
+    
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (hm->active) {
+        next.tv_nsec += (long)hm->interval_ms * 1000000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        if (!hm->active) {
+            break;
+        }
+        hostmon_take_sample(hm, &hm->ring[hm->count % HOSTMON_RING_SIZE]);
+        hm->count++;
+    }
+    
+    return NULL;
+}
+#endif
+
+/**
+ * Start the host metrics collector thread for a -K spec
+ * Returns 0 on success, -1 on a bad spec or if collection is not supported
+ */
+int hostmon_start(hostmon_t* hm, const char* spec_text) {
+    hostmon_spec_t spec;
+    
+    memset(hm, 0, sizeof(hostmon_t));
+    hm->fd_stat = hm->fd_meminfo = hm->fd_diskstats = -1;
+    if (hostmon_parse_spec(spec_text, &spec) < 0) {
+        return -1;
+    }
+    
+#ifdef __linux__
+    if (hostmon_open(hm, &spec) < 0) {
+        return -1;
+    }
+    hm->active = 1;
+    if (pthread_create(&hm->thread, NULL, hostmon_thread, hm) != 0) {
+        perror("Failed to start host metrics collector");
+        hm->active = 0;
+        return -1;
+    }
+    return 0;
+#else
+    printf("Warning: host metrics (-K) are only collected on Linux\n");
+    return -1;
+#endif
+}
+
+/**
+ * Stop the collector thread; the ring stays readable until hostmon_free
+ */
+void hostmon_stop(hostmon_t* hm) {
+#ifdef __linux__
+    if (hm->active) {
+        hm->active = 0;
+        pthread_join(hm->thread, NULL);
+    }
+#endif
+}
+
+/**
+ * Release collector resources
+ */
+void hostmon_free(hostmon_t* hm) {
+    if (hm->fd_stat >= 0) close(hm->fd_stat);
+    if (hm->fd_meminfo >= 0) close(hm->fd_meminfo);
+    if (hm->fd_diskstats >= 0) close(hm->fd_diskstats);
+    free(hm->buf);
+    free(hm->ring);
+    memset(hm, 0, sizeof(hostmon_t));
+}
+
+static void hostmon_print_header(void) {
+    printf("  %-9s %5s %5s %5s %5s %5s %8s %8s %4s %4s %9s %8s %8s  %-8s %6s %7s %7s %5s  %6s %s\n",
+           "", "us%", "sy%", "wa%", "st%", "id%", "intr/s", "cs/s", "r", "b", "avail MB", "dirty MB",
+           "swap MB", "disk", "util%", "r_await", "w_await", "aqu", "free%", "fs");
+}
+
+static void hostmon_print_row(const char* label, const hostmon_sample_t* s) {
+    printf("  %-9s %5.1f %5.1f %5.1f %5.1f %5.1f %8.0f %8.0f %4.0f %4.0f %9.0f %8.0f %8.0f  %-8s %6.1f %7.2f %7.2f "
+           "%5.2f  %6.1f %s\n",
+           label, s->user_pct, s->sys_pct, s->iowait_pct, s->steal_pct, s->idle_pct, s->intr_rate, s->cs_rate,
+           s->procs_running, s->procs_blocked, s->mem_avail_mb, s->dirty_mb, s->swap_used_mb,
+           s->disk_name[0] != '\0' ? s->disk_name : "-", s->disk.util_pct, s->disk.r_await_ms, s->disk.w_await_ms,
+           s->disk.queue, s->fs_free_pct, s->fs_dir[0] != '\0' ? s->fs_dir : "-");
+}
+
+/**
+ * Report host metrics over the run: median and worst interval, per-disk
+ * averages, filesystems under the free-space threshold and the collector's
+ * own cost. For a client, the intervals holding the slowest probes are
+ * shown with their host row; send_times/rtts may be NULL.
+ * Returns the number of filesystems that went under the threshold.
+ */
+int host_metrics_report(hostmon_t* hm, uint64_t* send_times, double* rtts, int count) {
+    if (hm->ring == NULL || hm->count < 1) {
+        return 0;
+    }
+    
+    uint64_t first = hm->count > HOSTMON_RING_SIZE ? hm->count - HOSTMON_RING_SIZE : 0;
+    int n = (int)(hm->count - first);
+    double* column = (double*)malloc(n * sizeof(double));
+    if (column == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Median and worst per field; worst is the minimum for idle, available memory and free space
+    hostmon_sample_t median, worst;
+    memset(&median, 0, sizeof(median));
+    memset(&worst, 0, sizeof(worst));
+    size_t offsets[] = {
+        offsetof(hostmon_sample_t, user_pct), offsetof(hostmon_sample_t, sys_pct),
+        offsetof(hostmon_sample_t, iowait_pct), offsetof(hostmon_sample_t, steal_pct),
+        offsetof(hostmon_sample_t, idle_pct), offsetof(hostmon_sample_t, intr_rate),
+        offsetof(hostmon_sample_t, cs_rate), offsetof(hostmon_sample_t, procs_running),
+        offsetof(hostmon_sample_t, procs_blocked), offsetof(hostmon_sample_t, mem_avail_mb),
+        offsetof(hostmon_sample_t, dirty_mb), offsetof(hostmon_sample_t, swap_used_mb),
+        offsetof(hostmon_sample_t, disk.util_pct), offsetof(hostmon_sample_t, disk.r_await_ms),
+        offsetof(hostmon_sample_t, disk.w_await_ms), offsetof(hostmon_sample_t, disk.queue),
+        offsetof(hostmon_sample_t, fs_free_pct)
+    };
+    for (size_t f = 0; f < sizeof(offsets) / sizeof(offsets[0]); f++) {
+        int lowest = offsets[f] == offsetof(hostmon_sample_t, idle_pct) ||
+                     offsets[f] == offsetof(hostmon_sample_t, mem_avail_mb) ||
+                     offsets[f] == offsetof(hostmon_sample_t, fs_free_pct);
+        for (int i = 0; i < n; i++) {
+            column[i] = *(double*)((char*)&hm->ring[(first + i) % HOSTMON_RING_SIZE] + offsets[f]);
+        }
+        qsort(column, n, sizeof(double), compare_doubles);
+        *(double*)((char*)&median + offsets[f]) = column[n / 2];
+        *(double*)((char*)&worst + offsets[f]) = lowest ? column[0] : column[n - 1];
+    }
+    for (int i = 0; i < n; i++) {
+        const hostmon_sample_t* s = &hm->ring[(first + i) % HOSTMON_RING_SIZE];
+        if (s->disk_name[0] != '\0' && s->disk.util_pct == worst.disk.util_pct && worst.disk_name[0] == '\0') {
+            strcpy(worst.disk_name, s->disk_name);
+        }
+        if (s->fs_dir[0] != '\0' && s->fs_free_pct == worst.fs_free_pct && worst.fs_dir[0] == '\0') {
+            strcpy(worst.fs_dir, s->fs_dir);
+        }
+    }
+    
+    const hostmon_sample_t* last = &hm->ring[(hm->count - 1) % HOSTMON_RING_SIZE];
+    printf("\nHost metrics (%d samples every %d ms, %.0f MB memory):\n", n, hm->interval_ms, last->mem_total_mb);
+    hostmon_print_header();
+    hostmon_print_row("Median", &median);
+    hostmon_print_row("Worst", &worst);
+    
+    // Whole-run disk averages from the first and last readings
+    int shown = 0;
+    for (int i = 0; i < hm->nr_disks; i++) {
+        hostmon_disk_t* d = &hm->disks[i];
+        if (d->skip || d->prev_usec <= d->first_usec ||
+            (d->prev.rd_ios == d->first.rd_ios && d->prev.wr_ios == d->first.wr_ios)) {
+            continue;
+        }
+        if (shown++ == 0) {
+            printf("\n  %-10s %8s %8s %8s %8s %8s %8s %6s %6s\n",
+                   "Disk", "r/s", "w/s", "rMB/s", "wMB/s", "r_await", "w_await", "util%", "peak%");
+        }
+        hostmon_io_t io;
+        hostmon_io_rates(&d->first, &d->prev, (d->prev_usec - d->first_usec) / 1000000.0, &io);
+        printf("  %-10s %8.1f %8.1f %8.2f %8.2f %8.2f %8.2f %6.1f %6.1f\n", d->name, io.r_s, io.w_s,
+               io.rmb_s, io.wmb_s, io.r_await_ms, io.w_await_ms, io.util_pct, d->peak_util);
+    }
+    if (shown == 0 && hm->nr_disks > 0) {
+        printf("\n  No disk I/O during the run\n");
+    }
+    
+    int low = 0;
+    for (int i = 0; i < hm->nr_fs; i++) {
+        if (hm->fs[i].min_free_pct < hm->free_pct) {
+            if (low++ == 0) {
+                printf("\n  Filesystems under %.0f%% free:\n", hm->free_pct);
+            }
+            printf("    %-40s %5.1f%% free (lowest %.1f%%)\n", hm->fs[i].dir, hm->fs[i].free_pct,
+                   hm->fs[i].min_free_pct);
+        }
+    }
+    if (low == 0 && hm->nr_fs > 0) {
+        printf("\n  All %d local filesystems kept %.0f%% or more free\n", hm->nr_fs, hm->free_pct);
+    }
+    printf("  Collector: %.1f us CPU per sample (%.4f%% of one CPU)\n",
+           hm->cpu_ns / 1000.0 / hm->count, 100.0 * hm->cpu_ns / ((double)hm->count * hm->interval_ms * 1e6));
+    
+    if (send_times != NULL && rtts != NULL && count > 0) {
+        // Slowest probe of each interval; sample i covers (ts[i-1], ts[i]]
+        double* slowest = (double*)calloc(n, sizeof(double));
+        int* order = (int*)malloc(n * sizeof(int));
+        if (slowest == NULL || order == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        uint64_t start = hm->ring[first % HOSTMON_RING_SIZE].ts_usec - hm->interval_ms * 1000ULL;
+        for (int p = 0; p < count; p++) {
+            uint64_t lo = first, hi = hm->count;
+            while (lo < hi) {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (hm->ring[mid % HOSTMON_RING_SIZE].ts_usec < send_times[p]) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo < hm->count && send_times[p] >= start && rtts[p] > slowest[lo - first]) {
+                slowest[lo - first] = rtts[p];
+            }
+        }
+        
+        int intervals = 0;
+        for (int i = 0; i < n; i++) {
+            if (slowest[i] > 0) {
+                order[intervals++] = i;
+            }
+        }
+        int top = intervals < HOSTMON_MAX_SLOW ? intervals : HOSTMON_MAX_SLOW;
+        for (int i = 0; i < top; i++) {
+            for (int j = i + 1; j < intervals; j++) {
+                if (slowest[order[j]] > slowest[order[i]]) {
+                    int tmp = order[i];
+                    order[i] = order[j];
+                    order[j] = tmp;
+                }
+            }
+        }
+        if (top > 0) {
+            printf("\nSlowest %d of %d probe intervals (max RTT) vs host metrics:\n", top, intervals);
+            hostmon_print_header();
+            for (int i = 0; i < top; i++) {
+                char label[32];
+                snprintf(label, sizeof(label), "%.3fms", slowest[order[i]] / 1000);
+                hostmon_print_row(label, &hm->ring[(first + order[i]) % HOSTMON_RING_SIZE]);
+            }
+        }
+        free(slowest);
+        free(order);
+    }
+    
+    free(column);
+    return low;
+}
+
+#ifdef __linux__
+/**
+ * Standalone host metrics (-K without -c/-s): one row per interval, like
+ * vmstat, until the sample count is reached or the run is interrupted.
+ * Exits non-zero when a local filesystem went under the free threshold.
+ */
+int run_host_monitor(config_t* config) {
+    hostmon_spec_t spec;
+    hostmon_t hm;
+    FILE* csv = NULL;
+    
+    memset(&hm, 0, sizeof(hostmon_t));
+    hm.fd_stat = hm.fd_meminfo = hm.fd_diskstats = -1;
+    if (hostmon_parse_spec(config->host_spec, &spec) < 0 || hostmon_open(&hm, &spec) < 0) {
+        hostmon_free(&hm);
+        return -1;
+    }
+    if (config->output_file[0] != '\0') {
+        csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "timestamp_us,user_pct,sys_pct,iowait_pct,steal_pct,idle_pct,intr_s,cs_s,"
+                         "procs_running,procs_blocked,mem_avail_mb,dirty_mb,swap_used_mb,disk,disk_util_pct,"
+                         "disk_r_s,disk_w_s,disk_r_await_ms,disk_w_await_ms,disk_queue,fs,fs_free_pct\n");
+        }
+    }
+    
+    printf("Host metrics every %d ms", spec.interval_ms);
+    if (spec.count > 0) {
+        printf(", %d samples", spec.count);
+    }
+    int disks = 0;
+    for (int i = 0; i < hm.nr_disks; i++) {
+        disks += !hm.disks[i].skip;
+    }
+    printf(" (%d disks, %d local filesystems, free alarm %.0f%%)\n\n", disks, hm.nr_fs, spec.free_pct);
+    hostmon_print_header();
+    
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (running && (spec.count == 0 || hm.count < (uint64_t)spec.count)) {
+        next.tv_nsec += (long)spec.interval_ms * 1000000L;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+        if (!running) {
+            break;
+        }
+        
+        hostmon_sample_t* s = &hm.ring[hm.count % HOSTMON_RING_SIZE];
+        hostmon_take_sample(&hm, s);
+        hm.count++;
+        
+        char label[16];
+        time_t now = (time_t)(s->ts_usec / 1000000);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        strftime(label, sizeof(label), "%H:%M:%S", &tm);
+        hostmon_print_row(label, s);
+        fflush(stdout);
+        if (csv != NULL) {
+            fprintf(csv, "%llu,%.1f,%.1f,%.1f,%.1f,%.1f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%.0f,%s,%.1f,%.1f,%.1f,"
+                         "%.2f,%.2f,%.2f,%s,%.1f\n",
+                    (unsigned long long)s->ts_usec, s->user_pct, s->sys_pct, s->iowait_pct, s->steal_pct,
+                    s->idle_pct, s->intr_rate, s->cs_rate, s->procs_running, s->procs_blocked, s->mem_avail_mb,
+                    s->dirty_mb, s->swap_used_mb, s->disk_name, s->disk.util_pct, s->disk.r_s, s->disk.w_s,
+                    s->disk.r_await_ms, s->disk.w_await_ms, s->disk.queue, s->fs_dir, s->fs_free_pct);
+        }
+    }
+    
+    int low = host_metrics_report(&hm, NULL, NULL, 0);
+    if (csv != NULL) {
+        fclose(csv);
+        printf("\nResults saved to %s\n", config->output_file);
+    }
+    hostmon_free(&hm);
+    return low > 0 ? -1 : 0;
+}
+#else
+int run_host_monitor(config_t* config) {
+    (void)config;
+    fprintf(stderr, "Host metrics (-K) read /proc and need Linux; on AIX use misc/diskmon.sh\n");
+    return -1;
+}
+#endif
@@ -0,0 +1,483 @@
+/**
+ * UDP multicast sender and receivers (-g)
+ */
+
+#include "netperf.h"
+
+/**
+ * Batched datagram receive: recvmmsg where available, one recvmsg otherwise
+ * Returns the number of messages received, -1 on error
+ */
+static int mcast_recv_batch(int fd, mcast_mmsghdr_t* msgs, int count, int flags) {
+#if defined(__linux__) && defined(SYS_recvmmsg)
+    return (int)syscall(SYS_recvmmsg, fd, msgs, count, flags, NULL);
+#else
+    (void)count;
+    ssize_t n = recvmsg(fd, &msgs[0].msg_hdr, flags & MSG_DONTWAIT);
+    if (n < 0) {
+        return -1;
+    }
+    msgs[0].msg_len = (unsigned int)n;
+    return 1;
+#endif
+}
+
+/**
+ * Batched datagram send: sendmmsg where available, one sendmsg per message otherwise
+ */
+static int mcast_send_batch(int fd, mcast_mmsghdr_t* msgs, int count) {
+#if defined(__linux__) && defined(SYS_sendmmsg)
+    return (int)syscall(SYS_sendmmsg, fd, msgs, count, 0);
+#else
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        if (sendmsg(fd, &msgs[i].msg_hdr, 0) >= 0) {
+            sent++;
+        }
+    }
+    return sent;
+#endif
+}
+
+/**
+ * Set bit seq in a growable bitmap; returns the previous value of the bit
+ */
+static int mcast_mark_seen(uint8_t** bitmap, size_t* bytes, uint64_t seq) {
+    size_t index = seq / 8;
+    if (index >= *bytes) {
+        size_t grown = *bytes > 0 ? *bytes : 4096;
+        while (grown <= index) {
+            grown *= 2;
+        }
+        uint8_t* p = (uint8_t*)realloc(*bitmap, grown);
+        if (p == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        memset(p + *bytes, 0, grown - *bytes);
+        *bitmap = p;
+        *bytes = grown;
+    }
+    int was = ((*bitmap)[index] >> (seq % 8)) & 1;
+    (*bitmap)[index] |= (uint8_t)(1 << (seq % 8));
+    return was;
+}
+
+/**
+ * IPv4 address of the -I interface for multicast join/send, INADDR_ANY if unset or not found
+ */
+static struct in_addr mcast_interface_addr(config_t* config) {
+    struct in_addr addr;
+    addr.s_addr = htonl(INADDR_ANY);
+#ifdef __linux__
+    if (config->interface[0] != '\0') {
+        struct ifaddrs* list;
+        if (getifaddrs(&list) == 0) {
+            for (struct ifaddrs* ifa = list; ifa != NULL; ifa = ifa->ifa_next) {
+                if (ifa->ifa_addr != NULL && ifa->ifa_addr->sa_family == AF_INET &&
+                    strcmp(ifa->ifa_name, config->interface) == 0) {
+                    addr = ((struct sockaddr_in*)ifa->ifa_addr)->sin_addr;
+                    break;
+                }
+            }
+            freeifaddrs(list);
+        }
+    }
+#endif
+    return addr;
+}
+
+/**
+ * Join the multicast group on the interface from -I (or the default route's)
+ * Returns the time spent in the join call, in microseconds, or -1 on failure
+ */
+static int64_t mcast_join(int fd, config_t* config) {
+    struct ip_mreq mreq;
+    memset(&mreq, 0, sizeof(mreq));
+    if (inet_pton(AF_INET, config->mcast_group, &mreq.imr_multiaddr) != 1 ||
+        !IN_MULTICAST(ntohl(mreq.imr_multiaddr.s_addr))) {
+        fprintf(stderr, "%s is not an IPv4 multicast group\n", config->mcast_group);
+        return -1;
+    }
+    mreq.imr_interface = mcast_interface_addr(config);
+
+    uint64_t start = get_timestamp_usec();
+    if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+        perror("IP_ADD_MEMBERSHIP failed");
+        return -1;
+    }
+    return (int64_t)(get_timestamp_usec() - start);
+}
+
+/**
+ * Multicast receiver: join the group, reflect each probe's header back to the
+ * sender (unicast, batched) and keep loss, duplicate and reorder counts.
+ * Replies leave from their own ephemeral port so the sender can tell apart
+ * receivers sharing a host.
+ */
+int run_mcast_receiver(config_t* config) {
+    struct sockaddr_storage address;
+    int opt = 1;
+    mcast_mmsghdr_t msgs[MCAST_BATCH];
+    mcast_mmsghdr_t replies[MCAST_BATCH];
+    struct iovec iovs[MCAST_BATCH], reply_iovs[MCAST_BATCH];
+    struct sockaddr_storage sources[MCAST_BATCH];
+    uint8_t* seen = NULL;
+    size_t seen_bytes = 0;
+    uint64_t received = 0, unique = 0, duplicates = 0, reordered = 0, corrupt = 0;
+    uint64_t highest = 0, first_seq = 0, batches = 0;
+    uint64_t first_usec = 0;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    // Several receivers may share the port on one host
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    int addr_size = init_socket_address(&address, NULL, config->port, 0);
+    if (addr_size < 0 || bind(fd, (struct sockaddr*)&address, addr_size) < 0) {
+        perror("Bind failed");
+        close(fd);
+        return -1;
+    }
+
+    uint64_t join_usec = get_timestamp_usec();
+    int64_t join_call = mcast_join(fd, config);
+    if (join_call < 0) {
+        close(fd);
+        return -1;
+    }
+    struct sockaddr_in reply_addr;
+    socklen_t reply_len = sizeof(reply_addr);
+    memset(&reply_addr, 0, sizeof(reply_addr));
+    reply_addr.sin_family = AF_INET;
+    int reply_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (reply_fd < 0 || bind(reply_fd, (struct sockaddr*)&reply_addr, sizeof(reply_addr)) < 0 ||
+        getsockname(reply_fd, (struct sockaddr*)&reply_addr, &reply_len) < 0) {
+        perror("Reply socket failed");
+        close(fd);
+        return -1;
+    }
+    register_server_socket(fd);
+    config->ready = 1;
+    printf("Multicast receiver joined %s:%d%s%s (join call %lld us), replying from port %d\n",
+           config->mcast_group, config->port, config->interface[0] != '\0' ? " on " : "", config->interface,
+           (long long)join_call, ntohs(reply_addr.sin_port));
+    fflush(stdout);
+
+    uint8_t* buffers = (uint8_t*)malloc((size_t)MCAST_BATCH * MAX_PACKET_SIZE);
+    if (buffers == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    while (running) {
+        for (int i = 0; i < MCAST_BATCH; i++) {
+            iovs[i].iov_base = buffers + (size_t)i * MAX_PACKET_SIZE;
+            iovs[i].iov_len = MAX_PACKET_SIZE;
+            memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &sources[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+        }
+
+        int n = mcast_recv_batch(fd, msgs, MCAST_BATCH, MSG_WAITFORONE);
+        if (n <= 0) {
+            if (n < 0 && running && errno != EINTR) {
+                perror("Multicast receive error");
+            }
+            if (n == 0 || !running) {
+                break;
+            }
+            continue;
+        }
+        uint64_t now = get_timestamp_usec();
+        batches++;
+
+        int num_replies = 0;
+        for (int i = 0; i < n; i++) {
+            packet_t* packet = (packet_t*)iovs[i].iov_base;
+            if (msgs[i].msg_len < sizeof(packet_t)) {
+                continue;
+            }
+            received++;
+            if (first_usec == 0) {
+                first_usec = now;
+                first_seq = packet->seq_num;
+            }
+            if (packet->packet_size != msgs[i].msg_len || !validate_packet(packet)) {
+                corrupt++;
+            }
+            if (mcast_mark_seen(&seen, &seen_bytes, packet->seq_num)) {
+                duplicates++;
+            } else {
+                unique++;
+                if (packet->seq_num < highest) {
+                    reordered++;
+                }
+            }
+            if (packet->seq_num > highest) {
+                highest = packet->seq_num;
+            }
+
+            // Reply with the header only, unicast to the sender
+            packet->server_recv = now;
+            packet->server_send = get_timestamp_usec();
+            packet->packet_size = sizeof(packet_t);
+            reply_iovs[num_replies].iov_base = packet;
+            reply_iovs[num_replies].iov_len = sizeof(packet_t);
+            memset(&replies[num_replies].msg_hdr, 0, sizeof(struct msghdr));
+            replies[num_replies].msg_hdr.msg_iov = &reply_iovs[num_replies];
+            replies[num_replies].msg_hdr.msg_iovlen = 1;
+            replies[num_replies].msg_hdr.msg_name = &sources[i];
+            replies[num_replies].msg_hdr.msg_namelen = msgs[i].msg_hdr.msg_namelen;
+            num_replies++;
+        }
+        if (num_replies > 0) {
+            mcast_send_batch(reply_fd, replies, num_replies);
+        }
+    }
+
+    printf("\n--- Multicast Receiver Summary (%s:%d) ---\n", config->mcast_group, config->port);
+    printf("  Join call: %lld us", (long long)join_call);
+    if (first_usec != 0) {
+        printf(", first datagram %.3f ms after joining\n", (first_usec - join_usec) / 1000.0);
+    } else {
+        printf(", no datagrams received\n");
+    }
+    printf("  Datagrams: %lu received, %lu unique, %lu duplicates, %lu reordered, %lu corrupt\n",
+           (unsigned long)received, (unsigned long)unique, (unsigned long)duplicates,
+           (unsigned long)reordered, (unsigned long)corrupt);
+    if (highest >= first_seq && first_seq > 0) {
+        // Probes sent before the join took effect are not loss
+        uint64_t span = highest - first_seq + 1;
+        uint64_t missing = span > unique ? span - unique : 0;
+        printf("  Sequence gaps: %lu missing in seq %lu..%lu (%.3f%%)\n", (unsigned long)missing,
+               (unsigned long)first_seq, (unsigned long)highest, 100.0 * missing / span);
+    }
+    if (batches > 0) {
+        printf("  Receive batching: %.1f datagrams per call\n", (double)received / batches);
+    }
+
+    free(buffers);
+    free(seen);
+    close(reply_fd);
+    close(fd);
+    printf("Multicast receiver shutdown complete\n");
+    return 0;
+}
+
+/**
+ * Process a batch of receiver replies at the sender
+ */
+static void mcast_collect(int fd, mcast_receiver_t* receivers, int* num_receivers, uint64_t* send_times,
+                          int num_packets, uint64_t start_usec, uint64_t* foreign) {
+    mcast_mmsghdr_t msgs[MCAST_BATCH];
+    struct iovec iovs[MCAST_BATCH];
+    struct sockaddr_storage sources[MCAST_BATCH];
+    packet_t headers[MCAST_BATCH];
+
+    for (;;) {
+        for (int i = 0; i < MCAST_BATCH; i++) {
+            iovs[i].iov_base = &headers[i];
+            iovs[i].iov_len = sizeof(packet_t);
+            memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &sources[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+        }
+        int n = mcast_recv_batch(fd, msgs, MCAST_BATCH, MSG_DONTWAIT);
+        if (n <= 0) {
+            return;
+        }
+        uint64_t now = get_timestamp_usec();
+
+        for (int i = 0; i < n; i++) {
+            packet_t* reply = &headers[i];
+            if (msgs[i].msg_len < sizeof(packet_t) || reply->seq_num < 1 ||
+                reply->seq_num > (uint64_t)num_packets || reply->client_send != send_times[reply->seq_num - 1]) {
+                (*foreign)++;
+                continue;
+            }
+
+            // Find (or add) the receiver by its source address
+            mcast_receiver_t* r = NULL;
+            for (int k = 0; k < *num_receivers; k++) {
+                if (receivers[k].addr_len == msgs[i].msg_hdr.msg_namelen &&
+                    memcmp(&receivers[k].addr, &sources[i], receivers[k].addr_len) == 0) {
+                    r = &receivers[k];
+                    break;
+                }
+            }
+            if (r == NULL) {
+                if (*num_receivers >= MCAST_MAX_RECEIVERS) {
+                    (*foreign)++;
+                    continue;
+                }
+                r = &receivers[(*num_receivers)++];
+                memset(r, 0, sizeof(mcast_receiver_t));
+                memcpy(&r->addr, &sources[i], msgs[i].msg_hdr.msg_namelen);
+                r->addr_len = msgs[i].msg_hdr.msg_namelen;
+                hist_init(&r->rtt);
+                r->first_seq = reply->seq_num;
+                r->first_reply_ms = (now - start_usec) / 1000.0;
+                r->seen = (uint8_t*)calloc(num_packets / 8 + 1, 1);
+                if (r->seen == NULL) {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+
+            uint64_t seq = reply->seq_num;
+            if (r->seen[seq / 8] & (1 << (seq % 8))) {
+                r->duplicates++;
+                continue;
+            }
+            r->seen[seq / 8] |= (uint8_t)(1 << (seq % 8));
+            r->replies++;
+            hist_record(&r->rtt, (now - reply->client_send) * 1000);
+        }
+    }
+}
+
+/**
+ * Multicast sender: send probes to the group at the configured rate and
+ * collect unicast replies from every receiver
+ */
+int run_mcast_sender(config_t* config) {
+    struct sockaddr_storage group_addr;
+    mcast_receiver_t* receivers;
+    int num_receivers = 0;
+    uint64_t foreign = 0;
+    int packets_sent = 0;
+    overhead_sample_t usage_start, usage_end;
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+    int addr_len = init_socket_address(&group_addr, config->mcast_group, config->port, 0);
+    if (addr_len < 0) {
+        close(fd);
+        return -1;
+    }
+    unsigned char ttl = MCAST_DEFAULT_TTL;
+    unsigned char loop = 1;
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    if (config->interface[0] != '\0') {
+        struct in_addr ifaddr = mcast_interface_addr(config);
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &ifaddr, sizeof(ifaddr));
+    }
+
+    receivers = (mcast_receiver_t*)calloc(MCAST_MAX_RECEIVERS, sizeof(mcast_receiver_t));
+    uint64_t* send_times = (uint64_t*)calloc(config->num_packets, sizeof(uint64_t));
+    if (receivers == NULL || send_times == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    packet_t* packet = create_packet(config->packet_size);
+
+    int interval_us = config->rate_pps > 0 ? 1000000 / config->rate_pps : config->delay_ms * 1000;
+    printf("Multicast sender: %d probes of %d bytes to %s:%d every %d us (TTL %d)\n",
+           config->num_packets, config->packet_size, config->mcast_group, config->port, interval_us, ttl);
+    fflush(stdout);
+
+    overhead_sample(&usage_start);
+    uint64_t start = get_timestamp_usec();
+    uint64_t next_send = start;
+    for (int i = 0; i < config->num_packets && running; i++) {
+        // Collect replies until this probe is due
+        for (;;) {
+            mcast_collect(fd, receivers, &num_receivers, send_times, config->num_packets, start, &foreign);
+            uint64_t now = get_timestamp_usec();
+            if (now >= next_send) {
+                break;
+            }
+            fd_set readable;
+            struct timeval tv;
+            FD_ZERO(&readable);
+            FD_SET(fd, &readable);
+            tv.tv_sec = (next_send - now) / 1000000;
+            tv.tv_usec = (next_send - now) % 1000000;
+            select(fd + 1, &readable, NULL, NULL, &tv);
+        }
+
+        packet->seq_num = i + 1;
+        packet->client_send = get_timestamp_usec();
+        packet->server_recv = 0;
+        packet->server_send = 0;
+        packet->packet_size = config->packet_size;
+        send_times[i] = packet->client_send;
+        if (sendto(fd, packet, config->packet_size, 0, (struct sockaddr*)&group_addr, addr_len) < 0) {
+            perror("Multicast send failed");
+            continue;
+        }
+        packets_sent++;
+        next_send += interval_us;
+    }
+
+    // Grace period for the last replies
+    uint64_t drain_end = get_timestamp_usec() + MCAST_DRAIN_USEC;
+    while (get_timestamp_usec() < drain_end) {
+        fd_set readable;
+        struct timeval tv = { 0, 10000 };
+        FD_ZERO(&readable);
+        FD_SET(fd, &readable);
+        select(fd + 1, &readable, NULL, NULL, &tv);
+        mcast_collect(fd, receivers, &num_receivers, send_times, config->num_packets, start, &foreign);
+    }
+    overhead_sample(&usage_end);
+    double duration = (usage_end.wall_usec - usage_start.wall_usec) / 1000000.0;
+
+    printf("\n--- Multicast Summary (%s:%d) ---\n", config->mcast_group, config->port);
+    printf("Probes sent: %d in %.2f s (%.0f pps)\n", packets_sent, duration,
+           duration > 0 ? packets_sent / duration : 0.0);
+    printf("Receivers replying: %d\n", num_receivers);
+    int status = num_receivers > 0 ? 0 : -1;
+    latency_hist_t combined;
+    hist_init(&combined);
+    for (int k = 0; k < num_receivers; k++) {
+        mcast_receiver_t* r = &receivers[k];
+        char host[INET6_ADDRSTRLEN];
+        struct sockaddr_in* sin = (struct sockaddr_in*)&r->addr;
+        inet_ntop(AF_INET, &sin->sin_addr, host, sizeof(host));
+        // Probes sent before the receiver's first reply count as join latency, not loss
+        uint64_t expected = packets_sent >= (int)r->first_seq ? packets_sent - r->first_seq + 1 : 0;
+        printf("  %s:%d: %lu replies, %lu lost (%.3f%%), %lu duplicates, first reply at seq %lu after %.3f ms\n",
+               host, ntohs(sin->sin_port), (unsigned long)r->replies,
+               (unsigned long)(expected > r->replies ? expected - r->replies : 0),
+               expected > 0 ? 100.0 * (expected > r->replies ? expected - r->replies : 0) / expected : 0.0,
+               (unsigned long)r->duplicates, (unsigned long)r->first_seq, r->first_reply_ms);
+        if (r->rtt.total > 0) {
+            printf("    RTT min %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n",
+                   r->rtt.min_ns / 1000.0, hist_percentile(&r->rtt, 50) / 1000.0,
+                   hist_percentile(&r->rtt, 99) / 1000.0, r->rtt.max_ns / 1000.0);
+        }
+        hist_merge(&combined, &r->rtt);
+        free(r->seen);
+    }
+    if (foreign > 0) {
+        printf("  Ignored %lu datagrams that did not match a sent probe\n", (unsigned long)foreign);
+    }
+    if (num_receivers == 0) {
+        printf("  No receiver replied: check IGMP snooping/querier on the switch and that receivers joined\n");
+    }
+    if (config->result != NULL) {
+        config->result->packets_sent = packets_sent;
+        config->result->packets_received = (int)combined.total;
+        config->result->duration_sec = duration;
+        hist_merge(&config->result->rtt, &combined);
+    }
+    status |= overhead_report("prober", &usage_start, &usage_end, packets_sent, config->overhead_budget);
+
+    free(packet);
+    free(send_times);
+    free(receivers);
+    close(fd);
+    return status;
+}
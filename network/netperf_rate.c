@@ -0,0 +1,430 @@
+/**
+ * Maximum sustainable probe rate search against an SLA (-L)
+ */
+
+#include "netperf.h"
+
+/**
+ * Parse "p99_us[,loss=pct][,step=ms][,start=pps][,max=pps]"; an empty
+ * p99_us keeps the default SLA
+ */
+int rate_parse_sla(const char* text, rate_sla_t* sla) {
+    char buffer[64];
+    sla->p99_us = RATE_SLA_P99_US;
+    sla->loss_pct = RATE_SLA_LOSS_PCT;
+    sla->step_ms = RATE_STEP_MS;
+    sla->start_pps = RATE_START_PPS;
+    sla->max_pps = RATE_MAX_PPS;
+
+    strncpy(buffer, text, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    for (char* item = strtok(buffer, ","); item != NULL; item = strtok(NULL, ",")) {
+        char name[16];
+        double value;
+        if (strchr(item, '=') == NULL) {
+            sla->p99_us = atof(item);
+            continue;
+        }
+        if (sscanf(item, "%15[^=]=%lf", name, &value) != 2 || value < 0) {
+            fprintf(stderr, "Bad -L setting '%s'\n", item);
+            return -1;
+        }
+        if (strcmp(name, "loss") == 0) {
+            sla->loss_pct = value;
+        } else if (strcmp(name, "step") == 0 && value > 0) {
+            sla->step_ms = (int)value;
+        } else if (strcmp(name, "start") == 0 && value >= RATE_MIN_PPS) {
+            sla->start_pps = (int)value;
+        } else if (strcmp(name, "max") == 0 && value >= RATE_MIN_PPS) {
+            sla->max_pps = (int)value;
+        } else {
+            fprintf(stderr, "Unknown -L setting '%s' (use loss, step, start, max)\n", name);
+            return -1;
+        }
+    }
+    if (sla->p99_us <= 0) {
+        fprintf(stderr, "-L needs a p99 target in us\n");
+        return -1;
+    }
+    if (sla->start_pps > sla->max_pps) {
+        sla->start_pps = sla->max_pps;
+    }
+    return 0;
+}
+
+/**
+ * Take one reply of a rate step; replies to earlier steps are ignored
+ */
+static void rate_take_reply(packet_t* reply, int size, uint64_t first_seq, uint64_t last_seq,
+                            double* rtts, rate_step_t* st) {
+    if (reply->packet_size != (uint32_t)size || reply->seq_num < first_seq || reply->seq_num > last_seq ||
+        st->received >= st->sent || !validate_packet(reply)) {
+        return;
+    }
+    rtts[st->received++] = get_timestamp_usec() - reply->client_send;
+}
+
+/**
+ * Offer target probes/s on sock for duration_ms, reading replies between
+ * sends, then wait drain_ms for stragglers. Sends are paced against a fixed
+ * schedule so a late wake-up sends the probes it owes at once rather than
+ * stretching the step. TCP sends never block: a full send buffer holds the
+ * probe back, which shows up as an offered rate below target.
+ * Returns -1 if the connection failed
+ */
+static int rate_run_step(int sock, int tcp, packet_t* packet, packet_t* reply, int size, uint64_t* seq,
+                         uint8_t* stream, int* stream_fill, double** rtts, int* capacity,
+                         int drain_ms, rate_step_t* st) {
+    int expected = (int)((int64_t)st->target_pps * st->duration_ms / 1000);
+    if (expected < 1) {
+        expected = 1;
+    }
+    if (expected > *capacity) {
+        double* grown = (double*)realloc(*rtts, expected * sizeof(double));
+        if (grown == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+        *rtts = grown;
+        *capacity = expected;
+    }
+
+    uint64_t first_seq = *seq + 1;
+    int tx_off = 0;          // Bytes of the current TCP probe already written
+    uint64_t start = get_timestamp_usec();
+    uint64_t send_end = start + (uint64_t)st->duration_ms * 1000;
+    uint64_t stop = send_end + (uint64_t)drain_ms * 1000;
+
+    while (running) {
+        uint64_t now = get_timestamp_usec();
+        int blocked = 0;
+        while (now < send_end && st->sent < expected &&
+               (tx_off > 0 || start + (uint64_t)st->sent * 1000000 / st->target_pps <= now)) {
+            if (tx_off == 0) {
+                packet->seq_num = ++*seq;
+                packet->packet_size = size;
+                packet->client_send = now;
+            }
+            if (tcp) {
+                ssize_t n = send(sock, (char*)packet + tx_off, size - tx_off, MSG_NOSIGNAL | MSG_DONTWAIT);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    return -1;
+                }
+                tx_off += n > 0 ? (int)n : 0;
+                if (tx_off < size) {
+                    blocked = 1;
+                    break;
+                }
+                tx_off = 0;
+            } else if (send(sock, packet, size, 0) < 0 && errno != ENOBUFS && errno != ECONNREFUSED) {
+                return -1;
+            }
+            st->sent++;
+            now = get_timestamp_usec();
+        }
+        if (tx_off > 0 && now >= send_end) {
+            // The probe never left whole; the stream is unusable for the next step
+            return -1;
+        }
+        if (now >= stop || (now >= send_end && st->received >= st->sent)) {
+            break;
+        }
+
+        // Sleep until the next probe is due or a reply arrives
+        uint64_t wake = stop;
+        if (!blocked && now < send_end && st->sent < expected) {
+            wake = start + (uint64_t)st->sent * 1000000 / st->target_pps;
+        }
+        uint64_t wait = wake > now ? wake - now : 0;
+        struct timeval tv = { (time_t)(wait / 1000000), (suseconds_t)(wait % 1000000) };
+        fd_set readable, writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        FD_SET(sock, &readable);
+        if (blocked) {
+            FD_SET(sock, &writable);
+        }
+        if (select(sock + 1, &readable, blocked ? &writable : NULL, NULL, &tv) <= 0 ||
+            !FD_ISSET(sock, &readable)) {
+            continue;
+        }
+
+        if (!tcp) {
+            while (recv(sock, reply, MAX_PACKET_SIZE, MSG_DONTWAIT) > 0) {
+                rate_take_reply(reply, size, first_seq, *seq, *rtts, st);
+            }
+            continue;
+        }
+        ssize_t n = recv(sock, stream + *stream_fill, RATE_RX_BUFFER - *stream_fill, MSG_DONTWAIT);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            return -1;
+        }
+        *stream_fill += n > 0 ? (int)n : 0;
+        int used = 0;
+        while (*stream_fill - used >= size) {
+            // Copied out so the header is aligned wherever the reply starts
+            memcpy(reply, stream + used, size);
+            rate_take_reply(reply, size, first_seq, *seq, *rtts, st);
+            used += size;
+        }
+        memmove(stream, stream + used, *stream_fill - used);
+        *stream_fill -= used;
+    }
+    return 0;
+}
+
+static void rate_print_row(int index, const rate_step_t* st) {
+    printf("  %4d %-8s %9d %9.0f %9.0f %8.3f %9.1f %9.1f %9.1f %9.1f  %s\n", index, st->phase,
+           st->target_pps, st->sent_pps, st->reply_pps, st->loss_pct, st->p50_us, st->p99_us, st->p999_us,
+           st->max_us, st->verdict);
+    fflush(stdout);
+}
+
+static void rate_print_header(void) {
+    printf("  %4s %-8s %9s %9s %9s %8s %9s %9s %9s %9s  %s\n", "step", "phase", "target", "sent/s",
+           "replies/s", "loss %", "p50 us", "p99 us", "p99.9 us", "max us", "SLA");
+}
+
+/**
+ * Adaptive rate search: finds the highest probe rate at which p99 and loss
+ * stay within the -L SLA. Short steps on one connection double the rate
+ * until the SLA breaks (or halve it until it holds), then bisect between the
+ * highest passing and lowest failing rate until they are within
+ * RATE_TOLERANCE, and repeat the passing end once so a lucky step is not
+ * reported as the knee. Prints every step and the sorted
+ * throughput-latency curve (-o writes it as CSV)
+ */
+int run_rate_search(config_t* config) {
+    struct sockaddr_storage server_addr;
+    rate_sla_t sla;
+    rate_step_t steps[RATE_MAX_STEPS];
+    int nsteps = 0;
+    int tcp = config->protocol == PROTOCOL_TCP;
+    int failed_conn = 0;
+
+    if (rate_parse_sla(config->rate_sla, &sla) < 0) {
+        return -1;
+    }
+    int sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+    int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (sock < 0 || addr_size < 0 || connect(sock, (struct sockaddr*)&server_addr, addr_size) < 0) {
+        perror("Connection failed");
+        if (sock >= 0) {
+            close(sock);
+        }
+        return -1;
+    }
+    if (tcp) {
+        int one = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+
+    int size = config->packet_size;
+    packet_t* packet = create_packet(size);
+    packet_t* reply = create_packet(MAX_PACKET_SIZE);
+    uint8_t* stream = (uint8_t*)malloc(RATE_RX_BUFFER);
+    int capacity = RATE_MIN_PROBES;
+    double* rtts = (double*)malloc(capacity * sizeof(double));
+    if (stream == NULL || rtts == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int stream_fill = 0;
+    uint64_t seq = 0;
+    int drain_ms = (int)(sla.p99_us * 4 / 1000);
+    if (drain_ms < RATE_DRAIN_MS) {
+        drain_ms = RATE_DRAIN_MS;
+    }
+
+    printf("Rate search over %s to %s:%d: SLA p99 <= %.0f us, loss <= %.3f%%; %d-byte probes, "
+           "%d ms steps from %d pps (max %d)\n", tcp ? "TCP" : "UDP", config->server_ip, config->port,
+           sla.p99_us, sla.loss_pct, size, sla.step_ms, sla.start_pps, sla.max_pps);
+    printf("\n");
+    rate_print_header();
+
+    int lo = 0;              // Highest rate that met the SLA
+    int hi = 0;              // Lowest rate that broke it
+    int confirmed = 0;
+    int offer_limited = 0;   // Highest target the client could not offer
+    int rate = sla.start_pps;
+    const char* phase = "ramp";
+    while (nsteps < RATE_MAX_STEPS && running) {
+        rate_step_t* st = &steps[nsteps];
+        memset(st, 0, sizeof(rate_step_t));
+        st->target_pps = rate;
+        st->phase = phase;
+        st->duration_ms = sla.step_ms;
+        if ((int64_t)st->duration_ms * rate / 1000 < RATE_MIN_PROBES) {
+            st->duration_ms = (int)((int64_t)RATE_MIN_PROBES * 1000 / rate);
+            if (st->duration_ms > RATE_MAX_STEP_MS) {
+                st->duration_ms = RATE_MAX_STEP_MS;
+            }
+        }
+        if (rate_run_step(sock, tcp, packet, reply, size, &seq, stream, &stream_fill, &rtts, &capacity,
+                          drain_ms, st) < 0) {
+            printf("Server disconnected during the %d pps step\n", rate);
+            failed_conn = 1;
+            break;
+        }
+        if (!running) {
+            break;
+        }
+
+        st->sent_pps = st->sent * 1000.0 / st->duration_ms;
+        st->reply_pps = st->received * 1000.0 / st->duration_ms;
+        st->loss_pct = st->sent > 0 ? 100.0 * (st->sent - st->received) / st->sent : 0.0;
+        if (st->received > 0) {
+            qsort(rtts, st->received, sizeof(double), compare_doubles);
+            st->p50_us = sorted_percentile(rtts, st->received, 50);
+            st->p99_us = sorted_percentile(rtts, st->received, 99);
+            st->p999_us = sorted_percentile(rtts, st->received, 99.9);
+            st->max_us = rtts[st->received - 1];
+        }
+        if (st->sent_pps < RATE_OFFERED_MIN * rate) {
+            st->verdict = "FAIL offer";
+            offer_limited = rate;
+        } else if (st->received == 0 || st->loss_pct > sla.loss_pct) {
+            st->verdict = "FAIL loss";
+        } else if (st->p99_us > sla.p99_us) {
+            st->verdict = "FAIL p99";
+        } else {
+            st->verdict = "pass";
+            st->pass = 1;
+        }
+        rate_print_row(++nsteps, st);
+
+        if (st->pass) {
+            if (rate > lo) {
+                lo = rate;
+            }
+            if (strcmp(phase, "confirm") == 0) {
+                confirmed = 1;
+                break;
+            }
+        } else {
+            if (hi == 0 || rate < hi) {
+                hi = rate;
+            }
+            if (rate <= lo) {
+                // The passing end failed on a repeat: fall back to the best pass below it
+                lo = 0;
+                for (int i = 0; i < nsteps; i++) {
+                    if (steps[i].pass && steps[i].target_pps < hi && steps[i].target_pps > lo) {
+                        lo = steps[i].target_pps;
+                    }
+                }
+            }
+        }
+
+        // Pick the next rate
+        if (hi == 0) {
+            if (rate >= sla.max_pps) {
+                break;
+            }
+            rate = rate > sla.max_pps / 2 ? sla.max_pps : rate * 2;
+            phase = "ramp";
+        } else if (lo == 0) {
+            if (rate <= RATE_MIN_PPS) {
+                break;
+            }
+            rate = rate / 2 > RATE_MIN_PPS ? rate / 2 : RATE_MIN_PPS;
+            phase = "back-off";
+        } else if (hi - lo <= lo * RATE_TOLERANCE) {
+            rate = lo;
+            phase = "confirm";
+        } else {
+            rate = lo + (hi - lo) / 2;
+            phase = "bisect";
+        }
+    }
+
+    // The curve in rate order; repeated rates keep their search order
+    int measured = nsteps;
+    rate_step_t* curve = (rate_step_t*)malloc((measured > 0 ? measured : 1) * sizeof(rate_step_t));
+    if (curve == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(curve, steps, measured * sizeof(rate_step_t));
+    for (int i = 1; i < measured; i++) {
+        // Insertion sort: stable and the step count is small
+        rate_step_t key = curve[i];
+        int j = i - 1;
+        while (j >= 0 && curve[j].target_pps > key.target_pps) {
+            curve[j + 1] = curve[j];
+            j--;
+        }
+        curve[j + 1] = key;
+    }
+    printf("\n--- Throughput-Latency Curve (%d steps) ---\n", measured);
+    rate_print_header();
+    for (int i = 0; i < measured; i++) {
+        rate_print_row(i + 1, &curve[i]);
+    }
+
+    int status = 0;
+    printf("\n--- SLA Knee ---\n");
+    const rate_step_t* knee = NULL;
+    for (int i = 0; i < measured; i++) {
+        if (curve[i].pass && curve[i].target_pps == lo) {
+            knee = &curve[i];
+        }
+    }
+    if (knee == NULL) {
+        printf("  SLA not met at any rate tried (lowest %d pps)\n", measured > 0 ? curve[0].target_pps : 0);
+        status = -1;
+    } else {
+        printf("  Max sustainable rate: %d pps (%.2f Mbit/s of %d-byte probes), p99 %.1f us, loss %.3f%%%s\n",
+               lo, lo * (double)size * 8 / 1e6, size, knee->p99_us, knee->loss_pct,
+               confirmed ? ", confirmed on a repeat" : "");
+        if (hi > 0) {
+            const rate_step_t* above = NULL;
+            for (int i = measured - 1; i >= 0; i--) {
+                if (!curve[i].pass && curve[i].target_pps == hi) {
+                    above = &curve[i];
+                }
+            }
+            printf("  SLA breaks by %d pps (%s: p99 %.1f us, loss %.3f%%)\n", hi,
+                   above != NULL ? above->verdict : "?", above != NULL ? above->p99_us : 0.0,
+                   above != NULL ? above->loss_pct : 0.0);
+        } else {
+            printf("  SLA still held at the search limit; raise max= to look further\n");
+        }
+        if (offer_limited > 0 && offer_limited == hi) {
+            printf("  Note: the client could not offer %d pps; the knee may be its send limit%s, not the path's\n",
+                   offer_limited, tcp ? " or TCP flow control" : "");
+        }
+        if (!confirmed && hi > 0 && !failed_conn) {
+            printf("  Not confirmed: the search ran out of steps or was interrupted\n");
+        }
+    }
+    if (failed_conn) {
+        status = -1;
+    }
+
+    if (config->output_file[0] != '\0') {
+        FILE* csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "step,phase,target_pps,duration_ms,sent,received,sent_pps,reply_pps,loss_pct,"
+                         "p50_us,p99_us,p999_us,max_us,sla\n");
+            for (int i = 0; i < measured; i++) {
+                rate_step_t* st = &steps[i];
+                fprintf(csv, "%d,%s,%d,%d,%d,%d,%.0f,%.0f,%.3f,%.1f,%.1f,%.1f,%.1f,%s\n", i + 1, st->phase,
+                        st->target_pps, st->duration_ms, st->sent, st->received, st->sent_pps, st->reply_pps,
+                        st->loss_pct, st->p50_us, st->p99_us, st->p999_us, st->max_us, st->verdict);
+            }
+            fclose(csv);
+            printf("\nResults saved to %s\n", config->output_file);
+        }
+    }
+
+    free(curve);
+    free(rtts);
+    free(stream);
+    free(reply);
+    free(packet);
+    close(sock);
+    return status;
+}
@@ -0,0 +1,458 @@
+/**
+ * Redo transport (-W): chunked writes to a receiver that persists each one
+ * before acknowledging it
+ */
+
+#include "netperf.h"
+
+static const char* redo_sync_names[] = { "none", "dsync", "fsync", "direct" };
+
+static uint64_t redo_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * Open the redo file for a sync mode. The file is pre-zeroed to
+ * REDO_FILE_SIZE first, so durable writes never extend it and the commit
+ * path has no metadata update, as with a pre-created online redo log.
+ * Returns the fd, or -errno
+ */
+static int redo_open_file(const char* path, int sync_mode) {
+    struct stat st;
+    int fd = open(path, O_WRONLY | O_CREAT, 0600);
+    if (fd < 0) {
+        return -errno;
+    }
+    if (fstat(fd, &st) == 0 && st.st_size < REDO_FILE_SIZE) {
+        char* zeros = (char*)calloc(1, 1 << 20);
+        if (zeros == NULL) {
+            close(fd);
+            return -ENOMEM;
+        }
+        for (off_t off = 0; off < REDO_FILE_SIZE; off += 1 << 20) {
+            if (pwrite(fd, zeros, 1 << 20, off) != 1 << 20) {
+                int err = errno != 0 ? errno : ENOSPC;
+                free(zeros);
+                close(fd);
+                return -err;
+            }
+        }
+        free(zeros);
+        fsync(fd);
+    }
+    close(fd);
+
+    int flags = O_WRONLY;
+    if (sync_mode == REDO_SYNC_DSYNC) {
+        flags |= O_DSYNC;
+    } else if (sync_mode == REDO_SYNC_DIRECT) {
+        flags |= O_DIRECT | O_DSYNC;
+    }
+    fd = open(path, flags);
+    return fd < 0 ? -errno : fd;
+}
+
+/**
+ * One redo session: read chunks, write up to hello.group of those already
+ * queued on the socket with one write (+ fsync), then acknowledge each
+ */
+static void redo_serve_session(int client_fd, const char* path) {
+    redo_hello_t hello;
+    redo_chunk_t header;
+    redo_ack_t acks[REDO_MAX_GROUP];
+    uint64_t received_ns[REDO_MAX_GROUP];
+    latency_hist_t disk;
+    uint64_t chunks = 0, writes = 0;
+    off_t offset = 0;
+    int one = 1;
+
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (recv_all(client_fd, &hello, sizeof(hello)) <= 0 || hello.magic != REDO_MAGIC) {
+        printf("Not a redo client (-W), closing\n");
+        return;
+    }
+    if (hello.chunk_size < 1 || hello.chunk_size > REDO_MAX_CHUNK) {
+        hello.chunk_size = REDO_DEFAULT_CHUNK;
+    }
+    if (hello.group < 1 || hello.group > REDO_MAX_GROUP) {
+        hello.group = 1;
+    }
+    if (hello.sync_mode > REDO_SYNC_DIRECT) {
+        hello.sync_mode = REDO_SYNC_DSYNC;
+    }
+    // O_DIRECT needs block-aligned lengths: pad each chunk, like redo blocks
+    hello.write_size = hello.sync_mode == REDO_SYNC_DIRECT ?
+        (hello.chunk_size + REDO_ALIGN - 1) / REDO_ALIGN * REDO_ALIGN : hello.chunk_size;
+    int fd = redo_open_file(path, hello.sync_mode);
+    hello.status = fd < 0 ? -fd : 0;
+    uint8_t* buffer = NULL;
+    if (fd >= 0 && posix_memalign((void**)&buffer, REDO_ALIGN, (size_t)hello.group * hello.write_size) != 0) {
+        hello.status = ENOMEM;
+        buffer = NULL;
+    }
+    send_all(client_fd, &hello, sizeof(hello));
+    if (hello.status != 0) {
+        printf("Redo file %s (sync=%s): %s\n", path, redo_sync_names[hello.sync_mode], strerror(hello.status));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    memset(buffer, 0, (size_t)hello.group * hello.write_size);
+    printf("Redo session: %u-byte chunks to %s, sync=%s, group commit up to %u\n", hello.chunk_size, path,
+           redo_sync_names[hello.sync_mode], hello.group);
+    hist_init(&disk);
+
+    while (running) {
+        // The first chunk blocks; more are taken only while already queued
+        uint32_t batch = 0;
+        while (batch < hello.group) {
+            if (batch > 0) {
+                struct pollfd pfd = { client_fd, POLLIN, 0 };
+                if (poll(&pfd, 1, 0) <= 0) {
+                    break;
+                }
+            }
+            if (recv_all(client_fd, &header, sizeof(header)) <= 0 || header.size != hello.chunk_size ||
+                recv_all(client_fd, buffer + (size_t)batch * hello.write_size, header.size) <= 0) {
+                batch = 0;
+                break;
+            }
+            received_ns[batch] = redo_now_ns();
+            acks[batch].seq = header.seq;
+            batch++;
+        }
+        if (batch == 0) {
+            break;
+        }
+
+        size_t length = (size_t)batch * hello.write_size;
+        if (offset + (off_t)length > REDO_FILE_SIZE) {
+            offset = 0;
+        }
+        uint64_t start = redo_now_ns();
+        int status = pwrite(fd, buffer, length, offset) == (ssize_t)length ? 0 : (errno != 0 ? errno : EIO);
+        if (status == 0 && hello.sync_mode == REDO_SYNC_FSYNC && fsync(fd) < 0) {
+            status = errno;
+        }
+        uint64_t done = redo_now_ns();
+        offset += length;
+        hist_record(&disk, done - start);
+        writes++;
+        chunks += batch;
+        for (uint32_t i = 0; i < batch; i++) {
+            acks[i].disk_ns = done - start;
+            acks[i].hold_ns = redo_now_ns() - received_ns[i];
+            acks[i].batch = batch;
+            acks[i].status = status;
+        }
+        if (send_all(client_fd, acks, batch * sizeof(redo_ack_t)) < 0 || status != 0) {
+            if (status != 0) {
+                printf("Redo write failed: %s\n", strerror(status));
+            }
+            break;
+        }
+    }
+
+    if (writes > 0) {
+        printf("Redo session done: %lu chunks in %lu writes (%.2f per write), %.1f MB written\n",
+               (unsigned long)chunks, (unsigned long)writes, (double)chunks / writes,
+               (double)chunks * hello.write_size / 1048576.0);
+        printf("  Disk write%s: p50 %.1f us, p99 %.1f us, max %.1f us\n",
+               hello.sync_mode == REDO_SYNC_FSYNC ? " + fsync" : "", hist_percentile(&disk, 50) / 1000.0,
+               hist_percentile(&disk, 99) / 1000.0, disk.max_ns / 1000.0);
+    }
+    fflush(stdout);
+    free(buffer);
+    close(fd);
+}
+
+/**
+ * Redo receiver: one TCP session at a time, each writing to the -W file
+ * (or REDO_FILE_NAME inside a -W directory)
+ */
+int run_redo_server(config_t* config) {
+    struct sockaddr_storage address;
+    char path[512];
+    struct stat st;
+    int opt = 1;
+
+    if (stat(config->redo_spec, &st) == 0 && S_ISDIR(st.st_mode)) {
+        snprintf(path, sizeof(path), "%s/%s", config->redo_spec, REDO_FILE_NAME);
+    } else {
+        snprintf(path, sizeof(path), "%s", config->redo_spec);
+    }
+    int server_fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    int addr_size = init_socket_address(&address, NULL, config->port, config->use_ipv6);
+    if (server_fd < 0 || addr_size < 0 || setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        bind(server_fd, (struct sockaddr*)&address, addr_size) < 0 || listen(server_fd, SOMAXCONN) < 0) {
+        perror("Listen failed");
+        exit(EXIT_FAILURE);
+    }
+    register_server_socket(server_fd);
+    printf("Redo receiver on %s port %d, writing to %s (%d MB, reused circularly)\n",
+           config->use_ipv6 ? "IPv6" : "IPv4", config->port, path, REDO_FILE_SIZE >> 20);
+    config->ready = 1;
+
+    while (running) {
+        int client_fd = accept(server_fd, NULL, NULL);
+        if (client_fd < 0) {
+            if (running) {
+                perror("Accept failed");
+            }
+            break;
+        }
+        redo_serve_session(client_fd, path);
+        close(client_fd);
+    }
+    return 0;
+}
+
+/**
+ * Print a histogram as power-of-two microsecond bins with bars
+ */
+static void redo_print_distribution(const latency_hist_t* h) {
+    uint64_t bins[64] = { 0 };
+    uint64_t peak = 0;
+    int lo = 63, hi = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (h->counts[i] == 0) {
+            continue;
+        }
+        uint64_t us = hist_bucket_floor(i) / 1000;
+        int bin = 0;
+        while (bin < 63 && (2ULL << bin) <= us) {
+            bin++;
+        }
+        bins[bin] += h->counts[i];
+        lo = bin < lo ? bin : lo;
+        hi = bin > hi ? bin : hi;
+    }
+    for (int b = lo; b <= hi; b++) {
+        peak = bins[b] > peak ? bins[b] : peak;
+    }
+    for (int b = lo; b <= hi && peak > 0; b++) {
+        char range[48];
+        int width = (int)(40 * bins[b] / peak);
+        snprintf(range, sizeof(range), "%llu-%llu", b == 0 ? 0ULL : 1ULL << b, (2ULL << b) - 1);
+        printf("  %15s us %8lu |", range, (unsigned long)bins[b]);
+        for (int k = 0; k < width; k++) {
+            putchar('#');
+        }
+        putchar('\n');
+    }
+}
+
+/**
+ * Redo transport client: streams -n chunks at -r per second with up to
+ * group chunks unacknowledged (group 1 = Data Guard SYNC: each commit waits
+ * for the standby's durable write) and splits each commit-ack latency into
+ * network (total minus receiver hold time), receiver disk and receiver wait
+ */
+int run_redo_client(config_t* config) {
+    struct sockaddr_storage server_addr;
+    redo_hello_t hello;
+    uint64_t send_ns[REDO_MAX_GROUP];
+    int status = 0;
+    int one = 1;
+
+    // Parse "size[,group=n][,sync=mode]"
+    char spec[256];
+    strncpy(spec, config->redo_spec, sizeof(spec) - 1);
+    spec[sizeof(spec) - 1] = '\0';
+    memset(&hello, 0, sizeof(hello));
+    hello.magic = REDO_MAGIC;
+    hello.chunk_size = REDO_DEFAULT_CHUNK;
+    hello.group = 1;
+    hello.sync_mode = REDO_SYNC_DIRECT;
+    for (char* item = strtok(spec, ","); item != NULL; item = strtok(NULL, ",")) {
+        if (strncmp(item, "group=", 6) == 0) {
+            hello.group = atoi(item + 6);
+        } else if (strncmp(item, "sync=", 5) == 0) {
+            int mode;
+            for (mode = 0; mode <= REDO_SYNC_DIRECT && strcmp(item + 5, redo_sync_names[mode]) != 0; mode++) {
+            }
+            if (mode > REDO_SYNC_DIRECT) {
+                fprintf(stderr, "Unknown sync mode '%s' (use direct, dsync, fsync or none)\n", item + 5);
+                return -1;
+            }
+            hello.sync_mode = mode;
+        } else if (atoi(item) > 0) {
+            hello.chunk_size = atoi(item);
+        } else {
+            fprintf(stderr, "Bad -W setting '%s'\n", item);
+            return -1;
+        }
+    }
+    hello.chunk_size = hello.chunk_size > REDO_MAX_CHUNK ? REDO_MAX_CHUNK : hello.chunk_size;
+    hello.group = hello.group < 1 ? 1 : hello.group > REDO_MAX_GROUP ? REDO_MAX_GROUP : hello.group;
+
+    int sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (sock < 0 || addr_size < 0 || connect(sock, (struct sockaddr*)&server_addr, addr_size) < 0) {
+        perror("Connection failed");
+        if (sock >= 0) {
+            close(sock);
+        }
+        return -1;
+    }
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (send_all(sock, &hello, sizeof(hello)) < 0 || recv_all(sock, &hello, sizeof(hello)) <= 0 ||
+        hello.magic != REDO_MAGIC) {
+        fprintf(stderr, "No redo receiver on %s:%d (start it with -s -W path)\n", config->server_ip, config->port);
+        close(sock);
+        return -1;
+    }
+    if (hello.status != 0) {
+        fprintf(stderr, "Receiver could not prepare its redo file with sync=%s: %s%s\n",
+                redo_sync_names[hello.sync_mode], strerror(hello.status),
+                hello.sync_mode == REDO_SYNC_DIRECT && hello.status == EINVAL ?
+                    " (the file system does not support O_DIRECT, e.g. tmpfs)" : "");
+        close(sock);
+        return -1;
+    }
+
+    int interval_us = config->rate_pps > 0 ? 1000000 / config->rate_pps : config->delay_ms * 1000;
+    printf("Redo transport to %s:%d: %d chunks of %u bytes, sync=%s, up to %u in flight",
+           config->server_ip, config->port, config->num_packets, hello.chunk_size,
+           redo_sync_names[hello.sync_mode], hello.group);
+    if (interval_us > 0) {
+        printf(", %d per second", 1000000 / interval_us);
+    }
+    printf("\n");
+    if (hello.write_size != hello.chunk_size) {
+        printf("O_DIRECT: the receiver pads each chunk to %u bytes\n", hello.write_size);
+    }
+
+    size_t frame = sizeof(redo_chunk_t) + hello.chunk_size;
+    uint8_t* chunk = (uint8_t*)malloc(frame);
+    latency_hist_t* hists = (latency_hist_t*)malloc(4 * sizeof(latency_hist_t));
+    float* rows = config->output_file[0] != '\0' ? (float*)calloc((size_t)config->num_packets * 5, sizeof(float))
+                                                  : NULL;
+    if (chunk == NULL || hists == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = sizeof(redo_chunk_t); i < frame; i++) {
+        chunk[i] = (uint8_t)i;
+    }
+    latency_hist_t* network = &hists[0];
+    latency_hist_t* disk = &hists[1];
+    latency_hist_t* wait = &hists[2];
+    latency_hist_t* total = &hists[3];
+    for (int h = 0; h < 4; h++) {
+        hist_init(&hists[h]);
+    }
+
+    int sent = 0, acked = 0, inflight = 0;
+    uint64_t batch_sum = 0;
+    uint64_t start = redo_now_ns();
+    uint64_t next_send = start;
+    while (acked < config->num_packets && running) {
+        uint64_t now = redo_now_ns();
+        while (sent < config->num_packets && inflight < (int)hello.group && now >= next_send) {
+            redo_chunk_t* header = (redo_chunk_t*)chunk;
+            header->seq = sent + 1;
+            header->client_send = now;
+            header->size = hello.chunk_size;
+            send_ns[header->seq % REDO_MAX_GROUP] = now;
+            if (send_all(sock, chunk, frame) < 0) {
+                printf("Receiver disconnected\n");
+                status = -1;
+                break;
+            }
+            sent++;
+            inflight++;
+            // A full window delays later commits rather than bunching them up
+            next_send += (uint64_t)interval_us * 1000;
+            next_send = next_send < now ? now : next_send;
+        }
+        if (status != 0) {
+            break;
+        }
+
+        int timeout_ms = 1000;
+        if (sent < config->num_packets && inflight < (int)hello.group) {
+            timeout_ms = next_send > now ? (int)((next_send - now + 999999) / 1000000) : 0;
+        }
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (poll(&pfd, 1, timeout_ms) <= 0) {
+            continue;
+        }
+        redo_ack_t ack;
+        if (recv_all(sock, &ack, sizeof(ack)) <= 0) {
+            printf("Receiver disconnected after %d acknowledgements\n", acked);
+            status = -1;
+            break;
+        }
+        if (ack.status != 0) {
+            printf("Receiver write failed: %s\n", strerror(ack.status));
+            status = -1;
+            break;
+        }
+        uint64_t total_ns = redo_now_ns() - send_ns[ack.seq % REDO_MAX_GROUP];
+        uint64_t network_ns = total_ns > ack.hold_ns ? total_ns - ack.hold_ns : 0;
+        uint64_t wait_ns = ack.hold_ns > ack.disk_ns ? ack.hold_ns - ack.disk_ns : 0;
+        hist_record(total, total_ns);
+        hist_record(network, network_ns);
+        hist_record(disk, ack.disk_ns);
+        hist_record(wait, wait_ns);
+        if (rows != NULL && acked < config->num_packets) {
+            float* row = &rows[(size_t)acked * 5];
+            row[0] = total_ns / 1000.0f;
+            row[1] = network_ns / 1000.0f;
+            row[2] = ack.disk_ns / 1000.0f;
+            row[3] = wait_ns / 1000.0f;
+            row[4] = (float)ack.batch;
+        }
+        batch_sum += ack.batch;
+        acked++;
+        inflight--;
+    }
+    double elapsed = (redo_now_ns() - start) / 1e9;
+
+    printf("\n--- Commit-Ack Latency (%d chunks, us) ---\n", acked);
+    printf("  %-26s %9s %9s %9s %9s %9s %9s\n", "component", "min", "p50", "p90", "p99", "p99.9", "max");
+    const char* labels[] = { "network + transfer", "receiver disk write", "receiver batch wait", "total commit-ack" };
+    for (int h = 0; h < 4 && acked > 0; h++) {
+        printf("  %-26s %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", labels[h], hists[h].min_ns / 1000.0,
+               hist_percentile(&hists[h], 50) / 1000.0, hist_percentile(&hists[h], 90) / 1000.0,
+               hist_percentile(&hists[h], 99) / 1000.0, hist_percentile(&hists[h], 99.9) / 1000.0,
+               hists[h].max_ns / 1000.0);
+    }
+    if (acked > 0) {
+        double p50_total = hist_percentile(total, 50);
+        printf("  Disk is %.0f%% of the p50 commit-ack time; %.2f chunks per receiver write\n",
+               p50_total > 0 ? 100.0 * hist_percentile(disk, 50) / p50_total : 0.0, (double)batch_sum / acked);
+        printf("  Throughput: %.0f commits/s, %.2f MB/s of redo\n", acked / elapsed,
+               acked * (double)hello.chunk_size / elapsed / 1048576.0);
+        printf("\nTotal commit-ack distribution:\n");
+        redo_print_distribution(total);
+    }
+    if (acked < config->num_packets) {
+        status = -1;
+    }
+
+    if (rows != NULL) {
+        FILE* csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "chunk,total_us,network_us,disk_us,wait_us,batch\n");
+            for (int i = 0; i < acked; i++) {
+                float* row = &rows[(size_t)i * 5];
+                fprintf(csv, "%d,%.1f,%.1f,%.1f,%.1f,%.0f\n", i + 1, row[0], row[1], row[2], row[3], row[4]);
+            }
+            fclose(csv);
+            printf("\nResults saved to %s\n", config->output_file);
+        }
+    }
+
+    free(rows);
+    free(hists);
+    free(chunk);
+    close(sock);
+    return status;
+}
@@ -0,0 +1,496 @@
+/**
+ * TCP and UDP reflectors (-s): worker threads that echo probes back
+ */
+
+#include "netperf.h"
+
+/**
+ * Reflector worker - TCP protocol
+ * Accepts from the shared listening socket and serves one connection at a time
+ */
+void* tcp_reflector_worker(void* arg) {
+    reflector_worker_t* worker = (reflector_worker_t*)arg;
+    config_t* config = worker->config;
+    struct sockaddr_storage address;
+    socklen_t addrlen;
+    packet_t* packet_buffer;
+    
+    // Allocate packet buffer for maximum possible size, on the worker's node if placed
+    if (worker->node >= 0) {
+        char role[32];
+        snprintf(role, sizeof(role), "reflector worker %d", worker->index);
+        packet_buffer = numa_place_thread(worker->node, role, MAX_PACKET_SIZE);
+    } else {
+        packet_buffer = create_packet(MAX_PACKET_SIZE);
+    }
+    busy_poll_init(&worker->busy, config->busy_poll);
+    if (config->rt_profile) {
+        char role[32];
+        snprintf(role, sizeof(role), "reflector worker %d", worker->index);
+        rt_profile_apply_thread(config, worker->index, role);
+    }
+    
+    if (config->perf_counters) {
+        perf_counters_open(&worker->counters);
+        perf_counters_start(&worker->counters);
+    }
+    
+    while (running) {
+        // Accept connection
+        addrlen = sizeof(address);
+        int client_fd = accept(worker->fd, (struct sockaddr*)&address, &addrlen);
+        if (client_fd < 0) {
+            if (running) {  // Only show error if we're still supposed to be running
+                perror("Accept failed");
+            }
+            break;
+        }
+        
+        // Get client address information
+        char client_str[INET6_ADDRSTRLEN];
+        int client_port = 0;
+        
+        if (address.ss_family == AF_INET6) {
+            struct sockaddr_in6* addr6 = (struct sockaddr_in6*)&address;
+            inet_ntop(AF_INET6, &addr6->sin6_addr, client_str, sizeof(client_str));
+            client_port = ntohs(addr6->sin6_port);
+        } else {
+            struct sockaddr_in* addr4 = (struct sockaddr_in*)&address;
+            inet_ntop(AF_INET, &addr4->sin_addr, client_str, sizeof(client_str));
+            client_port = ntohs(addr4->sin_port);
+        }
+        
+        printf("TCP connection accepted from [%s]:%d\n", client_str, client_port);
+        tls_conn_t* tls = NULL;
+        if (config->tls && tls_accept(client_fd, worker, &tls) < 0) {
+            close(client_fd);
+            continue;
+        }
+        // Pipelined probes (-L) would otherwise hold each reply until the previous one is acked
+        int nodelay = 1;
+        setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+        busy_poll_enable(client_fd, &worker->busy, config->busy_poll_us);
+
+        // Process incoming packets
+        uint64_t packet_count = 0;
+        while (running) {
+            // Receive packet header first to determine size
+            if (worker->busy.enabled && busy_poll_wait(client_fd, &worker->busy, -1) < 0) {
+                break;
+            }
+            if (stream_recv_all(client_fd, tls, packet_buffer, sizeof(packet_t)) <= 0) {
+                break;
+            }
+            
+            // Handle synchronization packets
+            if (packet_buffer->seq_num >= 0xFFFFFFFF - 20) {
+                // This is a sync packet, just timestamp and return
+                packet_buffer->server_recv = get_timestamp_usec();
+                packet_buffer->server_send = get_timestamp_usec();
+                stream_send_all(client_fd, tls, packet_buffer, sizeof(packet_t));
+                continue;
+            }
+            
+            // Then receive the rest of the packet if needed
+            if (packet_buffer->packet_size < sizeof(packet_t) ||
+                packet_buffer->packet_size > MAX_PACKET_SIZE) {
+                printf("Invalid packet size %u, dropping connection\n", packet_buffer->packet_size);
+                break;
+            }
+            int remaining_bytes = packet_buffer->packet_size - sizeof(packet_t);
+            if (remaining_bytes > 0 &&
+                stream_recv_all(client_fd, tls, ((char*)packet_buffer) + sizeof(packet_t), remaining_bytes) <= 0) {
+                printf("Client disconnected after %lu packets\n", packet_count);
+                break;
+            }
+            
+            // Update server timestamps
+            packet_buffer->server_recv = get_timestamp_usec();
+            if (worker->node >= 0) {
+                int cpu;
+                int node = numa_current_node(&cpu);
+                packet_buffer->server_node = node >= 0 ? node : NUMA_NODE_UNKNOWN;
+                packet_buffer->server_cpu = cpu;
+            }
+            packet_buffer->server_send = get_timestamp_usec();
+            
+            // Send packet back to client
+            if (stream_send_all(client_fd, tls, packet_buffer, packet_buffer->packet_size) < 0) {
+                break;
+            }
+            packet_count++;
+        }
+        
+        // Close client socket
+        tls_close(tls);
+        close(client_fd);
+        worker->packets += packet_count;
+    }
+    
+    if (config->perf_counters) {
+        perf_counters_stop(&worker->counters);
+    }
+    free(packet_buffer);
+    return NULL;
+}
+
+/**
+ * Server implementation - TCP protocol
+ */
+int run_tcp_server(config_t* config) {
+    int server_fd;
+    struct sockaddr_storage address;
+    int opt = 1;
+    uint64_t total_packets = 0;
+    overhead_sample_t usage_start, usage_end;
+    noise_sampler_t noise;
+    hostmon_t host;
+    int nworkers = config->workers > 0 ? config->workers : 1;
+    reflector_worker_t* workers;
+    
+    workers = (reflector_worker_t*)calloc(nworkers, sizeof(reflector_worker_t));
+    if (workers == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Create socket
+    server_fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        perror("Socket creation failed");
+        free(workers);
+        exit(EXIT_FAILURE);
+    }
+    
+    // Set socket options
+    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt failed");
+        free(workers);
+        close(server_fd);
+        exit(EXIT_FAILURE);
+    }
+    
+    // Setup address structure
+    int addr_size = init_socket_address(&address, NULL, config->port, config->use_ipv6);
+    if (addr_size < 0) {
+        close(server_fd);
+        free(workers);
+        exit(EXIT_FAILURE);
+    }
+    
+    // Bind socket
+    if (bind(server_fd, (struct sockaddr*)&address, addr_size) < 0) {
+        perror("Bind failed");
+        close(server_fd);
+        free(workers);
+        exit(EXIT_FAILURE);
+    }
+    
+    // Listen for connections
+    if (listen(server_fd, SOMAXCONN) < 0) {
+        perror("Listen failed");
+        close(server_fd);
+        free(workers);
+        exit(EXIT_FAILURE);
+    }
+    
+    if (config->tls && tls_init(config, 1) < 0) {
+        close(server_fd);
+        free(workers);
+        exit(EXIT_FAILURE);
+    }
+    
+    register_server_socket(server_fd);  // For signal handler
+    printf("TCP server started. Listening on %s port %d with %d worker%s%s...\n", 
+           config->use_ipv6 ? "IPv6" : "IPv4", config->port, nworkers, nworkers > 1 ? "s" : "",
+           config->tls ? " (TLS and plain TCP)" : "");
+    overhead_sample(&usage_start);
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_start(&noise, config->noise_interval_ms);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_start(&host, config->host_spec);
+    }
+    
+    // Worker 0 runs on this thread, the rest get their own
+    for (int w = 0; w < nworkers; w++) {
+        workers[w].config = config;
+        workers[w].fd = server_fd;
+        workers[w].index = w;
+    }
+    numa_assign_workers(config, workers, nworkers);
+    config->ready = 1;
+    for (int w = 1; w < nworkers; w++) {
+        if (pthread_create(&workers[w].thread, NULL, tcp_reflector_worker, &workers[w]) != 0) {
+            perror("Failed to start reflector worker");
+            exit(EXIT_FAILURE);
+        }
+    }
+    tcp_reflector_worker(&workers[0]);
+    for (int w = 1; w < nworkers; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+    
+    for (int w = 0; w < nworkers; w++) {
+        total_packets += workers[w].packets;
+    }
+    if (config->result != NULL) {
+        config->result->packets_received = (int)total_packets;
+    }
+    overhead_sample(&usage_end);
+    int status = overhead_report("reflector", &usage_start, &usage_end, total_packets,
+                                 config->overhead_budget);
+    if (config->perf_counters) {
+        for (int w = 0; w < nworkers; w++) {
+            char role[32];
+            snprintf(role, sizeof(role), nworkers > 1 ? "reflector worker %d" : "reflector", w);
+            perf_counters_report(role, &workers[w].counters, workers[w].packets);
+            perf_counters_close(&workers[w].counters);
+        }
+    }
+    if (config->busy_poll) {
+        for (int w = 0; w < nworkers; w++) {
+            char role[32];
+            snprintf(role, sizeof(role), nworkers > 1 ? "reflector worker %d" : "reflector", w);
+            busy_poll_report(role, &workers[w].busy);
+        }
+    }
+    if (config->tls) {
+        tls_server_report(workers, nworkers);
+    }
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_stop(&noise);
+        host_noise_report(&noise, NULL, NULL, 0);
+        noise_sampler_free(&noise);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_stop(&host);
+        host_metrics_report(&host, NULL, NULL, 0);
+        hostmon_free(&host);
+    }
+    
+    // Clean up
+    close(server_fd);
+    free(workers);
+    printf("TCP server shutdown complete\n");
+    return status;
+}
+
+/**
+ * Reflector worker - UDP protocol
+ * Each worker owns a socket; with several workers they share the port via SO_REUSEPORT
+ */
+void* udp_reflector_worker(void* arg) {
+    reflector_worker_t* worker = (reflector_worker_t*)arg;
+    config_t* config = worker->config;
+    struct sockaddr_storage client_addr;
+    socklen_t addr_len;
+    packet_t* packet_buffer;
+    
+    // Allocate packet buffer for maximum possible size, on the worker's node if placed
+    if (worker->node >= 0) {
+        char role[32];
+        snprintf(role, sizeof(role), "reflector worker %d", worker->index);
+        packet_buffer = numa_place_thread(worker->node, role, MAX_PACKET_SIZE);
+    } else {
+        packet_buffer = create_packet(MAX_PACKET_SIZE);
+    }
+    busy_poll_init(&worker->busy, config->busy_poll);
+    if (config->rt_profile) {
+        char role[32];
+        snprintf(role, sizeof(role), "reflector worker %d", worker->index);
+        rt_profile_apply_thread(config, worker->index, role);
+    }
+    
+    if (config->perf_counters) {
+        perf_counters_open(&worker->counters);
+        perf_counters_start(&worker->counters);
+    }
+    
+    // Process incoming datagrams
+    busy_poll_enable(worker->fd, &worker->busy, config->busy_poll_us);
+    while (running) {
+        addr_len = sizeof(client_addr);
+        
+        // Receive datagram
+        if (worker->busy.enabled && busy_poll_wait(worker->fd, &worker->busy, -1) <= 0) {
+            continue;
+        }
+        int bytes_received = recv_with_telemetry(worker->fd, packet_buffer, MAX_PACKET_SIZE,
+                                                 &client_addr, &addr_len, &worker->telemetry);
+        
+        if (bytes_received <= 0) {
+            if (running && errno != EINTR) {
+                perror("UDP receive error");
+            }
+            continue;
+        }
+        if (bytes_received < (int)sizeof(packet_t)) {
+            continue;  // Runt datagram, not one of ours
+        }
+        
+        // Update server timestamps
+        packet_buffer->server_recv = get_timestamp_usec();
+        packet_buffer->server_drops = worker->telemetry.rx_drops;
+        if (worker->node >= 0) {
+            int cpu;
+            int node = numa_current_node(&cpu);
+            packet_buffer->server_node = node >= 0 ? node : NUMA_NODE_UNKNOWN;
+            packet_buffer->server_cpu = cpu;
+        }
+        packet_buffer->server_send = get_timestamp_usec();
+        
+        // Send response back to the client (never more than was received)
+        if (packet_buffer->packet_size > (uint32_t)bytes_received) {
+            packet_buffer->packet_size = bytes_received;
+        }
+        sendto(worker->fd, packet_buffer, packet_buffer->packet_size, 0,
+              (struct sockaddr*)&client_addr, addr_len);
+        if (++worker->packets % QUEUE_SAMPLE_EVERY == 0) {
+            sock_telemetry_sample_queues(worker->fd, &worker->telemetry);
+        }
+    }
+    
+    if (config->perf_counters) {
+        perf_counters_stop(&worker->counters);
+    }
+    free(packet_buffer);
+    return NULL;
+}
+
+/**
+ * Server implementation - UDP protocol
+ */
+int run_udp_server(config_t* config) {
+    uint64_t total_packets = 0;
+    overhead_sample_t usage_start, usage_end;
+    noise_sampler_t noise;
+    hostmon_t host;
+    int nworkers = config->workers > 0 ? config->workers : 1;
+    reflector_worker_t* workers;
+    
+#ifndef SO_REUSEPORT
+    if (nworkers > 1) {
+        printf("Warning: SO_REUSEPORT not available, using a single UDP worker\n");
+        nworkers = 1;
+    }
+#endif
+    
+    workers = (reflector_worker_t*)calloc(nworkers, sizeof(reflector_worker_t));
+    if (workers == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    
+    // Setup address structure
+    struct sockaddr_storage server_addr;
+    int addr_size = init_socket_address(&server_addr, NULL, config->port, config->use_ipv6);
+    if (addr_size < 0) {
+        free(workers);
+        exit(EXIT_FAILURE);
+    }
+    
+    for (int w = 0; w < nworkers; w++) {
+        // Create socket
+        int server_fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+        if (server_fd < 0) {
+            perror("Socket creation failed");
+            exit(EXIT_FAILURE);
+        }
+#ifdef SO_REUSEPORT
+        if (nworkers > 1) {
+            int opt = 1;
+            if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+                perror("setsockopt SO_REUSEPORT failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+#endif
+        sock_telemetry_enable(server_fd, &workers[w].telemetry);
+        
+        // Bind socket
+        if (bind(server_fd, (struct sockaddr*)&server_addr, addr_size) < 0) {
+            perror("Bind failed");
+            close(server_fd);
+            exit(EXIT_FAILURE);
+        }
+        
+        register_server_socket(server_fd);  // For signal handler
+        workers[w].config = config;
+        workers[w].fd = server_fd;
+        workers[w].index = w;
+    }
+    numa_assign_workers(config, workers, nworkers);
+    
+    printf("UDP server started. Listening on %s port %d with %d worker%s...\n", 
+           config->use_ipv6 ? "IPv6" : "IPv4", config->port, nworkers, nworkers > 1 ? "s" : "");
+    overhead_sample(&usage_start);
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_start(&noise, config->noise_interval_ms);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_start(&host, config->host_spec);
+    }
+    
+    // Worker 0 runs on this thread, the rest get their own
+    config->ready = 1;
+    for (int w = 1; w < nworkers; w++) {
+        if (pthread_create(&workers[w].thread, NULL, udp_reflector_worker, &workers[w]) != 0) {
+            perror("Failed to start reflector worker");
+            exit(EXIT_FAILURE);
+        }
+    }
+    udp_reflector_worker(&workers[0]);
+    for (int w = 1; w < nworkers; w++) {
+        pthread_join(workers[w].thread, NULL);
+    }
+    
+    for (int w = 0; w < nworkers; w++) {
+        total_packets += workers[w].packets;
+    }
+    if (config->result != NULL) {
+        config->result->packets_received = (int)total_packets;
+    }
+    overhead_sample(&usage_end);
+    int status = overhead_report("reflector", &usage_start, &usage_end, total_packets,
+                                 config->overhead_budget);
+    if (config->perf_counters) {
+        for (int w = 0; w < nworkers; w++) {
+            char role[32];
+            snprintf(role, sizeof(role), nworkers > 1 ? "reflector worker %d" : "reflector", w);
+            perf_counters_report(role, &workers[w].counters, workers[w].packets);
+            perf_counters_close(&workers[w].counters);
+        }
+    }
+    if (config->busy_poll) {
+        for (int w = 0; w < nworkers; w++) {
+            char role[32];
+            snprintf(role, sizeof(role), nworkers > 1 ? "reflector worker %d" : "reflector", w);
+            busy_poll_report(role, &workers[w].busy);
+        }
+    }
+    if (config->noise_interval_ms > 0) {
+        noise_sampler_stop(&noise);
+        host_noise_report(&noise, NULL, NULL, 0);
+        noise_sampler_free(&noise);
+    }
+    if (config->host_spec[0] != '\0') {
+        hostmon_stop(&host);
+        host_metrics_report(&host, NULL, NULL, 0);
+        hostmon_free(&host);
+    }
+    printf("\nSocket telemetry:\n");
+    for (int w = 0; w < nworkers; w++) {
+        char role[32];
+        snprintf(role, sizeof(role), nworkers > 1 ? "Reflector worker %d" : "Reflector", w);
+        sock_telemetry_report(role, &workers[w].telemetry);
+    }
+    
+    // Clean up
+    for (int w = 0; w < nworkers; w++) {
+        close(workers[w].fd);
+    }
+    free(workers);
+    printf("UDP server shutdown complete\n");
+    return status;
+}
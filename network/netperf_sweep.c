@@ -0,0 +1,1055 @@
+/**
+ * Probe size sweep (-S), socket option sweep (-O) and path MTU discovery (-m)
+ */
+
+#include "netperf.h"
+
+/**
+ * Parse a size sweep spec: comma-separated sizes, ranges "from-to[:step]"
+ * (default 8 steps) and "mtu" for sizes around the path's one-packet limit.
+ * Returns the number of sizes, sorted and de-duplicated
+ */
+int sweep_parse_sizes(const char* spec, int mtu_payload, int* sizes, int max_sizes) {
+    char buffer[256];
+    int count = 0;
+
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    for (char* item = strtok(buffer, ","); item != NULL; item = strtok(NULL, ",")) {
+        int from, to, step = 0;
+        if (strcmp(item, "mtu") == 0) {
+            int around[] = { -64, -16, -1, 0, 1, 16, 64 };
+            for (int k = 0; k < 7 && count < max_sizes; k++) {
+                sizes[count++] = mtu_payload + around[k];
+            }
+            continue;
+        }
+        if (sscanf(item, "%d-%d:%d", &from, &to, &step) >= 2 && to >= from) {
+            if (step <= 0) {
+                step = (to - from) / SWEEP_DEFAULT_STEPS > 0 ? (to - from) / SWEEP_DEFAULT_STEPS : 1;
+            }
+            for (int size = from; size <= to && count < max_sizes; size += step) {
+                sizes[count++] = size;
+            }
+        } else if (count < max_sizes) {
+            sizes[count++] = atoi(item);
+        }
+    }
+
+    // Clamp, sort and drop duplicates
+    for (int i = 0; i < count; i++) {
+        if (sizes[i] < MIN_PACKET_SIZE) {
+            sizes[i] = MIN_PACKET_SIZE;
+        } else if (sizes[i] > MAX_PACKET_SIZE) {
+            sizes[i] = MAX_PACKET_SIZE;
+        }
+    }
+    for (int i = 1; i < count; i++) {
+        for (int j = i; j > 0 && sizes[j - 1] > sizes[j]; j--) {
+            int tmp = sizes[j];
+            sizes[j] = sizes[j - 1];
+            sizes[j - 1] = tmp;
+        }
+    }
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique == 0 || sizes[unique - 1] != sizes[i]) {
+            sizes[unique++] = sizes[i];
+        }
+    }
+    return unique;
+}
+
+/**
+ * Least-squares line through (x, y); returns 0 if fewer than two distinct x
+ */
+int sweep_fit(const double* x, const double* y, int n, double* intercept, double* slope) {
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    for (int i = 0; i < n; i++) {
+        sx += x[i];
+        sy += y[i];
+        sxx += x[i] * x[i];
+        sxy += x[i] * y[i];
+    }
+    double denom = n * sxx - sx * sx;
+    if (n < 2 || denom <= 0) {
+        return 0;
+    }
+    *slope = (n * sxy - sx * sy) / denom;
+    *intercept = (sy - *slope * sx) / n;
+    return 1;
+}
+
+/**
+ * The largest probe that still fits in one datagram (UDP) or one segment (TCP)
+ */
+static int sweep_mtu_payload(int sock, config_t* config) {
+    int value = 0;
+    socklen_t len = sizeof(value);
+    if (config->protocol == PROTOCOL_TCP) {
+#ifdef TCP_MAXSEG
+        if (getsockopt(sock, IPPROTO_TCP, TCP_MAXSEG, &value, &len) == 0 && value > 0) {
+            return value;
+        }
+#endif
+        return 1500 - (config->use_ipv6 ? 60 : 40);
+    }
+#if defined(__linux__) && defined(IP_MTU)
+    if (!config->use_ipv6 && getsockopt(sock, IPPROTO_IP, IP_MTU, &value, &len) == 0 && value > 0) {
+        return value - 28;
+    }
+#endif
+#if defined(__linux__) && defined(IPV6_MTU)
+    if (config->use_ipv6 && getsockopt(sock, IPPROTO_IPV6, IPV6_MTU, &value, &len) == 0 && value > 0) {
+        return value - 48;
+    }
+#endif
+    return 1500 - (config->use_ipv6 ? 48 : 28);
+}
+
+/**
+ * Send one probe of size bytes on a connected socket and wait for its echo,
+ * into packet. UDP waits at most timeout_ms and skips replies to earlier,
+ * timed-out probes; TCP blocks. The round trip is now - packet->client_send
+ */
+static int probe_exchange(int sock, packet_t* packet, int size, uint64_t seq, int tcp, int timeout_ms) {
+    packet->seq_num = seq;
+    packet->packet_size = size;
+    packet->client_send = get_timestamp_usec();
+    if (tcp) {
+        if (send_all(sock, packet, size) < 0 || recv_all(sock, packet, sizeof(packet_t)) <= 0 ||
+            packet->packet_size != (uint32_t)size ||
+            recv_all(sock, (char*)packet + sizeof(packet_t), size - sizeof(packet_t)) <= 0) {
+            return PROBE_DISCONNECTED;
+        }
+        return validate_packet(packet) ? PROBE_REPLY : PROBE_LOST;
+    }
+
+    if (send(sock, packet, size, 0) < 0) {
+        return PROBE_ERROR;
+    }
+    uint64_t deadline = packet->client_send + timeout_ms * 1000ULL;
+    for (;;) {
+        uint64_t now = get_timestamp_usec();
+        if (now >= deadline || !running) {
+            return PROBE_LOST;
+        }
+        struct pollfd pfd = { sock, POLLIN, 0 };
+        if (poll(&pfd, 1, (int)((deadline - now + 999) / 1000)) <= 0) {
+            continue;
+        }
+        if (pfd.revents & POLLERR) {
+            // Reading the pending error clears it
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(sock, SOL_SOCKET, SO_ERROR, &err, &len);
+            errno = err;
+            return PROBE_ERROR;
+        }
+        ssize_t n = recv(sock, packet, size, MSG_DONTWAIT);
+        if (n == size && packet->seq_num == seq && validate_packet(packet)) {
+            return PROBE_REPLY;
+        }
+    }
+}
+
+/**
+ * Size sweep client: one connection and one max-size buffer, -n probes per
+ * size, per-size percentiles and a fitted base latency and per-byte cost
+ */
+int run_size_sweep(config_t* config) {
+    struct sockaddr_storage server_addr;
+    int sizes[SWEEP_MAX_SIZES];
+    sweep_point_t points[SWEEP_MAX_SIZES];
+    int status = 0;
+    uint64_t seq = 0;
+    int connected = 1;
+    int measured = 0;
+
+    int sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET,
+                      config->protocol == PROTOCOL_TCP ? SOCK_STREAM : SOCK_DGRAM, 0);
+    int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (sock < 0 || addr_size < 0 || connect(sock, (struct sockaddr*)&server_addr, addr_size) < 0) {
+        perror("Connection failed");
+        if (sock >= 0) {
+            close(sock);
+        }
+        return -1;
+    }
+    int mtu_payload = sweep_mtu_payload(sock, config);
+    int nsizes = sweep_parse_sizes(config->sweep_sizes, mtu_payload, sizes, SWEEP_MAX_SIZES);
+    if (mtu_payload >= MAX_PACKET_SIZE && strstr(config->sweep_sizes, "mtu") != NULL) {
+        printf("Note: the one-packet limit (%d) is above the largest probe (%d); 'mtu' sizes are clamped\n",
+               mtu_payload, MAX_PACKET_SIZE);
+    }
+    if (nsizes == 0) {
+        fprintf(stderr, "No sizes in sweep '%s'\n", config->sweep_sizes);
+        close(sock);
+        return -1;
+    }
+
+    packet_t* packet = create_packet(MAX_PACKET_SIZE);
+    double* rtts = (double*)malloc(config->num_packets * sizeof(double));
+    if (rtts == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int interval_us = config->rate_pps > 0 ? 1000000 / config->rate_pps : config->delay_ms * 1000;
+    printf("Size sweep over %s to %s:%d: %d sizes x %d probes, one-packet limit %d bytes\n",
+           config->protocol == PROTOCOL_TCP ? "TCP" : "UDP", config->server_ip, config->port,
+           nsizes, config->num_packets, mtu_payload);
+    printf("\n  %8s %8s %6s %10s %10s %10s %10s %10s\n", "size", "replies", "lost", "min us", "p50 us",
+           "p90 us", "p99 us", "max us");
+
+    for (int s = 0; s < nsizes && running && connected; s++) {
+        sweep_point_t* pt = &points[s];
+        memset(pt, 0, sizeof(sweep_point_t));
+        pt->size = sizes[s];
+        measured = s + 1;
+        for (int i = 0; i < config->num_packets && running; i++) {
+            pt->sent++;
+            int result = probe_exchange(sock, packet, pt->size, ++seq, config->protocol == PROTOCOL_TCP,
+                                        SWEEP_TIMEOUT_MS);
+            if (result == PROBE_DISCONNECTED) {
+                printf("Server disconnected\n");
+                connected = 0;
+                break;
+            }
+            if (result == PROBE_REPLY) {
+                rtts[pt->received++] = get_timestamp_usec() - packet->client_send;
+            }
+            if (interval_us > 0) {
+                usleep(interval_us);
+            }
+        }
+
+        if (pt->received > 0) {
+            qsort(rtts, pt->received, sizeof(double), compare_doubles);
+            pt->min_us = rtts[0];
+            pt->p50_us = sorted_percentile(rtts, pt->received, 50);
+            pt->p90_us = sorted_percentile(rtts, pt->received, 90);
+            pt->p99_us = sorted_percentile(rtts, pt->received, 99);
+            pt->max_us = rtts[pt->received - 1];
+        }
+        printf("  %8d %8d %6d %10.1f %10.1f %10.1f %10.1f %10.1f%s\n", pt->size, pt->received,
+               pt->sent - pt->received, pt->min_us, pt->p50_us, pt->p90_us, pt->p99_us, pt->max_us,
+               pt->size == mtu_payload + 1 ? "  <- first size over one packet" : "");
+        fflush(stdout);
+        if (pt->received < pt->sent) {
+            status = -1;
+        }
+    }
+
+    // Fit p50 against size over all sizes, then each side of the one-packet limit
+    double x[SWEEP_MAX_SIZES], y[SWEEP_MAX_SIZES];
+    int n = 0, below = 0;
+    for (int s = 0; s < measured; s++) {
+        if (points[s].received > 0) {
+            x[n] = points[s].size;
+            y[n] = points[s].p50_us;
+            below += points[s].size <= mtu_payload;
+            n++;
+        }
+    }
+    double base, per_byte;
+    printf("\n--- Latency vs Size (p50 fit) ---\n");
+    if (sweep_fit(x, y, n, &base, &per_byte)) {
+        printf("  Base latency: %.2f us, per-byte cost: %.4f ns", base, per_byte * 1000.0);
+        if (per_byte > 0) {
+            // Each probe crosses the path twice per round trip
+            printf(" (~%.0f Mbit/s serialization)", 16.0 / per_byte);
+        }
+        printf("\n");
+    } else {
+        printf("  Need at least two sizes with replies to fit\n");
+    }
+    double base_lo, slope_lo, base_hi, slope_hi;
+    if (below >= 2 && n - below >= 2 && sweep_fit(x, y, below, &base_lo, &slope_lo) &&
+        sweep_fit(x + below, y + below, n - below, &base_hi, &slope_hi)) {
+        double step = (base_hi + slope_hi * (mtu_payload + 1)) - (base_lo + slope_lo * mtu_payload);
+        printf("  Up to %d bytes: %.2f us + %.4f ns/byte; above: %.2f us + %.4f ns/byte\n",
+               mtu_payload, base_lo, slope_lo * 1000.0, base_hi, slope_hi * 1000.0);
+        printf("  Step at the one-packet limit: %+.2f us%s\n", step,
+               step > 0.1 * base_lo ? " (fragmentation/segmentation cost)" : "");
+    }
+
+    if (config->output_file[0] != '\0') {
+        FILE* csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "size,sent,received,min_us,p50_us,p90_us,p99_us,max_us\n");
+            for (int s = 0; s < measured; s++) {
+                fprintf(csv, "%d,%d,%d,%.1f,%.1f,%.1f,%.1f,%.1f\n", points[s].size, points[s].sent,
+                        points[s].received, points[s].min_us, points[s].p50_us, points[s].p90_us,
+                        points[s].p99_us, points[s].max_us);
+            }
+            fclose(csv);
+            printf("\nResults saved to %s\n", config->output_file);
+        }
+    }
+
+    free(rtts);
+    free(packet);
+    close(sock);
+    return status;
+}
+
+/**
+ * Expand a socket option grid into combinations. spec is "all" or a comma
+ * list of nodelay, quickack, buf, busypoll and cc, each optionally
+ * "=v1:v2:..."; a bare name uses its default values and cc defaults to the
+ * kernel's available algorithms. 0 (empty for cc) leaves an option at the
+ * kernel default, and options not named stay there. TCP-only options are
+ * skipped for UDP. Returns the number of combinations, -1 on a bad spec
+ */
+int sockopt_parse_grid(const char* spec, int tcp, sockopt_set_t* combos, int max_combos) {
+    static const char* names[] = { "nodelay", "quickack", "buf", "busypoll", "cc" };
+    static const char* defaults[] = { "0:1", "0:1", "0:262144:4194304", "0:50", NULL };
+    enum { OPT_NODELAY, OPT_QUICKACK, OPT_BUF, OPT_BUSYPOLL, OPT_CC, OPT_COUNT };
+    char values[OPT_COUNT][SOCKOPT_MAX_VALUES][16];
+    int nvalues[OPT_COUNT];
+    char buffer[256];
+    char list[256];
+
+    for (int o = 0; o < OPT_COUNT; o++) {
+        nvalues[o] = 1;
+        strcpy(values[o][0], o == OPT_CC ? "" : "0");
+    }
+    strncpy(buffer, spec, sizeof(buffer) - 1);
+    buffer[sizeof(buffer) - 1] = '\0';
+    int all = strcmp(buffer, "all") == 0;
+    if (all) {
+        strcpy(buffer, "nodelay,quickack,buf,busypoll,cc");
+    }
+    for (char* item = buffer; item != NULL; ) {
+        const char* given = NULL;
+        char* next = strchr(item, ',');
+        if (next != NULL) {
+            *next++ = '\0';
+        }
+        char* eq = strchr(item, '=');
+        if (eq != NULL) {
+            *eq = '\0';
+            given = eq + 1;
+        }
+        int o;
+        for (o = 0; o < OPT_COUNT && strcmp(item, names[o]) != 0; o++) {
+        }
+        if (o == OPT_COUNT) {
+            fprintf(stderr, "Unknown socket option '%s' in -O (use nodelay, quickack, buf, busypoll, cc)\n",
+                    item);
+            return -1;
+        }
+        item = next;
+        if (!tcp && o != OPT_BUF && o != OPT_BUSYPOLL) {
+            if (!all) {
+                printf("Note: %s is a TCP option, skipped for UDP\n", names[o]);
+            }
+            continue;
+        }
+
+        if (given != NULL) {
+            strncpy(list, given, sizeof(list) - 1);
+        } else if (defaults[o] != NULL) {
+            strncpy(list, defaults[o], sizeof(list) - 1);
+        } else if (read_sys_line("/proc/sys/net/ipv4/tcp_available_congestion_control",
+                                 list, sizeof(list)) == 0) {
+            for (char* c = list; *c != '\0'; c++) {
+                *c = *c == ' ' ? ':' : *c;
+            }
+        } else {
+            strcpy(list, "cubic:reno");
+        }
+        list[sizeof(list) - 1] = '\0';
+        nvalues[o] = 0;
+        for (char* v = list; v != NULL && nvalues[o] < SOCKOPT_MAX_VALUES; ) {
+            char* next = strchr(v, ':');
+            if (next != NULL) {
+                *next++ = '\0';
+            }
+            if (*v != '\0' || o == OPT_CC) {
+                snprintf(values[o][nvalues[o]++], sizeof(values[o][0]), "%s", v);
+            }
+            v = next;
+        }
+        if (nvalues[o] == 0) {
+            nvalues[o] = 1;
+        }
+    }
+
+    int total = 1;
+    for (int o = 0; o < OPT_COUNT; o++) {
+        total *= nvalues[o];
+    }
+    if (total > max_combos) {
+        fprintf(stderr, "Socket option grid has %d combinations, the limit is %d\n", total, max_combos);
+        return -1;
+    }
+    // First option varies slowest
+    for (int c = 0; c < total; c++) {
+        int index[OPT_COUNT];
+        int rest = c;
+        for (int o = OPT_COUNT - 1; o >= 0; o--) {
+            index[o] = rest % nvalues[o];
+            rest /= nvalues[o];
+        }
+        sockopt_set_t* set = &combos[c];
+        memset(set, 0, sizeof(sockopt_set_t));
+        set->nodelay = atoi(values[OPT_NODELAY][index[OPT_NODELAY]]);
+        set->quickack = atoi(values[OPT_QUICKACK][index[OPT_QUICKACK]]);
+        set->sndbuf = atoi(values[OPT_BUF][index[OPT_BUF]]);
+        set->rcvbuf = set->sndbuf;
+        set->busy_poll_us = atoi(values[OPT_BUSYPOLL][index[OPT_BUSYPOLL]]);
+        snprintf(set->cc, sizeof(set->cc), "%s", values[OPT_CC][index[OPT_CC]]);
+    }
+    return total;
+}
+
+/**
+ * Set the non-default options of a combination; refusals show up in the read-back
+ */
+static void sockopt_apply(int fd, const sockopt_set_t* want, int tcp) {
+    int one = 1;
+    if (want->sndbuf > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &want->sndbuf, sizeof(int));
+    }
+    if (want->rcvbuf > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &want->rcvbuf, sizeof(int));
+    }
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    if (want->busy_poll_us > 0) {
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &want->busy_poll_us, sizeof(int));
+    }
+#endif
+    if (!tcp) {
+        return;
+    }
+    if (want->nodelay) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+#if defined(__linux__) && defined(TCP_QUICKACK)
+    if (want->quickack) {
+        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+    }
+#endif
+#if defined(__linux__) && defined(TCP_CONGESTION)
+    if (want->cc[0] != '\0') {
+        setsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, want->cc, strlen(want->cc));
+    }
+#endif
+}
+
+/**
+ * Read the options back from the socket; -1 where the platform cannot report one
+ */
+static void sockopt_read(int fd, sockopt_set_t* got, int tcp) {
+    socklen_t len = sizeof(int);
+    memset(got, 0, sizeof(sockopt_set_t));
+    got->busy_poll_us = -1;
+    got->quickack = -1;
+    getsockopt(fd, SOL_SOCKET, SO_SNDBUF, &got->sndbuf, &len);
+    len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &got->rcvbuf, &len);
+#if defined(__linux__) && defined(SO_BUSY_POLL)
+    len = sizeof(int);
+    getsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &got->busy_poll_us, &len);
+#endif
+    if (!tcp) {
+        return;
+    }
+    len = sizeof(int);
+    getsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &got->nodelay, &len);
+#if defined(__linux__) && defined(TCP_QUICKACK)
+    len = sizeof(int);
+    getsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &got->quickack, &len);
+#endif
+#if defined(__linux__) && defined(TCP_CONGESTION)
+    len = sizeof(got->cc) - 1;
+    getsockopt(fd, IPPROTO_TCP, TCP_CONGESTION, got->cc, &len);
+#endif
+}
+
+/**
+ * Whether the kernel did not give a combination what it asked for.
+ * Buffers count as given when at least the requested size (Linux doubles them)
+ */
+static int sockopt_refused(const sockopt_point_t* pt) {
+    const sockopt_set_t* w = &pt->want;
+    const sockopt_set_t* g = &pt->got;
+    return (w->nodelay && !g->nodelay) || (w->quickack && g->quickack == 0) ||
+           (w->sndbuf > 0 && g->sndbuf < w->sndbuf) || (w->rcvbuf > 0 && g->rcvbuf < w->rcvbuf) ||
+           (w->busy_poll_us > 0 && g->busy_poll_us != w->busy_poll_us) ||
+           (w->cc[0] != '\0' && strcmp(w->cc, g->cc) != 0);
+}
+
+static void sockopt_print_row(const char* label, const sockopt_point_t* pt, int tcp) {
+    char nodelay[12] = "-", quickack[12] = "-", busy[12] = "-";
+    if (tcp) {
+        snprintf(nodelay, sizeof(nodelay), "%d", pt->got.nodelay);
+        if (pt->got.quickack >= 0) {
+            snprintf(quickack, sizeof(quickack), "%d", pt->got.quickack);
+        }
+    }
+    if (pt->got.busy_poll_us >= 0) {
+        snprintf(busy, sizeof(busy), "%d", pt->got.busy_poll_us);
+    }
+    printf("  %5s %7s %8s %9d %9d %8s %-8s %7d %9.1f %9.1f %10.0f %8.1f%s\n", label, nodelay, quickack,
+           pt->got.sndbuf, pt->got.rcvbuf, busy, tcp ? pt->got.cc : "-", pt->received, pt->p50_us,
+           pt->p99_us, pt->probes_per_sec, pt->mbit_per_sec, sockopt_refused(pt) ? "  *" : "");
+}
+
+static void sockopt_print_header(const char* label) {
+    printf("  %5s %7s %8s %9s %9s %8s %-8s %7s %9s %9s %10s %8s\n", label, "nodelay", "quickack", "sndbuf",
+           "rcvbuf", "busypoll", "cc", "replies", "p50 us", "p99 us", "probes/s", "Mbit/s");
+}
+
+/**
+ * Socket option sweep client: a new connection per combination of the -O
+ * grid, -n probes each after a short warm-up, ranked by p99 and by
+ * throughput. Reported settings are the ones read back from the socket
+ */
+int run_sockopt_sweep(config_t* config) {
+    struct sockaddr_storage server_addr;
+    int tcp = config->protocol == PROTOCOL_TCP;
+    int status = 0;
+    uint64_t seq = 0;
+    int measured = 0;
+
+    sockopt_set_t* combos = (sockopt_set_t*)malloc(SOCKOPT_MAX_COMBOS * sizeof(sockopt_set_t));
+    sockopt_point_t* points = (sockopt_point_t*)calloc(SOCKOPT_MAX_COMBOS, sizeof(sockopt_point_t));
+    double* rtts = (double*)malloc(config->num_packets * sizeof(double));
+    if (combos == NULL || points == NULL || rtts == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int ncombos = sockopt_parse_grid(config->sockopt_grid, tcp, combos, SOCKOPT_MAX_COMBOS);
+    int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (ncombos <= 0 || addr_size < 0) {
+        free(combos);
+        free(points);
+        free(rtts);
+        return -1;
+    }
+
+    packet_t* packet = create_packet(config->packet_size);
+    int interval_us = config->rate_pps > 0 ? 1000000 / config->rate_pps : config->delay_ms * 1000;
+    printf("Socket option sweep over %s to %s:%d: %d combinations x %d probes of %d bytes\n",
+           tcp ? "TCP" : "UDP", config->server_ip, config->port, ncombos, config->num_packets,
+           config->packet_size);
+    if (interval_us > 0) {
+        printf("Note: probes are paced (-r/-d), so throughput is capped by the rate; use -r 0 -d 0 to rank it\n");
+    }
+    printf("Settings are read back from each socket; * = the kernel did not apply what was requested\n\n");
+    sockopt_print_header("#");
+
+    for (int c = 0; c < ncombos && running; c++) {
+        sockopt_point_t* pt = &points[c];
+        pt->want = combos[c];
+        measured = c + 1;
+
+        int sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET, tcp ? SOCK_STREAM : SOCK_DGRAM, 0);
+        if (sock < 0) {
+            perror("Socket creation failed");
+            status = -1;
+            break;
+        }
+        // Buffers and congestion control must be in place before the handshake
+        sockopt_apply(sock, &pt->want, tcp);
+        if (connect(sock, (struct sockaddr*)&server_addr, addr_size) < 0) {
+            perror("Connection failed");
+            close(sock);
+            status = -1;
+            break;
+        }
+
+        int connected = 1;
+        uint64_t start = 0;
+        for (int i = -SOCKOPT_WARMUP; i < config->num_packets && running && connected; i++) {
+            if (i == 0) {
+                sockopt_read(sock, &pt->got, tcp);
+                start = get_timestamp_usec();
+            }
+            pt->sent += i >= 0;
+            int result = probe_exchange(sock, packet, config->packet_size, ++seq, tcp, SWEEP_TIMEOUT_MS);
+            if (result == PROBE_DISCONNECTED) {
+                printf("Server disconnected\n");
+                connected = 0;
+                break;
+            }
+#if defined(__linux__) && defined(TCP_QUICKACK)
+            // Quick-ack mode is not sticky: re-arm it after every receive
+            if (tcp && pt->want.quickack) {
+                int one = 1;
+                setsockopt(sock, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+            }
+#endif
+            if (result == PROBE_REPLY && i >= 0) {
+                rtts[pt->received++] = get_timestamp_usec() - packet->client_send;
+            }
+            if (interval_us > 0) {
+                usleep(interval_us);
+            }
+        }
+        double elapsed = start > 0 ? (get_timestamp_usec() - start) / 1e6 : 0;
+        close(sock);
+
+        if (pt->received > 0) {
+            qsort(rtts, pt->received, sizeof(double), compare_doubles);
+            pt->p50_us = sorted_percentile(rtts, pt->received, 50);
+            pt->p99_us = sorted_percentile(rtts, pt->received, 99);
+        }
+        if (elapsed > 0) {
+            pt->probes_per_sec = pt->received / elapsed;
+            // Each probe crosses the path twice
+            pt->mbit_per_sec = pt->probes_per_sec * config->packet_size * 2 * 8 / 1e6;
+        }
+        char label[12];
+        snprintf(label, sizeof(label), "%d", c + 1);
+        sockopt_print_row(label, pt, tcp);
+        fflush(stdout);
+        if (!connected || pt->received < pt->sent) {
+            status = -1;
+        }
+        if (!connected) {
+            break;
+        }
+    }
+
+    // Rank combinations that got replies: by p99 ascending, then by throughput descending
+    int by_p99[SOCKOPT_MAX_COMBOS], by_rate[SOCKOPT_MAX_COMBOS];
+    int ranked = 0;
+    for (int c = 0; c < measured; c++) {
+        if (points[c].received > 0) {
+            by_p99[ranked] = by_rate[ranked] = c;
+            ranked++;
+        }
+    }
+    for (int i = 1; i < ranked; i++) {
+        for (int j = i; j > 0 && points[by_p99[j - 1]].p99_us > points[by_p99[j]].p99_us; j--) {
+            int tmp = by_p99[j];
+            by_p99[j] = by_p99[j - 1];
+            by_p99[j - 1] = tmp;
+        }
+        for (int j = i; j > 0 && points[by_rate[j - 1]].probes_per_sec < points[by_rate[j]].probes_per_sec; j--) {
+            int tmp = by_rate[j];
+            by_rate[j] = by_rate[j - 1];
+            by_rate[j - 1] = tmp;
+        }
+    }
+
+    if (ranked > 0) {
+        int shown = ranked < 10 ? ranked : 10;
+        printf("\n--- Ranked by p99 (top %d of %d) ---\n", shown, ranked);
+        sockopt_print_header("rank");
+        for (int i = 0; i < shown; i++) {
+            char label[8];
+            snprintf(label, sizeof(label), "%d", i + 1);
+            sockopt_print_row(label, &points[by_p99[i]], tcp);
+        }
+        printf("\n--- Ranked by throughput (top %d of %d) ---\n", shown, ranked);
+        sockopt_print_header("rank");
+        for (int i = 0; i < shown; i++) {
+            char label[8];
+            snprintf(label, sizeof(label), "%d", i + 1);
+            sockopt_print_row(label, &points[by_rate[i]], tcp);
+        }
+
+        // The all-default combination, if the grid has one, is the baseline;
+        // naming the system's default congestion control still counts as default
+        int baseline = -1;
+        char default_cc[64] = "";
+        read_sys_line("/proc/sys/net/ipv4/tcp_congestion_control", default_cc, sizeof(default_cc));
+        for (int c = 0; c < measured && baseline < 0; c++) {
+            const sockopt_set_t* w = &points[c].want;
+            if (points[c].received > 0 && !w->nodelay && !w->quickack && w->sndbuf == 0 &&
+                w->busy_poll_us == 0 && (w->cc[0] == '\0' || strcmp(w->cc, default_cc) == 0)) {
+                baseline = c;
+            }
+        }
+        const char* goals[] = { "Lowest p99", "Highest throughput" };
+        int winners[] = { by_p99[0], by_rate[0] };
+        printf("\n--- Winning Settings (read back) ---\n");
+        for (int k = 0; k < 2; k++) {
+            const sockopt_point_t* w = &points[winners[k]];
+            printf("  %s: #%d  SO_SNDBUF=%d SO_RCVBUF=%d", goals[k], winners[k] + 1, w->got.sndbuf,
+                   w->got.rcvbuf);
+            if (w->got.busy_poll_us >= 0) {
+                printf(" SO_BUSY_POLL=%d", w->got.busy_poll_us);
+            }
+            if (tcp) {
+                printf(" TCP_NODELAY=%d", w->got.nodelay);
+                if (w->got.quickack >= 0) {
+                    printf(" TCP_QUICKACK=%d", w->got.quickack);
+                }
+                if (w->got.cc[0] != '\0') {
+                    printf(" TCP_CONGESTION=%s", w->got.cc);
+                }
+            }
+            printf("\n");
+            if (baseline >= 0 && baseline != winners[k]) {
+                const sockopt_point_t* b = &points[baseline];
+                printf("    vs kernel defaults (#%d): p99 %.1f -> %.1f us, %.0f -> %.0f probes/s\n", baseline + 1,
+                       b->p99_us, w->p99_us, b->probes_per_sec, w->probes_per_sec);
+            }
+            if (sockopt_refused(w)) {
+                printf("    Note: the kernel did not apply every requested option; the values above are in effect\n");
+            }
+        }
+    } else {
+        printf("\nNo combination got replies\n");
+    }
+
+    if (config->output_file[0] != '\0') {
+        FILE* csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "combination,want_nodelay,want_quickack,want_buf,want_busy_poll,want_cc,"
+                         "nodelay,quickack,sndbuf,rcvbuf,busy_poll,cc,sent,received,p50_us,p99_us,"
+                         "probes_per_sec,mbit_per_sec\n");
+            for (int c = 0; c < measured; c++) {
+                const sockopt_point_t* pt = &points[c];
+                fprintf(csv, "%d,%d,%d,%d,%d,%s,%d,%d,%d,%d,%d,%s,%d,%d,%.1f,%.1f,%.0f,%.2f\n", c + 1,
+                        pt->want.nodelay, pt->want.quickack, pt->want.sndbuf, pt->want.busy_poll_us,
+                        pt->want.cc, pt->got.nodelay, pt->got.quickack, pt->got.sndbuf, pt->got.rcvbuf,
+                        pt->got.busy_poll_us, pt->got.cc, pt->sent, pt->received, pt->p50_us, pt->p99_us,
+                        pt->probes_per_sec, pt->mbit_per_sec);
+            }
+            fclose(csv);
+            printf("\nResults saved to %s\n", config->output_file);
+        }
+    }
+
+    free(packet);
+    free(rtts);
+    free(points);
+    free(combos);
+    return status;
+}
+
+/**
+ * Drain the socket error queue; keeps the last 'message too long' error's MTU
+ * and, for ICMP errors, the address of the hop that sent it.
+ * Returns the SO_EE_ORIGIN_* of that error, 0 if there was none
+ */
+static int pmtu_read_errqueue(int sock, int* mtu, char* from, size_t from_len) {
+    int origin = 0;
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ICMP)
+    char control[512];
+    char data[64];
+    struct sockaddr_storage peer;
+    for (;;) {
+        struct iovec iov = { data, sizeof(data) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name = &peer;
+        msg.msg_namelen = sizeof(peer);
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+        for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == IPPROTO_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            struct sock_extended_err* ee = (struct sock_extended_err*)CMSG_DATA(cm);
+            if (ee->ee_errno != EMSGSIZE) {
+                continue;
+            }
+            origin = ee->ee_origin;
+            *mtu = (int)ee->ee_info;
+            struct sockaddr* offender = SO_EE_OFFENDER(ee);
+            if (offender->sa_family == AF_INET) {
+                inet_ntop(AF_INET, &((struct sockaddr_in*)offender)->sin_addr, from, from_len);
+            } else if (offender->sa_family == AF_INET6) {
+                inet_ntop(AF_INET6, &((struct sockaddr_in6*)offender)->sin6_addr, from, from_len);
+            }
+        }
+    }
+#else
+    (void)sock;
+    (void)mtu;
+    (void)from;
+    (void)from_len;
+#endif
+    return origin;
+}
+
+/**
+ * Send one probe of size bytes and wait for its reply. Returns PMTU_PASS with
+ * *rtt_us set, PMTU_LOCAL or PMTU_ICMP when a 'message too long' error names
+ * the MTU in *mtu, or PMTU_SILENT on timeout
+ */
+static int pmtu_probe(int sock, packet_t* packet, int size, uint64_t seq, double* rtt_us, int* mtu,
+                      char* from, size_t from_len) {
+    int result = probe_exchange(sock, packet, size, seq, 0, PMTU_TIMEOUT_MS);
+    if (result == PROBE_REPLY) {
+        *rtt_us = get_timestamp_usec() - packet->client_send;
+        return PMTU_PASS;
+    }
+    if (result != PROBE_ERROR) {
+        return PMTU_SILENT;
+    }
+    int send_errno = errno;
+    int origin = pmtu_read_errqueue(sock, mtu, from, from_len);
+#if defined(__linux__) && defined(SO_EE_ORIGIN_ICMP)
+    if (origin == SO_EE_ORIGIN_ICMP || origin == SO_EE_ORIGIN_ICMP6) {
+        return PMTU_ICMP;
+    }
+#endif
+    (void)origin;
+    return send_errno == EMSGSIZE ? PMTU_LOCAL : PMTU_SILENT;
+}
+
+/**
+ * Set the don't-fragment policy: IP(V6)_PMTUDISC_PROBE sets DF but ignores
+ * the cached path MTU so every size is really tried; DONT lets the kernel fragment
+ */
+static void pmtu_set_df(int sock, int use_ipv6, int df) {
+#ifdef __linux__
+    int value;
+    if (use_ipv6) {
+#if defined(IPV6_MTU_DISCOVER) && defined(IPV6_PMTUDISC_PROBE)
+        value = df ? IPV6_PMTUDISC_PROBE : IPV6_PMTUDISC_DONT;
+        setsockopt(sock, IPPROTO_IPV6, IPV6_MTU_DISCOVER, &value, sizeof(value));
+#endif
+    } else {
+#if defined(IP_MTU_DISCOVER) && defined(IP_PMTUDISC_PROBE)
+        value = df ? IP_PMTUDISC_PROBE : IP_PMTUDISC_DONT;
+        setsockopt(sock, IPPROTO_IP, IP_MTU_DISCOVER, &value, sizeof(value));
+#endif
+    }
+#else
+    (void)sock;
+    (void)use_ipv6;
+    (void)df;
+#endif
+}
+
+/**
+ * Path MTU client: binary search of DF probes between MIN_PACKET_SIZE and
+ * MAX_PACKET_SIZE, classifying each failed size as refused locally, rejected
+ * by a hop via ICMP, or silently dropped (a black hole), then -n fragmentable
+ * probes around the threshold to show what crossing it costs
+ */
+int run_pmtu_discovery(config_t* config) {
+    static const char* outcomes[] = { "reply", "local MTU", "ICMP too big", "LOST" };
+    struct sockaddr_storage server_addr;
+    pmtu_step_t steps[PMTU_MAX_STEPS];
+    int nsteps = 0;
+    int status = 0;
+    uint64_t seq = 0;
+    int header = config->use_ipv6 ? 48 : 28;   // IP + UDP
+    int local_mtu = 0, icmp_mtu = 0, named_mtu = 0;
+    char icmp_from[INET6_ADDRSTRLEN] = "";
+    char from[INET6_ADDRSTRLEN] = "";
+    int silent_above = 0;                      // Smallest size lost without an error
+    double rtt;
+#ifdef __linux__
+    int one = 1;
+#endif
+
+    int sock = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_DGRAM, 0);
+    int addr_size = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (sock < 0 || addr_size < 0 || connect(sock, (struct sockaddr*)&server_addr, addr_size) < 0) {
+        perror("Connection failed");
+        if (sock >= 0) {
+            close(sock);
+        }
+        return -1;
+    }
+#ifdef __linux__
+    // Deliver ICMP errors with the reported MTU and the hop that sent them
+    if (config->use_ipv6) {
+        setsockopt(sock, IPPROTO_IPV6, IPV6_RECVERR, &one, sizeof(one));
+    } else {
+        setsockopt(sock, IPPROTO_IP, IP_RECVERR, &one, sizeof(one));
+    }
+#endif
+    pmtu_set_df(sock, config->use_ipv6, 1);
+    int kernel_mtu = sweep_mtu_payload(sock, config) + header;
+    packet_t* packet = create_packet(MAX_PACKET_SIZE);
+
+    printf("Path MTU discovery over UDP to %s:%d: DF probes of %d-%d bytes (%d-%d on the wire)\n",
+           config->server_ip, config->port, MIN_PACKET_SIZE, MAX_PACKET_SIZE, MIN_PACKET_SIZE + header,
+           MAX_PACKET_SIZE + header);
+    printf("Kernel's route MTU before the search: %d\n\n", kernel_mtu);
+
+    // A small probe must get through before any size can be blamed
+    int small = PMTU_SILENT;
+    for (int t = 0; t < PMTU_TRIES && small != PMTU_PASS && running; t++) {
+        small = pmtu_probe(sock, packet, MIN_PACKET_SIZE, ++seq, &rtt, &named_mtu, from, sizeof(from));
+    }
+    if (small != PMTU_PASS) {
+        fprintf(stderr, "No reply to %d-byte probes; is a UDP reflector (-s -u) running on %s:%d?\n",
+                MIN_PACKET_SIZE, config->server_ip, config->port);
+        free(packet);
+        close(sock);
+        return -1;
+    }
+
+    printf("  %8s %8s %-14s %10s\n", "payload", "on wire", "result", "rtt us");
+    int lo = MIN_PACKET_SIZE, hi = MAX_PACKET_SIZE;
+    int size = hi;    // Try the largest size first: a clean path ends the search at once
+    while (lo < hi && running && nsteps < PMTU_MAX_STEPS) {
+        int result = PMTU_SILENT;
+        for (int t = 0; t < PMTU_TRIES && result == PMTU_SILENT && running; t++) {
+            named_mtu = 0;
+            result = pmtu_probe(sock, packet, size, ++seq, &rtt, &named_mtu, from, sizeof(from));
+        }
+        if (result == PMTU_LOCAL && named_mtu > 0) {
+            local_mtu = named_mtu;
+        } else if (result == PMTU_ICMP && named_mtu > 0) {
+            icmp_mtu = named_mtu;
+            strcpy(icmp_from, from);
+        } else if (result == PMTU_SILENT) {
+            // Only a black hole if small probes still pass right after
+            double control_rtt;
+            if (pmtu_probe(sock, packet, MIN_PACKET_SIZE, ++seq, &control_rtt, &named_mtu, from,
+                           sizeof(from)) != PMTU_PASS) {
+                printf("  %8d %8d %-14s %10s  (small probes lost too: path loss, retrying)\n", size,
+                       size + header, "LOST", "-");
+                continue;
+            }
+            if (silent_above == 0 || size < silent_above) {
+                silent_above = size;
+            }
+        }
+
+        pmtu_step_t* step = &steps[nsteps++];
+        step->size = size;
+        step->result = result;
+        step->rtt_us = result == PMTU_PASS ? rtt : 0;
+        if (result == PMTU_PASS) {
+            printf("  %8d %8d %-14s %10.1f\n", size, size + header, outcomes[result], rtt);
+            lo = size;
+        } else {
+            printf("  %8d %8d %-14s %10s\n", size, size + header, outcomes[result], "-");
+            hi = size - 1;
+        }
+        // An error that names the MTU narrows the search directly: try that size next
+        size = (lo + hi + 1) / 2;
+        named_mtu = result == PMTU_LOCAL ? local_mtu : result == PMTU_ICMP ? icmp_mtu : 0;
+        if (named_mtu > header && named_mtu - header < hi && named_mtu - header >= lo) {
+            hi = named_mtu - header;
+            size = hi;
+        }
+        fflush(stdout);
+    }
+
+    int path_payload = lo;
+    int path_mtu = path_payload + header;
+    kernel_mtu = sweep_mtu_payload(sock, config) + header;
+    printf("\n--- Path MTU ---\n");
+    if (path_payload >= MAX_PACKET_SIZE) {
+        printf("  Path MTU: at least %d (the largest probe passed)\n", path_mtu);
+    } else {
+        printf("  Path MTU: %d bytes (largest DF payload that got a reply: %d)\n", path_mtu, path_payload);
+    }
+    if (local_mtu > 0) {
+        printf("  Local interface/route MTU: %d\n", local_mtu);
+    }
+    printf("  Kernel's route MTU after the search: %d\n", kernel_mtu);
+    if (icmp_mtu > 0) {
+        printf("  ICMP 'fragmentation needed' from %s reported MTU %d: path MTU discovery works\n",
+               icmp_from[0] != '\0' ? icmp_from : "a hop", icmp_mtu);
+    }
+    // Losses above an MTU a hop already reported are ICMP rate limiting, not a black hole
+    if (silent_above > 0 && icmp_mtu > 0 && silent_above + header > icmp_mtu) {
+        silent_above = 0;
+    }
+    if (silent_above > 0) {
+        printf("  PMTU BLACK HOLE: probes of %d bytes and more on the wire are dropped without an ICMP error\n",
+               silent_above + header);
+        printf("  while %d-byte probes pass. Senders never learn the lower MTU and large transfers stall;\n",
+               MIN_PACKET_SIZE + header);
+        printf("  check the MTU (jumbo frames) on both hosts' interfaces and every switch/router port between\n");
+        printf("  them, and that ICMP type 3 code 4 (ICMPv6 type 2) is not filtered\n");
+        status = -1;
+    } else if (local_mtu > 0 && path_mtu < local_mtu) {
+        printf("  The path MTU is below the local MTU (%d < %d): a hop has a smaller MTU\n", path_mtu, local_mtu);
+    }
+
+    // Latency across the fragmentation threshold, with fragmentation allowed
+    int sizes[] = { MIN_PACKET_SIZE, path_payload, path_payload + 1, 2 * path_payload };
+    double p50[4] = { 0 };
+    int lost_frag = 0;
+    double* rtts = (double*)malloc(config->num_packets * sizeof(double));
+    if (rtts == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    int interval_us = config->rate_pps > 0 ? 1000000 / config->rate_pps : config->delay_ms * 1000;
+    pmtu_set_df(sock, config->use_ipv6, 0);
+    printf("\n--- Latency Across the Fragmentation Threshold (DF off, %d probes each) ---\n",
+           config->num_packets);
+    printf("  %8s %8s %8s %6s %10s %10s\n", "payload", "on wire", "replies", "lost", "p50 us", "p99 us");
+    FILE* csv = NULL;
+    if (config->output_file[0] != '\0') {
+        csv = fopen(config->output_file, "w");
+        if (csv == NULL) {
+            perror("Failed to open output file");
+        } else {
+            fprintf(csv, "phase,payload,wire_bytes,result,received,p50_us,p99_us\n");
+            for (int s = 0; s < nsteps; s++) {
+                fprintf(csv, "search,%d,%d,%s,%d,%.1f,%.1f\n", steps[s].size, steps[s].size + header,
+                        outcomes[steps[s].result], steps[s].result == PMTU_PASS, steps[s].rtt_us,
+                        steps[s].rtt_us);
+            }
+        }
+    }
+    for (int s = 0; s < 4 && running; s++) {
+        if (sizes[s] > MAX_PACKET_SIZE || (s > 0 && sizes[s] == sizes[s - 1])) {
+            continue;
+        }
+        int received = 0;
+        for (int i = 0; i < config->num_packets && running; i++) {
+            if (pmtu_probe(sock, packet, sizes[s], ++seq, &rtt, &named_mtu, from, sizeof(from)) == PMTU_PASS) {
+                rtts[received++] = rtt;
+            }
+            if (interval_us > 0) {
+                usleep(interval_us);
+            }
+        }
+        double p99 = 0;
+        if (received > 0) {
+            qsort(rtts, received, sizeof(double), compare_doubles);
+            p50[s] = sorted_percentile(rtts, received, 50);
+            p99 = sorted_percentile(rtts, received, 99);
+        }
+        if (sizes[s] > path_payload && received < config->num_packets) {
+            lost_frag = 1;
+        }
+        printf("  %8d %8d %8d %6d %10.1f %10.1f%s\n", sizes[s], sizes[s] + header, received,
+               config->num_packets - received, p50[s], p99, s == 2 ? "  <- first size over the path MTU" : "");
+        if (csv != NULL) {
+            fprintf(csv, "latency,%d,%d,%s,%d,%.1f,%.1f\n", sizes[s], sizes[s] + header,
+                    received > 0 ? "reply" : "LOST", received, p50[s], p99);
+        }
+        fflush(stdout);
+    }
+    if (p50[1] > 0 && p50[2] > 0) {
+        printf("  Crossing the threshold costs %+.1f us at p50\n", p50[2] - p50[1]);
+    }
+    if (lost_frag) {
+        printf("  Probes over the path MTU were lost even with fragmentation allowed\n");
+        if (silent_above > 0) {
+            printf("  (the sender fragments at its local MTU, and the black hole drops those fragments too)\n");
+        }
+        status = -1;
+    }
+    if (csv != NULL) {
+        fclose(csv);
+        printf("\nResults saved to %s\n", config->output_file);
+    }
+
+    free(rtts);
+    free(packet);
+    close(sock);
+    return status;
+}
@@ -0,0 +1,504 @@
+/**
+ * TLS layer (make TLS=1): reflector handshakes, stream I/O over plain or
+ * TLS connections, and the -T client comparing handshakes and round trips
+ */
+
+#include "netperf.h"
+
+#ifdef HAVE_OPENSSL
+SSL_CTX* tls_ctx = NULL;
+#endif
+
+#ifdef HAVE_OPENSSL
+/**
+ * Print the OpenSSL error queue under a short prefix
+ */
+static void tls_print_errors(const char* what) {
+    unsigned long err;
+    char text[256];
+    fprintf(stderr, "%s failed", what);
+    while ((err = ERR_get_error()) != 0) {
+        ERR_error_string_n(err, text, sizeof(text));
+        fprintf(stderr, ": %s", text);
+    }
+    fprintf(stderr, "\n");
+}
+
+/**
+ * Give the reflector an ephemeral P-256 key and self-signed certificate
+ */
+static int tls_self_signed(SSL_CTX* ctx) {
+    EVP_PKEY* key = NULL;
+    EVP_PKEY_CTX* kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+    if (kctx == NULL || EVP_PKEY_keygen_init(kctx) <= 0 ||
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1) <= 0 ||
+        EVP_PKEY_keygen(kctx, &key) <= 0) {
+        EVP_PKEY_CTX_free(kctx);
+        return -1;
+    }
+    EVP_PKEY_CTX_free(kctx);
+
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 7 * 86400);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"netperf", -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    int ok = X509_sign(cert, key, EVP_sha256()) > 0 &&
+             SSL_CTX_use_certificate(ctx, cert) == 1 &&
+             SSL_CTX_use_PrivateKey(ctx, key) == 1;
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return ok ? 0 : -1;
+}
+#endif
+
+/**
+ * Set up the process-wide TLS context for a reflector or a client
+ * Returns 0 on success, -1 if TLS is unavailable
+ */
+int tls_init(config_t* config, int is_server) {
+#ifdef HAVE_OPENSSL
+    (void)config;
+    tls_ctx = SSL_CTX_new(is_server ? TLS_server_method() : TLS_client_method());
+    if (tls_ctx == NULL) {
+        tls_print_errors("SSL_CTX_new");
+        return -1;
+    }
+    SSL_CTX_set_min_proto_version(tls_ctx, TLS1_2_VERSION);
+#ifdef SSL_OP_ENABLE_KTLS
+    // Hand record encryption to the kernel where the tls module and cipher allow it
+    SSL_CTX_set_options(tls_ctx, SSL_OP_ENABLE_KTLS);
+#endif
+    if (is_server) {
+        if (tls_self_signed(tls_ctx) < 0) {
+            tls_print_errors("Self-signed certificate");
+            return -1;
+        }
+        // Stateless session tickets for resumption
+        SSL_CTX_set_session_id_context(tls_ctx, (const unsigned char*)"netperf", 7);
+        SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_SERVER);
+    } else {
+        // The reflector's certificate is ephemeral: measure, do not authenticate
+        SSL_CTX_set_verify(tls_ctx, SSL_VERIFY_NONE, NULL);
+        SSL_CTX_set_session_cache_mode(tls_ctx, SSL_SESS_CACHE_CLIENT);
+    }
+    return 0;
+#else
+    (void)config;
+    (void)is_server;
+    fprintf(stderr, "TLS support not compiled in (build with make TLS=1)\n");
+    return -1;
+#endif
+}
+
+/**
+ * Accept TLS on a reflector connection if the peer opens with a ClientHello;
+ * plain TCP probes on the same port are served without TLS (*conn = NULL).
+ * Returns 0 on success, -1 if the handshake failed
+ */
+int tls_accept(int fd, reflector_worker_t* worker, tls_conn_t** conn) {
+    *conn = NULL;
+#ifdef HAVE_OPENSSL
+    unsigned char head[3];
+    if (tls_ctx == NULL) {
+        return 0;
+    }
+    // A TLS handshake record starts 0x16 0x03 0x0N; a probe starts with its sequence number
+    if (recv(fd, head, sizeof(head), MSG_PEEK | MSG_WAITALL) != sizeof(head) ||
+        head[0] != 0x16 || head[1] != 0x03) {
+        return 0;
+    }
+
+    SSL* ssl = SSL_new(tls_ctx);
+    SSL_set_fd(ssl, fd);
+    uint64_t cpu_start = thread_cpu_ns();
+    if (SSL_accept(ssl) != 1) {
+        worker->tls_failed++;
+        if (running) {
+            tls_print_errors("TLS accept");
+        }
+        SSL_free(ssl);
+        return -1;
+    }
+    uint64_t cpu_ns = thread_cpu_ns() - cpu_start;
+    if (SSL_session_reused(ssl)) {
+        worker->tls_resumed++;
+        worker->tls_resumed_cpu_ns += cpu_ns;
+    } else {
+        worker->tls_full++;
+        worker->tls_full_cpu_ns += cpu_ns;
+    }
+#ifdef BIO_get_ktls_send
+    worker->tls_ktls_tx += BIO_get_ktls_send(SSL_get_wbio(ssl)) ? 1 : 0;
+    worker->tls_ktls_rx += BIO_get_ktls_recv(SSL_get_rbio(ssl)) ? 1 : 0;
+#endif
+    *conn = ssl;
+#else
+    (void)fd;
+    (void)worker;
+#endif
+    return 0;
+}
+
+/**
+ * Send a close_notify (without waiting for the peer's) and free the connection
+ */
+void tls_close(tls_conn_t* conn) {
+#ifdef HAVE_OPENSSL
+    if (conn != NULL) {
+        SSL_shutdown(conn);
+        SSL_free(conn);
+    }
+#else
+    (void)conn;
+#endif
+}
+
+/**
+ * recv_all()/send_all() over TLS when conn is set, plain TCP otherwise
+ */
+ssize_t stream_recv_all(int fd, tls_conn_t* conn, void* buffer, size_t length) {
+#ifdef HAVE_OPENSSL
+    if (conn != NULL) {
+        size_t done = 0;
+        while (done < length) {
+            int n = SSL_read(conn, (char*)buffer + done, (int)(length - done));
+            if (n <= 0) {
+                return SSL_get_error(conn, n) == SSL_ERROR_ZERO_RETURN ? 0 : -1;
+            }
+            done += n;
+        }
+        return (ssize_t)done;
+    }
+#else
+    (void)conn;
+#endif
+    return recv_all(fd, buffer, length);
+}
+
+ssize_t stream_send_all(int fd, tls_conn_t* conn, const void* buffer, size_t length) {
+#ifdef HAVE_OPENSSL
+    if (conn != NULL) {
+        // One record per probe, the way a client/server round trip is framed
+        return SSL_write(conn, buffer, (int)length) == (int)length ? (ssize_t)length : -1;
+    }
+#else
+    (void)conn;
+#endif
+    return send_all(fd, buffer, length);
+}
+
+/**
+ * Print the reflector's handshake counts and CPU cost per handshake
+ */
+void tls_server_report(reflector_worker_t* workers, int nworkers) {
+    uint64_t full = 0, resumed = 0, failed = 0, full_ns = 0, resumed_ns = 0, ktls_tx = 0, ktls_rx = 0;
+    for (int w = 0; w < nworkers; w++) {
+        full += workers[w].tls_full;
+        resumed += workers[w].tls_resumed;
+        failed += workers[w].tls_failed;
+        full_ns += workers[w].tls_full_cpu_ns;
+        resumed_ns += workers[w].tls_resumed_cpu_ns;
+        ktls_tx += workers[w].tls_ktls_tx;
+        ktls_rx += workers[w].tls_ktls_rx;
+    }
+    printf("\nTLS (reflector):\n");
+    printf("  Handshakes: %lu full, %lu resumed, %lu failed\n",
+           (unsigned long)full, (unsigned long)resumed, (unsigned long)failed);
+    if (full > 0 && full_ns > 0) {
+        printf("  CPU per full handshake: %.1f us (%.0f per second per core)\n",
+               full_ns / 1000.0 / full, 1e9 * full / full_ns);
+    }
+    if (resumed > 0 && resumed_ns > 0) {
+        printf("  CPU per resumed handshake: %.1f us (%.0f per second per core)\n",
+               resumed_ns / 1000.0 / resumed, 1e9 * resumed / resumed_ns);
+    }
+    printf("  kTLS: %lu of %lu connections offloaded TX, %lu RX%s\n",
+           (unsigned long)ktls_tx, (unsigned long)(full + resumed), (unsigned long)ktls_rx,
+           full + resumed > 0 && ktls_tx == 0 ? " (needs the tls kernel module and OpenSSL built with ktls)" : "");
+}
+
+/**
+ * One probe round trip on a connected stream, plain or TLS
+ * Returns the RTT in microseconds, or -1 if the connection failed
+ */
+static int64_t tls_probe(int fd, tls_conn_t* conn, packet_t* packet, uint64_t seq) {
+    int size = packet->packet_size;
+    packet->seq_num = seq;
+    packet->client_send = get_timestamp_usec();
+    packet->server_recv = 0;
+    packet->server_send = 0;
+    if (stream_send_all(fd, conn, packet, size) < 0 ||
+        stream_recv_all(fd, conn, packet, sizeof(packet_t)) <= 0 ||
+        packet->packet_size != (uint32_t)size ||
+        (size > (int)sizeof(packet_t) &&
+         stream_recv_all(fd, conn, (char*)packet + sizeof(packet_t), size - sizeof(packet_t)) <= 0)) {
+        return -1;
+    }
+    packet->client_recv = get_timestamp_usec();
+    return (int64_t)(packet->client_recv - packet->client_send);
+}
+
+#ifdef HAVE_OPENSSL
+/**
+ * Handshake thread: TCP connect, then full handshakes followed by resumed
+ * ones (each new connection presents the ticket from the previous one)
+ */
+static void* tls_handshake_thread(void* arg) {
+    tls_handshake_worker_t* hw = (tls_handshake_worker_t*)arg;
+    config_t* config = hw->config;
+    packet_t* packet = create_packet(sizeof(packet_t));
+    SSL_SESSION* session = NULL;
+
+    for (int i = 0; i < 2 * TLS_HANDSHAKES && running; i++) {
+        int resume = i >= TLS_HANDSHAKES;
+        int fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            hw->failed++;
+            continue;
+        }
+        uint64_t t0 = get_timestamp_usec();
+        if (connect(fd, (struct sockaddr*)hw->addr, hw->addr_len) < 0) {
+            hw->failed++;
+            close(fd);
+            continue;
+        }
+        uint64_t t1 = get_timestamp_usec();
+        hist_record(&hw->connect, (t1 - t0) * 1000);
+
+        SSL* ssl = SSL_new(tls_ctx);
+        SSL_set_fd(ssl, fd);
+        if (resume && session != NULL) {
+            SSL_set_session(ssl, session);
+        }
+        uint64_t cpu_start = thread_cpu_ns();
+        int ok = SSL_connect(ssl) == 1;
+        uint64_t cpu_ns = thread_cpu_ns() - cpu_start;
+        uint64_t t2 = get_timestamp_usec();
+        if (!ok) {
+            hw->failed++;
+        } else if (SSL_session_reused(ssl)) {
+            hist_record(&hw->resumed, (t2 - t1) * 1000);
+            hw->resumed_cpu_ns += cpu_ns;
+        } else {
+            hist_record(&hw->full, (t2 - t1) * 1000);
+            hw->full_cpu_ns += cpu_ns;
+            if (resume) {
+                hw->not_resumed++;
+            }
+        }
+
+        // One round trip delivers the TLS 1.3 session ticket for the next resumption
+        if (ok && tls_probe(fd, ssl, packet, i + 1) >= 0) {
+            SSL_SESSION* fresh = SSL_get1_session(ssl);
+            if (fresh != NULL) {
+                SSL_SESSION_free(session);
+                session = fresh;
+            }
+        }
+        tls_close(ssl);
+        close(fd);
+    }
+
+    SSL_SESSION_free(session);
+    free(packet);
+    return NULL;
+}
+#endif
+
+/**
+ * Probe pass over one connection, TLS or plain TCP, into rtt
+ * Returns the number of replies
+ */
+static int tls_probe_pass(config_t* config, struct sockaddr_storage* addr, int addr_len, int use_tls,
+                          latency_hist_t* rtt, int* sent) {
+    int received = 0;
+    tls_conn_t* conn = NULL;
+    int interval_us = config->rate_pps > 0 ? 1000000 / config->rate_pps : config->delay_ms * 1000;
+
+    *sent = 0;
+    int fd = socket(config->use_ipv6 ? AF_INET6 : AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)addr, addr_len) < 0) {
+        perror("Connection failed");
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+#ifdef HAVE_OPENSSL
+    if (use_tls) {
+        conn = SSL_new(tls_ctx);
+        SSL_set_fd(conn, fd);
+        if (SSL_connect(conn) != 1) {
+            tls_print_errors("TLS connect");
+            SSL_free(conn);
+            close(fd);
+            return 0;
+        }
+        int ktls_tx = 0, ktls_rx = 0;
+#ifdef BIO_get_ktls_send
+        ktls_tx = BIO_get_ktls_send(SSL_get_wbio(conn));
+        ktls_rx = BIO_get_ktls_recv(SSL_get_rbio(conn));
+#endif
+        printf("TLS session: %s, %s, kTLS TX %s, RX %s\n", SSL_get_version(conn), SSL_get_cipher_name(conn),
+               ktls_tx ? "on" : "off", ktls_rx ? "on" : "off");
+    }
+#else
+    (void)use_tls;
+#endif
+
+    packet_t* packet = create_packet(config->packet_size);
+    for (int i = 0; i < config->num_packets && running; i++) {
+        (*sent)++;
+        int64_t usec = tls_probe(fd, conn, packet, i + 1);
+        if (usec < 0) {
+            printf("Server disconnected\n");
+            break;
+        }
+        if (validate_packet(packet)) {
+            hist_record(rtt, (uint64_t)usec * 1000);
+            received++;
+        }
+        if (interval_us > 0) {
+            usleep(interval_us);
+        }
+    }
+    free(packet);
+    tls_close(conn);
+    close(fd);
+    return received;
+}
+
+/**
+ * TLS client: full and resumed handshake latency and rate on -w threads,
+ * then per-probe RTT with TLS against the same reflector over plain TCP
+ */
+int run_tls_client(config_t* config) {
+    struct sockaddr_storage server_addr;
+    latency_hist_t tls_rtt, plain_rtt;
+    int status = 0;
+
+    if (tls_init(config, 0) < 0) {
+        return -1;
+    }
+    int addr_len = init_socket_address(&server_addr, config->server_ip, config->port, config->use_ipv6);
+    if (addr_len < 0) {
+        return -1;
+    }
+
+#ifdef HAVE_OPENSSL
+    int nthreads = config->workers > 0 ? config->workers : 1;
+    tls_handshake_worker_t* hws = (tls_handshake_worker_t*)calloc(nthreads, sizeof(tls_handshake_worker_t));
+    if (hws == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    printf("TLS handshakes to %s:%d: %d full then %d resumed on each of %d connection thread%s\n",
+           config->server_ip, config->port, TLS_HANDSHAKES, TLS_HANDSHAKES, nthreads, nthreads > 1 ? "s" : "");
+    fflush(stdout);
+
+    uint64_t start = get_timestamp_usec();
+    for (int t = 0; t < nthreads; t++) {
+        hws[t].config = config;
+        hws[t].addr = &server_addr;
+        hws[t].addr_len = addr_len;
+        hist_init(&hws[t].connect);
+        hist_init(&hws[t].full);
+        hist_init(&hws[t].resumed);
+        if (pthread_create(&hws[t].thread, NULL, tls_handshake_thread, &hws[t]) != 0) {
+            perror("Failed to start handshake thread");
+            exit(EXIT_FAILURE);
+        }
+    }
+    latency_hist_t connect_hist, full, resumed;
+    uint64_t full_cpu_ns = 0, resumed_cpu_ns = 0;
+    int failed = 0, not_resumed = 0;
+    hist_init(&connect_hist);
+    hist_init(&full);
+    hist_init(&resumed);
+    for (int t = 0; t < nthreads; t++) {
+        pthread_join(hws[t].thread, NULL);
+        hist_merge(&connect_hist, &hws[t].connect);
+        hist_merge(&full, &hws[t].full);
+        hist_merge(&resumed, &hws[t].resumed);
+        full_cpu_ns += hws[t].full_cpu_ns;
+        resumed_cpu_ns += hws[t].resumed_cpu_ns;
+        failed += hws[t].failed;
+        not_resumed += hws[t].not_resumed;
+    }
+    double wall_sec = (get_timestamp_usec() - start) / 1000000.0;
+    free(hws);
+
+    printf("\n--- TLS Handshake Summary ---\n");
+    printf("  %-16s %8s %10s %10s %10s %14s\n", "", "count", "p50 us", "p99 us", "max us", "client CPU us");
+    printf("  %-16s %8lu %10.1f %10.1f %10.1f %14s\n", "TCP connect", (unsigned long)connect_hist.total,
+           hist_percentile(&connect_hist, 50) / 1000.0, hist_percentile(&connect_hist, 99) / 1000.0,
+           connect_hist.max_ns / 1000.0, "-");
+    printf("  %-16s %8lu %10.1f %10.1f %10.1f %14.1f\n", "TLS full", (unsigned long)full.total,
+           hist_percentile(&full, 50) / 1000.0, hist_percentile(&full, 99) / 1000.0, full.max_ns / 1000.0,
+           full.total > 0 ? full_cpu_ns / 1000.0 / full.total : 0.0);
+    printf("  %-16s %8lu %10.1f %10.1f %10.1f %14.1f\n", "TLS resumed", (unsigned long)resumed.total,
+           hist_percentile(&resumed, 50) / 1000.0, hist_percentile(&resumed, 99) / 1000.0,
+           resumed.max_ns / 1000.0, resumed.total > 0 ? resumed_cpu_ns / 1000.0 / resumed.total : 0.0);
+    uint64_t handshakes = full.total + resumed.total;
+    printf("  Rate: %.0f handshakes/s over %d thread%s", wall_sec > 0 ? handshakes / wall_sec : 0.0,
+           nthreads, nthreads > 1 ? "s" : "");
+    if (full_cpu_ns + resumed_cpu_ns > 0) {
+        printf(", client side %.0f full or %.0f resumed per core\n",
+               full.total > 0 ? 1e9 * full.total / full_cpu_ns : 0.0,
+               resumed.total > 0 && resumed_cpu_ns > 0 ? 1e9 * resumed.total / resumed_cpu_ns : 0.0);
+    } else {
+        printf("\n");
+    }
+    if (not_resumed > 0) {
+        printf("  WARNING: %d resumption attempts fell back to a full handshake (tickets disabled?)\n", not_resumed);
+    }
+    if (failed > 0) {
+        printf("  WARNING: %d connections or handshakes failed\n", failed);
+        status = -1;
+    }
+#endif
+
+    // Same probes with and without encryption
+    int tls_sent, plain_sent;
+    hist_init(&tls_rtt);
+    hist_init(&plain_rtt);
+    printf("\nProbing: %d packets of %d bytes over TLS, then over plain TCP\n", config->num_packets,
+           config->packet_size);
+    fflush(stdout);
+    overhead_sample_t usage_start, usage_end;
+    overhead_sample(&usage_start);
+    int tls_received = tls_probe_pass(config, &server_addr, addr_len, 1, &tls_rtt, &tls_sent);
+    overhead_sample(&usage_end);
+    int plain_received = tls_probe_pass(config, &server_addr, addr_len, 0, &plain_rtt, &plain_sent);
+
+    printf("\n--- TLS vs Plain TCP Probe RTT ---\n");
+    printf("  %-10s %8s %10s %10s %10s %10s\n", "", "replies", "min us", "p50 us", "p99 us", "max us");
+    const latency_hist_t* hists[2] = { &plain_rtt, &tls_rtt };
+    const char* names[2] = { "plain TCP", "TLS" };
+    for (int k = 0; k < 2; k++) {
+        printf("  %-10s %8lu %10.1f %10.1f %10.1f %10.1f\n", names[k], (unsigned long)hists[k]->total,
+               hists[k]->total > 0 ? hists[k]->min_ns / 1000.0 : 0.0, hist_percentile(hists[k], 50) / 1000.0,
+               hist_percentile(hists[k], 99) / 1000.0, hists[k]->max_ns / 1000.0);
+    }
+    if (tls_rtt.total > 0 && plain_rtt.total > 0) {
+        printf("  TLS adds: p50 %+.1f us, p99 %+.1f us per round trip\n",
+               ((double)hist_percentile(&tls_rtt, 50) - hist_percentile(&plain_rtt, 50)) / 1000.0,
+               ((double)hist_percentile(&tls_rtt, 99) - hist_percentile(&plain_rtt, 99)) / 1000.0);
+    }
+    if (tls_received < tls_sent || plain_received < plain_sent) {
+        status = -1;
+    }
+
+    if (config->result != NULL) {
+        config->result->packets_sent = tls_sent;
+        config->result->packets_received = tls_received;
+        config->result->duration_sec = (usage_end.wall_usec - usage_start.wall_usec) / 1000000.0;
+        hist_merge(&config->result->rtt, &tls_rtt);
+    }
+    status |= overhead_report("prober", &usage_start, &usage_end, tls_sent, config->overhead_budget);
+    return status;
+}
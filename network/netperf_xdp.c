@@ -0,0 +1,473 @@
+/**
+ * AF_XDP reflector (-X): UDP probes echoed from a UMEM ring on Linux,
+ * loaded through the raw bpf syscall
+ */
+
+#include "netperf.h"
+
+#ifdef HAVE_AF_XDP
+/**
+ * bpf(2) without libbpf
+ */
+static int xdp_bpf(int cmd, union bpf_attr* attr) {
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/**
+ * Load the XDP filter: IPv4/UDP datagrams to port go to the AF_XDP socket
+ * of their RX queue (via xsks_map), everything else to the kernel stack
+ */
+static int xdp_load_program(int map_fd, int port) {
+    char log[4096];
+    struct bpf_insn prog[] = {
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 6, 1, 0, 0),           // r6 = ctx
+        XDP_INSN(BPF_LDX | BPF_W | BPF_MEM, 2, 1, 0, 0),             // r2 = data
+        XDP_INSN(BPF_LDX | BPF_W | BPF_MEM, 3, 1, 4, 0),             // r3 = data_end
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_X, 4, 2, 0, 0),
+        XDP_INSN(BPF_ALU64 | BPF_ADD | BPF_K, 4, 0, 0, XDP_UDP_PAYLOAD),
+        XDP_INSN(BPF_JMP | BPF_JGT | BPF_X, 4, 3, 14, 0),            // too short -> pass
+        XDP_INSN(BPF_LDX | BPF_H | BPF_MEM, 5, 2, 12, 0),            // ethertype
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 12, htons(0x0800)),
+        XDP_INSN(BPF_LDX | BPF_B | BPF_MEM, 5, 2, 14, 0),            // version/IHL: no options
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 10, 0x45),
+        XDP_INSN(BPF_LDX | BPF_B | BPF_MEM, 5, 2, 23, 0),            // IP protocol
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 8, IPPROTO_UDP),
+        XDP_INSN(BPF_LDX | BPF_H | BPF_MEM, 5, 2, 36, 0),            // UDP destination port
+        XDP_INSN(BPF_JMP | BPF_JNE | BPF_K, 5, 0, 6, htons(port)),
+        XDP_INSN(BPF_LD | BPF_DW | BPF_IMM, 1, BPF_PSEUDO_MAP_FD, 0, map_fd),
+        XDP_INSN(0, 0, 0, 0, 0),
+        XDP_INSN(BPF_LDX | BPF_W | BPF_MEM, 2, 6, 16, 0),            // key = rx_queue_index
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, 3, 0, 0, XDP_PASS),    // no socket on queue -> pass
+        XDP_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        XDP_INSN(BPF_ALU64 | BPF_MOV | BPF_K, 0, 0, 0, XDP_PASS),    // pass:
+        XDP_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+    union bpf_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(uintptr_t)prog;
+    attr.insn_cnt = sizeof(prog) / sizeof(prog[0]);
+    attr.license = (uint64_t)(uintptr_t)"GPL";
+    int fd = xdp_bpf(BPF_PROG_LOAD, &attr);
+    if (fd < 0) {
+        int err = errno;
+        log[0] = '\0';
+        attr.log_buf = (uint64_t)(uintptr_t)log;
+        attr.log_size = sizeof(log);
+        attr.log_level = 1;
+        xdp_bpf(BPF_PROG_LOAD, &attr);
+        fprintf(stderr, "XDP program load failed: %s\n%s", strerror(err), log);
+    }
+    return fd;
+}
+
+/**
+ * Attach the program to ifindex through a bpf link: native (driver) XDP
+ * first, generic (skb) XDP as the fallback that works on veth and lo.
+ * Returns the link fd (closing it detaches), -1 on failure
+ */
+static int xdp_attach(int prog_fd, int ifindex, int* native) {
+    union bpf_attr attr;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd = prog_fd;
+        attr.link_create.target_ifindex = ifindex;
+        attr.link_create.attach_type = BPF_XDP;
+        attr.link_create.flags = attempt == 0 ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+        int fd = xdp_bpf(BPF_LINK_CREATE, &attr);
+        if (fd >= 0) {
+            *native = attempt == 0;
+            return fd;
+        }
+        if (attempt == 1) {
+            perror("XDP attach failed");
+        }
+    }
+    return -1;
+}
+
+/**
+ * Map one ring of an AF_XDP socket
+ */
+static int xdp_map_ring(int fd, xdp_ring_t* ring, const struct xdp_ring_offset* off, size_t entry_size,
+                        off_t pgoff) {
+    ring->size = XDP_RING_SIZE;
+    ring->map_len = off->desc + XDP_RING_SIZE * entry_size;
+    ring->map = mmap(NULL, ring->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, pgoff);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        return -1;
+    }
+    ring->producer = (uint32_t*)((char*)ring->map + off->producer);
+    ring->consumer = (uint32_t*)((char*)ring->map + off->consumer);
+    ring->flags = (uint32_t*)((char*)ring->map + off->flags);
+    ring->descs = (char*)ring->map + off->desc;
+    return 0;
+}
+
+/**
+ * Create an AF_XDP socket with its own UMEM on one queue of ifindex.
+ * Zero-copy is tried first; copy mode works on any driver.
+ */
+static int xdp_socket_open(xdp_worker_t* x, int ifindex) {
+    struct xdp_umem_reg reg;
+    struct xdp_mmap_offsets off;
+    struct sockaddr_xdp sxdp;
+    socklen_t optlen = sizeof(off);
+    int ring_size = XDP_RING_SIZE;
+
+    x->fd = socket(AF_XDP, SOCK_RAW, 0);
+    if (x->fd < 0) {
+        perror("AF_XDP socket failed");
+        return -1;
+    }
+    x->umem_len = (size_t)XDP_RING_SIZE * XDP_FRAME_SIZE;
+    x->umem = (uint8_t*)mmap(NULL, x->umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (x->umem == MAP_FAILED) {
+        x->umem = NULL;
+        perror("UMEM allocation failed");
+        return -1;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uint64_t)(uintptr_t)x->umem;
+    reg.len = x->umem_len;
+    reg.chunk_size = XDP_FRAME_SIZE;
+    if (setsockopt(x->fd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg)) < 0 ||
+        setsockopt(x->fd, SOL_XDP, XDP_UMEM_FILL_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(x->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(x->fd, SOL_XDP, XDP_RX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        setsockopt(x->fd, SOL_XDP, XDP_TX_RING, &ring_size, sizeof(ring_size)) < 0 ||
+        getsockopt(x->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen) < 0) {
+        perror("AF_XDP ring setup failed");
+        return -1;
+    }
+    if (xdp_map_ring(x->fd, &x->fill, &off.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) < 0 ||
+        xdp_map_ring(x->fd, &x->comp, &off.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING) < 0 ||
+        xdp_map_ring(x->fd, &x->rx, &off.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) < 0 ||
+        xdp_map_ring(x->fd, &x->tx, &off.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) < 0) {
+        perror("AF_XDP ring mmap failed");
+        return -1;
+    }
+
+    // Every frame starts on the fill ring; frames cycle fill -> rx -> tx -> completion -> fill
+    uint64_t* fill = (uint64_t*)x->fill.descs;
+    for (uint32_t i = 0; i < XDP_RING_SIZE; i++) {
+        fill[i] = (uint64_t)i * XDP_FRAME_SIZE;
+    }
+    __atomic_store_n(x->fill.producer, XDP_RING_SIZE, __ATOMIC_RELEASE);
+
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = x->queue;
+    sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+    x->zerocopy = 1;
+    if (bind(x->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0) {
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+        x->zerocopy = 0;
+        if (bind(x->fd, (struct sockaddr*)&sxdp, sizeof(sxdp)) < 0) {
+            perror("AF_XDP bind failed");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void xdp_socket_close(xdp_worker_t* x) {
+    xdp_ring_t* rings[4] = { &x->fill, &x->comp, &x->rx, &x->tx };
+    for (int r = 0; r < 4; r++) {
+        if (rings[r]->map != NULL) {
+            munmap(rings[r]->map, rings[r]->map_len);
+        }
+    }
+    if (x->fd >= 0) {
+        close(x->fd);
+    }
+    if (x->umem != NULL) {
+        munmap(x->umem, x->umem_len);
+    }
+}
+
+/**
+ * Return transmitted frames from the completion ring to the fill ring
+ */
+static void xdp_recycle(xdp_worker_t* x) {
+    uint32_t cons = *x->comp.consumer;
+    uint32_t n = __atomic_load_n(x->comp.producer, __ATOMIC_ACQUIRE) - cons;
+    if (n == 0) {
+        return;
+    }
+    uint64_t* comp = (uint64_t*)x->comp.descs;
+    uint64_t* fill = (uint64_t*)x->fill.descs;
+    uint32_t prod = *x->fill.producer;
+    for (uint32_t i = 0; i < n; i++) {
+        fill[(prod + i) & (XDP_RING_SIZE - 1)] = comp[(cons + i) & (XDP_RING_SIZE - 1)];
+    }
+    __atomic_store_n(x->fill.producer, prod + n, __ATOMIC_RELEASE);
+    __atomic_store_n(x->comp.consumer, cons + n, __ATOMIC_RELEASE);
+}
+
+/**
+ * AF_XDP reflector thread: take a batch off the RX ring, swap MAC/IP/UDP
+ * addresses and stamp each probe in place, and queue the same frames on
+ * the TX ring
+ */
+static void* xdp_reflector_worker(void* arg) {
+    xdp_worker_t* x = (xdp_worker_t*)arg;
+    struct pollfd pfd;
+    uint64_t cpu_start = thread_cpu_ns();
+
+    if (x->config->rt_profile) {
+        rt_profile_apply_thread(x->config, x->queue, "AF_XDP reflector");
+    }
+    pfd.fd = x->fd;
+    pfd.events = POLLIN;
+    while (running) {
+        xdp_recycle(x);
+
+        uint32_t rx_cons = *x->rx.consumer;
+        uint32_t avail = __atomic_load_n(x->rx.producer, __ATOMIC_ACQUIRE) - rx_cons;
+        if (avail == 0) {
+            poll(&pfd, 1, 100);
+            continue;
+        }
+        uint32_t tx_prod = *x->tx.producer;
+        uint32_t tx_free = XDP_RING_SIZE - (tx_prod - __atomic_load_n(x->tx.consumer, __ATOMIC_ACQUIRE));
+        uint32_t n = avail < XDP_BATCH ? avail : XDP_BATCH;
+        if (n > tx_free) {
+            n = tx_free;
+        }
+
+        uint64_t now = get_timestamp_usec();
+        struct xdp_desc* rx = (struct xdp_desc*)x->rx.descs;
+        struct xdp_desc* tx = (struct xdp_desc*)x->tx.descs;
+        uint64_t* fill = (uint64_t*)x->fill.descs;
+        uint32_t fill_prod = *x->fill.producer;
+        uint32_t queued = 0, dropped = 0;
+        for (uint32_t i = 0; i < n; i++) {
+            struct xdp_desc d = rx[(rx_cons + i) & (XDP_RING_SIZE - 1)];
+            uint8_t* frame = x->umem + d.addr;
+            if (d.len < XDP_UDP_PAYLOAD + sizeof(packet_t)) {
+                fill[(fill_prod + dropped++) & (XDP_RING_SIZE - 1)] = d.addr;
+                continue;
+            }
+            uint8_t mac[6];
+            uint32_t ip;
+            uint16_t udp_port;
+            memcpy(mac, frame, 6);                     // Ethernet destination <-> source
+            memcpy(frame, frame + 6, 6);
+            memcpy(frame + 6, mac, 6);
+            memcpy(&ip, frame + 26, 4);                // IPv4 source <-> destination
+            memcpy(frame + 26, frame + 30, 4);
+            memcpy(frame + 30, &ip, 4);
+            memcpy(&udp_port, frame + 34, 2);          // UDP source <-> destination port
+            memcpy(frame + 34, frame + 36, 2);
+            memcpy(frame + 36, &udp_port, 2);
+            memset(frame + 40, 0, 2);                  // Payload changes below: no UDP checksum
+            packet_t* packet = (packet_t*)(frame + XDP_UDP_PAYLOAD);
+            packet->server_recv = now;
+            packet->server_node = NUMA_NODE_UNKNOWN;
+            packet->server_send = get_timestamp_usec();
+            tx[(tx_prod + queued) & (XDP_RING_SIZE - 1)] = d;
+            queued++;
+        }
+        __atomic_store_n(x->rx.consumer, rx_cons + n, __ATOMIC_RELEASE);
+        if (dropped > 0) {
+            __atomic_store_n(x->fill.producer, fill_prod + dropped, __ATOMIC_RELEASE);
+            x->invalid += dropped;
+        }
+        if (queued > 0) {
+            __atomic_store_n(x->tx.producer, tx_prod + queued, __ATOMIC_RELEASE);
+            // Copy mode transmits only from sendto(); zero-copy only when the driver asks
+            if (!x->zerocopy || (__atomic_load_n(x->tx.flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP)) {
+                sendto(x->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+                x->kicks++;
+            }
+            if (x->packets == 0) {
+                x->first_usec = now;
+            }
+            x->last_usec = now;
+            x->packets += queued;
+            x->batches++;
+        }
+    }
+
+    x->cpu_ns = thread_cpu_ns() - cpu_start;
+    return NULL;
+}
+
+/**
+ * The socket reflector on port + 1, with its thread CPU recorded for the comparison
+ */
+static void* xdp_socket_path_thread(void* arg) {
+    xdp_socket_path_t* path = (xdp_socket_path_t*)arg;
+    uint64_t cpu_start = thread_cpu_ns();
+    udp_reflector_worker(&path->worker);
+    path->cpu_ns = thread_cpu_ns() - cpu_start;
+    return NULL;
+}
+#endif
+
+/**
+ * Server implementation - AF_XDP reflector for UDP probes on the -I interface.
+ * An ordinary socket reflector answers on port + 1 so clients can compare.
+ */
+int run_xdp_server(config_t* config) {
+#ifdef HAVE_AF_XDP
+    int nqueues = config->workers > 0 ? config->workers : 1;
+    int native = 0;
+    int status = 0;
+    union bpf_attr attr;
+    xdp_socket_path_t path;
+    reflector_worker_t* socket_path = &path.worker;
+
+    if (config->interface[0] == '\0') {
+        fprintf(stderr, "AF_XDP mode needs the interface to attach to (-I ifname)\n");
+        return -1;
+    }
+    int ifindex = if_nametoindex(config->interface);
+    if (ifindex == 0) {
+        perror("Unknown interface");
+        return -1;
+    }
+    if (strcmp(config->interface, "lo") == 0) {
+        // Frames sent from an AF_XDP socket carry no route, and lo then rejects the local source address
+        printf("Warning: replies transmitted on lo are dropped by the IP stack; test over a veth pair instead\n");
+    }
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(int);
+    attr.value_size = sizeof(int);
+    attr.max_entries = nqueues;
+    int map_fd = xdp_bpf(BPF_MAP_CREATE, &attr);
+    if (map_fd < 0) {
+        perror("XSKMAP creation failed (needs CAP_BPF/CAP_NET_ADMIN)");
+        return -1;
+    }
+    int prog_fd = xdp_load_program(map_fd, config->port);
+    if (prog_fd < 0) {
+        close(map_fd);
+        return -1;
+    }
+
+    xdp_worker_t* workers = (xdp_worker_t*)calloc(nqueues, sizeof(xdp_worker_t));
+    if (workers == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    for (int q = 0; q < nqueues; q++) {
+        workers[q].fd = -1;
+        workers[q].queue = q;
+        workers[q].config = config;
+        if (xdp_socket_open(&workers[q], ifindex) < 0) {
+            status = -1;
+            break;
+        }
+        memset(&attr, 0, sizeof(attr));
+        attr.map_fd = map_fd;
+        attr.key = (uint64_t)(uintptr_t)&workers[q].queue;
+        attr.value = (uint64_t)(uintptr_t)&workers[q].fd;
+        if (xdp_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+            perror("XSKMAP update failed");
+            status = -1;
+            break;
+        }
+    }
+    int link_fd = status == 0 ? xdp_attach(prog_fd, ifindex, &native) : -1;
+    if (link_fd < 0) {
+        for (int q = 0; q < nqueues; q++) {
+            xdp_socket_close(&workers[q]);
+        }
+        free(workers);
+        close(prog_fd);
+        close(map_fd);
+        return -1;
+    }
+
+    // Socket path for comparison, same process, next port
+    struct sockaddr_storage addr;
+    memset(&path, 0, sizeof(path));
+    socket_path->config = config;
+    socket_path->node = -1;
+    socket_path->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int addr_size = init_socket_address(&addr, NULL, config->port + 1, 0);
+    if (socket_path->fd < 0 || bind(socket_path->fd, (struct sockaddr*)&addr, addr_size) < 0) {
+        perror("Socket-path reflector bind failed");
+        exit(EXIT_FAILURE);
+    }
+    sock_telemetry_enable(socket_path->fd, &socket_path->telemetry);
+    register_server_socket(socket_path->fd);
+
+    printf("AF_XDP reflector on %s port %d: %d queue%s, %s XDP, %s mode; socket reflector on port %d\n",
+           config->interface, config->port, nqueues, nqueues > 1 ? "s" : "", native ? "native" : "generic",
+           workers[0].zerocopy ? "zero-copy" : "copy", config->port + 1);
+    fflush(stdout);
+    config->ready = 1;
+
+    if (pthread_create(&socket_path->thread, NULL, xdp_socket_path_thread, &path) != 0) {
+        perror("Failed to start socket-path reflector");
+        exit(EXIT_FAILURE);
+    }
+    for (int q = 1; q < nqueues; q++) {
+        if (pthread_create(&workers[q].thread, NULL, xdp_reflector_worker, &workers[q]) != 0) {
+            perror("Failed to start AF_XDP worker");
+            exit(EXIT_FAILURE);
+        }
+    }
+    xdp_reflector_worker(&workers[0]);
+    for (int q = 1; q < nqueues; q++) {
+        pthread_join(workers[q].thread, NULL);
+    }
+    pthread_join(socket_path->thread, NULL);
+    close(link_fd);
+
+    printf("\n--- AF_XDP vs Socket Reflector ---\n");
+    printf("  %-18s %10s %10s %12s %14s %12s\n", "path", "packets", "per batch", "CPU ns/pkt", "pps per core",
+           "XDP drops");
+    uint64_t total = 0;
+    for (int q = 0; q < nqueues; q++) {
+        xdp_worker_t* x = &workers[q];
+        struct xdp_statistics stats;
+        socklen_t optlen = sizeof(stats);
+        memset(&stats, 0, sizeof(stats));
+        getsockopt(x->fd, SOL_XDP, XDP_STATISTICS, &stats, &optlen);
+        char name[32];
+        snprintf(name, sizeof(name), "AF_XDP queue %d", q);
+        double ns = x->packets > 0 ? (double)x->cpu_ns / x->packets : 0.0;
+        printf("  %-18s %10lu %10.1f %12.0f %14.0f %12llu\n", name, (unsigned long)x->packets,
+               x->batches > 0 ? (double)x->packets / x->batches : 0.0, ns, ns > 0 ? 1e9 / ns : 0.0,
+               (unsigned long long)(stats.rx_dropped + stats.rx_invalid_descs));
+        if (x->last_usec > x->first_usec) {
+            printf("  %-18s   %.0f pps while active, %lu TX kicks, %lu short frames\n", "",
+                   x->packets * 1e6 / (x->last_usec - x->first_usec), (unsigned long)x->kicks,
+                   (unsigned long)x->invalid);
+        }
+        total += x->packets;
+    }
+    double socket_ns = socket_path->packets > 0 ? (double)path.cpu_ns / socket_path->packets : 0.0;
+    printf("  %-18s %10lu %10s %12.0f %14.0f %12u\n", "socket (port + 1)", (unsigned long)socket_path->packets,
+           "1", socket_ns, socket_ns > 0 ? 1e9 / socket_ns : 0.0, socket_path->telemetry.rx_drops);
+    printf("  Compare RTT by probing port %d (AF_XDP) and port %d (socket) from the client\n",
+           config->port, config->port + 1);
+    if (config->result != NULL) {
+        config->result->packets_received = (int)(total + socket_path->packets);
+    }
+
+    for (int q = 0; q < nqueues; q++) {
+        xdp_socket_close(&workers[q]);
+    }
+    close(socket_path->fd);
+    free(workers);
+    close(prog_fd);
+    close(map_fd);
+    printf("AF_XDP reflector shutdown complete\n");
+    return 0;
+#else
+    (void)config;
+    fprintf(stderr, "AF_XDP is not available on this platform (Linux with linux/if_xdp.h needed)\n");
+    return -1;
+#endif
+}
@@ -1,43 +1,852 @@
+/**
+ * End-to-end Test Driver for the Network Performance Measurement Tool
+ *
+ * Spawns the netperf reflector binary, runs scripted client scenarios against it
+ * over loopback (baseline, loss through a userspace UDP proxy, high rate, many
+ * connections, a controller campaign across agent processes, multicast to several
+ * receiver processes) and asserts the tool's accounting: every probe sent, losses match
+ * what the proxy dropped and nothing else, percentiles are ordered, and the
+ * reflector shuts down cleanly. Throughput and RTT percentiles of each scenario
+ * are recorded so the tool's own correctness under load is checked on every run.
+ *
+ * Compile with: gcc -O2 -std=gnu99 -o nettest test.c netperf_*.c -pthread -lm
+ *
+ * Usage:
+ *   ./nettest [-b netperf_binary] [-p base_port] [-s scenario] [-o results.json]
+ */
 
-#define _ALL_SOURCE
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <stdint.h>
-#include <sys/time.h>
-#include <signal.h>
+#include "netperf.h"
 
-// תצוגה לדוגמה - ממשק בסיסי בלבד לצורך הקימפול
-void print_usage(const char* prog_name) {
-    printf("Usage: %s [-s | -c server_ip]\n", prog_name);
+#include <sys/wait.h>
+#include <poll.h>
+
+#define TEST_DEFAULT_BINARY "./netperf"
+#define TEST_DEFAULT_PORT 19888
+#define TEST_PROXY_PORT_OFFSET 100      // Proxy listens this far above the reflector
+#define TEST_AGENT_PORT_OFFSET 200      // Agent control ports start this far above the reflector
+#define TEST_START_TIMEOUT_MS 5000
+#define TEST_STOP_TIMEOUT_MS 5000
+#define TEST_MAX_AGENTS 16
+#define TEST_MCAST_GROUP "230.0.1.0"
+#define TEST_MCAST_JOIN_MS 300          // Receivers are given this long to join before probing
+
+// One scripted scenario
+typedef struct {
+    const char* name;
+    int protocol;
+    int workers;             // Reflector worker threads
+    int clients;             // Concurrent client threads (one connection each)
+    int probes;              // Per client
+    int packet_size;
+    int rate_pps;            // Per client, 0 = unpaced
+    int loss_every;          // Route UDP through the proxy, dropping every Nth datagram each way
+    int campaign;            // Drive the run through a controller and one agent process per client;
+                             // 2 = mesh: the reflecting agent is also the first client;
+                             // 3 = agent limits: plans over the agent's -r/-n (rate_pps, probes) are refused
+    int multicast;           // One sender to a group joined by one receiver process per client
+} scenario_t;
+
+// Measurements and verdict of one scenario
+typedef struct {
+    const char* name;
+    int sent;
+    int received;
+    int late;
+    int proxy_dropped;
+    double wall_sec;
+    double throughput_pps;
+    double min_us;
+    double p50_us;
+    double p90_us;
+    double p99_us;
+    double max_us;
+    int failures;
+} scenario_result_t;
+
+// Client thread arguments
+typedef struct {
+    config_t config;
+    run_result_t result;
+    int status;
+    pthread_t thread;
+} test_client_t;
+
+// Userspace UDP proxy that drops a deterministic share of datagrams
+typedef struct {
+    int client_fd;           // Faces the clients
+    int upstream_fd;         // Connected to the reflector
+    int drop_every;
+    int requests;
+    int replies;
+    int dropped;
+    volatile int stop;
+    pthread_t thread;
+} loss_proxy_t;
+
+// Assertion helper: report and count a failed check without stopping the scenario
+#define CHECK(result, cond, ...) do { \
+        if (!(cond)) { \
+            printf("FAIL %s: ", (result)->name); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            (result)->failures++; \
+        } \
+    } while (0)
+
+void print_test_usage(const char* prog_name) {
+    printf("Usage: %s [-b netperf_binary] [-p base_port] [-s scenario] [-o results.json]\n\n", prog_name);
+    printf("Options:\n");
+    printf("  -b binary         Reflector binary to spawn (default: %s)\n", TEST_DEFAULT_BINARY);
+    printf("  -p port           First loopback port; each scenario uses the next one (default: %d)\n",
+           TEST_DEFAULT_PORT);
+    printf("  -s name           Only run scenarios whose name contains name\n");
+    printf("  -o file           Write scenario results as JSON\n");
+    printf("  -h                Display this help message\n");
+}
+
+/**
+ * Start the reflector binary as a child process; its reports go to /dev/null
+ */
+pid_t spawn_reflector(const char* binary, int protocol, int port, int workers) {
+    char port_arg[16], workers_arg[16];
+    snprintf(port_arg, sizeof(port_arg), "%d", port);
+    snprintf(workers_arg, sizeof(workers_arg), "%d", workers);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            close(devnull);
+        }
+        if (protocol == PROTOCOL_UDP) {
+            execl(binary, binary, "-s", "-u", "-p", port_arg, "-w", workers_arg, "-q", (char*)NULL);
+        } else {
+            execl(binary, binary, "-s", "-p", port_arg, "-w", workers_arg, "-q", (char*)NULL);
+        }
+        perror("exec of reflector failed");
+        _exit(127);
+    }
+    return pid;
 }
 
-// פונקציה שמחזירה timestamp במיקרושניות
-uint64_t get_timestamp_usec() {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return (uint64_t)(tv.tv_sec * 1000000 + tv.tv_usec);
+/**
+ * Wait until the reflector answers on its port
+ * Returns 0 when ready, -1 on timeout or if the child exited
+ */
+int wait_for_reflector(pid_t pid, int protocol, int port) {
+    struct sockaddr_storage addr;
+    int addr_len = init_socket_address(&addr, "127.0.0.1", port, 0);
+    packet_t probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.packet_size = sizeof(packet_t);
+
+    for (int waited = 0; waited < TEST_START_TIMEOUT_MS; waited += 10) {
+        int status;
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            fprintf(stderr, "Reflector exited during startup (status %d)\n", status);
+            return -1;
+        }
+
+        int fd = socket(AF_INET, protocol == PROTOCOL_UDP ? SOCK_DGRAM : SOCK_STREAM, 0);
+        if (fd < 0) {
+            perror("Socket creation failed");
+            return -1;
+        }
+        int ready = 0;
+        if (protocol == PROTOCOL_TCP) {
+            ready = connect(fd, (struct sockaddr*)&addr, addr_len) == 0;
+        } else {
+            struct timeval tv = { 0, 10000 };
+            setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            sendto(fd, &probe, sizeof(probe), 0, (struct sockaddr*)&addr, addr_len);
+            ready = recv(fd, &probe, sizeof(probe), 0) == (ssize_t)sizeof(probe);
+        }
+        close(fd);
+        if (ready) {
+            return 0;
+        }
+        usleep(10000);
+    }
+
+    fprintf(stderr, "Reflector did not answer on port %d\n", port);
+    return -1;
 }
 
-// סימולציה של התחלה
-int main(int argc, char *argv[]) {
-    printf("Enhanced Netperf Tool (demo)\n");
-    if (argc < 2) {
-        print_usage(argv[0]);
-        return 1;
-    }
-
-    if (strcmp(argv[1], "-s") == 0) {
-        printf("Running in server mode...\n");
-        // פה ייכנס הקוד המלא של run_tcp_server וכו'
-    } else if (strcmp(argv[1], "-c") == 0 && argc > 2) {
-        printf("Running in client mode, connecting to: %s\n", argv[2]);
-        // פה ייכנס הקוד של run_tcp_client וכו'
+/**
+ * Interrupt the reflector and reap it
+ * Returns its exit status, or -1 if it had to be killed
+ */
+int stop_reflector(pid_t pid) {
+    int status;
+    kill(pid, SIGINT);
+    for (int waited = 0; waited < TEST_STOP_TIMEOUT_MS; waited += 10) {
+        if (waitpid(pid, &status, WNOHANG) == pid) {
+            return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+        }
+        usleep(10000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return -1;
+}
+
+void* loss_proxy_thread(void* arg) {
+    loss_proxy_t* proxy = (loss_proxy_t*)arg;
+    char buffer[MAX_PACKET_SIZE];
+    struct sockaddr_storage client_addr;
+    socklen_t client_len = 0;
+    struct pollfd fds[2];
+
+    fds[0].fd = proxy->client_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = proxy->upstream_fd;
+    fds[1].events = POLLIN;
+
+    while (!proxy->stop) {
+        if (poll(fds, 2, 100) <= 0) {
+            continue;
+        }
+
+        // Client -> reflector: drop every Nth request
+        if (fds[0].revents & POLLIN) {
+            socklen_t len = sizeof(client_addr);
+            ssize_t n = recvfrom(proxy->client_fd, buffer, sizeof(buffer), 0,
+                                 (struct sockaddr*)&client_addr, &len);
+            if (n > 0) {
+                client_len = len;
+                if (++proxy->requests % proxy->drop_every == 0) {
+                    proxy->dropped++;
+                } else {
+                    send(proxy->upstream_fd, buffer, n, 0);
+                }
+            }
+        }
+
+        // Reflector -> client: drop replies half a period out of phase
+        if (fds[1].revents & POLLIN) {
+            ssize_t n = recv(proxy->upstream_fd, buffer, sizeof(buffer), 0);
+            if (n > 0 && client_len > 0) {
+                if (++proxy->replies % proxy->drop_every == proxy->drop_every / 2) {
+                    proxy->dropped++;
+                } else {
+                    sendto(proxy->client_fd, buffer, n, 0, (struct sockaddr*)&client_addr, client_len);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Start the proxy on listen_port, forwarding to the reflector on port
+ */
+int loss_proxy_start(loss_proxy_t* proxy, int listen_port, int port, int drop_every) {
+    struct sockaddr_storage addr;
+    int addr_len;
+
+    memset(proxy, 0, sizeof(loss_proxy_t));
+    proxy->drop_every = drop_every;
+    proxy->client_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    proxy->upstream_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (proxy->client_fd < 0 || proxy->upstream_fd < 0) {
+        perror("Socket creation failed");
+        return -1;
+    }
+
+    addr_len = init_socket_address(&addr, "127.0.0.1", listen_port, 0);
+    if (bind(proxy->client_fd, (struct sockaddr*)&addr, addr_len) < 0) {
+        perror("Proxy bind failed");
+        return -1;
+    }
+    addr_len = init_socket_address(&addr, "127.0.0.1", port, 0);
+    if (connect(proxy->upstream_fd, (struct sockaddr*)&addr, addr_len) < 0) {
+        perror("Proxy connect failed");
+        return -1;
+    }
+
+    if (pthread_create(&proxy->thread, NULL, loss_proxy_thread, proxy) != 0) {
+        perror("Failed to start proxy");
+        return -1;
+    }
+    return 0;
+}
+
+void loss_proxy_stop(loss_proxy_t* proxy) {
+    proxy->stop = 1;
+    pthread_join(proxy->thread, NULL);
+    close(proxy->client_fd);
+    close(proxy->upstream_fd);
+}
+
+void* test_client_thread(void* arg) {
+    test_client_t* client = (test_client_t*)arg;
+    if (client->config.protocol == PROTOCOL_TCP) {
+        client->status = run_tcp_client(&client->config);
     } else {
-        print_usage(argv[0]);
-        return 1;
+        client->status = run_udp_client(&client->config);
+    }
+    return NULL;
+}
+
+/**
+ * Run one scenario end to end and check its invariants
+ */
+void run_scenario(const scenario_t* s, const char* binary, int port, scenario_result_t* r) {
+    test_client_t* clients;
+    loss_proxy_t proxy;
+    latency_hist_t rtt;
+    int target_port = port;
+
+    memset(r, 0, sizeof(scenario_result_t));
+    r->name = s->name;
+
+    pid_t pid = spawn_reflector(binary, s->protocol, port, s->workers);
+    if (pid < 0 || wait_for_reflector(pid, s->protocol, port) < 0) {
+        CHECK(r, 0, "reflector did not start");
+        if (pid > 0) {
+            stop_reflector(pid);
+        }
+        return;
+    }
+
+    if (s->loss_every > 0) {
+        target_port = port + TEST_PROXY_PORT_OFFSET;
+        if (loss_proxy_start(&proxy, target_port, port, s->loss_every) < 0) {
+            CHECK(r, 0, "loss proxy did not start");
+            stop_reflector(pid);
+            return;
+        }
+    }
+
+    clients = (test_client_t*)calloc(s->clients, sizeof(test_client_t));
+    if (clients == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+
+    // The client's own reports go to /dev/null while the scenario runs
+    fflush(stdout);
+    int saved_stdout = dup(STDOUT_FILENO);
+    int devnull = open("/dev/null", O_WRONLY);
+    dup2(devnull, STDOUT_FILENO);
+    close(devnull);
+
+    uint64_t start = get_timestamp_usec();
+    for (int c = 0; c < s->clients; c++) {
+        config_t* config = &clients[c].config;
+        strcpy(config->server_ip, "127.0.0.1");
+        config->port = target_port;
+        config->protocol = s->protocol;
+        config->num_packets = s->probes;
+        config->packet_size = s->packet_size;
+        config->rate_pps = s->rate_pps;
+        config->quiet = 1;
+        config->result = &clients[c].result;
+        hist_init(&clients[c].result.rtt);
+
+        if (pthread_create(&clients[c].thread, NULL, test_client_thread, &clients[c]) != 0) {
+            perror("Failed to start client");
+            exit(EXIT_FAILURE);
+        }
     }
 
+    hist_init(&rtt);
+    for (int c = 0; c < s->clients; c++) {
+        pthread_join(clients[c].thread, NULL);
+    }
+    r->wall_sec = (get_timestamp_usec() - start) / 1000000.0;
+
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+
+    if (s->loss_every > 0) {
+        loss_proxy_stop(&proxy);
+        r->proxy_dropped = proxy.dropped;
+    }
+    int reflector_status = stop_reflector(pid);
+
+    // Sequence accounting per client
+    for (int c = 0; c < s->clients; c++) {
+        run_result_t* cr = &clients[c].result;
+        CHECK(r, clients[c].status == 0, "client %d returned status %d", c, clients[c].status);
+        CHECK(r, cr->packets_sent == s->probes, "client %d sent %d of %d probes",
+              c, cr->packets_sent, s->probes);
+        CHECK(r, cr->packets_received <= cr->packets_sent, "client %d received %d > sent %d",
+              c, cr->packets_received, cr->packets_sent);
+        CHECK(r, cr->rtt.total == (uint64_t)cr->packets_received,
+              "client %d recorded %lu RTTs for %d replies",
+              c, (unsigned long)cr->rtt.total, cr->packets_received);
+        hist_merge(&rtt, &cr->rtt);
+        r->sent += cr->packets_sent;
+        r->received += cr->packets_received;
+        r->late += cr->late_replies;
+    }
+
+    // Loss must be exactly what the proxy dropped; none on plain loopback
+    CHECK(r, r->sent - r->received == r->proxy_dropped,
+          "%d probes lost, expected %d", r->sent - r->received, r->proxy_dropped);
+    CHECK(r, r->late == 0, "%d late replies", r->late);
+
+    // Percentiles must be ordered and inside the observed range
+    if (rtt.total > 0) {
+        r->min_us = rtt.min_ns / 1000.0;
+        r->p50_us = hist_percentile(&rtt, 50) / 1000.0;
+        r->p90_us = hist_percentile(&rtt, 90) / 1000.0;
+        r->p99_us = hist_percentile(&rtt, 99) / 1000.0;
+        r->max_us = rtt.max_ns / 1000.0;
+        CHECK(r, r->min_us <= r->p50_us && r->p50_us <= r->p90_us &&
+                 r->p90_us <= r->p99_us && r->p99_us <= r->max_us,
+              "percentiles out of order: min %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f",
+              r->min_us, r->p50_us, r->p90_us, r->p99_us, r->max_us);
+    }
+    CHECK(r, r->received > 0, "no replies received");
+    CHECK(r, reflector_status == 0, "reflector exit status %d after SIGINT", reflector_status);
+
+    r->throughput_pps = r->wall_sec > 0 ? r->received / r->wall_sec : 0.0;
+    free(clients);
+}
+
+/**
+ * Start an agent process listening for a controller on port; max_pps and
+ * max_packets > 0 are passed as its -r/-n caps
+ */
+pid_t spawn_agent(const char* binary, int port, int max_pps, int max_packets) {
+    char port_arg[16], rate_arg[16], count_arg[16];
+    char* args[10];
+    int n = 0;
+    snprintf(port_arg, sizeof(port_arg), "%d", port);
+    snprintf(rate_arg, sizeof(rate_arg), "%d", max_pps);
+    snprintf(count_arg, sizeof(count_arg), "%d", max_packets);
+    args[n++] = (char*)binary;
+    args[n++] = "-A";
+    args[n++] = "-p";
+    args[n++] = port_arg;
+    if (max_pps > 0) {
+        args[n++] = "-r";
+        args[n++] = rate_arg;
+    }
+    if (max_packets > 0) {
+        args[n++] = "-n";
+        args[n++] = count_arg;
+    }
+    args[n] = NULL;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            close(devnull);
+        }
+        execv(binary, args);
+        perror("exec of agent failed");
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * Run a scenario as a controller campaign: one reflecting agent and one
+ * probing agent per client, all separate processes on loopback. In a mesh
+ * the reflecting agent holds both roles on one control connection.
+ */
+void run_campaign_scenario(const scenario_t* s, const char* binary, int port, scenario_result_t* r) {
+    int mesh = s->campaign == 2;
+    int num_agents = mesh ? s->clients : s->clients + 1;
+    pid_t pids[TEST_MAX_AGENTS];
+    config_t config;
+    run_result_t result;
+    char plan[64];
+    int spawned = 0;
+
+    memset(r, 0, sizeof(scenario_result_t));
+    r->name = s->name;
+    if (num_agents > TEST_MAX_AGENTS) {
+        CHECK(r, 0, "%d agents requested, at most %d", num_agents, TEST_MAX_AGENTS);
+        return;
+    }
+
+    snprintf(plan, sizeof(plan), "/tmp/nettest_plan_%d.txt", (int)getpid());
+    FILE* f = fopen(plan, "w");
+    if (f == NULL) {
+        CHECK(r, 0, "cannot write plan %s", plan);
+        return;
+    }
+    const char* proto = s->protocol == PROTOCOL_TCP ? "tcp" : "udp";
+    fprintf(f, "reflect agent=127.0.0.1:%d proto=%s port=%d workers=%d\n",
+            port + TEST_AGENT_PORT_OFFSET, proto, port, s->workers);
+    for (int a = mesh ? 0 : 1; a < num_agents; a++) {
+        fprintf(f, "probe agent=127.0.0.1:%d target=127.0.0.1:%d proto=%s size=%d rate=%d count=%d\n",
+                port + TEST_AGENT_PORT_OFFSET + a, port, proto, s->packet_size, s->rate_pps, s->probes);
+    }
+    fclose(f);
+
+    for (int a = 0; a < num_agents; a++) {
+        pids[a] = spawn_agent(binary, port + TEST_AGENT_PORT_OFFSET + a, 0, 0);
+        if (pids[a] < 0) {
+            CHECK(r, 0, "agent %d did not start", a);
+            break;
+        }
+        spawned++;
+    }
+
+    if (spawned == num_agents) {
+        memset(&config, 0, sizeof(config_t));
+        strncpy(config.plan_file, plan, sizeof(config.plan_file) - 1);
+        memset(&result, 0, sizeof(result));
+        hist_init(&result.rtt);
+        config.result = &result;
+
+        // The controller's report goes to /dev/null while the campaign runs
+        fflush(stdout);
+        int saved_stdout = dup(STDOUT_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+
+        uint64_t start = get_timestamp_usec();
+        int status = run_controller(&config);
+        r->wall_sec = (get_timestamp_usec() - start) / 1000000.0;
+
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+
+        r->sent = result.packets_sent;
+        r->received = result.packets_received;
+        CHECK(r, status == 0, "controller returned status %d", status);
+        CHECK(r, r->sent == s->clients * s->probes, "agents sent %d of %d probes",
+              r->sent, s->clients * s->probes);
+        CHECK(r, r->received == r->sent, "%d probes lost on loopback", r->sent - r->received);
+        CHECK(r, result.rtt.total == (uint64_t)r->received, "merged histogram holds %lu of %d replies",
+              (unsigned long)result.rtt.total, r->received);
+        if (result.rtt.total > 0) {
+            r->min_us = result.rtt.min_ns / 1000.0;
+            r->p50_us = hist_percentile(&result.rtt, 50) / 1000.0;
+            r->p90_us = hist_percentile(&result.rtt, 90) / 1000.0;
+            r->p99_us = hist_percentile(&result.rtt, 99) / 1000.0;
+            r->max_us = result.rtt.max_ns / 1000.0;
+            CHECK(r, r->min_us <= r->p50_us && r->p50_us <= r->p90_us &&
+                     r->p90_us <= r->p99_us && r->p99_us <= r->max_us,
+                  "percentiles out of order: min %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f",
+                  r->min_us, r->p50_us, r->p90_us, r->p99_us, r->max_us);
+        }
+        r->throughput_pps = r->wall_sec > 0 ? r->received / r->wall_sec : 0.0;
+    }
+
+    for (int a = 0; a < spawned; a++) {
+        int agent_status = stop_reflector(pids[a]);
+        CHECK(r, agent_status == 0, "agent %d exit status %d after SIGINT", a, agent_status);
+    }
+    unlink(plan);
+}
+
+/**
+ * Send one PLAN to an agent and check whether it is accepted
+ */
+static void check_agent_plan(scenario_result_t* r, int fd, FILE* in, char* line, const char* plan,
+                             const char* expected) {
+    if (ctl_send_line(fd, "PLAN role=probe %s", plan) < 0 || ctl_read_line(in, line, TEST_START_TIMEOUT_MS) == NULL) {
+        CHECK(r, 0, "no reply to PLAN %s", plan);
+        return;
+    }
+    CHECK(r, strncmp(line, expected, strlen(expected)) == 0, "PLAN %s: expected %s, got %.60s",
+          plan, expected, line);
+}
+
+/**
+ * Start an agent with -r/-n caps and check that it refuses plans above
+ * them, including unpaced ones (rate=0), and accepts a plan within them
+ */
+void run_agent_limits_scenario(const scenario_t* s, const char* binary, int port, scenario_result_t* r) {
+    char plan[160];
+    char* line = (char*)malloc(CTL_MAX_LINE);
+    int ctl_port = port + TEST_AGENT_PORT_OFFSET;
+
+    memset(r, 0, sizeof(scenario_result_t));
+    r->name = s->name;
+    pid_t pid = spawn_agent(binary, ctl_port, s->rate_pps, s->probes);
+    if (pid < 0 || line == NULL) {
+        CHECK(r, 0, "agent did not start");
+        free(line);
+        return;
+    }
+
+    campaign_agent_t agent;
+    memset(&agent, 0, sizeof(agent));
+    snprintf(agent.host, sizeof(agent.host), "127.0.0.1");
+    agent.port = ctl_port;
+    if (campaign_connect(&agent, line) < 0) {
+        CHECK(r, 0, "cannot connect to the agent on port %d", ctl_port);
+    } else {
+        const char* target = "target=127.0.0.1:9 proto=udp size=64";
+        snprintf(plan, sizeof(plan), "%s rate=0 count=%d", target, s->probes);
+        check_agent_plan(r, agent.fd, agent.in, line, plan, "ERR reason=rate_limit");
+        snprintf(plan, sizeof(plan), "%s rate=%d count=10", target, s->rate_pps + 1);
+        check_agent_plan(r, agent.fd, agent.in, line, plan, "ERR reason=rate_limit");
+        snprintf(plan, sizeof(plan), "%s rate=%d duration=3600", target, s->rate_pps);
+        check_agent_plan(r, agent.fd, agent.in, line, plan, "ERR reason=count_limit");
+        snprintf(plan, sizeof(plan), "%s rate=%d count=%d", target, s->rate_pps, s->probes);
+        check_agent_plan(r, agent.fd, agent.in, line, plan, "READY");
+        ctl_send_line(agent.fd, "BYE");
+    }
+    if (agent.in != NULL) {
+        fclose(agent.in);
+    }
+    if (agent.fd > 0) {
+        close(agent.fd);
+    }
+
+    int agent_status = stop_reflector(pid);
+    CHECK(r, agent_status == 0, "agent exit status %d after SIGINT", agent_status);
+    free(line);
+}
+
+/**
+ * Start a multicast receiver process joined to TEST_MCAST_GROUP on port
+ */
+pid_t spawn_mcast_receiver(const char* binary, int port) {
+    char port_arg[16];
+    snprintf(port_arg, sizeof(port_arg), "%d", port);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork failed");
+        return -1;
+    }
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            close(devnull);
+        }
+        execl(binary, binary, "-s", "-g", TEST_MCAST_GROUP, "-p", port_arg, (char*)NULL);
+        perror("exec of multicast receiver failed");
+        _exit(127);
+    }
+    return pid;
+}
+
+/**
+ * Run a scenario as multicast: one in-process sender, one receiver process
+ * per client, every receiver must answer every probe
+ */
+void run_multicast_scenario(const scenario_t* s, const char* binary, int port, scenario_result_t* r) {
+    pid_t pids[TEST_MAX_AGENTS];
+    config_t config;
+    run_result_t result;
+    int spawned = 0;
+
+    memset(r, 0, sizeof(scenario_result_t));
+    r->name = s->name;
+    if (s->clients > TEST_MAX_AGENTS) {
+        CHECK(r, 0, "%d receivers requested, at most %d", s->clients, TEST_MAX_AGENTS);
+        return;
+    }
+
+    for (int c = 0; c < s->clients; c++) {
+        pids[c] = spawn_mcast_receiver(binary, port);
+        if (pids[c] < 0) {
+            CHECK(r, 0, "receiver %d did not start", c);
+            break;
+        }
+        spawned++;
+    }
+
+    if (spawned == s->clients) {
+        usleep(TEST_MCAST_JOIN_MS * 1000);
+        memset(&config, 0, sizeof(config_t));
+        strncpy(config.mcast_group, TEST_MCAST_GROUP, sizeof(config.mcast_group) - 1);
+        config.port = port;
+        config.protocol = PROTOCOL_UDP;
+        config.num_packets = s->probes;
+        config.packet_size = s->packet_size;
+        config.rate_pps = s->rate_pps;
+        memset(&result, 0, sizeof(result));
+        hist_init(&result.rtt);
+        config.result = &result;
+
+        // The sender's report goes to /dev/null while the scenario runs
+        fflush(stdout);
+        int saved_stdout = dup(STDOUT_FILENO);
+        int devnull = open("/dev/null", O_WRONLY);
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+
+        uint64_t start = get_timestamp_usec();
+        int status = run_mcast_sender(&config);
+        r->wall_sec = (get_timestamp_usec() - start) / 1000000.0;
+
+        fflush(stdout);
+        dup2(saved_stdout, STDOUT_FILENO);
+        close(saved_stdout);
+
+        // Each probe is counted once per answering receiver
+        r->sent = result.packets_sent * s->clients;
+        r->received = result.packets_received;
+        CHECK(r, status == 0, "sender returned status %d", status);
+        CHECK(r, result.packets_sent == s->probes, "sender sent %d of %d probes", result.packets_sent, s->probes);
+        CHECK(r, r->received == r->sent, "%d of %d receiver replies missing", r->sent - r->received, r->sent);
+        if (result.rtt.total > 0) {
+            r->min_us = result.rtt.min_ns / 1000.0;
+            r->p50_us = hist_percentile(&result.rtt, 50) / 1000.0;
+            r->p90_us = hist_percentile(&result.rtt, 90) / 1000.0;
+            r->p99_us = hist_percentile(&result.rtt, 99) / 1000.0;
+            r->max_us = result.rtt.max_ns / 1000.0;
+            CHECK(r, r->min_us <= r->p50_us && r->p50_us <= r->p90_us &&
+                     r->p90_us <= r->p99_us && r->p99_us <= r->max_us,
+                  "percentiles out of order: min %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f",
+                  r->min_us, r->p50_us, r->p90_us, r->p99_us, r->max_us);
+        }
+        r->throughput_pps = r->wall_sec > 0 ? r->received / r->wall_sec : 0.0;
+    }
+
+    for (int c = 0; c < spawned; c++) {
+        int receiver_status = stop_reflector(pids[c]);
+        CHECK(r, receiver_status == 0, "receiver %d exit status %d after SIGINT", c, receiver_status);
+    }
+}
+
+/**
+ * Write scenario results as JSON, one result object per line
+ */
+int write_test_json(const char* path, const scenario_t* scenarios, const scenario_result_t* results,
+                    const int* ran, int count) {
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        perror("Failed to open results file");
+        return -1;
+    }
+
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    time_t now = time(NULL);
+    char created[32];
+    strftime(created, sizeof(created), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"tool\": \"nettest\",\n");
+    fprintf(f, "  \"host\": \"%s\",\n", host);
+    fprintf(f, "  \"created\": \"%s\",\n", created);
+    fprintf(f, "  \"results\": [\n");
+    int first = 1;
+    for (int i = 0; i < count; i++) {
+        if (!ran[i]) {
+            continue;
+        }
+        const scenario_result_t* r = &results[i];
+        fprintf(f, "%s    {\"scenario\": \"%s\", \"pass\": %s, \"failures\": %d, \"sent\": %d, \"received\": %d, "
+                   "\"proxy_dropped\": %d, \"throughput_pps\": %.1f, \"p50_us\": %.2f, \"p90_us\": %.2f, "
+                   "\"p99_us\": %.2f, \"max_us\": %.2f}",
+                first ? "" : ",\n", scenarios[i].name, r->failures == 0 ? "true" : "false", r->failures,
+                r->sent, r->received, r->proxy_dropped, r->throughput_pps,
+                r->p50_us, r->p90_us, r->p99_us, r->max_us);
+        first = 0;
+    }
+    fprintf(f, "\n  ]\n}\n");
+    fclose(f);
     return 0;
 }
+
+int main(int argc, char *argv[]) {
+    int opt;
+    const char* binary = TEST_DEFAULT_BINARY;
+    int port = TEST_DEFAULT_PORT;
+    const char* filter = NULL;
+    const char* output_file = NULL;
+
+    static const scenario_t scenarios[] = {
+        // name                   protocol      workers clients probes size  rate  loss_every campaign multicast
+        { "udp_baseline",         PROTOCOL_UDP, 1,      1,      5000,  1024, 0,    0,         0,        0 },
+        { "tcp_baseline",         PROTOCOL_TCP, 1,      1,      5000,  1024, 0,    0,         0,        0 },
+        { "udp_loss_proxy",       PROTOCOL_UDP, 1,      1,      100,   512,  0,    40,        0,        0 },
+        { "udp_high_rate",        PROTOCOL_UDP, 4,      4,      20000, 256,  0,    0,         0,        0 },
+        { "udp_many_clients",     PROTOCOL_UDP, 2,      16,     500,   1024, 2000, 0,         0,        0 },
+        { "tcp_many_connections", PROTOCOL_TCP, 8,      32,     200,   1024, 0,    0,         0,        0 },
+        { "campaign_agents",      PROTOCOL_UDP, 2,      3,      2000,  256,  4000, 0,         1,        0 },
+        { "campaign_mesh",        PROTOCOL_TCP, 2,      2,      2000,  256,  4000, 0,         2,        0 },
+        { "campaign_agent_limits", PROTOCOL_UDP, 1,     1,      1000,  64,   100,  0,         3,        0 },
+        { "udp_multicast",        PROTOCOL_UDP, 1,      3,      2000,  512,  2000, 0,         0,        1 },
+    };
+    int num_scenarios = sizeof(scenarios) / sizeof(scenarios[0]);
+    scenario_result_t results[sizeof(scenarios) / sizeof(scenarios[0])];
+    int ran[sizeof(scenarios) / sizeof(scenarios[0])];
+
+    signal(SIGPIPE, SIG_IGN);
+
+    while ((opt = getopt(argc, argv, "b:p:s:o:h")) != -1) {
+        switch (opt) {
+            case 'b':
+                binary = optarg;
+                break;
+            case 'p':
+                port = atoi(optarg);
+                break;
+            case 's':
+                filter = optarg;
+                break;
+            case 'o':
+                output_file = optarg;
+                break;
+            case 'h':
+                print_test_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_test_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (access(binary, X_OK) != 0) {
+        fprintf(stderr, "Reflector binary %s not found (build it with make netperf)\n", binary);
+        exit(EXIT_FAILURE);
+    }
+
+    printf("%-22s %8s %8s %6s %12s %9s %9s %9s  %s\n",
+           "scenario", "sent", "recv", "drop", "probes/s", "p50 us", "p99 us", "max us", "result");
+    int failed = 0, passed = 0;
+    for (int i = 0; i < num_scenarios; i++) {
+        ran[i] = filter == NULL || strstr(scenarios[i].name, filter) != NULL;
+        if (!ran[i]) {
+            continue;
+        }
+        if (scenarios[i].campaign == 3) {
+            run_agent_limits_scenario(&scenarios[i], binary, port + i, &results[i]);
+        } else if (scenarios[i].campaign) {
+            run_campaign_scenario(&scenarios[i], binary, port + i, &results[i]);
+        } else if (scenarios[i].multicast) {
+            run_multicast_scenario(&scenarios[i], binary, port + i, &results[i]);
+        } else {
+            run_scenario(&scenarios[i], binary, port + i, &results[i]);
+        }
+        scenario_result_t* r = &results[i];
+        printf("%-22s %8d %8d %6d %12.0f %9.2f %9.2f %9.2f  %s\n", r->name,
+               r->sent, r->received, r->proxy_dropped, r->throughput_pps,
+               r->p50_us, r->p99_us, r->max_us, r->failures == 0 ? "PASS" : "FAIL");
+        fflush(stdout);
+        if (r->failures == 0) {
+            passed++;
+        } else {
+            failed++;
+        }
+    }
+
+    printf("\n%d passed, %d failed\n", passed, failed);
+    if (output_file != NULL && write_test_json(output_file, scenarios, results, ran, num_scenarios) == 0) {
+        printf("Results saved to %s\n", output_file);
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -85,7 +85,18 @@ EOF
         # Get all potential log files
         find $LISTENER_LOG -name "*.log" -type f -mmin -$HOURS_AGO > $TEMP_DIR/listener_logs.tmp
         
-        if [ -s $TEMP_DIR/listener_logs.tmp ]; then
+        # An ADR trace directory: hand over the listener home so ora_logscan
+        # also finds alert/log.xml when text logging is off
+        LISTENER_HOME="$LISTENER_LOG"
+        if [ "$(basename "$LISTENER_LOG")" = "trace" ] && [ -d "$(dirname "$LISTENER_LOG")/alert" ]; then
+            LISTENER_HOME=$(dirname "$LISTENER_LOG")
+        fi
+        
+        if [ -x "$SCRIPT_DIR/ora_logscan" ]; then
+            # Parallel parse: connect rates, logon storms, services, return codes and errors
+            "$SCRIPT_DIR/ora_logscan" listener -m $HOURS_AGO "$LISTENER_HOME"
+            log_message "Listener logs in $LISTENER_HOME analyzed with ora_logscan"
+        elif [ -s $TEMP_DIR/listener_logs.tmp ]; then
             LISTENER_ERRORS=$(cat $(cat $TEMP_DIR/listener_logs.tmp) | grep -i "TNS-\|error\|warn\|fail" 2>/dev/null)
             
             if [ -n "$LISTENER_ERRORS" ]; then
@@ -158,9 +169,16 @@ EOF
         if [ -s $TEMP_DIR/alert_log_list.tmp ]; then
             echo -e "\n${YELLOW}Critical events from the last $HISTORY_HOURS hours:${NC}"
             
-            # Extract relevant error patterns with context
-            cat $ALERT_LOG | grep -A 3 -B 1 -i "ORA-\|error\|warn\|fail\|corrupt\|exception\|incident" | 
-                grep -v "failover\|information\|success" | tail -$ALERT_LOG_ENTRIES > $TEMP_DIR/alert_errors.tmp
+            # Extract relevant error patterns with context; the native scanner (make -C oracle)
+            # only reads what was appended since its last run
+            if [ -x "$SCRIPT_DIR/ora_logscan" ] && mkdir -p "$LOGSCAN_STATE_DIR" 2>/dev/null; then
+                "$SCRIPT_DIR/ora_logscan" alert -n $ALERT_LOG_ENTRIES \
+                    -s "$LOGSCAN_STATE_DIR/alert_${ORACLE_SID}.state" "$ALERT_LOG" > $TEMP_DIR/alert_errors.tmp
+                log_message "Alert log scanned with ora_logscan (state in $LOGSCAN_STATE_DIR)"
+            else
+                cat $ALERT_LOG | grep -A 3 -B 1 -i "ORA-\|error\|warn\|fail\|corrupt\|exception\|incident" | 
+                    grep -v "failover\|information\|success" | tail -$ALERT_LOG_ENTRIES > $TEMP_DIR/alert_errors.tmp
+            fi
             
             if [ -s $TEMP_DIR/alert_errors.tmp ]; then
                 # Format and highlight errors
@@ -30,6 +30,7 @@ MAX_TOP_PROCESSES=15
 HISTORY_HOURS=24
 LISTENER_ERROR_HOURS=1
 ALERT_LOG_ENTRIES=100
+LOGSCAN_STATE_DIR="$HOME/.ora_diag"   # Offsets kept by ora_logscan between runs
 RAC_PING_COUNT=30
 MOUNT_WARNING_THRESHOLD=90
 IO_SAMPLES=5
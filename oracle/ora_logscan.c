@@ -0,0 +1,2435 @@
+/**
+ * Native Oracle log scanner
+ *
+ * Replaces the cat | grep pipelines of ora_alerts.sh for multi-GB logs. The
+ * log is read through mmap windows, all patterns are matched in one pass
+ * with a bit-parallel (Shift-And) automaton, and scanned pages are dropped
+ * from the page cache so a DB host does not lose its working set.
+ *
+ * Listener logs (listener.log or ADR log.xml) are split into line-aligned
+ * chunks parsed on all cores; each thread keeps its own counters, which are
+ * merged once at the end.
+ *
+ * Follow mode is a daemon: inotify on the diag directories wakes it when a
+ * log grows, only the appended bytes are mapped and split into lines in
+ * place, and rolling ORA-/TNS- counters go to a JSON metrics file.
+ *
+ * AIX Compatibility:
+ * Compile with: gcc -O2 -std=gnu99 -D_ALL_SOURCE -o ora_logscan ora_logscan.c -lpthread
+ *
+ * Usage:
+ *   Alert log: ./ora_logscan alert [-s state_file] [-n entries] [-S] [-t top] [-v] alert_SID.log
+ *   Listener:  ./ora_logscan listener [-j threads] [-m minutes] [-r rate] [-t top] [-v] file|dir...
+ *   Follow:    ./ora_logscan follow [-o metrics.json] [-i interval_ms] [-w window_s] [-q] [-v] file|dir...
+ */
+
+/* Define AIX compatibility features */
+#define _ALL_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <pthread.h>
+#include <time.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#define LOGSCAN_WINDOW (256UL << 20)     // Bytes mapped at once; bounds address space on 32-bit AIX
+#define LOGSCAN_MAX_PATTERN_BITS 64     // Total pattern length one automaton can hold
+#define LOGSCAN_STATE_MAGIC "ora_logscan-state 1"
+#define ALERT_DEFAULT_ENTRIES 100       // ALERT_LOG_ENTRIES in ora_common.sh
+#define ALERT_DEFAULT_TOP 10
+#define ALERT_BEFORE 1                  // Context lines, as grep -B 1 -A 3 in ora_alerts.sh
+#define ALERT_AFTER 3
+#define LISTENER_CHUNK (32UL << 20)      // Bytes of log per parallel task
+#define LISTENER_LINE_SLACK (1UL << 20)  // Mapped past a chunk to finish its last line
+#define LISTENER_MAX_THREADS 256
+#define LISTENER_DEFAULT_STORM 50       // Connects per second that make a logon storm
+#define LISTENER_DEFAULT_TOP 10
+#define LISTENER_STORM_GAP 2            // Quieter seconds allowed inside one storm
+#define LISTENER_MAX_STORMS 10
+#define LISTENER_RECENT 20              // As tail -20 in ora_alerts.sh
+#define LISTENER_NAME_WIDTH 28
+#define FOLLOW_MAX_FILES 64             // Logs followed at once
+#define FOLLOW_MAX_WATCHES 256          // Directories watched
+#define FOLLOW_MAX_CODES 256            // Distinct ORA-/TNS- codes; the rest count as "other"
+#define FOLLOW_MAX_DEPTH 6              // Below a directory argument, to reach diag/*/*/*/trace
+#define FOLLOW_DEFAULT_WINDOW 60        // Seconds in the rolling counts
+#define FOLLOW_MAX_WINDOW 3600
+#define FOLLOW_DEFAULT_INTERVAL_MS 1000 // Metrics snapshot period
+#define FOLLOW_MIN_WRITE_MS 100         // Earliest rewrite after new codes
+#define FOLLOW_POLL_MS 200              // File check period without inotify
+
+// Case-insensitive multi-pattern matcher: bit j of mask[c] is set when
+// character c may sit at position j of the concatenated patterns
+typedef struct {
+    uint64_t mask[256];
+    uint64_t start;          // First position of every pattern
+    uint64_t final;          // Last position of every pattern
+} pattern_set_t;
+
+// Last lines output, oldest first once full
+typedef struct {
+    char** lines;
+    int capacity;
+    int count;
+    int head;                // Next slot to write
+} line_ring_t;
+
+// Where a scan stopped, persisted between runs
+typedef struct {
+    unsigned long long dev;
+    unsigned long long ino;
+    uint64_t offset;         // Byte after the last complete line scanned
+    uint64_t line;           // Complete lines scanned
+    uint64_t last_emitted;   // Line number of the last line output, 0 = none
+    int after;               // Context lines still owed to the last match
+    char* prev;              // Last complete line, for before-context at the start of the next scan
+    size_t prev_len;
+    line_ring_t ring;
+} scan_state_t;
+
+// Per-run counters
+typedef struct {
+    uint64_t bytes;
+    uint64_t lines;
+    uint64_t matches;
+    int rotated;             // 1 = finished a rotated file, 2 = rotated file not found, 3 = truncated
+} scan_stats_t;
+
+// Line handler for scan_range(); prev is the line before this one (may be empty)
+typedef void (*line_fn_t)(void* ctx, const char* line, size_t len, const char* prev, size_t prev_len);
+
+static const char* alert_patterns[] = { "ora-", "error", "warn", "fail", "corrupt", "exception", "incident" };
+static const char* alert_excludes[] = { "failover", "information", "success" };
+static const char* listener_patterns[] = { "tns-", "error", "warn", "fail" };
+static const char* month_names = "JANFEBMARAPRMAYJUNJULAUGSEPOCTNOVDEC";
+
+/**
+ * Get current timestamp in microseconds
+ */
+static uint64_t get_timestamp_usec(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Build the automaton for up to 64 pattern characters in total; returns -1 if they do not fit
+ */
+static int pattern_set_build(pattern_set_t* ps, const char* const* patterns, int count) {
+    int bit = 0;
+    memset(ps, 0, sizeof(pattern_set_t));
+    for (int p = 0; p < count; p++) {
+        int len = (int)strlen(patterns[p]);
+        if (len == 0 || bit + len > LOGSCAN_MAX_PATTERN_BITS) {
+            return -1;
+        }
+        ps->start |= 1ULL << bit;
+        for (int j = 0; j < len; j++) {
+            unsigned char c = (unsigned char)patterns[p][j];
+            ps->mask[c] |= 1ULL << (bit + j);
+            if (c >= 'a' && c <= 'z') {
+                ps->mask[c - 'a' + 'A'] |= 1ULL << (bit + j);
+            } else if (c >= 'A' && c <= 'Z') {
+                ps->mask[c - 'A' + 'a'] |= 1ULL << (bit + j);
+            }
+        }
+        bit += len;
+        ps->final |= 1ULL << (bit - 1);
+    }
+    return 0;
+}
+
+/**
+ * Whether any pattern occurs in the line: one shift, OR and AND per byte
+ * however many patterns there are
+ */
+static inline int pattern_set_match(const pattern_set_t* ps, const char* line, size_t len) {
+    uint64_t state = 0;
+    for (size_t i = 0; i < len; i++) {
+        state = ((state << 1) | ps->start) & ps->mask[(unsigned char)line[i]];
+        if (state & ps->final) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Case-sensitive substring search in a line that is not NUL-terminated
+ */
+static const char* line_find(const char* line, size_t len, const char* word) {
+    size_t wlen = strlen(word);
+    const char* end = line + len;
+    for (const char* p = line; (size_t)(end - p) >= wlen; p++) {
+        p = memchr(p, word[0], end - p - wlen + 1);
+        if (p == NULL) {
+            return NULL;
+        }
+        if (memcmp(p, word, wlen) == 0) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int line_contains(const char* line, size_t len, const char* word) {
+    return line_find(line, len, word) != NULL;
+}
+
+static void ring_init(line_ring_t* r, int capacity) {
+    r->capacity = capacity > 0 ? capacity : 1;
+    r->lines = (char**)calloc(r->capacity, sizeof(char*));
+    r->count = 0;
+    r->head = 0;
+    if (r->lines == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void ring_push(line_ring_t* r, const char* line, size_t len) {
+    char* copy = (char*)malloc(len + 1);
+    if (copy == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    free(r->lines[r->head]);
+    r->lines[r->head] = copy;
+    r->head = (r->head + 1) % r->capacity;
+    if (r->count < r->capacity) {
+        r->count++;
+    }
+}
+
+static const char* ring_get(const line_ring_t* r, int i) {
+    return r->lines[(r->head - r->count + i + r->capacity) % r->capacity];
+}
+
+static void ring_free(line_ring_t* r) {
+    for (int i = 0; i < r->capacity; i++) {
+        free(r->lines[i]);
+    }
+    free(r->lines);
+}
+
+static void state_set_prev(scan_state_t* st, const char* line, size_t len) {
+    char* copy = (char*)realloc(st->prev, len + 1);
+    if (copy == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    st->prev = copy;
+    st->prev_len = len;
+}
+
+/**
+ * Read one line of any length; returns its length without the newline, -1 at EOF
+ */
+static ssize_t read_line(FILE* f, char** buffer, size_t* capacity) {
+    size_t len = 0;
+    if (*buffer == NULL) {
+        *capacity = 4096;
+        *buffer = (char*)malloc(*capacity);
+    }
+    while (*buffer != NULL && fgets(*buffer + len, (int)(*capacity - len), f) != NULL) {
+        len += strlen(*buffer + len);
+        if (len > 0 && (*buffer)[len - 1] == '\n') {
+            (*buffer)[--len] = '\0';
+            return (ssize_t)len;
+        }
+        *capacity *= 2;
+        *buffer = (char*)realloc(*buffer, *capacity);
+    }
+    return len > 0 ? (ssize_t)len : -1;
+}
+
+/**
+ * Load a state file; a missing or unreadable one starts from the beginning
+ */
+static void state_load(const char* path, scan_state_t* st) {
+    FILE* f = path != NULL ? fopen(path, "r") : NULL;
+    if (f == NULL) {
+        return;
+    }
+    char* line = NULL;
+    size_t capacity = 0;
+    ssize_t len = read_line(f, &line, &capacity);
+    if (len < 0 || strcmp(line, LOGSCAN_STATE_MAGIC) != 0) {
+        fprintf(stderr, "Ignoring unrecognized state file %s\n", path);
+    } else if (read_line(f, &line, &capacity) >= 0 &&
+               sscanf(line, "file %llu %llu %llu %llu %llu %d", &st->dev, &st->ino,
+                      (unsigned long long*)&st->offset, (unsigned long long*)&st->line,
+                      (unsigned long long*)&st->last_emitted, &st->after) == 6) {
+        size_t prev_len = 0;
+        if (read_line(f, &line, &capacity) >= 0 && sscanf(line, "prev %zu", &prev_len) == 1 &&
+            (len = read_line(f, &line, &capacity)) >= 0 && (size_t)len == prev_len) {
+            state_set_prev(st, line, prev_len);
+        }
+        int count = 0;
+        if (read_line(f, &line, &capacity) >= 0 && sscanf(line, "entries %d", &count) == 1) {
+            for (int i = 0; i < count && (len = read_line(f, &line, &capacity)) >= 0; i++) {
+                ring_push(&st->ring, line, len);
+            }
+        }
+    }
+    free(line);
+    fclose(f);
+}
+
+/**
+ * Write the state next to its final name and rename it into place
+ */
+static int state_save(const char* path, const scan_state_t* st) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot write state file %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    fprintf(f, "%s\n", LOGSCAN_STATE_MAGIC);
+    fprintf(f, "file %llu %llu %llu %llu %llu %d\n", st->dev, st->ino, (unsigned long long)st->offset,
+            (unsigned long long)st->line, (unsigned long long)st->last_emitted, st->after);
+    fprintf(f, "prev %zu\n", st->prev_len);
+    fwrite(st->prev != NULL ? st->prev : "", 1, st->prev_len, f);
+    fprintf(f, "\nentries %d\n", st->ring.count);
+    for (int i = 0; i < st->ring.count; i++) {
+        fprintf(f, "%s\n", ring_get(&st->ring, i));
+    }
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "Cannot write state file %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Call fn for every complete line in [from, to) of fd, mapping at most
+ * LOGSCAN_WINDOW bytes at a time. A trailing line without its newline is
+ * left for the next run, since the writer may still be appending to it.
+ * Scanned pages are dropped from the page cache. Returns the offset after
+ * the last complete line, or (uint64_t)-1 if the file cannot be mapped
+ */
+static uint64_t scan_range(int fd, uint64_t from, uint64_t to, line_fn_t fn, void* ctx, scan_state_t* st,
+                           scan_stats_t* stats) {
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t pos = from;
+    while (pos < to) {
+        uint64_t map_off = pos & ~(page - 1);
+        size_t map_len = to - map_off < LOGSCAN_WINDOW ? (size_t)(to - map_off) : LOGSCAN_WINDOW;
+        char* base = (char*)mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, (off_t)map_off);
+        if (base == MAP_FAILED) {
+            perror("mmap failed");
+            return (uint64_t)-1;
+        }
+        posix_madvise(base, map_len, POSIX_MADV_SEQUENTIAL);
+
+        const char* p = base + (pos - map_off);
+        const char* end = base + map_len;
+        const char* prev = st->prev != NULL ? st->prev : "";
+        size_t prev_len = st->prev_len;
+        const char* nl;
+        while (p < end && (nl = (const char*)memchr(p, '\n', end - p)) != NULL) {
+            size_t len = nl - p;
+            if (len > 0 && p[len - 1] == '\r') {
+                len--;
+            }
+            st->line++;
+            stats->lines++;
+            fn(ctx, p, len, prev, prev_len);
+            prev = p;
+            prev_len = len;
+            p = nl + 1;
+        }
+        // The previous line must outlive the mapping
+        if (prev != st->prev) {
+            state_set_prev(st, prev, prev_len);
+        }
+
+        uint64_t next = map_off + (uint64_t)(p - base);
+        if (next == pos && map_off + map_len < to) {
+            // One line longer than the window: take it in window-sized pieces
+            next = map_off + map_len;
+        }
+        munmap(base, map_len);
+#ifdef POSIX_FADV_DONTNEED
+        posix_fadvise(fd, (off_t)map_off, (off_t)(next - map_off), POSIX_FADV_DONTNEED);
+#endif
+        stats->bytes += next - pos;
+        if (next == pos) {
+            break;
+        }
+        pos = next;
+    }
+    return pos;
+}
+
+/**
+ * Open the log and, with saved state, decide where to resume: the saved
+ * offset if the inode is unchanged, the rest of the rotated file first if
+ * it is still in the same directory, or the start of a truncated log
+ */
+static int scan_log(const char* path, scan_state_t* st, line_fn_t fn, void* ctx, scan_stats_t* stats) {
+    struct stat sb;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &sb) < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    if (st->ino != 0 && (st->ino != (unsigned long long)sb.st_ino || st->dev != (unsigned long long)sb.st_dev)) {
+        // Rotated: look for the old inode beside the log (alert_SID.log.1, ...)
+        char dir_buf[4096];
+        snprintf(dir_buf, sizeof(dir_buf), "%s", path);
+        const char* dir = dirname(dir_buf);
+        DIR* d = opendir(dir);
+        struct dirent* e;
+        stats->rotated = 2;
+        while (d != NULL && (e = readdir(d)) != NULL) {
+            if ((unsigned long long)e->d_ino != st->ino) {
+                continue;
+            }
+            char old_path[4096];
+            struct stat old_sb;
+            snprintf(old_path, sizeof(old_path), "%s/%s", dir, e->d_name);
+            int old_fd = open(old_path, O_RDONLY);
+            if (old_fd >= 0 && fstat(old_fd, &old_sb) == 0 && (unsigned long long)old_sb.st_dev == st->dev &&
+                (uint64_t)old_sb.st_size >= st->offset) {
+                scan_range(old_fd, st->offset, (uint64_t)old_sb.st_size, fn, ctx, st, stats);
+                stats->rotated = 1;
+            }
+            if (old_fd >= 0) {
+                close(old_fd);
+            }
+            break;
+        }
+        if (d != NULL) {
+            closedir(d);
+        }
+        st->offset = 0;
+    } else if ((uint64_t)sb.st_size < st->offset) {
+        stats->rotated = 3;
+        st->offset = 0;
+    }
+    st->dev = (unsigned long long)sb.st_dev;
+    st->ino = (unsigned long long)sb.st_ino;
+
+    uint64_t end = scan_range(fd, st->offset, (uint64_t)sb.st_size, fn, ctx, st, stats);
+    close(fd);
+    if (end == (uint64_t)-1) {
+        return -1;
+    }
+    st->offset = end;
+    return 0;
+}
+
+// Alert scan context
+typedef struct {
+    pattern_set_t patterns;
+    scan_state_t* st;
+    scan_stats_t* stats;
+} alert_ctx_t;
+
+/**
+ * Output a line unless it holds an excluded word (grep -v, case-sensitive)
+ */
+static void alert_emit(alert_ctx_t* a, const char* line, size_t len) {
+    for (size_t i = 0; i < sizeof(alert_excludes) / sizeof(alert_excludes[0]); i++) {
+        if (line_contains(line, len, alert_excludes[i])) {
+            return;
+        }
+    }
+    ring_push(&a->st->ring, line, len);
+}
+
+/**
+ * grep -i -B 1 -A 3 semantics, including "--" between non-adjacent groups
+ */
+static void alert_line(void* ctx, const char* line, size_t len, const char* prev, size_t prev_len) {
+    alert_ctx_t* a = (alert_ctx_t*)ctx;
+    scan_state_t* st = a->st;
+    uint64_t k = st->line;
+
+    if (pattern_set_match(&a->patterns, line, len)) {
+        a->stats->matches++;
+        uint64_t first = k > ALERT_BEFORE ? k - ALERT_BEFORE : 1;
+        if (first <= st->last_emitted) {
+            first = st->last_emitted + 1;
+        }
+        if (st->last_emitted != 0 && first > st->last_emitted + 1) {
+            ring_push(&st->ring, "--", 2);
+        }
+        if (first < k) {
+            alert_emit(a, prev, prev_len);
+        }
+        alert_emit(a, line, len);
+        st->last_emitted = k;
+        st->after = ALERT_AFTER;
+    } else if (st->after > 0) {
+        alert_emit(a, line, len);
+        st->last_emitted = k;
+        st->after--;
+    }
+}
+
+// One ORA- code and its count for the summary
+typedef struct {
+    char code[16];
+    int count;
+} ora_count_t;
+
+static int compare_ora_counts(const void* a, const void* b) {
+    const ora_count_t* x = (const ora_count_t*)a;
+    const ora_count_t* y = (const ora_count_t*)b;
+    if (x->count != y->count) {
+        return y->count - x->count;
+    }
+    // sort -nr breaks ties on the whole line, in reverse
+    return strcmp(y->code, x->code);
+}
+
+/**
+ * ORA- code frequencies over the entries, printed like
+ * grep -o "ORA-[0-9]\+" | sort | uniq -c | sort -nr | head -top
+ */
+static void alert_summary(const line_ring_t* ring, int top) {
+    ora_count_t* counts = NULL;
+    int ncounts = 0, capacity = 0;
+    for (int i = 0; i < ring->count; i++) {
+        const char* p = ring_get(ring, i);
+        while ((p = strstr(p, "ORA-")) != NULL) {
+            size_t digits = strspn(p + 4, "0123456789");
+            if (digits == 0 || digits > 10) {
+                p += 4;
+                continue;
+            }
+            char code[16];
+            memcpy(code, p, 4 + digits);
+            code[4 + digits] = '\0';
+            p += 4 + digits;
+            int j = 0;
+            while (j < ncounts && strcmp(counts[j].code, code) != 0) {
+                j++;
+            }
+            if (j == ncounts) {
+                if (ncounts == capacity) {
+                    capacity = capacity > 0 ? capacity * 2 : 64;
+                    counts = (ora_count_t*)realloc(counts, capacity * sizeof(ora_count_t));
+                    if (counts == NULL) {
+                        perror("Memory allocation failed");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                strcpy(counts[ncounts].code, code);
+                counts[ncounts++].count = 0;
+            }
+            counts[j].count++;
+        }
+    }
+    qsort(counts, ncounts, sizeof(ora_count_t), compare_ora_counts);
+    for (int i = 0; i < ncounts && i < top; i++) {
+        printf("%7d %s\n", counts[i].count, counts[i].code);
+    }
+    free(counts);
+}
+
+void print_usage(const char* prog_name) {
+    printf("Usage:\n");
+    printf("  %s alert [-s state_file] [-n entries] [-S] [-t top] [-v] alert_SID.log\n", prog_name);
+    printf("  %s listener [-j threads] [-m minutes] [-r rate] [-t top] [-v] file|dir...\n", prog_name);
+    printf("  %s follow [-o metrics.json] [-i interval_ms] [-w window_s] [-q] [-v] file|dir...\n\n", prog_name);
+    printf("alert: lines matching ORA-, error, warn, fail, corrupt, exception or incident\n");
+    printf("(case-insensitive) with 1 line before and 3 after, minus lines containing\n");
+    printf("failover, information or success; the last entries lines are printed\n\n");
+    printf("Options:\n");
+    printf("  -s state_file     Resume from the offset and inode saved here, and save them\n");
+    printf("                    with the last entries lines for the next run; follows rotation\n");
+    printf("  -n entries        Lines kept and printed (default: %d)\n", ALERT_DEFAULT_ENTRIES);
+    printf("  -S                Print the ORA- code frequency table of those lines instead\n");
+    printf("  -t top            Codes in the table (default: %d)\n", ALERT_DEFAULT_TOP);
+    printf("  -v                Report bytes, lines and time taken on stderr\n");
+    printf("  -h                Display this help message\n\n");
+    printf("listener: connects per second, logon storms, per-service rates, client hosts,\n");
+    printf("programs, refused return codes and TNS-/error/warn/fail lines of listener.log\n");
+    printf("or log.xml files, parsed in parallel. A directory adds its .log and .xml files\n");
+    printf("and those of its trace/ subdirectory, or of alert/ when there is no text log\n");
+    printf("(an ADR listener home keeps the same entries in both)\n\n");
+    printf("Options:\n");
+    printf("  -j threads        Parse threads (default: online CPUs)\n");
+    printf("  -m minutes        Only entries stamped in the last minutes; files in a\n");
+    printf("                    directory not written in that time are skipped\n");
+    printf("  -r rate           Connects per second that make a logon storm (default: %d)\n",
+           LISTENER_DEFAULT_STORM);
+    printf("  -t top            Rows in the busiest-seconds, host, program and error tables\n");
+    printf("                    (default: %d)\n", LISTENER_DEFAULT_TOP);
+    printf("  -v                Report chunks, threads and time taken on stderr\n\n");
+    printf("follow: daemon counting ORA- and TNS- codes in lines appended to the .log and\n");
+    printf(".xml files of the given directories (and their trace/alert subdirectories)\n");
+    printf("or files; woken by inotify on Linux, polled every %d ms elsewhere\n\n", FOLLOW_POLL_MS);
+    printf("Options:\n");
+    printf("  -o metrics.json   Keep a JSON snapshot of the counters here (rewritten atomically)\n");
+    printf("  -i interval_ms    Snapshot period (default: %d, min %d); new codes are\n", FOLLOW_DEFAULT_INTERVAL_MS,
+           FOLLOW_MIN_WRITE_MS);
+    printf("                    written within %d ms\n", FOLLOW_MIN_WRITE_MS);
+    printf("  -w window_s       Seconds in the rolling counts (default: %d, max %d)\n", FOLLOW_DEFAULT_WINDOW,
+           FOLLOW_MAX_WINDOW);
+    printf("  -q                Do not print the matching lines\n");
+    printf("  -v                Report files followed and detection lag on stderr\n");
+    printf("A rotated log is read to its end, last unfinished line included, before the\n");
+    printf("new file at its path is followed from the start\n");
+}
+
+int run_alert(int argc, char* argv[]) {
+    const char* state_file = NULL;
+    int entries = ALERT_DEFAULT_ENTRIES;
+    int top = ALERT_DEFAULT_TOP;
+    int summary = 0, verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:St:vh")) != -1) {
+        switch (opt) {
+            case 's':
+                state_file = optarg;
+                break;
+            case 'n':
+                entries = atoi(optarg);
+                break;
+            case 'S':
+                summary = 1;
+                break;
+            case 't':
+                top = atoi(optarg);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc - 1 || entries < 1) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    scan_state_t st;
+    scan_stats_t stats;
+    alert_ctx_t ctx;
+    memset(&st, 0, sizeof(st));
+    memset(&stats, 0, sizeof(stats));
+    ring_init(&st.ring, entries);
+    pattern_set_build(&ctx.patterns, alert_patterns, sizeof(alert_patterns) / sizeof(alert_patterns[0]));
+    ctx.st = &st;
+    ctx.stats = &stats;
+    state_load(state_file, &st);
+    uint64_t resumed_at = st.offset;
+
+    uint64_t start = get_timestamp_usec();
+    if (scan_log(argv[optind], &st, alert_line, &ctx, &stats) < 0) {
+        ring_free(&st.ring);
+        free(st.prev);
+        return 1;
+    }
+    uint64_t elapsed = get_timestamp_usec() - start;
+
+    if (summary) {
+        alert_summary(&st.ring, top);
+    } else {
+        for (int i = 0; i < st.ring.count; i++) {
+            printf("%s\n", ring_get(&st.ring, i));
+        }
+    }
+    if (verbose) {
+        static const char* rotation[] = { "", ", finished the rotated log first",
+                                          ", log rotated (previous file not found)", ", log truncated" };
+        fprintf(stderr, "Scanned %.1f MB (%llu lines, %llu matches) from offset %llu in %.1f ms%s\n",
+                stats.bytes / 1048576.0, (unsigned long long)stats.lines, (unsigned long long)stats.matches,
+                (unsigned long long)resumed_at, elapsed / 1000.0, rotation[stats.rotated]);
+    }
+
+    int status = 0;
+    if (state_file != NULL && state_save(state_file, &st) < 0) {
+        status = 1;
+    }
+    ring_free(&st.ring);
+    free(st.prev);
+    return status;
+}
+
+static void* xcalloc(size_t count, size_t size) {
+    void* p = calloc(count, size);
+    if (p == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+// Open-addressing map from a non-zero 64-bit key to a counter
+typedef struct {
+    uint64_t* keys;          // 0 = empty slot
+    uint64_t* values;
+    size_t capacity;         // Power of two
+    size_t count;
+} count_map_t;
+
+static uint64_t* count_map_slot(count_map_t* m, uint64_t key);
+
+static void count_map_grow(count_map_t* m) {
+    count_map_t bigger;
+    bigger.capacity = m->capacity > 0 ? m->capacity * 2 : 1024;
+    bigger.count = 0;
+    bigger.keys = (uint64_t*)xcalloc(bigger.capacity, sizeof(uint64_t));
+    bigger.values = (uint64_t*)xcalloc(bigger.capacity, sizeof(uint64_t));
+    for (size_t i = 0; i < m->capacity; i++) {
+        if (m->keys[i] != 0) {
+            *count_map_slot(&bigger, m->keys[i]) = m->values[i];
+        }
+    }
+    free(m->keys);
+    free(m->values);
+    *m = bigger;
+}
+
+/**
+ * Counter for key, inserted as 0 if missing; valid until the next insert
+ */
+static uint64_t* count_map_slot(count_map_t* m, uint64_t key) {
+    if ((m->count + 1) * 4 > m->capacity * 3) {
+        count_map_grow(m);
+    }
+    uint64_t h = key * 0x9E3779B97F4A7C15ULL;
+    size_t mask = m->capacity - 1;
+    size_t i = (size_t)(h ^ (h >> 32)) & mask;
+    while (m->keys[i] != 0 && m->keys[i] != key) {
+        i = (i + 1) & mask;
+    }
+    if (m->keys[i] == 0) {
+        m->keys[i] = key;
+        m->count++;
+    }
+    return &m->values[i];
+}
+
+static void count_map_free(count_map_t* m) {
+    free(m->keys);
+    free(m->values);
+    memset(m, 0, sizeof(count_map_t));
+}
+
+// One interned name and its counters; the id is its index in the table
+typedef struct {
+    char* text;
+    size_t len;
+    uint32_t hash;
+    uint64_t count;
+    uint64_t refused;        // Connects refused with a non-zero return code
+} str_entry_t;
+
+typedef struct {
+    str_entry_t* entries;
+    size_t count;
+    size_t entries_capacity;
+    uint32_t* slots;         // Entry index + 1, 0 = empty
+    size_t slots_capacity;   // Power of two
+} str_table_t;
+
+static uint32_t str_hash(const char* s, size_t len) {
+    uint32_t h = 2166136261U;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)s[i]) * 16777619U;
+    }
+    return h;
+}
+
+static void str_table_rehash(str_table_t* t) {
+    free(t->slots);
+    t->slots_capacity = t->slots_capacity > 0 ? t->slots_capacity * 2 : 64;
+    t->slots = (uint32_t*)xcalloc(t->slots_capacity, sizeof(uint32_t));
+    size_t mask = t->slots_capacity - 1;
+    for (size_t e = 0; e < t->count; e++) {
+        size_t i = t->entries[e].hash & mask;
+        while (t->slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        t->slots[i] = (uint32_t)(e + 1);
+    }
+}
+
+/**
+ * Id of the name, added with zero counters if new
+ */
+static uint32_t str_table_intern(str_table_t* t, const char* s, size_t len) {
+    if ((t->count + 1) * 2 > t->slots_capacity) {
+        str_table_rehash(t);
+    }
+    uint32_t h = str_hash(s, len);
+    size_t mask = t->slots_capacity - 1;
+    size_t i = h & mask;
+    while (t->slots[i] != 0) {
+        str_entry_t* e = &t->entries[t->slots[i] - 1];
+        if (e->hash == h && e->len == len && memcmp(e->text, s, len) == 0) {
+            return t->slots[i] - 1;
+        }
+        i = (i + 1) & mask;
+    }
+    if (t->count == t->entries_capacity) {
+        t->entries_capacity = t->entries_capacity > 0 ? t->entries_capacity * 2 : 64;
+        t->entries = (str_entry_t*)realloc(t->entries, t->entries_capacity * sizeof(str_entry_t));
+        if (t->entries == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    str_entry_t* e = &t->entries[t->count];
+    memset(e, 0, sizeof(str_entry_t));
+    e->text = (char*)xcalloc(len + 1, 1);
+    memcpy(e->text, s, len);
+    e->len = len;
+    e->hash = h;
+    t->slots[i] = (uint32_t)(t->count + 1);
+    return (uint32_t)t->count++;
+}
+
+static void str_table_free(str_table_t* t) {
+    for (size_t e = 0; e < t->count; e++) {
+        free(t->entries[e].text);
+    }
+    free(t->entries);
+    free(t->slots);
+    memset(t, 0, sizeof(str_table_t));
+}
+
+// An error line for the "most recent" list, ordered by file and offset
+typedef struct {
+    int file;
+    uint64_t offset;
+    char* text;
+} recent_line_t;
+
+// Counters of one parse thread, merged into the first after the scan
+typedef struct {
+    str_table_t services;
+    str_table_t hosts;           // Client address, HOST= of the ADDRESS
+    str_table_t programs;
+    str_table_t messages;        // Error/warning lines without their timestamp
+    count_map_t per_second;      // Second -> connects
+    count_map_t service_second;  // Service id << 32 | second -> connects
+    count_map_t host_minute;     // Host id << 32 | minute -> connects
+    count_map_t codes;           // Non-zero return code -> connects
+    uint64_t lines;
+    uint64_t connects;
+    uint64_t refused;
+    uint64_t events;             // service_update, ping, status and other commands
+    uint64_t error_lines;
+    uint64_t skipped;            // Lines stamped before the cutoff
+    int64_t first;               // Connect seconds, -1 = none yet
+    int64_t last;
+    recent_line_t recent[LISTENER_RECENT];
+    int recent_count;
+} listener_agg_t;
+
+// A byte range of one file, parsed by one thread
+typedef struct {
+    int file;
+    uint64_t start;
+    uint64_t end;
+} listener_task_t;
+
+// Shared by the parse threads
+typedef struct {
+    const char** paths;
+    int* fds;
+    uint64_t* sizes;
+    int nfiles;
+    listener_task_t* tasks;
+    int ntasks;
+    int next_task;
+    pthread_mutex_t lock;
+    int64_t cutoff;              // Lines stamped before this second are skipped, -1 = none
+    pattern_set_t errors;
+} listener_job_t;
+
+typedef struct {
+    listener_job_t* job;
+    listener_agg_t agg;
+    pthread_t thread;
+} listener_worker_t;
+
+/**
+ * Days from 1970-01-01 to a proleptic Gregorian date
+ */
+static int64_t days_from_civil(int year, int month, int day) {
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yoe = year - era * 400;
+    int64_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    return era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+/**
+ * Seconds for a leading "17-OCT-2026 10:00:01", with the wall clock taken
+ * as UTC so no time zone lookup is needed; -1 if the line has none
+ */
+static int64_t listener_parse_time(const char* p, size_t len) {
+    static const int digits[] = { 0, 1, 7, 8, 9, 10, 12, 13, 15, 16, 18, 19 };
+    if (len < 20 || p[2] != '-' || p[6] != '-' || p[11] != ' ' || p[14] != ':' || p[17] != ':') {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(digits) / sizeof(digits[0]); i++) {
+        if (p[digits[i]] < '0' || p[digits[i]] > '9') {
+            return -1;
+        }
+    }
+    int month = 0;
+    while (month < 12 && ((p[3] & ~0x20) != month_names[month * 3] || (p[4] & ~0x20) != month_names[month * 3 + 1] ||
+                          (p[5] & ~0x20) != month_names[month * 3 + 2])) {
+        month++;
+    }
+    if (month == 12) {
+        return -1;
+    }
+#define D(i) (p[i] - '0')
+    int day = D(0) * 10 + D(1);
+    int year = D(7) * 1000 + D(8) * 100 + D(9) * 10 + D(10);
+    int64_t seconds = (D(12) * 10 + D(13)) * 3600 + (D(15) * 10 + D(16)) * 60 + D(18) * 10 + D(19);
+#undef D
+    return days_from_civil(year, month + 1, day) * 86400 + seconds;
+}
+
+static void listener_format_time(int64_t t, char* buf, size_t size) {
+    int64_t days = t >= 0 ? t / 86400 : (t - 86399) / 86400;
+    int64_t rem = t - days * 86400;
+    // Inverse of days_from_civil
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    int year = (int)(yoe + era * 400 + (month <= 2));
+    snprintf(buf, size, "%02d-%.3s-%04d %02d:%02d:%02d", day, month_names + (month - 1) * 3, year,
+             (int)(rem / 3600), (int)(rem / 60 % 60), (int)(rem % 60));
+}
+
+/**
+ * Value of NAME= in a connect descriptor, up to its closing parenthesis;
+ * balanced ones inside are kept, as in PROGRAM=oracle@host (TNS V1-V3)
+ */
+static const char* listener_value(const char* p, size_t len, const char* name, size_t* value_len) {
+    const char* v = line_find(p, len, name);
+    if (v == NULL) {
+        return NULL;
+    }
+    v += strlen(name);
+    const char* e = v;
+    for (int depth = 0; e < p + len && (*e != ')' || depth > 0); e++) {
+        depth += *e == '(' ? 1 : *e == ')' ? -1 : 0;
+    }
+    *value_len = e - v;
+    return *value_len > 0 ? v : NULL;
+}
+
+/**
+ * Start of the next " * " separator; found by its '*', which is far rarer
+ * than the space line_find() would scan for
+ */
+static const char* listener_next_field(const char* start, const char* end) {
+    const char* p = start + 1;
+    while (p < end && (p = (const char*)memchr(p, '*', end - p)) != NULL) {
+        if (p + 1 < end && p[-1] == ' ' && p[1] == ' ') {
+            return p - 1;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+/**
+ * Keep the line if it is among the LISTENER_RECENT latest seen by this
+ * thread; lines from one thread arrive in file order, merged ones do not
+ */
+static void listener_keep_recent(listener_agg_t* agg, int file, uint64_t offset, const char* line, size_t len) {
+    int slot = agg->recent_count;
+    if (slot == LISTENER_RECENT) {
+        slot = 0;
+        for (int i = 1; i < LISTENER_RECENT; i++) {
+            if (agg->recent[i].file < agg->recent[slot].file ||
+                (agg->recent[i].file == agg->recent[slot].file && agg->recent[i].offset < agg->recent[slot].offset)) {
+                slot = i;
+            }
+        }
+        if (file < agg->recent[slot].file || (file == agg->recent[slot].file && offset < agg->recent[slot].offset)) {
+            return;
+        }
+    } else {
+        agg->recent_count++;
+    }
+    char* copy = (char*)realloc(agg->recent[slot].text, len + 1);
+    if (copy == NULL) {
+        perror("Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    agg->recent[slot].file = file;
+    agg->recent[slot].offset = offset;
+    agg->recent[slot].text = copy;
+}
+
+/**
+ * Parse one line. Connect entries look like
+ *   17-OCT-2026 10:00:01 * (CONNECT_DATA=...(CID=(PROGRAM=x)(HOST=h)(USER=u))) *
+ *     (ADDRESS=(PROTOCOL=tcp)(HOST=10.1.2.3)(PORT=51234)) * establish * service * 0
+ * and log.xml carries the same text in <txt> elements. *stamp is the time of
+ * the last stamped line, so TNS- lines after an entry share its cutoff
+ */
+static void listener_line(const listener_job_t* job, listener_agg_t* agg, int file, uint64_t offset, const char* p,
+                          size_t len, int64_t* stamp) {
+    agg->lines++;
+    while (len > 0 && (*p == ' ' || *p == '\t')) {
+        p++;
+        len--;
+    }
+    if (len > 0 && *p == '<') {
+        // log.xml: only the text of <txt> elements, not the markup
+        if (len < 5 || memcmp(p, "<txt>", 5) != 0) {
+            return;
+        }
+        p += 5;
+        len -= 5;
+        const char* txt_end = line_find(p, len, "</txt>");
+        if (txt_end != NULL) {
+            len = txt_end - p;
+        }
+    }
+    while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\r')) {
+        len--;
+    }
+    if (len == 0) {
+        return;
+    }
+
+    int64_t t = listener_parse_time(p, len);
+    if (t >= 0) {
+        *stamp = t;
+    }
+    if (job->cutoff >= 0 && *stamp >= 0 && *stamp < job->cutoff) {
+        agg->skipped++;
+        return;
+    }
+
+    if (pattern_set_match(&job->errors, p, len)) {
+        agg->error_lines++;
+        listener_keep_recent(agg, file, offset, p, len);
+        // Counted without the timestamp, so repeats of one error group together
+        const char* msg = p;
+        size_t msg_len = len;
+        if (t >= 0) {
+            msg += 20;
+            msg_len -= 20;
+            if (msg_len >= 3 && memcmp(msg, " * ", 3) == 0) {
+                msg += 3;
+                msg_len -= 3;
+            }
+        }
+        uint32_t id = str_table_intern(&agg->messages, msg, msg_len);
+        agg->messages.entries[id].count++;
+    }
+    if (t < 0) {
+        return;
+    }
+
+    const char* field[6];
+    size_t flen[6];
+    int nfields = 0;
+    const char* end = p + len;
+    const char* s = p;
+    while (nfields < 6) {
+        const char* sep = nfields < 5 ? listener_next_field(s, end) : NULL;
+        field[nfields] = s;
+        flen[nfields++] = (sep != NULL ? sep : end) - s;
+        if (sep == NULL) {
+            break;
+        }
+        s = sep + 3;
+    }
+    if (nfields < 6 || flen[3] != 9 || memcmp(field[3], "establish", 9) != 0) {
+        if (nfields >= 3) {
+            agg->events++;
+        }
+        return;
+    }
+
+    uint64_t rc = 0;
+    for (size_t i = 0; i < flen[5] && field[5][i] >= '0' && field[5][i] <= '9'; i++) {
+        rc = rc * 10 + (uint64_t)(field[5][i] - '0');
+    }
+    size_t host_len = 0, program_len = 0;
+    const char* host = listener_value(field[2], flen[2], "HOST=", &host_len);
+    const char* program = listener_value(field[1], flen[1], "PROGRAM=", &program_len);
+    uint32_t service_id = flen[4] > 0 ? str_table_intern(&agg->services, field[4], flen[4])
+                                      : str_table_intern(&agg->services, "(none)", 6);
+    uint32_t host_id = host != NULL ? str_table_intern(&agg->hosts, host, host_len)
+                                    : str_table_intern(&agg->hosts, "(local)", 7);
+    uint32_t program_id = program != NULL ? str_table_intern(&agg->programs, program, program_len)
+                                          : str_table_intern(&agg->programs, "(unknown)", 9);
+
+    agg->connects++;
+    agg->services.entries[service_id].count++;
+    agg->hosts.entries[host_id].count++;
+    agg->programs.entries[program_id].count++;
+    if (rc != 0) {
+        agg->refused++;
+        agg->services.entries[service_id].refused++;
+        agg->hosts.entries[host_id].refused++;
+        agg->programs.entries[program_id].refused++;
+        (*count_map_slot(&agg->codes, rc))++;
+    }
+    (*count_map_slot(&agg->per_second, (uint64_t)t))++;
+    (*count_map_slot(&agg->service_second, (uint64_t)service_id << 32 | (uint64_t)t))++;
+    (*count_map_slot(&agg->host_minute, (uint64_t)host_id << 32 | (uint64_t)(t / 60)))++;
+    if (agg->first < 0 || t < agg->first) {
+        agg->first = t;
+    }
+    if (t > agg->last) {
+        agg->last = t;
+    }
+}
+
+/**
+ * Parse the lines that start inside the task's range; the last one is
+ * finished from up to LISTENER_LINE_SLACK bytes past it
+ */
+static int listener_parse_chunk(const listener_job_t* job, const listener_task_t* task, listener_agg_t* agg) {
+    uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+    uint64_t size = job->sizes[task->file];
+    // From the byte before the chunk, to see whether it starts a line
+    uint64_t map_off = (task->start > 0 ? task->start - 1 : 0) & ~(page - 1);
+    uint64_t map_end = size - task->end > LISTENER_LINE_SLACK ? task->end + LISTENER_LINE_SLACK : size;
+    size_t map_len = (size_t)(map_end - map_off);
+    int fd = job->fds[task->file];
+    char* base = (char*)mmap(NULL, map_len, PROT_READ, MAP_SHARED, fd, (off_t)map_off);
+    if (base == MAP_FAILED) {
+        perror("mmap failed");
+        return -1;
+    }
+    posix_madvise(base, map_len, POSIX_MADV_SEQUENTIAL);
+
+    const char* p = base + (task->start - map_off);
+    const char* stop = base + (task->end - map_off);
+    const char* end = base + map_len;
+    if (task->start > 0 && p[-1] != '\n') {
+        // The line in progress belongs to the previous chunk
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        p = nl != NULL ? nl + 1 : end;
+    }
+    int64_t stamp = -1;
+    while (p < stop) {
+        const char* nl = (const char*)memchr(p, '\n', end - p);
+        const char* line_end = nl != NULL ? nl : end;
+        listener_line(job, agg, task->file, (uint64_t)(p - base) + map_off, p, line_end - p, &stamp);
+        p = line_end + 1;
+    }
+
+    munmap(base, map_len);
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, (off_t)task->start, (off_t)(task->end - task->start), POSIX_FADV_DONTNEED);
+#endif
+    return 0;
+}
+
+static void* listener_worker(void* arg) {
+    listener_worker_t* w = (listener_worker_t*)arg;
+    listener_job_t* job = w->job;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        int t = job->next_task < job->ntasks ? job->next_task++ : -1;
+        pthread_mutex_unlock(&job->lock);
+        if (t < 0 || listener_parse_chunk(job, &job->tasks[t], &w->agg) < 0) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Add the names of from into into; returns from's ids mapped to into's
+ */
+static uint32_t* str_table_merge(str_table_t* into, const str_table_t* from) {
+    uint32_t* map = (uint32_t*)xcalloc(from->count + 1, sizeof(uint32_t));
+    for (size_t e = 0; e < from->count; e++) {
+        map[e] = str_table_intern(into, from->entries[e].text, from->entries[e].len);
+        into->entries[map[e]].count += from->entries[e].count;
+        into->entries[map[e]].refused += from->entries[e].refused;
+    }
+    return map;
+}
+
+/**
+ * Add a map whose keys carry an id in their upper 32 bits, renumbered by ids (NULL = keys as is)
+ */
+static void count_map_merge(count_map_t* into, const count_map_t* from, const uint32_t* ids) {
+    for (size_t i = 0; i < from->capacity; i++) {
+        if (from->keys[i] != 0) {
+            uint64_t key = from->keys[i];
+            if (ids != NULL) {
+                key = (uint64_t)ids[key >> 32] << 32 | (key & 0xFFFFFFFFULL);
+            }
+            *count_map_slot(into, key) += from->values[i];
+        }
+    }
+}
+
+static void listener_agg_free(listener_agg_t* agg) {
+    str_table_free(&agg->services);
+    str_table_free(&agg->hosts);
+    str_table_free(&agg->programs);
+    str_table_free(&agg->messages);
+    count_map_free(&agg->per_second);
+    count_map_free(&agg->service_second);
+    count_map_free(&agg->host_minute);
+    count_map_free(&agg->codes);
+    for (int i = 0; i < agg->recent_count; i++) {
+        free(agg->recent[i].text);
+    }
+}
+
+static void listener_merge(listener_agg_t* into, listener_agg_t* from) {
+    uint32_t* services = str_table_merge(&into->services, &from->services);
+    uint32_t* hosts = str_table_merge(&into->hosts, &from->hosts);
+    free(str_table_merge(&into->programs, &from->programs));
+    free(str_table_merge(&into->messages, &from->messages));
+    count_map_merge(&into->per_second, &from->per_second, NULL);
+    count_map_merge(&into->service_second, &from->service_second, services);
+    count_map_merge(&into->host_minute, &from->host_minute, hosts);
+    count_map_merge(&into->codes, &from->codes, NULL);
+    free(services);
+    free(hosts);
+
+    into->lines += from->lines;
+    into->connects += from->connects;
+    into->refused += from->refused;
+    into->events += from->events;
+    into->error_lines += from->error_lines;
+    into->skipped += from->skipped;
+    if (from->first >= 0 && (into->first < 0 || from->first < into->first)) {
+        into->first = from->first;
+    }
+    if (from->last > into->last) {
+        into->last = from->last;
+    }
+    for (int i = 0; i < from->recent_count; i++) {
+        const recent_line_t* r = &from->recent[i];
+        listener_keep_recent(into, r->file, r->offset, r->text, strlen(r->text));
+    }
+}
+
+// One second of connects, and a logon storm built from such seconds
+typedef struct {
+    int64_t second;
+    uint64_t count;
+} second_count_t;
+
+typedef struct {
+    int64_t start;
+    int64_t end;
+    uint64_t connects;
+    uint64_t peak;
+    int64_t peak_at;
+} storm_t;
+
+static int compare_seconds(const void* a, const void* b) {
+    const second_count_t* x = (const second_count_t*)a;
+    const second_count_t* y = (const second_count_t*)b;
+    return x->second < y->second ? -1 : x->second > y->second;
+}
+
+static int compare_second_counts(const void* a, const void* b) {
+    const second_count_t* x = (const second_count_t*)a;
+    const second_count_t* y = (const second_count_t*)b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->second < y->second ? -1 : x->second > y->second;
+}
+
+static int compare_storm_connects(const void* a, const void* b) {
+    const storm_t* x = (const storm_t*)a;
+    const storm_t* y = (const storm_t*)b;
+    if (x->connects != y->connects) {
+        return x->connects < y->connects ? 1 : -1;
+    }
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int compare_storm_start(const void* a, const void* b) {
+    const storm_t* x = (const storm_t*)a;
+    const storm_t* y = (const storm_t*)b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+static int compare_entry_counts(const void* a, const void* b) {
+    const str_entry_t* x = *(const str_entry_t* const*)a;
+    const str_entry_t* y = *(const str_entry_t* const*)b;
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return strcmp(x->text, y->text);
+}
+
+static int compare_recent(const void* a, const void* b) {
+    const recent_line_t* x = (const recent_line_t*)a;
+    const recent_line_t* y = (const recent_line_t*)b;
+    if (x->file != y->file) {
+        return x->file - y->file;
+    }
+    return x->offset < y->offset ? -1 : x->offset > y->offset;
+}
+
+/**
+ * Entries of a table by count, descending; the caller frees the array
+ */
+static str_entry_t** str_table_sorted(const str_table_t* t) {
+    str_entry_t** sorted = (str_entry_t**)xcalloc(t->count + 1, sizeof(str_entry_t*));
+    for (size_t e = 0; e < t->count; e++) {
+        sorted[e] = &t->entries[e];
+    }
+    qsort(sorted, t->count, sizeof(str_entry_t*), compare_entry_counts);
+    return sorted;
+}
+
+static void listener_print_names(const char* title, const str_table_t* t, int top) {
+    str_entry_t** sorted = str_table_sorted(t);
+    printf("\n--- %s (top %d of %zu) ---\n", title, top, t->count);
+    printf("  %-*s %10s %10s\n", LISTENER_NAME_WIDTH, "Name", "Connects", "Refused");
+    for (size_t i = 0; i < t->count && i < (size_t)top; i++) {
+        printf("  %-*.*s %10llu %10llu\n", LISTENER_NAME_WIDTH, LISTENER_NAME_WIDTH, sorted[i]->text,
+               (unsigned long long)sorted[i]->count, (unsigned long long)sorted[i]->refused);
+    }
+    free(sorted);
+}
+
+/**
+ * Find logon storms: runs of seconds at or above the rate, allowing
+ * LISTENER_STORM_GAP quieter seconds inside one run
+ */
+static storm_t* listener_find_storms(const second_count_t* seconds, size_t nseconds, uint64_t rate, size_t* nstorms) {
+    storm_t* storms = NULL;
+    size_t count = 0, capacity = 0;
+    uint64_t pending = 0;  // Connects in quieter seconds since the storm's last busy one
+    for (size_t i = 0; i < nseconds; i++) {
+        storm_t* cur = count > 0 ? &storms[count - 1] : NULL;
+        if (seconds[i].count < rate) {
+            if (cur != NULL && seconds[i].second - cur->end <= LISTENER_STORM_GAP) {
+                pending += seconds[i].count;
+            }
+            continue;
+        }
+        if (cur != NULL && seconds[i].second - cur->end <= LISTENER_STORM_GAP + 1) {
+            cur->connects += pending + seconds[i].count;
+            cur->end = seconds[i].second;
+        } else {
+            if (count == capacity) {
+                capacity = capacity > 0 ? capacity * 2 : 64;
+                storms = (storm_t*)realloc(storms, capacity * sizeof(storm_t));
+                if (storms == NULL) {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            cur = &storms[count++];
+            cur->start = cur->end = seconds[i].second;
+            cur->connects = seconds[i].count;
+            cur->peak = 0;
+        }
+        if (seconds[i].count > cur->peak) {
+            cur->peak = seconds[i].count;
+            cur->peak_at = seconds[i].second;
+        }
+        pending = 0;
+    }
+    *nstorms = count;
+    return storms;
+}
+
+/**
+ * Storms with their busiest service (by second) and client host (by the
+ * minutes the storm touches)
+ */
+/**
+ * Entry with the largest count; ties go to the smaller name, as in
+ * compare_entry_counts, since ids depend on the thread merge order
+ */
+static size_t listener_top_entry(const str_table_t* t, const uint64_t* counts) {
+    size_t top = 0;
+    for (size_t i = 1; i < t->count; i++) {
+        if (counts[i] > counts[top] ||
+            (counts[i] == counts[top] && strcmp(t->entries[i].text, t->entries[top].text) < 0)) {
+            top = i;
+        }
+    }
+    return top;
+}
+
+static void listener_print_storms(const listener_agg_t* agg, const second_count_t* seconds, size_t nseconds,
+                                  uint64_t rate) {
+    size_t nstorms = 0;
+    storm_t* storms = listener_find_storms(seconds, nseconds, rate, &nstorms);
+    printf("\n--- Logon Storms (>= %llu connects/s) ---\n", (unsigned long long)rate);
+    if (nstorms == 0) {
+        printf("  None: no second reached %llu connects\n", (unsigned long long)rate);
+        free(storms);
+        return;
+    }
+    qsort(storms, nstorms, sizeof(storm_t), compare_storm_connects);
+    size_t shown = nstorms < LISTENER_MAX_STORMS ? nstorms : LISTENER_MAX_STORMS;
+    qsort(storms, shown, sizeof(storm_t), compare_storm_start);
+
+    uint64_t* by_service = (uint64_t*)xcalloc(shown * (agg->services.count + 1), sizeof(uint64_t));
+    uint64_t* by_host = (uint64_t*)xcalloc(shown * (agg->hosts.count + 1), sizeof(uint64_t));
+    for (size_t i = 0; i < agg->service_second.capacity; i++) {
+        uint64_t key = agg->service_second.keys[i];
+        int64_t second = (int64_t)(key & 0xFFFFFFFFULL);
+        for (size_t s = 0; key != 0 && s < shown; s++) {
+            if (second >= storms[s].start && second <= storms[s].end) {
+                by_service[s * agg->services.count + (key >> 32)] += agg->service_second.values[i];
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < agg->host_minute.capacity; i++) {
+        uint64_t key = agg->host_minute.keys[i];
+        int64_t minute = (int64_t)(key & 0xFFFFFFFFULL);
+        for (size_t s = 0; key != 0 && s < shown; s++) {
+            if (minute * 60 <= storms[s].end && minute * 60 + 59 >= storms[s].start) {
+                by_host[s * agg->hosts.count + (key >> 32)] += agg->host_minute.values[i];
+            }
+        }
+    }
+
+    printf("  %zu storm(s), %zu largest shown\n", nstorms, shown);
+    printf("  %-20s %8s %10s %8s  %-20s %-20s\n", "Start", "Seconds", "Connects", "Peak/s", "Top service",
+           "Top host (minutes)");
+    for (size_t s = 0; s < shown; s++) {
+        size_t top_service = listener_top_entry(&agg->services, &by_service[s * agg->services.count]);
+        size_t top_host = listener_top_entry(&agg->hosts, &by_host[s * agg->hosts.count]);
+        char start[32];
+        listener_format_time(storms[s].start, start, sizeof(start));
+        printf("  %-20s %8lld %10llu %8llu  %-20.20s %-20.20s\n", start,
+               (long long)(storms[s].end - storms[s].start + 1), (unsigned long long)storms[s].connects,
+               (unsigned long long)storms[s].peak, agg->services.entries[top_service].text,
+               agg->hosts.entries[top_host].text);
+    }
+    free(by_service);
+    free(by_host);
+    free(storms);
+}
+
+/**
+ * Connection rate, storms, per-service rates, top hosts and programs,
+ * return codes and error lines
+ */
+static void listener_report(listener_agg_t* agg, uint64_t rate, int top) {
+    printf("Lines: %llu, connects: %llu (%llu refused), other commands: %llu, error/warning lines: %llu\n",
+           (unsigned long long)agg->lines, (unsigned long long)agg->connects, (unsigned long long)agg->refused,
+           (unsigned long long)agg->events, (unsigned long long)agg->error_lines);
+    if (agg->skipped > 0) {
+        printf("Skipped %llu lines before the cutoff\n", (unsigned long long)agg->skipped);
+    }
+
+    if (agg->connects > 0) {
+        char first[32], last[32];
+        int64_t span = agg->last - agg->first + 1;
+        listener_format_time(agg->first, first, sizeof(first));
+        listener_format_time(agg->last, last, sizeof(last));
+
+        size_t nseconds = 0;
+        second_count_t* seconds = (second_count_t*)xcalloc(agg->per_second.count + 1, sizeof(second_count_t));
+        for (size_t i = 0; i < agg->per_second.capacity; i++) {
+            if (agg->per_second.keys[i] != 0) {
+                seconds[nseconds].second = (int64_t)agg->per_second.keys[i];
+                seconds[nseconds++].count = agg->per_second.values[i];
+            }
+        }
+        qsort(seconds, nseconds, sizeof(second_count_t), compare_second_counts);
+
+        printf("\n--- Connection Rate ---\n");
+        printf("  Span:            %s to %s (%lld s)\n", first, last, (long long)span);
+        printf("  Average:         %.2f connects/s over the span\n", (double)agg->connects / span);
+        printf("  Active seconds:  %zu (median %llu, p99 %llu connects/s)\n", nseconds,
+               (unsigned long long)seconds[nseconds / 2].count, (unsigned long long)seconds[nseconds / 100].count);
+        printf("  Busiest seconds:\n");
+        for (size_t i = 0; i < nseconds && i < (size_t)top; i++) {
+            char when[32];
+            listener_format_time(seconds[i].second, when, sizeof(when));
+            printf("    %8llu  %s\n", (unsigned long long)seconds[i].count, when);
+        }
+
+        qsort(seconds, nseconds, sizeof(second_count_t), compare_seconds);
+        listener_print_storms(agg, seconds, nseconds, rate);
+        free(seconds);
+
+        // Per-service peak second
+        uint64_t* peak = (uint64_t*)xcalloc(agg->services.count + 1, sizeof(uint64_t));
+        int64_t* peak_at = (int64_t*)xcalloc(agg->services.count + 1, sizeof(int64_t));
+        for (size_t i = 0; i < agg->service_second.capacity; i++) {
+            uint64_t key = agg->service_second.keys[i];
+            int64_t second = (int64_t)(key & 0xFFFFFFFFULL);
+            uint64_t count = agg->service_second.values[i];
+            // Ties go to the earliest second, whatever the hash order
+            if (key != 0 && (count > peak[key >> 32] || (count == peak[key >> 32] && second < peak_at[key >> 32]))) {
+                peak[key >> 32] = count;
+                peak_at[key >> 32] = second;
+            }
+        }
+        str_entry_t** sorted = str_table_sorted(&agg->services);
+        printf("\n--- Services ---\n");
+        printf("  %-*s %10s %10s %9s %7s  %s\n", LISTENER_NAME_WIDTH, "Service", "Connects", "Refused", "Avg/s",
+               "Peak/s", "Peak at");
+        for (size_t i = 0; i < agg->services.count; i++) {
+            size_t id = (size_t)(sorted[i] - agg->services.entries);
+            char when[32];
+            listener_format_time(peak_at[id], when, sizeof(when));
+            printf("  %-*.*s %10llu %10llu %9.2f %7llu  %s\n", LISTENER_NAME_WIDTH, LISTENER_NAME_WIDTH,
+                   sorted[i]->text, (unsigned long long)sorted[i]->count, (unsigned long long)sorted[i]->refused,
+                   (double)sorted[i]->count / span, (unsigned long long)peak[id], when);
+        }
+        free(sorted);
+        free(peak);
+        free(peak_at);
+
+        listener_print_names("Client Hosts", &agg->hosts, top);
+        listener_print_names("Programs", &agg->programs, top);
+    }
+
+    if (agg->refused > 0) {
+        size_t ncodes = 0;
+        second_count_t* codes = (second_count_t*)xcalloc(agg->codes.count + 1, sizeof(second_count_t));
+        for (size_t i = 0; i < agg->codes.capacity; i++) {
+            if (agg->codes.keys[i] != 0) {
+                codes[ncodes].second = (int64_t)agg->codes.keys[i];
+                codes[ncodes++].count = agg->codes.values[i];
+            }
+        }
+        qsort(codes, ncodes, sizeof(second_count_t), compare_second_counts);
+        printf("\n--- Refused Connects by Return Code ---\n");
+        for (size_t i = 0; i < ncodes; i++) {
+            printf("%7llu TNS-%05lld\n", (unsigned long long)codes[i].count, (long long)codes[i].second);
+        }
+        free(codes);
+    }
+
+    if (agg->error_lines > 0) {
+        str_entry_t** sorted = str_table_sorted(&agg->messages);
+        printf("\n--- Error/Warning Lines (top %d of %zu distinct) ---\n", top, agg->messages.count);
+        for (size_t i = 0; i < agg->messages.count && i < (size_t)top; i++) {
+            printf("%7llu %s\n", (unsigned long long)sorted[i]->count, sorted[i]->text);
+        }
+        free(sorted);
+
+        qsort(agg->recent, agg->recent_count, sizeof(recent_line_t), compare_recent);
+        printf("\n--- Most Recent Errors ---\n");
+        for (int i = 0; i < agg->recent_count; i++) {
+            printf("%s\n", agg->recent[i].text);
+        }
+    }
+}
+
+static void listener_push_path(listener_job_t* job, const char* path, uint64_t mtime) {
+    if (job->nfiles % 64 == 0) {
+        job->paths = (const char**)realloc(job->paths, (job->nfiles + 64) * sizeof(char*));
+        job->sizes = (uint64_t*)realloc(job->sizes, (job->nfiles + 64) * sizeof(uint64_t));
+        if (job->paths == NULL || job->sizes == NULL) {
+            perror("Memory allocation failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    job->paths[job->nfiles] = strdup(path);
+    job->sizes[job->nfiles++] = mtime;  // Replaced by the size once opened
+}
+
+/**
+ * Add the .log and .xml files of one directory modified since newer_than
+ */
+static void listener_add_dir(listener_job_t* job, const char* path, time_t newer_than) {
+    DIR* d = opendir(path);
+    struct dirent* e;
+    struct stat sb;
+    while (d != NULL && (e = readdir(d)) != NULL) {
+        size_t len = strlen(e->d_name);
+        if (len > 4 && (strcmp(e->d_name + len - 4, ".log") == 0 || strcmp(e->d_name + len - 4, ".xml") == 0)) {
+            char child[4096];
+            snprintf(child, sizeof(child), "%s/%s", path, e->d_name);
+            if (stat(child, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_mtime >= newer_than) {
+                listener_push_path(job, child, (uint64_t)sb.st_mtime);
+            }
+        }
+    }
+    if (d != NULL) {
+        closedir(d);
+    }
+}
+
+/**
+ * Add a file, or the .log and .xml files of a directory oldest first. For
+ * an ADR listener home, trace/ holds listener.log and alert/ log.xml with
+ * the same entries, so log.xml is read only when there is no text log.
+ * Files in a directory last written before newer_than are skipped
+ */
+static int listener_add_path(listener_job_t* job, const char* path, time_t newer_than) {
+    struct stat sb;
+    if (stat(path, &sb) < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    if (!S_ISDIR(sb.st_mode)) {
+        listener_push_path(job, path, (uint64_t)sb.st_mtime);
+        return 0;
+    }
+    int first = job->nfiles;
+    char sub[4096];
+    listener_add_dir(job, path, newer_than);
+    snprintf(sub, sizeof(sub), "%s/trace", path);
+    listener_add_dir(job, sub, newer_than);
+    if (job->nfiles == first) {
+        snprintf(sub, sizeof(sub), "%s/alert", path);
+        listener_add_dir(job, sub, newer_than);
+    }
+    // By mtime, so the most recent errors come last
+    for (int i = first + 1; i < job->nfiles; i++) {
+        for (int j = i; j > first && job->sizes[j - 1] > job->sizes[j]; j--) {
+            uint64_t mtime = job->sizes[j];
+            const char* name = job->paths[j];
+            job->sizes[j] = job->sizes[j - 1];
+            job->paths[j] = job->paths[j - 1];
+            job->sizes[j - 1] = mtime;
+            job->paths[j - 1] = name;
+        }
+    }
+    return 0;
+}
+
+int run_listener(int argc, char* argv[]) {
+    long threads = sysconf(_SC_NPROCESSORS_ONLN);
+    long minutes = 0;
+    uint64_t rate = LISTENER_DEFAULT_STORM;
+    int top = LISTENER_DEFAULT_TOP;
+    int verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:m:r:t:vh")) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = atol(optarg);
+                break;
+            case 'm':
+                minutes = atol(optarg);
+                break;
+            case 'r':
+                rate = (uint64_t)atoll(optarg);
+                break;
+            case 't':
+                top = atoi(optarg);
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc || threads < 1 || minutes < 0 || rate < 1 || top < 1) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (threads > LISTENER_MAX_THREADS) {
+        threads = LISTENER_MAX_THREADS;
+    }
+
+    int status = 0;
+    listener_job_t job;
+    memset(&job, 0, sizeof(job));
+    // Like find -mmin: a directory's files idle for longer than -m hold no entries in range
+    time_t newer_than = minutes > 0 ? time(NULL) - minutes * 60 : 0;
+    for (int i = optind; i < argc; i++) {
+        if (listener_add_path(&job, argv[i], newer_than) < 0) {
+            status = 1;
+        }
+    }
+    job.fds = (int*)xcalloc(job.nfiles + 1, sizeof(int));
+    job.cutoff = -1;
+    if (minutes > 0) {
+        // Log stamps are local wall-clock time, parsed as if UTC
+        time_t now = time(NULL);
+        struct tm tm;
+        localtime_r(&now, &tm);
+        job.cutoff = days_from_civil(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday) * 86400 + tm.tm_hour * 3600 +
+                     tm.tm_min * 60 + tm.tm_sec - minutes * 60;
+    }
+    pattern_set_build(&job.errors, listener_patterns, sizeof(listener_patterns) / sizeof(listener_patterns[0]));
+    pthread_mutex_init(&job.lock, NULL);
+
+    uint64_t total = 0;
+    int capacity = 0;
+    for (int f = 0; f < job.nfiles; f++) {
+        struct stat sb;
+        job.fds[f] = open(job.paths[f], O_RDONLY);
+        if (job.fds[f] < 0 || fstat(job.fds[f], &sb) < 0) {
+            fprintf(stderr, "Cannot open %s: %s\n", job.paths[f], strerror(errno));
+            status = 1;
+            job.sizes[f] = 0;
+            continue;
+        }
+        job.sizes[f] = (uint64_t)sb.st_size;
+        total += job.sizes[f];
+        for (uint64_t start = 0; start < job.sizes[f]; start += LISTENER_CHUNK) {
+            if (job.ntasks == capacity) {
+                capacity = capacity > 0 ? capacity * 2 : 256;
+                job.tasks = (listener_task_t*)realloc(job.tasks, capacity * sizeof(listener_task_t));
+                if (job.tasks == NULL) {
+                    perror("Memory allocation failed");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            job.tasks[job.ntasks].file = f;
+            job.tasks[job.ntasks].start = start;
+            job.tasks[job.ntasks++].end =
+                job.sizes[f] - start > LISTENER_CHUNK ? start + LISTENER_CHUNK : job.sizes[f];
+        }
+    }
+    if (threads > job.ntasks) {
+        threads = job.ntasks > 0 ? job.ntasks : 1;
+    }
+
+    uint64_t start = get_timestamp_usec();
+    listener_worker_t* workers = (listener_worker_t*)xcalloc(threads, sizeof(listener_worker_t));
+    for (long i = 0; i < threads; i++) {
+        workers[i].job = &job;
+        workers[i].agg.first = workers[i].agg.last = -1;
+        if (i > 0 && pthread_create(&workers[i].thread, NULL, listener_worker, &workers[i]) != 0) {
+            perror("pthread_create failed");
+            exit(EXIT_FAILURE);
+        }
+    }
+    listener_worker(&workers[0]);
+    for (long i = 1; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        listener_merge(&workers[0].agg, &workers[i].agg);
+        listener_agg_free(&workers[i].agg);
+    }
+    uint64_t elapsed = get_timestamp_usec() - start;
+    if (job.next_task < job.ntasks) {
+        status = 1;
+    }
+
+    printf("Listener log analysis: %d file(s), %.1f MB\n", job.nfiles, total / 1048576.0);
+    if (job.cutoff >= 0) {
+        char since[32];
+        listener_format_time(job.cutoff, since, sizeof(since));
+        printf("Entries since %s (last %ld minutes)\n", since, minutes);
+    }
+    listener_report(&workers[0].agg, rate, top);
+    if (verbose) {
+        fprintf(stderr, "Parsed %.1f MB in %d chunks on %ld threads in %.1f ms (%.0f MB/s)\n", total / 1048576.0,
+                job.ntasks, threads, elapsed / 1000.0, elapsed > 0 ? total / 1.048576 / elapsed : 0.0);
+    }
+
+    listener_agg_free(&workers[0].agg);
+    free(workers);
+    for (int f = 0; f < job.nfiles; f++) {
+        if (job.fds[f] >= 0) {
+            close(job.fds[f]);
+        }
+        free((char*)job.paths[f]);
+    }
+    free(job.paths);
+    free(job.sizes);
+    free(job.fds);
+    free(job.tasks);
+    pthread_mutex_destroy(&job.lock);
+    return status;
+}
+
+// One ORA-/TNS- code with its total and a per-second ring over the window
+typedef struct {
+    char code[16];           // "ORA-00600"; "other" once FOLLOW_MAX_CODES are in use
+    uint64_t total;
+    uint64_t in_window;      // Sum of the ring
+    time_t last_seen;
+    uint32_t* ring;          // Indexed by second % window
+} follow_code_t;
+
+typedef struct follow follow_t;
+
+// A followed log, read through its open descriptor so a rotated inode can be drained
+typedef struct {
+    follow_t* daemon;
+    char path[4096];
+    const char* name;        // Basename within path
+    int fd;                  // Open on st.ino, which may no longer be at path
+    int wd;                  // Watch of its directory, -1 = polled
+    int dirty;               // Event seen since the last read
+    scan_state_t st;
+    scan_stats_t stats;      // Cumulative over the run
+} follow_file_t;
+
+struct follow {
+    int inotify_fd;          // -1 = poll every FOLLOW_POLL_MS
+    int wds[FOLLOW_MAX_WATCHES];
+    char* dirs[FOLLOW_MAX_WATCHES];
+    int nwatches;
+    follow_file_t files[FOLLOW_MAX_FILES];
+    int nfiles;
+    follow_code_t codes[FOLLOW_MAX_CODES];
+    int ncodes;
+    int window;              // Seconds in each code's ring
+    int64_t window_sec;      // Newest second the rings hold, on the monotonic clock
+    uint64_t matches;        // Lines with at least one code
+    uint64_t reads;          // Files read after an event
+    double lag_last_ms;      // Event-to-count delay: file mtime to the end of its read
+    double lag_max_ms;
+    double lag_sum_ms;
+    int quiet;
+    int changed;             // Counters moved since the last snapshot
+    int full_warned;
+};
+
+static volatile sig_atomic_t follow_running = 1;
+
+static void follow_stop(int sig) {
+    (void)sig;
+    follow_running = 0;
+}
+
+static uint64_t follow_monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int follow_wanted(const char* name) {
+    size_t len = strlen(name);
+    return len > 4 && (strcmp(name + len - 4, ".log") == 0 || strcmp(name + len - 4, ".xml") == 0);
+}
+
+/**
+ * Clear ring slots for the seconds that left the window since the last call
+ */
+static void follow_advance(follow_t* d, int64_t second) {
+    if (second <= d->window_sec) {
+        return;
+    }
+    int64_t from = second - d->window_sec > d->window ? second - d->window + 1 : d->window_sec + 1;
+    for (int64_t s = from; s <= second; s++) {
+        int slot = (int)(s % d->window);
+        for (int i = 0; i < d->ncodes; i++) {
+            d->codes[i].in_window -= d->codes[i].ring[slot];
+            d->codes[i].ring[slot] = 0;
+        }
+    }
+    d->window_sec = second;
+}
+
+static void follow_count(follow_t* d, const char* code, size_t len) {
+    int i = 0;
+    while (i < d->ncodes && (strncmp(d->codes[i].code, code, len) != 0 || d->codes[i].code[len] != '\0')) {
+        i++;
+    }
+    if (i == d->ncodes) {
+        // The last slot collects every code beyond the table
+        if (d->ncodes == FOLLOW_MAX_CODES - 1) {
+            code = "other";
+            len = 5;
+        } else if (d->ncodes == FOLLOW_MAX_CODES) {
+            i = FOLLOW_MAX_CODES - 1;
+        }
+        if (i == d->ncodes) {
+            memcpy(d->codes[i].code, code, len);
+            d->codes[i].code[len] = '\0';
+            d->codes[i].ring = (uint32_t*)xcalloc(d->window, sizeof(uint32_t));
+            d->ncodes++;
+        }
+    }
+    follow_code_t* c = &d->codes[i];
+    c->total++;
+    c->in_window++;
+    c->ring[d->window_sec % d->window]++;
+    c->last_seen = time(NULL);
+    d->changed = 1;
+}
+
+/**
+ * Count the ORA-nnnnn and TNS-nnnnn tokens of an appended line, reading it
+ * in place from the mapping
+ */
+static void follow_line(void* ctx, const char* line, size_t len, const char* prev, size_t prev_len) {
+    follow_file_t* f = (follow_file_t*)ctx;
+    follow_t* d = f->daemon;
+    int found = 0;
+    (void)prev;
+    (void)prev_len;
+    for (const char* p = line + 3; p < line + len && (p = (const char*)memchr(p, '-', line + len - p)) != NULL; p++) {
+        if (memcmp(p - 3, "ORA", 3) != 0 && memcmp(p - 3, "TNS", 3) != 0) {
+            continue;
+        }
+        size_t digits = 0;
+        while (p + 1 + digits < line + len && digits < 10 && p[1 + digits] >= '0' && p[1 + digits] <= '9') {
+            digits++;
+        }
+        if (digits > 0) {
+            follow_count(d, p - 3, 4 + digits);
+            found = 1;
+        }
+    }
+    if (found) {
+        d->matches++;
+        if (!d->quiet) {
+            char when[32];
+            time_t now = time(NULL);
+            struct tm tm;
+            strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", localtime_r(&now, &tm));
+            printf("%s %s: %.*s\n", when, f->name, (int)len, line);
+        }
+    }
+}
+
+/**
+ * Start following a file: existing ones from their current end, files
+ * created while running from the start
+ */
+static follow_file_t* follow_add_file(follow_t* d, const char* path, int wd, int from_start) {
+    if (d->nfiles == FOLLOW_MAX_FILES) {
+        if (!d->full_warned) {
+            fprintf(stderr, "Not following %s or later files: already %d files\n", path, FOLLOW_MAX_FILES);
+            d->full_warned = 1;
+        }
+        return NULL;
+    }
+    follow_file_t* f = &d->files[d->nfiles];
+    struct stat sb;
+    memset(f, 0, sizeof(follow_file_t));
+    if (stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+        return NULL;
+    }
+    f->fd = open(path, O_RDONLY);
+    if (f->fd < 0 || fstat(f->fd, &sb) < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        if (f->fd >= 0) {
+            close(f->fd);
+        }
+        return NULL;
+    }
+    snprintf(f->path, sizeof(f->path), "%s", path);
+    const char* slash = strrchr(f->path, '/');
+    f->name = slash != NULL ? slash + 1 : f->path;
+    f->daemon = d;
+    f->wd = wd;
+    ring_init(&f->st.ring, 1);
+    f->st.dev = (unsigned long long)sb.st_dev;
+    f->st.ino = (unsigned long long)sb.st_ino;
+    f->st.offset = from_start ? 0 : (uint64_t)sb.st_size;
+    f->dirty = from_start;
+    d->nfiles++;
+    return f;
+}
+
+/**
+ * Watch descriptor for the directory, -1 when polling, -2 if it cannot be watched
+ */
+static int follow_add_watch(follow_t* d, const char* dir) {
+    if (d->nwatches == FOLLOW_MAX_WATCHES) {
+        fprintf(stderr, "Not watching %s: already %d directories\n", dir, FOLLOW_MAX_WATCHES);
+        return -2;
+    }
+    int wd = -1;
+#ifdef __linux__
+    if (d->inotify_fd >= 0) {
+        wd = inotify_add_watch(d->inotify_fd, dir, IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_MOVED_TO);
+        if (wd < 0) {
+            fprintf(stderr, "Cannot watch %s: %s\n", dir, strerror(errno));
+            return -2;
+        }
+    }
+#endif
+    d->wds[d->nwatches] = wd;
+    d->dirs[d->nwatches++] = strdup(dir);
+    return wd;
+}
+
+/**
+ * Watch a directory given on the command line and, below it, the ADR
+ * trace and alert directories; follow their .log and .xml files
+ */
+static void follow_add_tree(follow_t* d, const char* dir, int depth) {
+    DIR* dp = opendir(dir);
+    if (dp == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", dir, strerror(errno));
+        return;
+    }
+    const char* base = strrchr(dir, '/');
+    base = base != NULL ? base + 1 : dir;
+    int wd = -2;  // Files here are followed only in a watched directory
+    if (depth == 0 || strcmp(base, "trace") == 0 || strcmp(base, "alert") == 0) {
+        wd = follow_add_watch(d, dir);
+    }
+    struct dirent* e;
+    while ((e = readdir(dp)) != NULL) {
+        char child[4096];
+        struct stat sb;
+        if (e->d_name[0] == '.' || strcmp(e->d_name, "incident") == 0 || strcmp(e->d_name, "cdump") == 0) {
+            continue;
+        }
+        snprintf(child, sizeof(child), "%s/%s", dir, e->d_name);
+        if (lstat(child, &sb) < 0) {
+            continue;
+        }
+        if (S_ISDIR(sb.st_mode) && depth < FOLLOW_MAX_DEPTH) {
+            follow_add_tree(d, child, depth + 1);
+        } else if (S_ISREG(sb.st_mode) && wd != -2 && follow_wanted(e->d_name)) {
+            follow_add_file(d, child, wd, 0);
+        }
+    }
+    closedir(dp);
+}
+
+/**
+ * Count the complete lines appended to the open inode; one truncated in
+ * place is read again from its start
+ */
+static int follow_drain(follow_file_t* f, struct stat* sb) {
+    if (fstat(f->fd, sb) < 0) {
+        return -1;
+    }
+    if ((uint64_t)sb->st_size < f->st.offset) {
+        f->st.offset = 0;
+    }
+    uint64_t end = scan_range(f->fd, f->st.offset, (uint64_t)sb->st_size, follow_line, f, &f->st, &f->stats);
+    if (end == (uint64_t)-1) {
+        return -1;
+    }
+    f->st.offset = end;
+    return 0;
+}
+
+/**
+ * Count the last line of a rotated inode, which nothing will complete now
+ */
+static void follow_flush_partial(follow_file_t* f, uint64_t size) {
+    if (size <= f->st.offset) {
+        return;
+    }
+    size_t len = (size_t)(size - f->st.offset);
+    char* buf = (char*)malloc(len);
+    if (buf != NULL && pread(f->fd, buf, len, (off_t)f->st.offset) == (ssize_t)len) {
+        f->st.offset = size;
+        f->st.line++;
+        f->stats.lines++;
+        f->stats.bytes += len;
+        follow_line(f, buf, len > 0 && buf[len - 1] == '\r' ? len - 1 : len, "", 0);
+    }
+    free(buf);
+}
+
+/**
+ * Read what was appended to a file and record how long after its last
+ * write the lines were counted. When the path names a new inode, the old
+ * one is drained to EOF, its unfinished last line included, before the
+ * new file is read from its start
+ */
+static void follow_read(follow_t* d, follow_file_t* f) {
+    uint64_t before = f->stats.bytes;
+    struct stat sb, path_sb;
+    f->dirty = 0;
+    int rotated = stat(f->path, &path_sb) == 0 && ((unsigned long long)path_sb.st_ino != f->st.ino ||
+                                                    (unsigned long long)path_sb.st_dev != f->st.dev);
+    if (follow_drain(f, &sb) < 0) {
+        return;
+    }
+    if (rotated) {
+        int fd = open(f->path, O_RDONLY);
+        if (fd >= 0) {
+            follow_flush_partial(f, (uint64_t)sb.st_size);
+            close(f->fd);
+            f->fd = fd;
+            f->st.offset = 0;
+            f->st.dev = (unsigned long long)path_sb.st_dev;
+            f->st.ino = (unsigned long long)path_sb.st_ino;
+            if (follow_drain(f, &sb) < 0) {
+                return;
+            }
+        }
+    }
+    if (f->stats.bytes == before) {
+        return;
+    }
+    d->reads++;
+    struct timeval now;
+    gettimeofday(&now, NULL);
+#ifdef __linux__
+    double mtime_ms = sb.st_mtim.tv_sec * 1000.0 + sb.st_mtim.tv_nsec / 1e6;
+#else
+    double mtime_ms = sb.st_mtime * 1000.0;
+#endif
+    double lag = now.tv_sec * 1000.0 + now.tv_usec / 1000.0 - mtime_ms;
+    d->lag_last_ms = lag > 0 ? lag : 0;
+    d->lag_sum_ms += d->lag_last_ms;
+    if (d->lag_last_ms > d->lag_max_ms) {
+        d->lag_max_ms = d->lag_last_ms;
+    }
+}
+
+#ifdef __linux__
+/**
+ * Mark the files named by a batch of events; new .log/.xml files in a
+ * watched directory are followed from their start
+ */
+static void follow_events(follow_t* d) {
+    char buf[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(d->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + n;) {
+            struct inotify_event* ev = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                for (int i = 0; i < d->nfiles; i++) {
+                    d->files[i].dirty = 1;
+                }
+                continue;
+            }
+            if (ev->len == 0 || !follow_wanted(ev->name)) {
+                continue;
+            }
+            int i = 0;
+            while (i < d->nfiles && (d->files[i].wd != ev->wd || strcmp(d->files[i].name, ev->name) != 0)) {
+                i++;
+            }
+            if (i < d->nfiles) {
+                d->files[i].dirty = 1;
+                continue;
+            }
+            for (int w = 0; w < d->nwatches; w++) {
+                if (d->wds[w] == ev->wd) {
+                    char path[4096];
+                    snprintf(path, sizeof(path), "%s/%s", d->dirs[w], ev->name);
+                    follow_add_file(d, path, ev->wd, 1);
+                    break;
+                }
+            }
+        }
+    }
+}
+#endif
+
+static int compare_follow_codes(const void* a, const void* b) {
+    const follow_code_t* x = *(const follow_code_t* const*)a;
+    const follow_code_t* y = *(const follow_code_t* const*)b;
+    if (x->total != y->total) {
+        return x->total < y->total ? 1 : -1;
+    }
+    return strcmp(x->code, y->code);
+}
+
+/**
+ * Write s as a quoted JSON string; paths and host names may hold quotes,
+ * backslashes or control characters
+ */
+static void json_write_string(FILE* f, const char* s) {
+    fputc('"', f);
+    for (const unsigned char* p = (const unsigned char*)s; *p != '\0'; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(f, "\\%c", *p);
+        } else if (*p < 0x20) {
+            fprintf(f, "\\u%04x", *p);
+        } else {
+            fputc(*p, f);
+        }
+    }
+    fputc('"', f);
+}
+
+/**
+ * Snapshot as JSON, in the layout of the netbench and campaign reports;
+ * written beside the target and renamed so readers never see half a file
+ */
+static int follow_write_metrics(follow_t* d, const char* path, uint64_t uptime_ms) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Cannot write metrics file %s: %s\n", tmp, strerror(errno));
+        return -1;
+    }
+    char host[256] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    time_t now = time(NULL);
+    char updated[32];
+    strftime(updated, sizeof(updated), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    uint64_t lines = 0, bytes = 0;
+    for (int i = 0; i < d->nfiles; i++) {
+        lines += d->files[i].stats.lines;
+        bytes += d->files[i].stats.bytes;
+    }
+    fprintf(f, "{\n");
+    fprintf(f, "  \"tool\": \"ora_logscan-follow\",\n");
+    fprintf(f, "  \"version\": 1,\n");
+    fprintf(f, "  \"host\": ");
+    json_write_string(f, host);
+    fprintf(f, ",\n");
+    fprintf(f, "  \"updated\": \"%s\",\n", updated);
+    fprintf(f, "  \"uptime_s\": %.1f,\n", uptime_ms / 1000.0);
+    fprintf(f, "  \"window_s\": %d,\n", d->window);
+    fprintf(f, "  \"watch\": \"%s\",\n", d->inotify_fd >= 0 ? "inotify" : "poll");
+    fprintf(f, "  \"bytes\": %llu,\n  \"lines\": %llu,\n  \"matches\": %llu,\n", (unsigned long long)bytes,
+            (unsigned long long)lines, (unsigned long long)d->matches);
+    fprintf(f, "  \"detect_lag_ms\": {\"last\": %.1f, \"avg\": %.1f, \"max\": %.1f},\n", d->lag_last_ms,
+            d->reads > 0 ? d->lag_sum_ms / d->reads : 0.0, d->lag_max_ms);
+    fprintf(f, "  \"files\": [\n");
+    for (int i = 0; i < d->nfiles; i++) {
+        follow_file_t* ff = &d->files[i];
+        fprintf(f, "    {\"path\": ");
+        json_write_string(f, ff->path);
+        fprintf(f, ", \"offset\": %llu, \"lines\": %llu}%s\n",
+                (unsigned long long)ff->st.offset, (unsigned long long)ff->stats.lines,
+                i + 1 < d->nfiles ? "," : "");
+    }
+    fprintf(f, "  ],\n");
+
+    follow_code_t* sorted[FOLLOW_MAX_CODES];
+    for (int i = 0; i < d->ncodes; i++) {
+        sorted[i] = &d->codes[i];
+    }
+    qsort(sorted, d->ncodes, sizeof(follow_code_t*), compare_follow_codes);
+    static const char* kinds[] = { "ORA-", "TNS-" };
+    static const char* keys[] = { "ora", "tns" };
+    for (int k = 0; k < 2; k++) {
+        int first = 1;
+        fprintf(f, "  \"%s\": [", keys[k]);
+        for (int i = 0; i < d->ncodes; i++) {
+            // "other" is listed once, with ORA- codes
+            int other = strcmp(sorted[i]->code, "other") == 0;
+            if ((other && k != 0) || (!other && strncmp(sorted[i]->code, kinds[k], 4) != 0)) {
+                continue;
+            }
+            char seen[32];
+            strftime(seen, sizeof(seen), "%Y-%m-%dT%H:%M:%SZ", gmtime(&sorted[i]->last_seen));
+            fprintf(f, "%s\n    {\"code\": \"%s\", \"total\": %llu, \"window\": %llu, \"last_seen\": \"%s\"}",
+                    first ? "" : ",", sorted[i]->code, (unsigned long long)sorted[i]->total,
+                    (unsigned long long)sorted[i]->in_window, seen);
+            first = 0;
+        }
+        fprintf(f, "%s]%s\n", first ? "" : "\n  ", k == 0 ? "," : "");
+    }
+    fprintf(f, "}\n");
+    if (fclose(f) != 0 || rename(tmp, path) != 0) {
+        fprintf(stderr, "Cannot write metrics file %s: %s\n", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+int run_follow(int argc, char* argv[]) {
+    const char* metrics = NULL;
+    int interval_ms = FOLLOW_DEFAULT_INTERVAL_MS;
+    int window = FOLLOW_DEFAULT_WINDOW;
+    int quiet = 0, verbose = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:i:w:qvh")) != -1) {
+        switch (opt) {
+            case 'o':
+                metrics = optarg;
+                break;
+            case 'i':
+                interval_ms = atoi(optarg);
+                break;
+            case 'w':
+                window = atoi(optarg);
+                break;
+            case 'q':
+                quiet = 1;
+                break;
+            case 'v':
+                verbose = 1;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                exit(EXIT_SUCCESS);
+            default:
+                print_usage(argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind >= argc || interval_ms < FOLLOW_MIN_WRITE_MS || window < 1 || window > FOLLOW_MAX_WINDOW) {
+        print_usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    follow_t* d = (follow_t*)xcalloc(1, sizeof(follow_t));
+    d->window = window;
+    d->quiet = quiet;
+    d->inotify_fd = -1;
+#ifdef __linux__
+    d->inotify_fd = inotify_init();
+    if (d->inotify_fd < 0) {
+        fprintf(stderr, "inotify unavailable (%s), polling every %d ms\n", strerror(errno), FOLLOW_POLL_MS);
+    } else {
+        fcntl(d->inotify_fd, F_SETFL, fcntl(d->inotify_fd, F_GETFL) | O_NONBLOCK);
+    }
+#endif
+    for (int i = optind; i < argc; i++) {
+        struct stat sb;
+        if (stat(argv[i], &sb) == 0 && S_ISDIR(sb.st_mode)) {
+            follow_add_tree(d, argv[i], 0);
+        } else {
+            // A single log: watch its directory to see it written and rotated
+            char dir_buf[4096];
+            snprintf(dir_buf, sizeof(dir_buf), "%s", argv[i]);
+            int wd = follow_add_watch(d, dirname(dir_buf));
+            if (wd == -2 || follow_add_file(d, argv[i], wd, 0) == NULL) {
+                fprintf(stderr, "Cannot follow %s\n", argv[i]);
+            }
+        }
+    }
+    if (d->nfiles == 0 && d->nwatches == 0) {
+        fprintf(stderr, "Nothing to follow\n");
+        return 1;
+    }
+    if (verbose) {
+        fprintf(stderr, "Following %d files in %d directories (%s)\n", d->nfiles, d->nwatches,
+                d->inotify_fd >= 0 ? "inotify" : "polled");
+    }
+
+    signal(SIGINT, follow_stop);
+    signal(SIGTERM, follow_stop);
+    uint64_t start = follow_monotonic_ms();
+    uint64_t last_write = 0, next_write = start;
+    while (follow_running) {
+        uint64_t now = follow_monotonic_ms();
+        int timeout = next_write > now ? (int)(next_write - now) : 0;
+        if (d->inotify_fd < 0) {
+            if (timeout > FOLLOW_POLL_MS) {
+                timeout = FOLLOW_POLL_MS;
+            }
+            usleep(timeout * 1000);
+            for (int i = 0; i < d->nfiles; i++) {
+                d->files[i].dirty = 1;
+            }
+        }
+#ifdef __linux__
+        else {
+            struct pollfd pfd = { d->inotify_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, timeout) > 0) {
+                follow_events(d);
+            }
+        }
+#endif
+        now = follow_monotonic_ms();
+        follow_advance(d, (int64_t)(now / 1000));
+        for (int i = 0; i < d->nfiles; i++) {
+            if (d->files[i].dirty) {
+                follow_read(d, &d->files[i]);
+            }
+        }
+        fflush(stdout);
+
+        now = follow_monotonic_ms();
+        if (now >= next_write || (d->changed && now - last_write >= FOLLOW_MIN_WRITE_MS)) {
+            if (metrics != NULL) {
+                follow_write_metrics(d, metrics, now - start);
+            }
+            d->changed = 0;
+            last_write = now;
+            if (now >= next_write) {
+                next_write = now + interval_ms;
+            }
+        }
+    }
+
+    if (metrics != NULL) {
+        follow_write_metrics(d, metrics, follow_monotonic_ms() - start);
+    }
+    if (verbose) {
+        uint64_t bytes = 0;
+        for (int i = 0; i < d->nfiles; i++) {
+            bytes += d->files[i].stats.bytes;
+        }
+        fprintf(stderr, "Read %.1f MB in %llu reads, %llu lines with codes, detection lag avg %.1f ms, max %.1f ms\n",
+                bytes / 1048576.0, (unsigned long long)d->reads, (unsigned long long)d->matches,
+                d->reads > 0 ? d->lag_sum_ms / d->reads : 0.0, d->lag_max_ms);
+    }
+    for (int i = 0; i < d->nfiles; i++) {
+        close(d->files[i].fd);
+        ring_free(&d->files[i].st.ring);
+        free(d->files[i].st.prev);
+    }
+    for (int i = 0; i < d->ncodes; i++) {
+        free(d->codes[i].ring);
+    }
+    for (int i = 0; i < d->nwatches; i++) {
+        free(d->dirs[i]);
+    }
+    if (d->inotify_fd >= 0) {
+        close(d->inotify_fd);
+    }
+    free(d);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (strcmp(argv[1], "alert") == 0) {
+        return run_alert(argc - 1, argv + 1);
+    }
+    if (strcmp(argv[1], "listener") == 0) {
+        return run_listener(argc - 1, argv + 1);
+    }
+    if (strcmp(argv[1], "follow") == 0) {
+        return run_follow(argc - 1, argv + 1);
+    }
+    if (strcmp(argv[1], "-h") == 0) {
+        print_usage(argv[0]);
+        return EXIT_SUCCESS;
+    }
+    fprintf(stderr, "Unknown mode '%s'\n", argv[1]);
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+}